@@ -89,7 +89,7 @@ float DE1(float3 z, float scale, float iterations) {
 	return  length(z)*pow(scale, float(-n));;
 }
 
-float Mandelbulb(float3 p)
+float Mandelbulb(float3 p, int iterations)
 {
 	float3 w = p;
 	float m = dot(w, w);
@@ -98,7 +98,7 @@ float Mandelbulb(float3 p)
 	float dz = 1.0;
 
 
-	for (int i = 0; i < 25; i++)
+	for (int i = 0; i < iterations; i++)
 	{
 		float m2 = m * m;
 		float m4 = m2 * m2;
@@ -132,15 +132,33 @@ float Mandelbulb(float3 p)
 
 //------------------------------------------------------------------
 
+// Pixel footprint at the point map() is looking at, set by castRay with PIXEL_FOOTPRINT_LOD.
+// 0 keeps every detail, which is what normals, AO and shadows use.
+static float mapFootprint = 0.0;
+
 float2 map(in float3 inpos)
 {
 	float3 pos = inpos;
 
 	float2 res = float2(1e10, 0.0);
 
-	res = opU(res, float2(DE1(pos - float3(-2,-1,-7), 2, 15), 5));
+	// Only iterate as deep as the footprint can resolve. DE1 after n iterations is within
+	// 1.5*2^-n of the full estimate, which is taken off so it never overestimates; a Mandelbulb
+	// cut short only grows outwards. Six spare bulb iterations cover its approximate estimate.
+	float sierpinskiIterations = 15;
+	float sierpinskiSlack = 0.0;
+	int bulbIterations = 25;
+	if (mapFootprint > 0.0)
+	{
+		sierpinskiIterations = clamp(ceil(log2(1.5 / mapFootprint)), 0, 15);
+		if (sierpinskiIterations < 15)
+			sierpinskiSlack = 1.5*exp2(-sierpinskiIterations);
+		bulbIterations = clamp(int(ceil(log(1.25 / mapFootprint) / log(8.0))) + 6, 1, 25);
+	}
+
+	res = opU(res, float2(DE1(pos - float3(-2,-1,-7), 2, sierpinskiIterations) - sierpinskiSlack, 5));
 
-	res = opU(res, float2(Mandelbulb(pos - float3(2,-1, -7)), 40));
+	res = opU(res, float2(Mandelbulb(pos - float3(2,-1, -7), bulbIterations), 40));
 
 	return res;
 }
@@ -159,7 +177,11 @@ float2 iBox(in float3 ro, in float3 rd, in float3 rad)
 
 const float maxHei = 0.8;
 
-float2 castRay(in float3 ro, in float3 rd)
+// 1 = let map() skip fractal iterations the pixel footprint can't resolve while marching. The
+// coarse surface is never behind the real one, so a ray that reaches it finishes at full detail.
+#define PIXEL_FOOTPRINT_LOD 0
+
+float2 castRay(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float2 res = float2(-1.0, -1.0);
 
@@ -183,17 +205,25 @@ float2 castRay(in float3 ro, in float3 rd)
 		tmax = min(tb.y, tmax);
 
 		float t = tmin;
+		bool lod = PIXEL_FOOTPRINT_LOD != 0;
 		for (int i = 0; i < 170 && t < tmax; i++)
 		{
-
+			mapFootprint = lod ? pixelRadius * t : 0.0;
 			float2 h = map(ro + rd * t);
 			if (abs(h.x) < (0.001*t))
 			{
+				if (lod)
+				{
+					// Look again from here with full detail.
+					lod = false;
+					continue;
+				}
 				res = float2(t, h.y);
 				break;
 			}
 			t += h.x;
 		}
+		mapFootprint = 0.0;
 
 	}
 
@@ -266,10 +296,10 @@ float checkersGradBox(in float2 p)
 	return 0.5 - 0.5*i.x*i.y;
 }
 
-float3 render(in float3 ro, in float3 rd)
+float3 render(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float3 col = float3(0.7, 0.9, 1.0) + rd.y*0.8;
-	float2 res = castRay(ro, rd);
+	float2 res = castRay(ro, rd, pixelRadius);
 	float t = res.x;
 	float m = res.y;
 	if (m > -0.5)
@@ -346,6 +376,9 @@ PixelShaderOutput main(VS_QUAD input)
 	eyeRay.o = eyePos.xyz;
 	eyeRay.d = normalize(PixelPos - eyePos.xyz);
 
-	output.colour = float4(render(eyeRay.o, eyeRay.d), 1);
+	// Half the angle one pixel covers, the footprint radius at distance 1.
+	float pixelRadius = 0.5 * zoom * abs(ddx(input.canvasXY.x)) / length(PixelPos - eyePos.xyz);
+
+	output.colour = float4(render(eyeRay.o, eyeRay.d, pixelRadius), 1);
 	return output;
 }
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+// Minimal HLSL-style vector types so the shader SDF code in Content\*.hlsl can be
+// ported to the CPU line for line.
+namespace ProceduralAliens
+{
+	namespace Hlsl
+	{
+		struct float2
+		{
+			float x, y;
+
+			float2() : x(0), y(0) {}
+			explicit float2(float s) : x(s), y(s) {}
+			float2(float px, float py) : x(px), y(py) {}
+		};
+
+		struct float3
+		{
+			float x, y, z;
+
+			float3() : x(0), y(0), z(0) {}
+			explicit float3(float s) : x(s), y(s), z(s) {}
+			float3(float px, float py, float pz) : x(px), y(py), z(pz) {}
+
+			float& operator[](int i) { return (&x)[i]; }
+			float operator[](int i) const { return (&x)[i]; }
+		};
+
+		inline float2 operator+(const float2& a, const float2& b) { return float2(a.x + b.x, a.y + b.y); }
+		inline float2 operator-(const float2& a, const float2& b) { return float2(a.x - b.x, a.y - b.y); }
+		inline float2 operator*(const float2& a, const float2& b) { return float2(a.x * b.x, a.y * b.y); }
+		inline float2 operator/(const float2& a, const float2& b) { return float2(a.x / b.x, a.y / b.y); }
+		inline float2 operator*(const float2& a, float s) { return float2(a.x * s, a.y * s); }
+		inline float2 operator*(float s, const float2& a) { return float2(a.x * s, a.y * s); }
+		inline float2 operator-(const float2& a) { return float2(-a.x, -a.y); }
+
+		inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+		inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+		inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+		inline float3 operator/(const float3& a, const float3& b) { return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+		inline float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+		inline float3 operator*(float s, const float3& a) { return float3(a.x * s, a.y * s, a.z * s); }
+		inline float3 operator/(const float3& a, float s) { return float3(a.x / s, a.y / s, a.z / s); }
+		inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+		inline float3& operator+=(float3& a, const float3& b) { a = a + b; return a; }
+		inline float3& operator-=(float3& a, const float3& b) { a = a - b; return a; }
+		inline float3& operator*=(float3& a, float s) { a = a * s; return a; }
+
+		inline float dot(const float2& a, const float2& b) { return a.x * b.x + a.y * b.y; }
+		inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		inline float length(const float2& a) { return std::sqrt(dot(a, a)); }
+		inline float length(const float3& a) { return std::sqrt(dot(a, a)); }
+		inline float3 normalize(const float3& a) { return a * (1.0f / length(a)); }
+		inline float3 cross(const float3& a, const float3& b)
+		{
+			return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		}
+		inline float3 reflect(const float3& i, const float3& n) { return i - 2.0f * dot(n, i) * n; }
+
+		inline float2 abs(const float2& a) { return float2(std::fabs(a.x), std::fabs(a.y)); }
+		inline float3 abs(const float3& a) { return float3(std::fabs(a.x), std::fabs(a.y), std::fabs(a.z)); }
+		inline float2 max(const float2& a, float s) { return float2(std::max(a.x, s), std::max(a.y, s)); }
+		inline float3 max(const float3& a, float s) { return float3(std::max(a.x, s), std::max(a.y, s), std::max(a.z, s)); }
+		inline float3 min(const float3& a, const float3& b) { return float3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+		inline float3 max(const float3& a, const float3& b) { return float3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+
+		inline float clamp(float x, float a, float b) { return std::min(std::max(x, a), b); }
+		inline float3 clamp(const float3& v, float a, float b) { return float3(clamp(v.x, a, b), clamp(v.y, a, b), clamp(v.z, a, b)); }
+		inline float saturate(float x) { return clamp(x, 0.0f, 1.0f); }
+		inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+		inline float3 lerp(const float3& a, const float3& b, float t) { return a + (b - a) * t; }
+		inline float sign(float x) { return (x > 0.0f) ? 1.0f : ((x < 0.0f) ? -1.0f : 0.0f); }
+		inline float frac(float x) { return x - std::floor(x); }
+		inline float smoothstep(float a, float b, float x)
+		{
+			float t = saturate((x - a) / (b - a));
+			return t * t * (3.0f - 2.0f * t);
+		}
+		// HLSL fmod keeps the sign of the dividend, as does the C runtime.
+		inline float3 fmod(const float3& a, const float3& b)
+		{
+			return float3(std::fmod(a.x, b.x), std::fmod(a.y, b.y), std::fmod(a.z, b.z));
+		}
+	}
+}
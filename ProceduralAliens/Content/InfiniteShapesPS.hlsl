@@ -327,14 +327,81 @@ float softMin2(float x, float y, float a)
 
 //------------------------------------------------------------------
 
+// Pixel footprint at the point map() is looking at, set by castRay with PIXEL_FOOTPRINT_LOD.
+// 0 keeps every detail, which is what normals, AO and shadows use.
+static float mapFootprint = 0.0;
+
+// 1 = give each cell its own creatures, scale and rotation about y from Hash() of the cell
+// coordinates, the same way as SdfRepeatField: bit 0 of the variant is the alien, bit 1 the
+// spaceship.
+#define CELL_VARIANTS 0
+// 1 = castRay walks the cells along the ray and jumps over the ones whose content box it misses.
+#define CELL_SKIP 0
+
+static const float cellPeriod = 15.0;
+static const float cellMinScale = 0.75;
+static const float cellMaxScale = 1.25;
+// Bound of one cell's content relative to its centre (SdfBounds of the cell scene); with variants,
+// of every variant at every rotation and scale.
+#if CELL_VARIANTS
+static const float3 cellBoxMin = float3(-4.05, -1.34, -4.05);
+static const float3 cellBoxMax = float3(4.05, 4.63, 4.05);
+#else
+static const float3 cellBoxMin = float3(-0.6, -1.07, -1.7);
+static const float3 cellBoxMax = float3(2.7, 3.7, 1.77);
+#endif
+
 float2 map(in float3 inpos)
 {
 	float3 pos = inpos;
 	pos.xz = (frac(inpos.xz / 15) - 0.5) * 15;
 
+#if CELL_VARIANTS
+	float2 cell = floor(inpos.xz / cellPeriod);
+	int creatures = min(int(Hash(cell) * 4.0), 3);
+	float cellScale = lerp(cellMinScale, cellMaxScale, Hash(cell + float2(0.5, 0.5)));
+	float cellAngle = 6.2831853 * Hash(cell + float2(0.25, 0.75));
+	float cellCos = cos(cellAngle);
+	float cellSin = sin(cellAngle);
+	pos = float3(cellCos*pos.x + cellSin*pos.z, pos.y, -cellSin*pos.x + cellCos*pos.z) / cellScale;
+	float footprint = mapFootprint / cellScale;
+#else
+	int creatures = 3;
+	float cellScale = 1.0;
+	float footprint = mapFootprint;
+#endif
+
 	float2 res = float2(1e10, 0.0);
 	
 	float initDist = 0;
+
+	// Displacements smaller than the footprint are skipped and the distance is shortened by the
+	// most they could have moved the surface instead, so the march never oversteps. An offset added
+	// to all three coordinates moves the point sqrt(3) times its amplitude.
+	float pylonNoise = -0.03;
+	if (0.03 > footprint)
+		pylonNoise = 0.03*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z);
+	float legWobble = 0.0;
+	float legSlack = 1.732*0.02;
+	if (legSlack > footprint)
+	{
+		legWobble = 0.02*sin(20 * pos.y + time);
+		legSlack = 0.0;
+	}
+	float brainRipple = 0.0;
+	float brainSlack = 1.732*0.005;
+	if (brainSlack > footprint)
+	{
+		brainRipple = 0.005*sin(20 * pos.x + time)*sin(45 * pos.z + time);
+		brainSlack = 0.0;
+	}
+	float hullNoise = 0.0;
+	float hullSlack = 1.732*0.02;
+	if (hullSlack > footprint)
+	{
+		hullNoise = 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z);
+		hullSlack = 0.0;
+	}
 	//pylons
 	res = opU(
 		float2(sdTorus(pos - float3(0, 2.5, 0 + initDist), float2(0.2, 0.01)), 90),
@@ -354,57 +421,70 @@ float2 map(in float3 inpos)
 
 	res = opU(res, float2(sdCylinder(pos - float3(0, 1, 0 + initDist), float2(0.03, 2)), 90));
 
-	res = opU(res, float2(0.5*sdSphere(pos - float3(0, 3, 0 + initDist), 0.1) + 0.03*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), 65));
+	res = opU(res, float2(0.5*sdSphere(pos - float3(0, 3, 0 + initDist), 0.1) + pylonNoise, 65));
 
-	//aliens
-	//body
-	res = opU(res,
-		float2(opS(
-			sdSphere(pos - float3(2, 0, 1 + initDist), float2(0.25, 0.05)),
-			opU(
+	if (creatures & 1)
+	{
+		//aliens
+		//body
+		res = opU(res,
+			float2(opS(
+				sdSphere(pos - float3(2, 0, 1 + initDist), float2(0.25, 0.05)),
 				opU(
-					sdCapsule(pos - float3(1.75, 0, 1 + initDist), float3(-0.5, 0, 0), float3(0.5, 0, 0), 0.15),
-					sdCapsule(pos - float3(2, -0.25, 1 + initDist), float3(0, -0.5, 0), float3(0, 0.5, 0), 0.15)),
-				sdCapsule(pos - float3(2, 0, 0.75 + initDist), float3(0, 0, -0.5), float3(0, 0, 0.5), 0.15)
-			)),
-			100
-			));
-
-	//eye
-	res = opU(res, float2(sdSphere(pos - float3(2, 0, 1 + initDist), float2(0.2, 0.05)), 20));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist), float3(0, 0, 0), float3(0, 0, -0.12), 0.1), 82));
-
-	//arms
-	//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1+ initDist) + 0.02*sin(45*pos.x)*sin(45*pos.z), float3(-0.5, 0, 0), float3(0.5, 0, 0), 0.05), 80));
-
-	//legs
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(0.5, -1, 0), 0.05), 100));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(0, -1, -0.4), 0.05), 100));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(-0.5, -1, 0.2), 0.05), 100));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(0.25, -1, 0.4), 0.05), 100));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(0, -1, 0), 0.05), 100));
-	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + 0.02*sin(20 * pos.y + time), float3(0, 0, 0), float3(-0.25, -1, 0.7), 0.05), 100));
-
-	//brain
-	res = opU(res, float2(softMin2(sdRoundCone(pos - float3(2, 0, 1 + initDist) + 0.005*sin(20 * pos.x + time)*sin(45 * pos.z + time), float3(0, 0.5, 0), float3(0, 0, 0), 0.3, 0.01),
-		sdTorus(opTwist(pos - float3(2, 0.5, 1 + initDist)), float2(0.25, 0.1)), 0.2), 90));
-
-	//laser
-	//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 0.5+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.02), 65));
-	//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 0+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.03), 65));
-	//res = opU(res, float2(sdCapsule(pos - float3(2, 0, -0.5+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.04), 65));
-
-	//spaceship
-	res = opU(res, float2(opS(opS(
-		softMax2(sdSphere(pos - float3(2, 3, -1 + initDist), 0.7),
-			sdTorus88(pos - float3(2, 3, -1.2 + initDist), float2(0.6, 0.3)),
-			0.8),
-		sdCylinder(opRep(pos - float3(2, 3, -2 + initDist), float3(1, 1, 0.1)), float2(0.02, 6))),
-		sdCylinder(opRep(pos - float3(1, 3, -2 + initDist), float3(1, 1, 0.1)), float2(0.02, 6))),
-		90));
-
-	res = opU(res, float2(sdSphere(pos - float3(2, 3, -1.2 + initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), 0.2), 65));
+					opU(
+						sdCapsule(pos - float3(1.75, 0, 1 + initDist), float3(-0.5, 0, 0), float3(0.5, 0, 0), 0.15),
+						sdCapsule(pos - float3(2, -0.25, 1 + initDist), float3(0, -0.5, 0), float3(0, 0.5, 0), 0.15)),
+					sdCapsule(pos - float3(2, 0, 0.75 + initDist), float3(0, 0, -0.5), float3(0, 0, 0.5), 0.15)
+				)),
+				100
+				));
+
+		//eye
+		res = opU(res, float2(sdSphere(pos - float3(2, 0, 1 + initDist), float2(0.2, 0.05)), 20));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist), float3(0, 0, 0), float3(0, 0, -0.12), 0.1), 82));
+
+		//arms
+		//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1+ initDist) + 0.02*sin(45*pos.x)*sin(45*pos.z), float3(-0.5, 0, 0), float3(0.5, 0, 0), 0.05), 80));
+
+		//legs
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(0.5, -1, 0), 0.05) - legSlack, 100));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(0, -1, -0.4), 0.05) - legSlack, 100));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(-0.5, -1, 0.2), 0.05) - legSlack, 100));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(0.25, -1, 0.4), 0.05) - legSlack, 100));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(0, -1, 0), 0.05) - legSlack, 100));
+		res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1 + initDist) + legWobble, float3(0, 0, 0), float3(-0.25, -1, 0.7), 0.05) - legSlack, 100));
+
+		//brain
+		res = opU(res, float2(softMin2(sdRoundCone(pos - float3(2, 0, 1 + initDist) + brainRipple, float3(0, 0.5, 0), float3(0, 0, 0), 0.3, 0.01) - brainSlack,
+			sdTorus(opTwist(pos - float3(2, 0.5, 1 + initDist)), float2(0.25, 0.1)), 0.2), 90));
+
+		//laser
+		//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 0.5+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.02), 65));
+		//res = opU(res, float2(sdCapsule(pos - float3(2, 0, 0+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.03), 65));
+		//res = opU(res, float2(sdCapsule(pos - float3(2, 0, -0.5+ initDist) + 0.02*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z), float3(0, 0, 0), float3(0, 0, -0.25), 0.04), 65));
+	}
+
+	if (creatures & 2)
+	{
+		//spaceship
+		res = opU(res, float2(opS(opS(
+			softMax2(sdSphere(pos - float3(2, 3, -1 + initDist), 0.7),
+				sdTorus88(pos - float3(2, 3, -1.2 + initDist), float2(0.6, 0.3)),
+				0.8),
+			sdCylinder(opRep(pos - float3(2, 3, -2 + initDist), float3(1, 1, 0.1)), float2(0.02, 6))),
+			sdCylinder(opRep(pos - float3(1, 3, -2 + initDist), float3(1, 1, 0.1)), float2(0.02, 6))),
+			90));
+
+		res = opU(res, float2(sdSphere(pos - float3(2, 3, -1.2 + initDist) + hullNoise, 0.2) - hullSlack, 65));
+	}
 
+	res.x *= cellScale;
+#if CELL_VARIANTS
+	// Turned and scaled, the neighbours' content is still at least this far inside their cells, so
+	// it can't be closer than the edge of this one plus that.
+	float cellGap = 0.5*cellPeriod - cellBoxMax.x;
+	res.x = min(res.x, 0.5*cellPeriod - max(abs(inpos.x - (cell.x + 0.5)*cellPeriod), abs(inpos.z - (cell.y + 0.5)*cellPeriod)) + cellGap);
+#endif
 	return res;
 }
 
@@ -422,9 +502,69 @@ float2 iBox(in float3 ro, in float3 rd, in float3 rad)
 
 const float maxHei = 0.8;
 
-float2 castRay(in float3 ro, in float3 rd)
+#if CELL_SKIP
+// SdfRepeatField::SkipEmpty with the same box in every cell: the furthest t along the ray that
+// passes through no cell's content box, tmax if there is none left before it.
+float cellSkip(float3 ro, float3 rd, float t, float tmax)
+{
+	// Never infinite, so a zero component can't turn the slab tests into 0*inf.
+	float3 inv = 1.0 / ((rd < 0.0 ? -1.0 : 1.0) * max(abs(rd), 1e-20));
+
+	// Above and below the content there is nothing at all.
+	float2 ty = (float2(cellBoxMin.y, cellBoxMax.y) - ro.y) * inv.y;
+	t = max(t, min(ty.x, ty.y));
+	float tend = min(tmax, max(ty.x, ty.y));
+
+	float2 cell = floor((ro.xz + rd.xz * t) / cellPeriod);
+	float2 stepDir = rd.xz < 0.0 ? -1.0 : 1.0;
+	for (int i = 0; i < 256 && t < tend; i++)
+	{
+		float2 exits = ((cell + 0.5 + 0.5*stepDir) * cellPeriod - ro.xz) * inv.xz;
+		float cellExit = min(exits.x, exits.y);
+
+		float3 origin = ro - float3((cell.x + 0.5)*cellPeriod, 0.0, (cell.y + 0.5)*cellPeriod);
+		float3 t1 = (cellBoxMin - origin) * inv;
+		float3 t2 = (cellBoxMax - origin) * inv;
+		float3 tn = min(t1, t2);
+		float3 tf = max(t1, t2);
+		float tnear = max(max(tn.x, tn.y), tn.z);
+		float tfar = min(min(tf.x, tf.y), tf.z);
+		if (tnear <= tfar && tfar >= t && tnear <= cellExit)
+			return max(t, tnear);
+
+		t = max(t, cellExit);
+		if (exits.x < exits.y)
+			cell.x += stepDir.x;
+		else
+			cell.y += stepDir.y;
+	}
+	return (t >= tend) ? tmax : t;
+}
+#endif
+
+// Over-relaxed sphere tracing (Keinert et al. 2014): steps are scaled by marchOmega and the ray
+// falls back to plain steps from the previous point when consecutive unbounding spheres stop
+// overlapping. 1.0 gives the original sphere tracer.
+static const float marchOmega = 1.0;
+static const int marchMaxSteps = 250;
+
+// 1 = hit when the distance is below the pixel footprint instead of 0.00001*t.
+#define PIXEL_FOOTPRINT_EPSILON 0
+// 1 = let map() skip detail smaller than the pixel footprint while marching. The coarse surface
+// is never behind the real one, so a ray that reaches it finishes at full detail.
+#define PIXEL_FOOTPRINT_LOD 0
+// 1 = show steps per pixel (green to red) and rays that ran out of steps (blue) instead of shading.
+#define SHOW_MARCH_STEPS 0
+
+// Per-ray counters, written by castRay.
+static int marchSteps;
+static bool marchCapped;
+
+float2 castRay(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float2 res = float2(-1.0, -1.0);
+	marchSteps = 0;
+	marchCapped = false;
 
 	float tmin = 1.0;
 	float tmax = 200.0;
@@ -445,19 +585,78 @@ float2 castRay(in float3 ro, in float3 rd)
 		tmin = max(tb.x, tmin);
 		tmax = min(tb.y, tmax);
 
+#if PIXEL_FOOTPRINT_EPSILON
+		float epsilon = pixelRadius;
+#else
+		float epsilon = 0.00001;
+#endif
+		float omega = marchOmega;
 		float t = tmin;
-		for (int i = 0; i < 250 && t < tmax; i++)
+		float previousT = tmin;
+		float previousRadius = 0.0;
+		float stepLength = 0.0;
+		float candidateError = 1e10;
+		float2 candidate = float2(-1.0, -1.0);
+		bool lod = PIXEL_FOOTPRINT_LOD != 0;
+
+		int i = 0;
+		for (; i < marchMaxSteps && t < tmax; i++)
 		{
-
+#if CELL_SKIP
+			float skipped = cellSkip(ro, rd, t, tmax);
+			if (skipped > t)
+			{
+				// Over-relaxation starts afresh after the jump.
+				t = skipped;
+				previousT = t;
+				previousRadius = 0.0;
+				stepLength = 0.0;
+				if (t >= tmax)
+					break;
+			}
+#endif
+			mapFootprint = lod ? pixelRadius * t : 0.0;
 			float2 h = map(ro + rd * t);
-			if (abs(h.x) < (0.00001*t))
+			marchSteps++;
+			float radius = abs(h.x);
+			if (omega > 1.0 && radius + previousRadius < stepLength)
 			{
-				res = float2(t, h.y);
+				t = previousT + stepLength / omega;
+				omega = 1.0;
+				continue;
+			}
+
+			float error = radius / t;
+			if (error < candidateError)
+			{
+				candidateError = error;
+				candidate = float2(t, h.y);
+			}
+			if (error < epsilon)
+			{
+				if (lod)
+				{
+					// Look again from here with full detail; only those samples can be the hit.
+					lod = false;
+					candidateError = 1e10;
+					candidate = float2(-1.0, -1.0);
+					continue;
+				}
 				break;
 			}
-			t += h.x;
+
+			previousT = t;
+			previousRadius = radius;
+			stepLength = h.x * omega;
+			t += stepLength;
 		}
 
+		mapFootprint = 0.0;
+		marchCapped = (i == marchMaxSteps) && (t < tmax);
+		if (candidateError < epsilon)
+		{
+			res = candidate;
+		}
 	}
 
 	return res;
@@ -529,10 +728,13 @@ float checkersGradBox(in float2 p)
 	return 0.5 - 0.5*i.x*i.y;
 }
 
-float3 render(in float3 ro, in float3 rd)
+float3 render(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float3 col = float3(0.7, 0.9, 1.0) + rd.y*0.8;
-	float2 res = castRay(ro, rd);
+	float2 res = castRay(ro, rd, pixelRadius);
+#if SHOW_MARCH_STEPS
+	return marchCapped ? float3(0.0, 0.0, 1.0) : lerp(float3(0.0, 1.0, 0.0), float3(1.0, 0.0, 0.0), marchSteps / float(marchMaxSteps));
+#else
 	float t = res.x;
 	float m = res.y;
 	if (m > -0.5)
@@ -586,6 +788,7 @@ float3 render(in float3 ro, in float3 rd)
 	}
 
 	return float3(clamp(col, 0.0, 1.0));
+#endif
 }
 
 float3x3 setCamera(in float3 ro, in float3 ta, float cr)
@@ -609,6 +812,9 @@ PixelShaderOutput main(VS_QUAD input)
 	eyeRay.o = eyePos.xyz;
 	eyeRay.d = normalize(PixelPos - eyePos.xyz);
 
-	output.colour = float4(render(eyeRay.o, eyeRay.d), 1);
+	// Half the angle one pixel covers, for the footprint hit test.
+	float pixelRadius = 0.5 * zoom * abs(ddx(input.canvasXY.x)) / length(PixelPos - eyePos.xyz);
+
+	output.colour = float4(render(eyeRay.o, eyeRay.d, pixelRadius), 1);
 	return output;
 }
@@ -0,0 +1,64 @@
+﻿#include "pch.h"
+#include "SdfAntialias.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	bool Differ(const SdfImage& image, int a, int b, const SdfEdgeSettings& settings)
+	{
+		if (image.material[a] != image.material[b])
+		{
+			return true;
+		}
+		const float ta = image.t[a];
+		const float tb = image.t[b];
+		if (ta >= 0.0f && std::fabs(ta - tb) > settings.depth * std::min(ta, tb))
+		{
+			return true;
+		}
+		const float3 d = abs(image.colour[a] - image.colour[b]);
+		return std::max(d.x, std::max(d.y, d.z)) > settings.colour;
+	}
+}
+
+// Each pixel is compared with the one to its right and the one below, which covers every pair
+// of 4-neighbours once.
+void SdfAntialias::FindEdges(const SdfImage& image, const SdfEdgeSettings& settings, std::vector<int>& pixels)
+{
+	const int width = image.width;
+	const int height = image.height;
+	std::vector<uint8_t> edge(width * height, 0);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const int i = y * width + x;
+			if (x + 1 < width && Differ(image, i, i + 1, settings))
+			{
+				edge[i] = edge[i + 1] = 1;
+			}
+			if (y + 1 < height && Differ(image, i, i + width, settings))
+			{
+				edge[i] = edge[i + width] = 1;
+			}
+		}
+	}
+
+	pixels.clear();
+	for (int i = 0; i < width * height; i++)
+	{
+		if (edge[i])
+		{
+			pixels.push_back(i);
+		}
+	}
+}
+
+float2 SdfAntialias::GridOffset(int sample, int grid)
+{
+	return float2((sample % grid + 0.5f) / grid - 0.5f, (sample / grid + 0.5f) / grid - 0.5f);
+}
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include "SdfRaymarcher.h"
+
+namespace ProceduralAliens
+{
+	// Differences between neighbouring pixels that make an edge worth supersampling.
+	struct SdfEdgeSettings
+	{
+		float depth = 0.05f;  // hit distances further apart than this fraction of the nearer one
+		float colour = 0.1f;  // largest colour channel difference
+	};
+
+	// Edge-adaptive antialiasing for the CPU renderers. A frame is rendered with one ray per pixel,
+	// FindEdges() picks the pixels that differ from a neighbour in hit, material, depth or colour,
+	// and the renderer supersamples only those, with the same grid of samples a uniformly
+	// supersampled frame would give every pixel.
+	class SdfAntialias
+	{
+	public:
+		// The pixels to supersample, in image order. Both pixels of a differing pair are edges.
+		static void FindEdges(const SdfImage& image, const SdfEdgeSettings& settings, std::vector<int>& pixels);
+
+		// Sample 'sample' of a grid x grid pattern: its offset from the pixel centre, in pixels.
+		static Hlsl::float2 GridOffset(int sample, int grid);
+	};
+}
@@ -0,0 +1,1970 @@
+﻿#include "pch.h"
+#include "SdfBenchmark.h"
+#include "SdfScenes.h"
+#include "SdfBvh.h"
+#include "SdfBrickMap.h"
+#include "SdfReprojection.h"
+#include "SdfPacketMarcher.h"
+#include "SdfMesher.h"
+#include "SdfFractals.h"
+#include "SdfLightVolume.h"
+#include "SdfRepeat.h"
+#include "SdfProgressive.h"
+#include "SdfPrimitives.h"
+#include "SdfAntialias.h"
+#include "SdfPartition.h"
+#include "SphereProgressive.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <ppl.h>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const float BenchmarkTime = 1.25f;
+
+	// Fly-through script: 30 fps, eye moving forward at the MoveEye speed of 10 units/s.
+	const float FrameSeconds = 1.0f / 30.0f;
+	const float FlySpeed = 10.0f;
+
+	double SecondsSince(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	struct FractalCase
+	{
+		const wchar_t* name;
+		bool mandelbulb;
+		SdfMandelbulbParams mandelbulbParams;
+		SdfSierpinskiParams sierpinskiParams;
+	};
+
+	template <int Lanes>
+	double TimeFractalBatch(const FractalCase& fractal, const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+		std::vector<float>& distances, SdfFractalStats& stats)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i + Lanes <= x.size(); i += Lanes)
+		{
+			if (fractal.mandelbulb)
+			{
+				SdfFractals::Mandelbulb<Lanes>(&x[i], &y[i], &z[i], &distances[i], fractal.mandelbulbParams, &stats);
+			}
+			else
+			{
+				SdfFractals::Sierpinski<Lanes>(&x[i], &y[i], &z[i], &distances[i], fractal.sierpinskiParams, &stats);
+			}
+		}
+		return SecondsSince(start);
+	}
+
+	// Root mean square difference of the colour channels.
+	double ColourRmse(const SdfImage& a, const SdfImage& b)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < a.colour.size(); i++)
+		{
+			const float3 d = a.colour[i] - b.colour[i];
+			sum += dot(d, d);
+		}
+		return std::sqrt(sum / (3.0 * std::max<size_t>(a.colour.size(), 1)));
+	}
+
+	// Mean of the largest colour channel difference, and the pixels where it is visible in 8 bits.
+	double ColourError(const SdfImage& a, const SdfImage& b, int& visible)
+	{
+		double sum = 0.0;
+		visible = 0;
+		for (size_t i = 0; i < a.colour.size(); i++)
+		{
+			const float3 d = abs(a.colour[i] - b.colour[i]);
+			const float error = std::max(d.x, std::max(d.y, d.z));
+			sum += error;
+			visible += (error > 2.0f / 255.0f) ? 1 : 0;
+		}
+		return sum / std::max<size_t>(a.colour.size(), 1);
+	}
+
+	// Pixels whose hit distance or material differs between two renders.
+	int CountChangedPixels(const SdfImage& a, const SdfImage& b)
+	{
+		int changed = 0;
+		for (size_t i = 0; i < a.t.size(); i++)
+		{
+			if (std::fabs(a.t[i] - b.t[i]) > 1e-3f * std::max(1.0f, a.t[i]) || a.material[i] != b.material[i])
+			{
+				changed++;
+			}
+		}
+		return changed;
+	}
+
+	// How an image's hits differ from a reference render of the same view: hits on another
+	// material, hits more than 5% nearer or further, and pixels only one of the two hits.
+	struct HitDifferences
+	{
+		int material = 0;
+		int depth = 0;
+		int gained = 0;
+		int lost = 0;
+
+		void Add(const SdfImage& reference, const SdfImage& image)
+		{
+			for (size_t i = 0; i < reference.t.size(); i++)
+			{
+				const bool referenceHit = reference.t[i] >= 0.0f;
+				const bool imageHit = image.t[i] >= 0.0f;
+				gained += (imageHit && !referenceHit) ? 1 : 0;
+				lost += (referenceHit && !imageHit) ? 1 : 0;
+				if (referenceHit && imageHit)
+				{
+					material += (image.material[i] != reference.material[i]) ? 1 : 0;
+					depth += (std::fabs(image.t[i] - reference.t[i]) > 0.05f * reference.t[i]) ? 1 : 0;
+				}
+			}
+		}
+	};
+}
+
+std::vector<SdfBenchmarkScene> SdfBenchmark::GetScenes()
+{
+	std::vector<SdfBenchmarkScene> scenes(3);
+
+	scenes[0].name = L"InfiniteShapes";
+	scenes[0].scene = SdfScenes::BuildInfiniteShapes();
+	scenes[0].reference = &SdfScenes::InfiniteShapesMap;
+	scenes[0].boundsMin = float3(-7.5f, -1.5f, -7.5f);
+	scenes[0].boundsMax = float3(7.5f, 4.0f, 7.5f);
+	scenes[0].voxelSize = 0.02f;
+
+	scenes[1].name = L"Primitives";
+	scenes[1].scene = SdfScenes::BuildPrimitives();
+	scenes[1].reference = &SdfScenes::PrimitivesMap;
+	scenes[1].boundsMin = float3(-5.0f, -4.0f, -1.0f);
+	scenes[1].boundsMax = float3(5.0f, -2.0f, 1.0f);
+	scenes[1].voxelSize = 0.02f;
+
+	scenes[2].name = L"Fractal";
+	scenes[2].scene = SdfScenes::BuildFractal();
+	scenes[2].reference = &SdfScenes::FractalMap;
+	scenes[2].boundsMin = float3(-3.5f, -2.5f, -8.5f);
+	scenes[2].boundsMax = float3(3.5f, 0.5f, -5.5f);
+	scenes[2].voxelSize = 0.01f;
+	scenes[2].march.maxSteps = 170;
+	scenes[2].march.hitEpsilon = 0.001f;
+	scenes[2].march.fogColour = float3(0.8f, 0.9f, 1.0f);
+
+	return scenes;
+}
+
+// ShinySpheresPS's view: zoom 5, and ShinySpheresVS fits the height.
+SdfCamera SdfBenchmark::SpheresCamera(int width, int height)
+{
+	SdfCamera camera;
+	camera.zoom = 5.0f;
+	camera.width = width;
+	camera.height = height;
+	camera.canvasHalfSize = float2(static_cast<float>(width) / height, 1.0f);
+	return camera;
+}
+
+// The layers size their canvas from the projection: InfiniteShapes and Primitives fit the
+// width, Fractal fits the height.
+void SdfBenchmark::SetViewport(SdfBenchmarkScene& scene, int width, int height)
+{
+	scene.camera.width = width;
+	scene.camera.height = height;
+	scene.camera.canvasHalfSize = (scene.name == L"Fractal") ?
+		float2(static_cast<float>(width) / height, 1.0f) :
+		float2(1.0f, static_cast<float>(height) / width);
+}
+
+std::vector<float3> SdfBenchmark::SamplePoints(const SdfBenchmarkScene& scene, int count)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> u(0.0f, 1.0f);
+	std::vector<float3> points(count);
+	for (float3& p : points)
+	{
+		p = float3(
+			lerp(scene.boundsMin.x, scene.boundsMax.x, u(rng)),
+			lerp(scene.boundsMin.y, scene.boundsMax.y, u(rng)),
+			lerp(scene.boundsMin.z, scene.boundsMax.z, u(rng)));
+	}
+	return points;
+}
+
+// Compiled bytecode against the hand-written map() it replaces, with each bytecode time also
+// given as a multiple of the hand-written one.
+std::wstring SdfBenchmark::RunEvaluation(int pointCount)
+{
+	std::wostringstream report;
+	report << L"SDF evaluation, " << pointCount << L" points per scene\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (const SdfBenchmarkScene& scene : GetScenes())
+	{
+		std::vector<float3> points = SamplePoints(scene, pointCount);
+		std::vector<float2> reference(pointCount);
+		std::vector<float2> scalar(pointCount);
+		std::vector<float2> batched(pointCount);
+
+		SdfProgram program;
+		auto start = std::chrono::high_resolution_clock::now();
+		program.Compile(scene.scene);
+		double compileSeconds = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < pointCount; i++)
+		{
+			reference[i] = scene.reference(points[i], context.time);
+		}
+		double referenceSeconds = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < pointCount; i++)
+		{
+			scalar[i] = program.Map(points[i], context, nullptr);
+		}
+		double scalarSeconds = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		program.Evaluate(points.data(), batched.data(), pointCount, context);
+		double batchedSeconds = SecondsSince(start);
+
+		float maxError = 0.0f;
+		int materialMismatches = 0;
+		for (int i = 0; i < pointCount; i++)
+		{
+			maxError = std::max(maxError, std::fabs(batched[i].x - reference[i].x));
+			maxError = std::max(maxError, std::fabs(scalar[i].x - reference[i].x));
+			if (batched[i].y != reference[i].y && std::fabs(reference[i].x) < 1.0f)
+			{
+				materialMismatches++;
+			}
+		}
+
+		const double toNs = 1e9 / pointCount;
+		report << L"  " << scene.name
+			<< L": " << program.GetInstructionCount() << L" instructions, "
+			<< program.GetItemCount() << L" terms, "
+			<< program.GetPointRegisterCount() << L"+" << program.GetDistanceRegisterCount() << L" registers, "
+			<< L"compile " << compileSeconds * 1e6 << L" us\n"
+			<< L"    hand-written map " << referenceSeconds * toNs << L" ns/point, "
+			<< L"bytecode scalar " << scalarSeconds * toNs << L" ns/point (" << scalarSeconds / referenceSeconds << L"x), "
+			<< L"bytecode x" << SdfLanes << L" " << batchedSeconds * toNs << L" ns/point (" << batchedSeconds / referenceSeconds << L"x)\n"
+			<< L"    max |error| " << maxError << L", material mismatches " << materialMismatches << L"\n";
+	}
+
+	return report.str();
+}
+
+// Renders each layer with every term evaluated, then with the BVH skipping terms whose bound
+// is further away than the nearest surface found so far.
+std::wstring SdfBenchmark::RunCulling(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF BVH culling, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+
+		SetViewport(scene, width, height);
+
+		SdfImage flatImage, bvhImage;
+		SdfRenderStats flatStats, bvhStats;
+		SdfRaymarcher(program, scene.march).Render(scene.camera, context, flatImage, &flatStats);
+		SdfRaymarcher(bvh, scene.march).Render(scene.camera, context, bvhImage, &bvhStats);
+
+		int changedPixels = CountChangedPixels(flatImage, bvhImage);
+
+		auto perStep = [](const SdfRenderStats& stats)
+		{
+			return static_cast<double>(stats.march.primitiveEvaluations) / std::max<uint64_t>(stats.march.mapCalls, 1);
+		};
+		report << L"  " << scene.name << L": " << program.GetPrimitiveCount() << L" primitives, "
+			<< program.GetItemCount() << L" terms, " << bvh.GetNodeCount() << L" BVH nodes\n"
+			<< L"    all terms " << flatStats.seconds * 1e3 << L" ms, " << perStep(flatStats) << L" primitives/step, "
+			<< static_cast<double>(flatStats.steps) / flatStats.rays << L" steps/pixel\n"
+			<< L"    BVH       " << bvhStats.seconds * 1e3 << L" ms, " << perStep(bvhStats) << L" primitives/step, "
+			<< static_cast<double>(bvhStats.steps) / bvhStats.rays << L" steps/pixel\n"
+			<< L"    speedup " << flatStats.seconds / bvhStats.seconds << L"x, changed pixels " << changedPixels << L"\n";
+	}
+
+	return report.str();
+}
+
+// Marches the brick cache, refining hits on the BVH, against marching the BVH alone.
+std::wstring SdfBenchmark::RunBrickMap(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF brick map, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		SdfBrickMap bricks;
+		auto start = std::chrono::high_resolution_clock::now();
+		bricks.Build(program, context, scene.voxelSize);
+		double buildSeconds = SecondsSince(start);
+
+		SdfImage exactImage, cachedImage;
+		SdfRenderStats exactStats, cachedStats;
+		SdfRaymarcher(bvh, scene.march).Render(scene.camera, context, exactImage, &exactStats);
+		SdfRaymarcher cached(bricks, scene.march);
+		cached.SetRefineField(&bvh, 4.0f * scene.voxelSize);
+		cached.Render(scene.camera, context, cachedImage, &cachedStats);
+
+		report << L"  " << scene.name << L": voxel " << scene.voxelSize << L", "
+			<< bricks.GetBrickCount() << L" of " << bricks.GetCellCount() << L" cells bricked, build " << buildSeconds * 1e3 << L" ms\n"
+			<< L"    memory " << bricks.GetMemoryBytes() / 1024 << L" KB (dense float grid " << bricks.GetDenseBytes() / 1024 << L" KB)\n"
+			<< L"    exact  " << exactStats.seconds * 1e3 << L" ms, " << static_cast<double>(exactStats.steps) / exactStats.rays << L" steps/pixel\n"
+			<< L"    cached " << cachedStats.seconds * 1e3 << L" ms, " << static_cast<double>(cachedStats.steps) / cachedStats.rays << L" steps/pixel\n"
+			<< L"    speedup " << exactStats.seconds / cachedStats.seconds << L"x, changed pixels " << CountChangedPixels(exactImage, cachedImage) << L"\n";
+	}
+
+	return report.str();
+}
+
+// Full resolution marching from tmin against starting from the cone prepass result.
+std::wstring SdfBenchmark::RunConePrepass(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF cone prepass, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		SdfMarchSettings coneMarch = scene.march;
+		coneMarch.conePrepass = true;
+
+		SdfImage directImage, coneImage;
+		SdfRenderStats directStats, coneStats;
+		SdfRaymarcher(bvh, scene.march).Render(scene.camera, context, directImage, &directStats);
+		SdfRaymarcher(bvh, coneMarch).Render(scene.camera, context, coneImage, &coneStats);
+
+		const double pixels = static_cast<double>(directStats.rays);
+		report << L"  " << scene.name << L":\n"
+			<< L"    direct " << directStats.seconds * 1e3 << L" ms, " << directStats.steps / pixels << L" steps/pixel\n"
+			<< L"    cones  " << coneStats.seconds * 1e3 << L" ms, " << coneStats.steps / pixels << L" steps/pixel + "
+			<< coneStats.prepassSteps / pixels << L" prepass steps/pixel\n"
+			<< L"    speedup " << directStats.seconds / coneStats.seconds << L"x, changed pixels " << CountChangedPixels(directImage, coneImage) << L"\n";
+	}
+
+	return report.str();
+}
+
+// Scripted fly-through, every frame rendered from scratch and with the reprojection cache.
+std::wstring SdfBenchmark::RunFlyThrough(int width, int height, int frames)
+{
+	std::wostringstream report;
+	report << L"SDF reprojection, " << width << L"x" << height << L", " << frames << L" frame fly-through\n";
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		// With the cone prepass on, misses are cheap and the cost is in the hits the cache reuses.
+		SdfMarchSettings march = scene.march;
+		march.conePrepass = true;
+		SdfRaymarcher raymarcher(bvh, march);
+		SdfReprojection reprojection;
+		SdfRenderStats fullTotal, cachedTotal;
+		double fullSeconds = 0, cachedSeconds = 0;
+		int changedPixels = 0;
+		HitDifferences differences;
+
+		for (int frame = 0; frame < frames; frame++)
+		{
+			SdfContext context;
+			context.time = BenchmarkTime + frame * FrameSeconds;
+			SdfCamera camera = scene.camera;
+			camera.eye.z += FlySpeed * FrameSeconds * frame;
+
+			SdfImage fullImage, cachedImage;
+			SdfRenderStats fullStats, cachedStats;
+			raymarcher.Render(camera, context, fullImage, &fullStats);
+			reprojection.Render(raymarcher, camera, context, cachedImage, &cachedStats);
+
+			// The first frame has nothing to reuse.
+			if (frame > 0)
+			{
+				fullTotal.Add(fullStats);
+				cachedTotal.Add(cachedStats);
+				fullSeconds += fullStats.seconds;
+				cachedSeconds += cachedStats.seconds;
+				changedPixels += CountChangedPixels(fullImage, cachedImage);
+				differences.Add(fullImage, cachedImage);
+			}
+		}
+
+		report << L"  " << scene.name << L": reuse " << 100.0 * cachedTotal.reused / std::max<uint64_t>(cachedTotal.rays, 1) << L"% of pixels ("
+			<< 100.0 * cachedTotal.reused / std::max<uint64_t>(fullTotal.hits, 1) << L"% of hits)\n"
+			<< L"    full   " << fullSeconds * 1e3 / (frames - 1) << L" ms/frame, " << static_cast<double>(fullTotal.steps) / fullTotal.rays << L" steps/pixel\n"
+			<< L"    cached " << cachedSeconds * 1e3 / (frames - 1) << L" ms/frame, " << static_cast<double>(cachedTotal.steps) / cachedTotal.rays << L" steps/pixel\n"
+			<< L"    speedup " << fullSeconds / cachedSeconds << L"x, changed pixels " << changedPixels << L"\n"
+			<< L"    against the full render: " << differences.material << L" other materials, " << differences.depth
+			<< L" depths off by more than 5%, " << differences.gained << L" hits gained, " << differences.lost << L" lost\n";
+	}
+
+	return report.str();
+}
+
+// Sweeps the over-relaxation factor with the shader's epsilon and with the pixel footprint epsilon.
+std::wstring SdfBenchmark::RunOverRelaxation(int width, int height)
+{
+	const float omegas[] = { 1.0f, 1.2f, 1.4f, 1.6f };
+
+	std::wostringstream report;
+	report << L"SDF over-relaxed sphere tracing, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		report << L"  " << scene.name << L":\n";
+		SdfImage baseline;
+		for (int footprint = 0; footprint < 2; footprint++)
+		{
+			for (float omega : omegas)
+			{
+				SdfMarchSettings march = scene.march;
+				march.omega = omega;
+				march.footprintEpsilon = footprint != 0;
+
+				SdfImage image;
+				SdfRenderStats stats;
+				SdfRaymarcher(bvh, march).Render(scene.camera, context, image, &stats);
+				if (baseline.t.empty())
+				{
+					baseline = image;
+				}
+
+				report << L"    " << (footprint ? L"footprint" : L"t-relative") << L" epsilon, omega " << omega << L": "
+					<< stats.seconds * 1e3 << L" ms, " << static_cast<double>(stats.steps) / stats.rays << L" steps/pixel, "
+					<< stats.capped << L" capped, changed pixels " << CountChangedPixels(baseline, image) << L"\n";
+			}
+		}
+	}
+
+	return report.str();
+}
+
+// Primary ray throughput, single rays against 8 and 16 lane packets. Shading is off so only
+// the march is timed.
+std::wstring SdfBenchmark::RunPackets(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF packet marching, " << width << L"x" << height << L" frame, march only\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		SdfMarchSettings march = scene.march;
+		march.shade = false;
+		SdfRaymarcher raymarcher(bvh, march);
+
+		SdfImage singleImage, image8, image16;
+		SdfRenderStats singleStats, stats8, stats16;
+		raymarcher.Render(scene.camera, context, singleImage, &singleStats);
+		SdfPacketMarcher<8>(bvh, raymarcher).Render(scene.camera, context, image8, &stats8);
+		SdfPacketMarcher<16>(bvh, raymarcher).Render(scene.camera, context, image16, &stats16);
+
+		auto line = [&](const wchar_t* name, const SdfRenderStats& stats, const SdfImage& image)
+		{
+			report << L"    " << name << stats.seconds * 1e3 << L" ms, " << stats.rays / stats.seconds * 1e-6 << L" Mrays/s, "
+				<< static_cast<double>(stats.march.primitiveEvaluations) / std::max<uint64_t>(stats.march.mapCalls, 1) << L" primitives/step, "
+				<< L"changed pixels " << CountChangedPixels(singleImage, image) << L"\n";
+		};
+		report << L"  " << scene.name << L":\n";
+		line(L"single    ", singleStats, singleImage);
+		line(L"packet x8 ", stats8, image8);
+		line(L"packet x16 ", stats16, image16);
+	}
+
+	return report.str();
+}
+
+// Normals at the primary hits of each layer: calcNormal()'s tetrahedral taps against one dual
+// number pass. The dual gradient is the exact derivative of the float map, so the angle between
+// the two is the error of the finite difference.
+std::wstring SdfBenchmark::RunNormals(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF normals, tetrahedral differences vs dual numbers, " << width << L"x" << height << L" frame hits\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		SdfMarchSettings march = scene.march;
+		march.shade = false;
+		SdfImage image;
+		SdfRaymarcher(bvh, march).Render(scene.camera, context, image, nullptr);
+
+		std::vector<float3> hits;
+		for (int y = 0; y < image.height; y++)
+		{
+			for (int x = 0; x < image.width; x++)
+			{
+				float t = image.t[y * image.width + x];
+				if (t >= 0.0f)
+				{
+					hits.push_back(scene.camera.eye + scene.camera.RayDirection(static_cast<float>(x), static_cast<float>(y)) * t);
+				}
+			}
+		}
+
+		report << L"  " << scene.name << L", " << hits.size() << L" hits:\n";
+		if (hits.empty())
+		{
+			continue;
+		}
+
+		std::vector<float3> normals[4];
+		const SdfField* fields[2] = { &program, &bvh };
+		const wchar_t* names[4] = { L"tetrahedral, flat  ", L"tetrahedral, bvh   ", L"dual, flat         ", L"dual, bvh          " };
+		for (int method = 0; method < 4; method++)
+		{
+			march.gradientNormals = method >= 2;
+			SdfRaymarcher raymarcher(*fields[method & 1], march);
+			SdfEvalStats stats;
+			normals[method].resize(hits.size());
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < hits.size(); i++)
+			{
+				normals[method][i] = raymarcher.CalcNormal(hits[i], context, &stats);
+			}
+			double seconds = SecondsSince(start);
+
+			report << L"    " << names[method] << seconds * 1e9 / hits.size() << L" ns/normal, "
+				<< static_cast<double>(stats.primitiveEvaluations) / hits.size() << L" primitives/normal\n";
+		}
+
+		// Angle between the tetrahedral and dual normals, in degrees.
+		std::vector<float> angles(hits.size());
+		double sum = 0.0;
+		for (size_t i = 0; i < hits.size(); i++)
+		{
+			float c = clamp(dot(normals[1][i], normals[3][i]), -1.0f, 1.0f);
+			angles[i] = std::acos(c) * 57.29578f;
+			sum += angles[i];
+		}
+		std::sort(angles.begin(), angles.end());
+		report << L"    tetrahedral error: mean " << sum / angles.size() << L" deg, 99th percentile "
+			<< angles[angles.size() * 99 / 100] << L" deg, max " << angles.back() << L" deg\n";
+	}
+
+	return report.str();
+}
+
+// Dual contouring throughput over each layer's sample bounds at a few octree depths. Voxels
+// are finest level cells whose corners were evaluated; "dense" counts every cell of the grid.
+std::wstring SdfBenchmark::RunMeshing()
+{
+	const int depths[] = { 5, 6, 7 };
+
+	std::wostringstream report;
+	report << L"SDF mesh extraction, octree dual contouring\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (const SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+
+		SdfAabb region;
+		region.min = scene.boundsMin;
+		region.max = scene.boundsMax;
+
+		report << L"  " << scene.name << L":\n";
+		for (int depth : depths)
+		{
+			SdfMeshSettings settings;
+			settings.depth = depth;
+			SdfMesh mesh;
+			SdfMeshStats stats;
+			SdfMesher(bvh, settings).Extract(region, context, mesh, &stats);
+
+			const double dense = std::pow(8.0, depth);
+			report << L"    " << (1 << depth) << L"^3: " << stats.seconds * 1e3 << L" ms, "
+				<< stats.nodes << L" nodes, " << stats.cells << L" voxels, " << mesh.positions.size() << L" vertices, "
+				<< mesh.GetTriangleCount() << L" triangles, " << stats.holes << L" holes\n"
+				<< L"      " << stats.cells / stats.seconds * 1e-6 << L" Mvoxels/s ("
+				<< dense / stats.seconds * 1e-6 << L" dense), " << mesh.GetTriangleCount() / stats.seconds * 1e-6 << L" Mtris/s\n";
+		}
+	}
+
+	return report.str();
+}
+
+// Batched fractal distance estimators against the scalar ports of FractalPS, over points in a
+// cube around each fractal. Lane use is the share of packet iterations spent on live lanes.
+std::wstring SdfBenchmark::RunFractals(int pointCount)
+{
+	pointCount -= pointCount % 16;
+
+	std::wostringstream report;
+	report << L"SDF fractal batches, " << pointCount << L" points\n";
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> u(-1.5f, 1.5f);
+	std::vector<float> x(pointCount), y(pointCount), z(pointCount);
+	for (int i = 0; i < pointCount; i++)
+	{
+		x[i] = u(rng);
+		y[i] = u(rng);
+		z[i] = u(rng);
+	}
+
+	std::vector<FractalCase> cases(5);
+	cases[0].name = L"Mandelbulb power 8, 25 iterations";
+	cases[0].mandelbulb = true;
+	cases[1].name = L"Mandelbulb power 8 (polar), 25 iterations";
+	cases[1].mandelbulb = true;
+	cases[1].mandelbulbParams.power = 8.0001f;
+	cases[2].name = L"Mandelbulb power 4, 12 iterations";
+	cases[2].mandelbulb = true;
+	cases[2].mandelbulbParams.power = 4.0f;
+	cases[2].mandelbulbParams.iterations = 12;
+	cases[3].name = L"Sierpinski scale 2, 15 iterations";
+	cases[3].mandelbulb = false;
+	cases[4].name = L"Sierpinski scale 2, 15 iterations, bailout 16";
+	cases[4].mandelbulb = false;
+	cases[4].sierpinskiParams.bailout = 16.0f;
+
+	for (const FractalCase& fractal : cases)
+	{
+		const SdfMandelbulbParams& mb = fractal.mandelbulbParams;
+		const SdfSierpinskiParams& sp = fractal.sierpinskiParams;
+
+		// The scalar reference always runs every Sierpinski iteration, so the bailout case
+		// also shows the error bailing out costs.
+		std::vector<float> reference(pointCount);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < pointCount; i++)
+		{
+			const float3 p(x[i], y[i], z[i]);
+			if (fractal.mandelbulb)
+			{
+				reference[i] = (mb.power == 8.0f) ? sdMandelbulb(p, mb.iterations) : sdMandelbulb(p, mb.iterations, mb.power);
+			}
+			else
+			{
+				reference[i] = sdSierpinski(p, sp.scale, static_cast<float>(sp.iterations));
+			}
+		}
+		double scalarSeconds = SecondsSince(start);
+
+		std::vector<float> batched8(pointCount), batched16(pointCount);
+		SdfFractalStats stats8, stats16;
+		double seconds8 = TimeFractalBatch<8>(fractal, x, y, z, batched8, stats8);
+		double seconds16 = TimeFractalBatch<16>(fractal, x, y, z, batched16, stats16);
+
+		float maxError = 0.0f;
+		for (int i = 0; i < pointCount; i++)
+		{
+			maxError = std::max(maxError, std::fabs(batched8[i] - reference[i]));
+			maxError = std::max(maxError, std::fabs(batched16[i] - reference[i]));
+		}
+
+		report << L"  " << fractal.name << L":\n"
+			<< L"    scalar " << scalarSeconds * 1e9 / pointCount << L" ns/point, x8 " << seconds8 * 1e9 / pointCount
+			<< L" ns/point, x16 " << seconds16 * 1e9 / pointCount << L" ns/point\n"
+			<< L"    lane use x8 " << 100.0 * stats8.laneIterations / std::max<uint64_t>(stats8.packetIterations, 1)
+			<< L"%, x16 " << 100.0 * stats16.laneIterations / std::max<uint64_t>(stats16.packetIterations, 1)
+			<< L"%, max |error| " << maxError << L"\n";
+	}
+
+	return report.str();
+}
+
+// Full detail at every step against dropping detail under the pixel footprint, march only.
+// InfiniteShapes looks down the xz repetition to tmax, 13 cells deep, where most pixels cover
+// more than the surface noise and the leg wobble.
+std::wstring SdfBenchmark::RunFootprintLod(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF footprint level of detail, " << width << L"x" << height << L" frame, march only\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		SdfMarchSettings fullMarch = scene.march;
+		fullMarch.shade = false;
+		SdfMarchSettings lodMarch = fullMarch;
+		lodMarch.footprintLod = true;
+
+		// Best of three, alternating, since the difference is smaller than the run to run noise.
+		SdfImage fullImage, lodImage;
+		SdfRenderStats fullStats, lodStats;
+		double fullSeconds = 1e30, lodSeconds = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			SdfRaymarcher(bvh, fullMarch).Render(scene.camera, context, fullImage, &fullStats);
+			SdfRaymarcher(bvh, lodMarch).Render(scene.camera, context, lodImage, &lodStats);
+			fullSeconds = std::min(fullSeconds, fullStats.seconds);
+			lodSeconds = std::min(lodSeconds, lodStats.seconds);
+		}
+
+		// Rays finish on the full detail surface, so the two images should agree to the hit
+		// epsilon. A full detail hit that turns into a miss would mean the coarse field overestimated.
+		int lost = 0;
+		for (size_t i = 0; i < fullImage.t.size(); i++)
+		{
+			lost += (fullImage.t[i] >= 0.0f && lodImage.t[i] < 0.0f) ? 1 : 0;
+		}
+
+		const double pixels = static_cast<double>(fullStats.rays);
+		report << L"  " << scene.name << L":\n"
+			<< L"    full detail " << fullSeconds * 1e3 << L" ms, " << fullStats.steps / pixels << L" steps/pixel\n"
+			<< L"    footprint   " << lodSeconds * 1e3 << L" ms, " << lodStats.steps / pixels << L" steps/pixel\n"
+			<< L"    speedup " << fullSeconds / lodSeconds << L"x, changed pixels " << CountChangedPixels(fullImage, lodImage)
+			<< L", hits lost " << lost << L"\n";
+	}
+
+	return report.str();
+}
+
+// InfiniteShapes out to the horizon: the RepeatXZ program against SdfRepeatField's cell walk,
+// then hashed per cell variants with and without the culling.
+std::wstring SdfBenchmark::RunRepetition(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF cell repetition, " << width << L"x" << height << L" frame, march only\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	SdfBenchmarkScene scene = GetScenes()[0];
+	SetViewport(scene, width, height);
+	SdfProgram program;
+	program.Compile(scene.scene);
+	SdfBvh bvh;
+	bvh.Build(program);
+
+	// Variant i has the alien if bit 0 is set and the spaceship if bit 1 is, as in InfiniteShapesPS.
+	SdfScene cellScenes[4];
+	SdfProgram cellPrograms[4];
+	SdfBvh cellBvhs[4];
+	SdfBound cellBounds[4];
+	for (int i = 0; i < 4; i++)
+	{
+		cellScenes[i] = SdfScenes::BuildInfiniteShapesCell((i & 1) != 0, (i & 2) != 0);
+		cellPrograms[i].Compile(cellScenes[i]);
+		cellBvhs[i].Build(cellPrograms[i]);
+		cellBounds[i] = SdfBounds::Compute(cellScenes[i], cellScenes[i].GetRoot());
+	}
+
+	SdfRepeatSettings plain;
+	SdfRepeatField cells(plain);
+	cells.AddVariant(cellBvhs[3], cellBounds[3]);
+
+	SdfRepeatSettings varied;
+	varied.minScale = 0.75f;
+	varied.maxScale = 1.25f;
+	varied.rotate = true;
+	SdfRepeatField variants(varied);
+	varied.cellCulling = false;
+	SdfRepeatField variantsReference(varied);
+	for (int i = 0; i < 4; i++)
+	{
+		variants.AddVariant(cellBvhs[i], cellBounds[i]);
+		variantsReference.AddVariant(cellBvhs[i], cellBounds[i]);
+	}
+
+	const float distances[] = { 200.0f, 1000.0f };
+	for (float distance : distances)
+	{
+		SdfMarchSettings march = scene.march;
+		march.shade = false;
+		march.tmax = distance;
+		march.boxSize = distance;
+		march.maxSteps = 1000;
+
+		const SdfField* fields[] = { &bvh, &cells, &variantsReference, &variants };
+		const wchar_t* names[] = { L"RepeatXZ program", L"cell walk       ", L"variants, full  ", L"variants, culled" };
+		SdfImage images[4];
+		SdfRenderStats stats[4];
+		double seconds[4] = { 1e30, 1e30, 1e30, 1e30 };
+		for (int run = 0; run < 3; run++)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				SdfRaymarcher(*fields[i], march).Render(scene.camera, context, images[i], &stats[i]);
+				seconds[i] = std::min(seconds[i], stats[i].seconds);
+			}
+		}
+
+		report << L"  tmax " << distance << L":\n";
+		const double pixels = static_cast<double>(stats[0].rays);
+		for (int i = 0; i < 4; i++)
+		{
+			report << L"    " << names[i] << L" " << seconds[i] * 1e3 << L" ms, " << stats[i].steps / pixels << L" steps/pixel, "
+				<< stats[i].march.primitiveEvaluations / pixels << L" primitives/pixel, " << stats[i].hits << L" hits\n";
+		}
+		// Culling only ever shortens distances and skips cells the ray misses, so each pair should
+		// agree to the hit epsilon.
+		report << L"    cell walk speedup " << seconds[0] / seconds[1] << L"x, changed pixels " << CountChangedPixels(images[0], images[1]) << L"\n"
+			<< L"    variant culling speedup " << seconds[2] / seconds[3] << L"x, changed pixels " << CountChangedPixels(images[2], images[3]) << L"\n";
+	}
+
+	return report.str();
+}
+
+// AO and sun shadows from a baked volume of the static terms, with the moving ones evaluated
+// live, against evaluating everything per pixel.
+std::wstring SdfBenchmark::RunLightVolume(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF baked AO and sun visibility, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		// The fractal's detail is far below any voxel size that would fit in memory.
+		if (scene.name == L"Fractal")
+		{
+			continue;
+		}
+
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+
+		const SdfScene staticScene = scene.scene.KeepTerms(false);
+		const SdfScene dynamicScene = scene.scene.KeepTerms(true);
+		SdfProgram staticProgram, dynamicProgram;
+		staticProgram.Compile(staticScene);
+		dynamicProgram.Compile(dynamicScene);
+		SdfBvh staticBvh, dynamicBvh;
+		staticBvh.Build(staticProgram);
+		dynamicBvh.Build(dynamicProgram);
+
+		// A voxel a few times coarser than the meshing one: AO and soft shadows are smooth.
+		SdfLightVolume volume;
+		volume.Build(staticBvh, &dynamicBvh, context, scene.march.sunDirection, 5.0f * scene.voxelSize);
+
+		SdfRaymarcher live(bvh, scene.march);
+		SdfRaymarcher baked(bvh, scene.march);
+		baked.SetLightVolume(&volume);
+
+		SdfImage liveImage, bakedImage;
+		SdfRenderStats liveStats, bakedStats;
+		double liveSeconds = 1e30, bakedSeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			live.Render(scene.camera, context, liveImage, &liveStats);
+			baked.Render(scene.camera, context, bakedImage, &bakedStats);
+			liveSeconds = std::min(liveSeconds, liveStats.seconds);
+			bakedSeconds = std::min(bakedSeconds, bakedStats.seconds);
+		}
+
+		// The march is the same, so only the shading differs.
+		double errorSum = 0.0;
+		float errorMax = 0.0f;
+		int visible = 0;
+		for (size_t i = 0; i < liveImage.colour.size(); i++)
+		{
+			if (liveImage.t[i] < 0.0f)
+			{
+				continue;
+			}
+			const float3 d = abs(liveImage.colour[i] - bakedImage.colour[i]);
+			const float error = std::max(d.x, std::max(d.y, d.z));
+			errorSum += error;
+			errorMax = std::max(errorMax, error);
+			visible += (error > 2.0f / 255.0f) ? 1 : 0;
+		}
+
+		const double hits = static_cast<double>(std::max<uint64_t>(liveStats.hits, 1));
+		report << L"  " << scene.name << L": " << staticProgram.GetItemCount() << L" static terms, "
+			<< dynamicProgram.GetItemCount() << L" animated\n"
+			<< L"    bake " << volume.GetBakeSeconds() * 1e3 << L" ms, " << volume.GetSampleCount() << L" samples ("
+			<< volume.GetTracedCount() << L" near the content), " << volume.GetMemoryBytes() / 1024 << L" KB, "
+			<< volume.GetBakeStats().mapCalls << L" map calls\n"
+			<< L"    live  " << liveSeconds * 1e3 << L" ms, " << liveStats.shading.mapCalls / hits << L" shading map calls/pixel, "
+			<< liveStats.shading.primitiveEvaluations / hits << L" primitives/pixel\n"
+			<< L"    baked " << bakedSeconds * 1e3 << L" ms, " << bakedStats.shading.mapCalls / hits << L" shading map calls/pixel, "
+			<< bakedStats.shading.primitiveEvaluations / hits << L" primitives/pixel\n"
+			<< L"    colour error mean " << errorSum / hits << L", max " << errorMax << L", " << visible << L" of "
+			<< liveStats.hits << L" pixels off by more than 2/255\n";
+	}
+
+	return report.str();
+}
+
+std::wstring SdfBenchmark::Run()
+{
+	std::wstring report;
+	report += RunEvaluation(1 << 16);
+	report += RunCulling(320, 180);
+	report += RunBrickMap(320, 180);
+	report += RunConePrepass(320, 180);
+	report += RunFlyThrough(320, 180, 10);
+	report += RunOverRelaxation(320, 180);
+	report += RunPackets(320, 180);
+	report += RunNormals(320, 180);
+	report += RunMeshing();
+	report += RunFractals(1 << 14);
+	report += RunFootprintLod(320, 180);
+	report += RunRepetition(320, 180);
+	report += RunLightVolume(320, 180);
+	report += RunProgressive(320, 180);
+	report += RunSpheres(320, 180);
+	report += RunSphereShadows(320, 180);
+	report += RunSphereWavefront(320, 180);
+	report += RunSphereAnimation(320, 180, 60);
+	report += RunSpherePaths(320, 180);
+	report += RunAntialiasing(320, 180);
+	report += RunDeferredShading(320, 180);
+	report += RunVisibilityScale(320, 180);
+	report += RunPartition(320, 180, 4);
+	report += RunRebake(1 << 14);
+	return report;
+}
+
+// Time to the first (1 in 16) image and to each refinement after it, and how far each filled
+// image is from the full render, for both kinds of fill.
+std::wstring SdfBenchmark::RunProgressive(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF progressive refinement, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+		SdfRaymarcher raymarcher(bvh, scene.march);
+
+		SdfImage fullImage;
+		SdfRenderStats fullStats;
+		double fullSeconds = 1e30;
+		double levelSeconds[SdfProgressive::Levels];
+		std::fill(levelSeconds, levelSeconds + SdfProgressive::Levels, 1e30);
+		for (int run = 0; run < 2; run++)
+		{
+			raymarcher.Render(scene.camera, context, fullImage, &fullStats);
+			fullSeconds = std::min(fullSeconds, fullStats.seconds);
+
+			SdfProgressive progressive;
+			for (int level = 0; level < SdfProgressive::Levels; level++)
+			{
+				SdfImage image;
+				SdfRenderStats stats;
+				progressive.Refine(raymarcher, scene.camera, context, image, &stats);
+				levelSeconds[level] = std::min(levelSeconds[level], stats.seconds);
+			}
+		}
+
+		report << L"  " << scene.name << L": full frame " << fullSeconds * 1e3 << L" ms\n";
+		const wchar_t* upsampleNames[] = { L"nearest", L"bilinear" };
+		const SdfUpsample upsamples[] = { SdfUpsample::Nearest, SdfUpsample::Bilinear };
+		double total = 0.0;
+		for (int level = 0; level < SdfProgressive::Levels; level++)
+		{
+			total += levelSeconds[level];
+			const int stride = SdfProgressive::GetStride(level);
+			report << L"    1 in " << stride * stride << L": +" << levelSeconds[level] * 1e3 << L" ms (" << total * 1e3 << L" ms, "
+				<< 100.0 * total / fullSeconds << L"% of the full frame)";
+			for (int u = 0; u < 2; u++)
+			{
+				SdfProgressive progressive(upsamples[u]);
+				SdfImage image;
+				for (int refine = 0; refine <= level; refine++)
+				{
+					progressive.Refine(raymarcher, scene.camera, context, image, nullptr);
+				}
+
+				double errorSum = 0.0;
+				for (size_t i = 0; i < image.colour.size(); i++)
+				{
+					const float3 d = abs(image.colour[i] - fullImage.colour[i]);
+					errorSum += std::max(d.x, std::max(d.y, d.z));
+				}
+				report << L", " << upsampleNames[u] << L" colour error " << errorSum / image.colour.size()
+					<< L" with " << CountChangedPixels(image, fullImage) << L" changed pixels";
+			}
+			report << L"\n";
+		}
+	}
+
+	return report.str();
+}
+
+// ShinySpheres traced on the CPU with 3 to 1M spheres: BVH build and frame times for each leaf
+// test width, and the shader's linear loops where they finish in reasonable time.
+std::wstring SdfBenchmark::RunSpheres(int width, int height)
+{
+	std::wostringstream report;
+	report << L"ShinySpheres CPU ray tracer, " << width << L"x" << height << L" frame\n";
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const SphereLighting lighting;
+	const int counts[] = { 3, 100, 1000, 10000, 100000, 1000000 };
+	const int maxLinearCount = 1000;
+	const int laneCounts[] = { 1, 4, 8 };
+
+	for (int count : counts)
+	{
+		const SphereScene scene = SphereScene::Generate(count, 1234);
+		report << L"  " << count << L" spheres\n";
+
+		SdfImage linearImage;
+		double linearSeconds = 0.0;
+		if (count <= maxLinearCount)
+		{
+			SphereTracer tracer(scene, nullptr, lighting);
+			SphereTraceStats stats;
+			linearSeconds = 1e30;
+			for (int run = 0; run < 2; run++)
+			{
+				tracer.Render(camera, linearImage, &stats);
+				linearSeconds = std::min(linearSeconds, stats.seconds);
+			}
+			report << L"    linear: " << linearSeconds * 1e3 << L" ms, " << stats.GetRayCount() / linearSeconds * 1e-6 << L" Mrays/s ("
+				<< stats.primaryRays << L" primary, " << stats.reflectionRays << L" reflection, " << stats.shadowRays << L" shadow)\n";
+		}
+
+		for (int lanes : laneCounts)
+		{
+			SphereBvh bvh;
+			bvh.Build(scene, lanes);
+			SphereTracer tracer(scene, &bvh, lighting);
+			SdfImage image;
+			SphereTraceStats stats;
+			double seconds = 1e30;
+			for (int run = 0; run < 2; run++)
+			{
+				tracer.Render(camera, image, &stats);
+				seconds = std::min(seconds, stats.seconds);
+			}
+
+			const double rays = static_cast<double>(stats.GetRayCount());
+			report << L"    bvh x" << lanes << L": build " << bvh.GetBuildSeconds() * 1e3 << L" ms, " << bvh.GetNodeCount() << L" nodes, depth "
+				<< bvh.GetDepth() << L", frame " << seconds * 1e3 << L" ms, " << rays / seconds * 1e-6 << L" Mrays/s, "
+				<< (stats.queries.nodes + stats.shadowQueries.nodes) / rays << L" boxes/ray, "
+				<< (stats.queries.sphereTests + stats.shadowQueries.sphereTests) / rays << L" sphere tests/ray";
+			if (count <= maxLinearCount)
+			{
+				report << L", " << linearSeconds / seconds << L"x linear, " << CountChangedPixels(image, linearImage) << L" changed pixels";
+			}
+			report << L"\n";
+		}
+	}
+
+	return report.str();
+}
+
+// Primary and shadow rays timed as separate streams, so each gets its own rays per second. The
+// shadow rays go from every lit primary hit to the light, once through Occluded() and once as
+// the shader's old Shadow(), a nearest hit query with no end that any sphere at all satisfies.
+std::wstring SdfBenchmark::RunSphereShadows(int width, int height)
+{
+	std::wostringstream report;
+	report << L"ShinySpheres shadow rays, " << width << L"x" << height << L" frame, 8 wide leaves\n";
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const SphereLighting lighting;
+	const int counts[] = { 1000, 100000, 1000000 };
+
+	for (int count : counts)
+	{
+		const SphereScene scene = SphereScene::Generate(count, 1234);
+		SphereBvh bvh;
+		bvh.Build(scene, 8);
+
+		// Primary rays, keeping the lit hits as shadow ray origins.
+		std::vector<SphereHit> hits(width * height);
+		std::vector<SphereQueryStats> rowStats(height);
+		double primarySeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			Concurrency::parallel_for(0, height, [&](int y)
+			{
+				rowStats[y] = SphereQueryStats();
+				for (int x = 0; x < width; x++)
+				{
+					hits[y * width + x] = bvh.Intersect(camera.eye, camera.RayDirection(static_cast<float>(x), static_cast<float>(y)), lighting.farPlane, &rowStats[y]);
+				}
+			});
+			primarySeconds = std::min(primarySeconds, SecondsSince(start));
+		}
+		SphereQueryStats primaryStats;
+		for (const SphereQueryStats& s : rowStats)
+		{
+			primaryStats.Add(s);
+		}
+
+		std::vector<float3> origins;
+		std::vector<float3> directions;
+		std::vector<float> distances;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const SphereHit& hit = hits[y * width + x];
+				if (hit.sphere < 0)
+				{
+					continue;
+				}
+				const float3 p = camera.eye + camera.RayDirection(static_cast<float>(x), static_cast<float>(y)) * hit.t;
+				const float3 toLight = lighting.lightPosition - p;
+				const float3 l = normalize(toLight);
+				if (dot(p - scene.GetCentre(hit.sphere), l) > 0.0f)
+				{
+					origins.push_back(p);
+					directions.push_back(l);
+					distances.push_back(length(toLight));
+				}
+			}
+		}
+
+		// Both kinds of shadow query over the same rays, in chunks of a row's worth.
+		const int shadowCount = static_cast<int>(origins.size());
+		const int chunks = (shadowCount + width - 1) / width;
+		std::vector<uint8_t> occluded(shadowCount), unbounded(shadowCount);
+		std::vector<SphereQueryStats> occludedStats(chunks), unboundedStats(chunks);
+		double occludedSeconds = 1e30, unboundedSeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			Concurrency::parallel_for(0, chunks, [&](int chunk)
+			{
+				occludedStats[chunk] = SphereQueryStats();
+				for (int i = chunk * width; i < std::min(shadowCount, (chunk + 1) * width); i++)
+				{
+					occluded[i] = bvh.Occluded(origins[i], directions[i], 0.0f, distances[i], &occludedStats[chunk]) ? 1 : 0;
+				}
+			});
+			occludedSeconds = std::min(occludedSeconds, SecondsSince(start));
+
+			start = std::chrono::high_resolution_clock::now();
+			Concurrency::parallel_for(0, chunks, [&](int chunk)
+			{
+				unboundedStats[chunk] = SphereQueryStats();
+				for (int i = chunk * width; i < std::min(shadowCount, (chunk + 1) * width); i++)
+				{
+					unbounded[i] = (bvh.Intersect(origins[i], directions[i], std::numeric_limits<float>::infinity(), &unboundedStats[chunk]).sphere >= 0) ? 1 : 0;
+				}
+			});
+			unboundedSeconds = std::min(unboundedSeconds, SecondsSince(start));
+		}
+
+		SphereQueryStats occludedTotal, unboundedTotal;
+		int inShadow = 0, beyondLight = 0;
+		for (int chunk = 0; chunk < chunks; chunk++)
+		{
+			occludedTotal.Add(occludedStats[chunk]);
+			unboundedTotal.Add(unboundedStats[chunk]);
+		}
+		for (int i = 0; i < shadowCount; i++)
+		{
+			inShadow += occluded[i];
+			beyondLight += (unbounded[i] && !occluded[i]) ? 1 : 0;
+		}
+
+		const double primaryRays = static_cast<double>(width * height);
+		const double shadowRays = static_cast<double>(std::max(shadowCount, 1));
+		report << L"  " << count << L" spheres\n"
+			<< L"    primary " << primaryRays / primarySeconds * 1e-6 << L" Mrays/s, " << primaryStats.nodes / primaryRays << L" boxes/ray, "
+			<< primaryStats.sphereTests / primaryRays << L" sphere tests/ray\n"
+			<< L"    shadow, Occluded() " << shadowCount / occludedSeconds * 1e-6 << L" Mrays/s, " << occludedTotal.nodes / shadowRays << L" boxes/ray, "
+			<< occludedTotal.sphereTests / shadowRays << L" sphere tests/ray\n"
+			<< L"    shadow, nearest hit " << shadowCount / unboundedSeconds * 1e-6 << L" Mrays/s, " << unboundedTotal.nodes / shadowRays << L" boxes/ray, "
+			<< unboundedTotal.sphereTests / shadowRays << L" sphere tests/ray\n"
+			<< L"    " << inShadow << L" of " << shadowCount << L" in shadow, " << beyondLight << L" more only blocked beyond the light\n";
+	}
+
+	return report.str();
+}
+
+// Depth-first against wavefront tracing of the reflection bounces. Secondary rays per second are
+// compared on the same rays: the wavefront's batches as traced, unsorted, and replayed in the
+// order depth-first tracing meets them, a pixel's whole chain at a time.
+std::wstring SdfBenchmark::RunSphereWavefront(int width, int height)
+{
+	std::wostringstream report;
+	report << L"ShinySpheres wavefront reflections, " << width << L"x" << height << L" frame, 8 wide leaves\n";
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const SphereLighting lighting;
+	const int counts[] = { 1000, 100000, 1000000 };
+	const float cutoff = 0.1f;
+
+	for (int count : counts)
+	{
+		const SphereScene scene = SphereScene::Generate(count, 1234);
+		SphereBvh bvh;
+		bvh.Build(scene, 8);
+		SphereTracer tracer(scene, &bvh, lighting);
+
+		SdfImage depthFirstImage;
+		SphereTraceStats stats;
+		double depthFirstSeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			tracer.Render(camera, depthFirstImage, &stats);
+			depthFirstSeconds = std::min(depthFirstSeconds, stats.seconds);
+		}
+		report << L"  " << count << L" spheres\n    depth first: frame " << depthFirstSeconds * 1e3 << L" ms\n";
+
+		// Sorted, unsorted and with the cutoff; the sorted run keeps its batches for the replay.
+		const wchar_t* names[] = { L"wavefront", L"unsorted", L"cutoff" };
+		std::vector<std::vector<SphereWaveRay>> batches;
+		for (int mode = 0; mode < 3; mode++)
+		{
+			SphereWavefrontSettings settings;
+			settings.sort = mode != 1;
+			settings.cutoff = (mode == 2) ? cutoff : 0.0f;
+
+			SdfImage image;
+			SphereBounceStats bounces[SphereMaxDepth], best[SphereMaxDepth];
+			double seconds = 1e30;
+			for (int run = 0; run < 2; run++)
+			{
+				tracer.RenderWavefront(camera, settings, image, &stats, bounces, (mode == 0 && run == 0) ? &batches : nullptr);
+				seconds = std::min(seconds, stats.seconds);
+				for (int b = 0; b < SphereMaxDepth; b++)
+				{
+					if (run == 0 || bounces[b].traceSeconds < best[b].traceSeconds)
+					{
+						best[b] = bounces[b];
+					}
+				}
+			}
+
+			double secondaryRays = 0.0, secondarySeconds = 0.0, sortSeconds = 0.0;
+			uint64_t dropped = best[0].dropped;
+			for (int b = 1; b < SphereMaxDepth; b++)
+			{
+				secondaryRays += static_cast<double>(best[b].rays);
+				secondarySeconds += best[b].traceSeconds;
+				sortSeconds += best[b].sortSeconds;
+				dropped += best[b].dropped;
+			}
+
+			double errorSum = 0.0;
+			float errorMax = 0.0f;
+			for (size_t i = 0; i < image.colour.size(); i++)
+			{
+				const float3 d = abs(image.colour[i] - depthFirstImage.colour[i]);
+				const float error = std::max(d.x, std::max(d.y, d.z));
+				errorSum += error;
+				errorMax = std::max(errorMax, error);
+			}
+
+			report << L"    " << names[mode] << L": frame " << seconds * 1e3 << L" ms, secondary rays";
+			for (int b = 1; b < SphereMaxDepth; b++)
+			{
+				report << L" " << best[b].rays;
+			}
+			report << L", " << secondaryRays / std::max(secondarySeconds, 1e-9) * 1e-6 << L" Mrays/s, sort " << sortSeconds * 1e3 << L" ms";
+			if (settings.cutoff > 0.0f)
+			{
+				report << L", " << dropped << L" dropped below " << settings.cutoff;
+			}
+			report << L", colour error mean " << errorSum / image.colour.size() << L", max " << errorMax << L"\n";
+		}
+
+		// The same secondary rays in depth-first order: batches are in bounce order, so a stable
+		// sort on the pixel puts each pixel's chain together.
+		std::vector<SphereWaveRay> chains;
+		for (size_t b = 1; b < batches.size(); b++)
+		{
+			chains.insert(chains.end(), batches[b].begin(), batches[b].end());
+		}
+		std::stable_sort(chains.begin(), chains.end(), [](const SphereWaveRay& a, const SphereWaveRay& b) { return a.pixel < b.pixel; });
+		std::vector<SphereHit> hits;
+		double replaySeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			SphereTraceStats replayStats;
+			auto start = std::chrono::high_resolution_clock::now();
+			tracer.TraceStream(chains, hits, replayStats);
+			replaySeconds = std::min(replaySeconds, SecondsSince(start));
+		}
+		report << L"    depth first order: " << chains.size() << L" secondary rays, " << chains.size() / replaySeconds * 1e-6 << L" Mrays/s\n";
+	}
+
+	return report.str();
+}
+
+// 100k spheres bobbing at 30 frames a second, with the BVH kept up to date three ways: refitted
+// only, rebuilt from scratch every frame, and Update()'s refit with partial and full rebuilds when
+// the SAH cost has grown. The last frame of each is checked against a fresh build.
+std::wstring SdfBenchmark::RunSphereAnimation(int width, int height, int frames)
+{
+	std::wostringstream report;
+	const int count = 100000;
+	const float motion = 3.0f;
+	const float frameTime = 1.0f / 30.0f;
+	report << L"ShinySpheres animation, " << count << L" moving spheres, " << frames << L" frames, " << width << L"x" << height << L", 8 wide leaves\n";
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const SphereLighting lighting;
+	const wchar_t* names[] = { L"refit only", L"full rebuild", L"adaptive" };
+	const SphereBvhUpdateSettings settings;
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		SphereScene scene = SphereScene::Generate(count, 1234, motion);
+		SphereBvh bvh;
+		bvh.Build(scene, 8);
+		SphereTracer tracer(scene, &bvh, lighting);
+
+		double animateSeconds = 0.0, refitSeconds = 0.0, rebuildSeconds = 0.0, renderSeconds = 0.0, worstUpdate = 0.0;
+		int treelets = 0, fullRebuilds = 0;
+		float growth = 1.0f, worstGrowth = 1.0f;
+		SdfImage image;
+		for (int frame = 1; frame <= frames; frame++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			scene.Animate(frame * frameTime);
+			animateSeconds += SecondsSince(start);
+
+			SphereBvhUpdateStats update;
+			if (mode == 0)
+			{
+				start = std::chrono::high_resolution_clock::now();
+				bvh.Refit(scene);
+				update.refitSeconds = SecondsSince(start);
+			}
+			else if (mode == 1)
+			{
+				bvh.Build(scene, 8);
+				update.rebuildSeconds = bvh.GetBuildSeconds();
+				update.fullRebuild = true;
+			}
+			else
+			{
+				update = bvh.Update(scene, settings);
+			}
+			refitSeconds += update.refitSeconds;
+			rebuildSeconds += update.rebuildSeconds;
+			worstUpdate = std::max(worstUpdate, update.refitSeconds + update.rebuildSeconds);
+			treelets += update.treeletsRebuilt;
+			fullRebuilds += update.fullRebuild ? 1 : 0;
+			growth = bvh.GetSahCost();
+
+			SphereTraceStats stats;
+			tracer.Render(camera, image, &stats);
+			renderSeconds += stats.seconds;
+
+			SphereBvh fresh;
+			fresh.Build(scene, 8);
+			growth /= fresh.GetSahCost();
+			worstGrowth = std::max(worstGrowth, growth);
+		}
+
+		SphereBvh fresh;
+		fresh.Build(scene, 8);
+		SdfImage freshImage;
+		SphereTracer(scene, &fresh, lighting).Render(camera, freshImage, nullptr);
+
+		const double perFrame = 1e3 / frames;
+		report << L"  " << names[mode] << L": per frame animate " << animateSeconds * perFrame << L" ms, refit " << refitSeconds * perFrame
+			<< L" ms, rebuild " << rebuildSeconds * perFrame << L" ms, worst update " << worstUpdate * 1e3 << L" ms, render " << renderSeconds * perFrame << L" ms\n"
+			<< L"    " << fullRebuilds << L" full rebuilds, " << treelets << L" treelets rebuilt, SAH cost over a fresh build's "
+			<< growth << L" at the end, " << worstGrowth << L" at worst, changed pixels " << CountChangedPixels(image, freshImage) << L"\n";
+	}
+
+	return report.str();
+}
+
+// Progressive path tracing: paths per second per core, and how long the accumulated image takes
+// to get within NoiseThreshold of a reference traced with many more paths from another seed.
+// The reference's own noise is in the error too, so it is kept well below the threshold.
+std::wstring SdfBenchmark::RunSpherePaths(int width, int height)
+{
+	std::wostringstream report;
+	const int referenceSamples = 256;
+	const int maxSamples = 128;
+	const double noiseThreshold = 0.05;
+	const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+	report << L"ShinySpheres progressive path tracing, " << width << L"x" << height << L", " << cores << L" cores, RMS noise threshold " << noiseThreshold << L"\n";
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const SphereLighting lighting;
+	const int counts[] = { 3, 1000 };
+
+	for (int count : counts)
+	{
+		const SphereScene scene = (count == 3) ? SphereScene::ShinySpheres() : SphereScene::Generate(count, 1234);
+		SphereBvh bvh;
+		bvh.Build(scene, 8);
+		SphereTracer tracer(scene, &bvh, lighting);
+
+		SpherePathSettings referenceSettings;
+		referenceSettings.samples = 16;
+		referenceSettings.seed = 1;
+		SphereProgressive reference;
+		SdfImage referenceImage;
+		while (reference.Refine(tracer, camera, referenceSettings, referenceImage, nullptr) < referenceSamples)
+		{
+		}
+
+		SpherePathSettings settings;
+		SphereProgressive progressive;
+		SdfImage image;
+		SphereTraceStats stats, total;
+		double seconds = 0.0, thresholdSeconds = -1.0;
+		int thresholdSamples = -1;
+		report << L"  " << count << L" spheres\n    RMS error";
+		for (int samples = 1; samples <= maxSamples; samples++)
+		{
+			progressive.Refine(tracer, camera, settings, image, &stats);
+			seconds += stats.seconds;
+			total.Add(stats);
+			const double error = ColourRmse(image, referenceImage);
+			if (thresholdSamples < 0 && error < noiseThreshold)
+			{
+				thresholdSamples = samples;
+				thresholdSeconds = seconds;
+			}
+			if ((samples & (samples - 1)) == 0)
+			{
+				report << L" " << samples << L":" << error;
+			}
+		}
+
+		const double paths = static_cast<double>(total.primaryRays);
+		report << L"\n    " << paths / seconds / cores * 1e-6 << L" M paths/s/core, " << (total.reflectionRays + paths) / paths << L" segments and "
+			<< total.shadowRays / paths << L" shadow rays a path, ";
+		if (thresholdSamples > 0)
+		{
+			report << L"under the threshold after " << thresholdSamples << L" paths a pixel, " << thresholdSeconds * 1e3 << L" ms\n";
+		}
+		else
+		{
+			report << L"still above the threshold after " << maxSamples << L" paths a pixel, " << seconds * 1e3 << L" ms\n";
+		}
+
+		// Moving the eye has to throw the accumulated paths away.
+		SdfCamera moved = camera;
+		moved.eye.x += 0.1f;
+		const int afterMove = progressive.Refine(tracer, moved, settings, image, nullptr);
+		report << L"    after moving the camera: " << afterMove << L" path a pixel\n";
+	}
+
+	return report.str();
+}
+
+// One ray per pixel, uniform 4x4 supersampling, and 4x4 supersampling of only the pixels
+// SdfAntialias::FindEdges picks, for the SDF scenes and ShinySpheres. Errors are against the
+// uniform image; samples count the first ray of every pixel as well as the extra ones.
+std::wstring SdfBenchmark::RunAntialiasing(int width, int height)
+{
+	std::wostringstream report;
+	const int grid = 4;
+	const SdfEdgeSettings edgeSettings;
+	report << L"Edge-adaptive supersampling, " << width << L"x" << height << L", " << grid << L"x" << grid << L" samples per supersampled pixel\n";
+
+	const int pixelCount = width * height;
+	std::vector<int> allPixels(pixelCount);
+	for (int i = 0; i < pixelCount; i++)
+	{
+		allPixels[i] = i;
+	}
+
+	auto addReport = [&](const std::wstring& name, const SdfImage& single, const SdfImage& uniform, const SdfImage& adaptive, size_t edges,
+		double singleSeconds, double uniformSeconds, double edgeSeconds, double adaptiveSeconds)
+	{
+		int singleVisible, adaptiveVisible;
+		const double singleError = ColourError(single, uniform, singleVisible);
+		const double adaptiveError = ColourError(adaptive, uniform, adaptiveVisible);
+		const double samples = pixelCount + static_cast<double>(edges) * grid * grid;
+		report << L"  " << name << L": " << edges << L" edge pixels (" << 100.0 * edges / pixelCount << L"%), samples "
+			<< 100.0 * samples / (static_cast<double>(pixelCount) * grid * grid) << L"% of uniform\n"
+			<< L"    frame 1 ray " << singleSeconds * 1e3 << L" ms, uniform " << uniformSeconds * 1e3 << L" ms, adaptive "
+			<< (singleSeconds + edgeSeconds + adaptiveSeconds) * 1e3 << L" ms (finding edges " << edgeSeconds * 1e3 << L" ms)\n"
+			<< L"    colour error against uniform: 1 ray " << singleError << L" with " << singleVisible << L" visible, adaptive "
+			<< adaptiveError << L" with " << adaptiveVisible << L" visible\n";
+	};
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+		SdfRaymarcher raymarcher(bvh, scene.march);
+
+		SdfImage single, uniform, adaptive;
+		SdfRenderStats stats;
+		raymarcher.Render(scene.camera, context, single, &stats);
+		const double singleSeconds = stats.seconds;
+
+		uniform = single;
+		raymarcher.RenderSupersampled(scene.camera, context, allPixels, grid, uniform, &stats);
+		const double uniformSeconds = stats.seconds;
+
+		adaptive = single;
+		std::vector<int> edges;
+		auto start = std::chrono::high_resolution_clock::now();
+		SdfAntialias::FindEdges(single, edgeSettings, edges);
+		const double edgeSeconds = SecondsSince(start);
+		raymarcher.RenderSupersampled(scene.camera, context, edges, grid, adaptive, &stats);
+		addReport(scene.name, single, uniform, adaptive, edges.size(), singleSeconds, uniformSeconds, edgeSeconds, stats.seconds);
+	}
+
+	const SdfCamera camera = SpheresCamera(width, height);
+	const int counts[] = { 3, 1000 };
+	for (int count : counts)
+	{
+		const SphereScene spheres = (count == 3) ? SphereScene::ShinySpheres() : SphereScene::Generate(count, 1234);
+		SphereBvh sphereBvh;
+		sphereBvh.Build(spheres, 8);
+		SphereTracer tracer(spheres, &sphereBvh, SphereLighting());
+
+		SdfImage single, uniform, adaptive;
+		SphereTraceStats stats;
+		tracer.Render(camera, single, &stats);
+		const double singleSeconds = stats.seconds;
+
+		uniform = single;
+		tracer.RenderSupersampled(camera, allPixels, grid, uniform, &stats);
+		const double uniformSeconds = stats.seconds;
+
+		adaptive = single;
+		std::vector<int> edges;
+		auto start = std::chrono::high_resolution_clock::now();
+		SdfAntialias::FindEdges(single, edgeSettings, edges);
+		const double edgeSeconds = SecondsSince(start);
+		tracer.RenderSupersampled(camera, edges, grid, adaptive, &stats);
+		std::wostringstream name;
+		name << L"ShinySpheres, " << count << L" spheres";
+		addReport(name.str(), single, uniform, adaptive, edges.size(), singleSeconds, uniformSeconds, edgeSeconds, stats.seconds);
+	}
+
+	return report.str();
+}
+
+// Render() against its two phases: the hit phase (march, normal, AO and shadows into the
+// G-buffer) and the shading phase at each lane count. The shading is timed on its own, so its
+// throughput is hits shaded per second; the colours are compared with Render()'s.
+std::wstring SdfBenchmark::RunDeferredShading(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF deferred shading, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+	const int lanes[] = { 1, 4, 8 };
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+		SdfRaymarcher raymarcher(bvh, scene.march);
+
+		SdfImage forwardImage, image;
+		SdfGBuffer gbuffer;
+		SdfRenderStats stats;
+		double forwardSeconds = 1e30, hitSeconds = 1e30;
+		for (int run = 0; run < 2; run++)
+		{
+			raymarcher.Render(scene.camera, context, forwardImage, &stats);
+			forwardSeconds = std::min(forwardSeconds, stats.seconds);
+			raymarcher.RenderGBuffer(scene.camera, context, gbuffer, image, &stats);
+			hitSeconds = std::min(hitSeconds, stats.seconds);
+		}
+		const int hits = gbuffer.GetCount();
+		report << L"  " << scene.name << L": " << hits << L" hits, Render() " << forwardSeconds * 1e3 << L" ms, hit phase " << hitSeconds * 1e3 << L" ms\n";
+
+		for (int width : lanes)
+		{
+			double shadeSeconds = 1e30;
+			for (int run = 0; run < 5; run++)
+			{
+				raymarcher.ShadeGBuffer(scene.camera, gbuffer, width, image, &stats);
+				shadeSeconds = std::min(shadeSeconds, stats.seconds);
+			}
+
+			float errorMax = 0.0f;
+			for (size_t i = 0; i < image.colour.size(); i++)
+			{
+				const float3 d = abs(image.colour[i] - forwardImage.colour[i]);
+				errorMax = std::max(errorMax, std::max(d.x, std::max(d.y, d.z)));
+			}
+			report << L"    shading " << width << L" wide: " << shadeSeconds * 1e3 << L" ms, " << hits / shadeSeconds * 1e-6 << L" M hits/s, frame "
+				<< (hitSeconds + shadeSeconds) * 1e3 << L" ms, colour error max " << errorMax << L", changed pixels " << CountChangedPixels(image, forwardImage) << L"\n";
+		}
+	}
+
+	return report.str();
+}
+
+// AO and soft shadows at full, half and quarter resolution in the G-buffer, upsampled by depth
+// and normal. Frame times are the hit phase plus 8 wide shading; errors are against full
+// resolution visibility.
+std::wstring SdfBenchmark::RunVisibilityScale(int width, int height)
+{
+	std::wostringstream report;
+	report << L"SDF reduced resolution AO and soft shadows, " << width << L"x" << height << L" frame\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+	const int scales[] = { 1, 2, 4 };
+
+	for (SdfBenchmarkScene& scene : GetScenes())
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+		SetViewport(scene, width, height);
+		report << L"  " << scene.name << L"\n";
+
+		SdfImage fullImage;
+		double fullSeconds = 0.0;
+		for (int scale : scales)
+		{
+			SdfMarchSettings settings = scene.march;
+			settings.visibilityScale = scale;
+			SdfRaymarcher raymarcher(bvh, settings);
+
+			SdfImage image;
+			SdfGBuffer gbuffer;
+			SdfRenderStats hitStats, shadeStats;
+			double seconds = 1e30;
+			for (int run = 0; run < 2; run++)
+			{
+				raymarcher.RenderGBuffer(scene.camera, context, gbuffer, image, &hitStats);
+				raymarcher.ShadeGBuffer(scene.camera, gbuffer, 8, image, &shadeStats);
+				seconds = std::min(seconds, hitStats.seconds + shadeStats.seconds);
+			}
+			if (scale == 1)
+			{
+				fullImage = image;
+				fullSeconds = seconds;
+			}
+
+			int visible;
+			float errorMax = 0.0f;
+			const double errorMean = ColourError(image, fullImage, visible);
+			for (size_t i = 0; i < image.colour.size(); i++)
+			{
+				const float3 d = abs(image.colour[i] - fullImage.colour[i]);
+				errorMax = std::max(errorMax, std::max(d.x, std::max(d.y, d.z)));
+			}
+			const int hits = gbuffer.GetCount();
+			report << L"    1 in " << scale * scale << L": frame " << seconds * 1e3 << L" ms (" << 100.0 * seconds / fullSeconds << L"%), shading map() calls "
+				<< hitStats.shading.mapCalls << L", " << hitStats.unmatched << L" of " << hits << L" hits evaluated for want of a match, colour error mean "
+				<< errorMean << L", max " << errorMax << L", " << visible << L" visible\n";
+		}
+	}
+
+	return report.str();
+}
+
+// The scenes split into a static and a dynamic half: how they split, how often the static half
+// answers alone, and frames at successive times rendered from the whole scene, from the two
+// halves and from a bake of the static half plus the live dynamic one. The shader scenes only
+// split by min, so a smooth union of a static and a moving shape checks the blend as well.
+std::wstring SdfBenchmark::RunPartition(int width, int height, int frames)
+{
+	std::wostringstream report;
+	report << L"SDF static/dynamic partition, " << width << L"x" << height << L" frames\n";
+
+	std::vector<SdfBenchmarkScene> scenes = GetScenes();
+	SdfBenchmarkScene blend;
+	blend.name = L"SmoothBlend";
+	{
+		SdfScene& s = blend.scene;
+		SdfWave wave;
+		wave.amplitude = 0.1f;
+		wave.terms = 1;
+		wave.frequency[0] = float3(0.0f, 8.0f, 0.0f);
+		wave.timeScale[0] = 2.0f;
+		const int ground = s.Material(10, s.Union({
+			s.Translate(float3(0.0f, -1.0f, 0.0f), s.Box(float3(3.0f, 0.2f, 3.0f))),
+			s.Translate(float3(1.5f, 0.0f, 0.0f), s.RoundBox(float3(0.4f, 0.8f, 0.4f), 0.1f)) }));
+		const int blob = s.Material(20, s.DomainWave(wave, s.Translate(float3(-0.5f, -0.4f, 0.0f), s.Sphere(0.6f))));
+		s.SetRoot(s.Scale(0.8f, s.SmoothMin(ground, blob, 0.4f)));
+		blend.boundsMin = float3(-3.0f, -1.5f, -3.0f);
+		blend.boundsMax = float3(3.0f, 1.5f, 3.0f);
+		blend.voxelSize = 0.02f;
+	}
+	scenes.push_back(blend);
+
+	for (SdfBenchmarkScene& scene : scenes)
+	{
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBvh bvh;
+		bvh.Build(program);
+
+		SdfScene staticScene, dynamicScene;
+		const SdfSplit split = scene.scene.Split(staticScene, dynamicScene);
+		SdfProgram staticProgram, dynamicProgram;
+		staticProgram.Compile(staticScene);
+		dynamicProgram.Compile(dynamicScene);
+		SdfBvh staticBvh, dynamicBvh;
+		staticBvh.Build(staticProgram);
+		dynamicBvh.Build(dynamicProgram);
+		const SdfField* staticField = (staticProgram.GetItemCount() > 0) ? &staticBvh : nullptr;
+		SdfPartition exact;
+		exact.Build(staticField, &dynamicBvh, split);
+
+		report << L"  " << scene.name << L": " << staticProgram.GetItemCount() << L" static terms, "
+			<< dynamicProgram.GetItemCount() << L" dynamic, combined by "
+			<< ((split.blend > 0.0f) ? L"softMin2" : L"min") << L"\n";
+
+		// The halves against the whole scene at random points and times.
+		const int pointCount = 1 << 14;
+		std::vector<float3> points = SamplePoints(scene, pointCount);
+		SdfEvalStats pointStats;
+		float errorMax = 0.0f;
+		int materialErrors = 0;
+		for (int i = 0; i < pointCount; i++)
+		{
+			SdfContext context;
+			context.time = BenchmarkTime + 0.37f * (i % 16);
+			const float2 whole = program.Map(points[i], context, nullptr);
+			const float2 parts = exact.Map(points[i], context, &pointStats);
+			errorMax = std::max(errorMax, std::fabs(whole.x - parts.x));
+			materialErrors += (whole.x < 0.01f && whole.y != parts.y) ? 1 : 0;
+		}
+		const double calls = static_cast<double>(std::max<uint64_t>(pointStats.partitionCalls, 1));
+		report << L"    points: distance error max " << errorMax << L", " << materialErrors << L" wrong materials near the surface, "
+			<< 100.0 * pointStats.staticCalls / calls << L"% static only\n";
+
+		if (scene.name == L"SmoothBlend")
+		{
+			continue;
+		}
+
+		// A bake of the static half outlives every frame; only the dynamic half is live.
+		SdfBrickMap bricks;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (staticField)
+		{
+			SdfContext bakeContext;
+			bakeContext.time = BenchmarkTime;
+			bricks.Build(staticProgram, bakeContext, scene.voxelSize);
+		}
+		const double bakeSeconds = SecondsSince(start);
+		SdfPartition baked;
+		baked.Build(staticField ? &bricks : nullptr, &dynamicBvh, split);
+
+		SetViewport(scene, width, height);
+		SdfRaymarcher whole(bvh, scene.march);
+		SdfRaymarcher halves(exact, scene.march);
+		SdfRaymarcher cached(baked, scene.march);
+		cached.SetRefineField(&exact, 4.0f * scene.voxelSize);
+
+		SdfRenderStats wholeStats, halvesStats, cachedStats;
+		double wholeSeconds = 0.0, halvesSeconds = 0.0, cachedSeconds = 0.0;
+		int halvesChanged = 0, cachedChanged = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			SdfContext context;
+			context.time = BenchmarkTime + frame * FrameSeconds;
+			auto render = [&](const SdfRaymarcher& raymarcher, SdfImage& image, SdfRenderStats& total, double& seconds)
+			{
+				SdfRenderStats stats;
+				raymarcher.Render(scene.camera, context, image, &stats);
+				total.Add(stats);
+				seconds += stats.seconds;
+			};
+			SdfImage wholeImage, halvesImage, cachedImage;
+			render(whole, wholeImage, wholeStats, wholeSeconds);
+			render(halves, halvesImage, halvesStats, halvesSeconds);
+			render(cached, cachedImage, cachedStats, cachedSeconds);
+			halvesChanged += CountChangedPixels(wholeImage, halvesImage);
+			cachedChanged += CountChangedPixels(wholeImage, cachedImage);
+		}
+
+		auto staticShare = [](const SdfRenderStats& stats)
+		{
+			const uint64_t calls = stats.march.partitionCalls + stats.shading.partitionCalls;
+			return 100.0 * (stats.march.staticCalls + stats.shading.staticCalls) / std::max<uint64_t>(calls, 1);
+		};
+		const double frameCount = static_cast<double>(std::max(frames, 1));
+		report << L"    whole  " << wholeSeconds * 1e3 / frameCount << L" ms/frame, "
+			<< (wholeStats.march.primitiveEvaluations + wholeStats.shading.primitiveEvaluations) / frameCount << L" primitives/frame\n"
+			<< L"    halves " << halvesSeconds * 1e3 / frameCount << L" ms/frame, "
+			<< (halvesStats.march.primitiveEvaluations + halvesStats.shading.primitiveEvaluations) / frameCount << L" primitives/frame, "
+			<< staticShare(halvesStats) << L"% static only, changed pixels " << halvesChanged << L"\n"
+			<< L"    baked  " << cachedSeconds * 1e3 / frameCount << L" ms/frame after a " << bakeSeconds * 1e3 << L" ms bake, "
+			<< staticShare(cachedStats) << L"% static only, changed pixels " << cachedChanged << L"\n";
+	}
+
+	return report.str();
+}
+
+// One primitive at a time grown a little, with the brick map brought up to date by Update()
+// and by a full Build(). The updated map has to match the rebuilt one wherever the fresh
+// bake has bricks, and never promise more distance than it anywhere.
+std::wstring SdfBenchmark::RunRebake(int pointCount)
+{
+	std::wostringstream report;
+	report << L"SDF brick map incremental rebake\n";
+
+	SdfContext context;
+	context.time = BenchmarkTime;
+
+	for (const SdfBenchmarkScene& scene : GetScenes())
+	{
+		if (scene.name == L"Fractal")
+		{
+			continue;
+		}
+
+		SdfProgram program;
+		program.Compile(scene.scene);
+		SdfBrickMap baked;
+		baked.Build(program, context, scene.voxelSize);
+		report << L"  " << scene.name << L": " << program.GetItemCount() << L" terms, " << baked.GetBrickCount() << L" of "
+			<< baked.GetCellCount() << L" cells bricked\n";
+
+		// The primitives the compiled scene actually contains, a few of them spread over the tree.
+		std::vector<int> primitives;
+		std::vector<int> stack(1, scene.scene.GetRoot());
+		while (!stack.empty())
+		{
+			const int node = stack.back();
+			stack.pop_back();
+			const SdfNode& n = scene.scene.GetNode(node);
+			if (!n.enabled)
+			{
+				continue;
+			}
+			if (SdfScene::IsPrimitive(n.type))
+			{
+				primitives.push_back(node);
+			}
+			stack.insert(stack.end(), n.children.begin(), n.children.end());
+		}
+		std::sort(primitives.begin(), primitives.end());
+		const int edits = std::min(4, static_cast<int>(primitives.size()));
+
+		const std::vector<float3> points = SamplePoints(scene, pointCount);
+		for (int edit = 0; edit < edits; edit++)
+		{
+			const int node = primitives[edit * primitives.size() / edits];
+			SdfScene editedScene = scene.scene;
+			editedScene.GetNode(node).params[0] += 0.05f;
+			SdfProgram editedProgram;
+			editedProgram.Compile(editedScene);
+
+			SdfBrickMap updated = baked;
+			const SdfRebakeStats stats = updated.Update(editedProgram);
+
+			SdfBrickMap rebuilt;
+			auto start = std::chrono::high_resolution_clock::now();
+			rebuilt.Build(editedProgram, context, scene.voxelSize);
+			const double buildSeconds = SecondsSince(start);
+
+			float nearError = 0.0f;
+			float further = 0.0f;
+			for (const float3& p : points)
+			{
+				const float2 a = updated.Map(p, context, nullptr);
+				const float2 b = rebuilt.Map(p, context, nullptr);
+				if (std::fabs(b.x) < 2.0f * scene.voxelSize)
+				{
+					nearError = std::max(nearError, std::fabs(a.x - b.x));
+				}
+				further = std::max(further, a.x - b.x);
+			}
+
+			report << L"    node " << node << L": " << stats.changedTerms << L" terms changed, " << stats.dirtyCells << L" cells dirty, "
+				<< stats.sampledBricks << L" bricks sampled" << (stats.full ? L" (full rebuild)" : L"") << L"\n"
+				<< L"      update " << stats.seconds * 1e3 << L" ms, build " << buildSeconds * 1e3 << L" ms, "
+				<< updated.GetBrickCount() << L" bricks against " << rebuilt.GetBrickCount() << L"\n"
+				<< L"      error near the surface " << nearError << L", most distance over the rebuild " << further << L"\n";
+		}
+	}
+
+	return report.str();
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include "SdfProgram.h"
+#include "SdfRaymarcher.h"
+#include <string>
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// Sample points, reference map() and view for one of the raymarched layers.
+	struct SdfBenchmarkScene
+	{
+		std::wstring name;
+		SdfScene scene;
+		Hlsl::float2(*reference)(const Hlsl::float3&, float);
+		Hlsl::float3 boundsMin;
+		Hlsl::float3 boundsMax;
+		SdfCamera camera;
+		SdfMarchSettings march;
+		float voxelSize;
+	};
+
+	// CPU timings for the SDF evaluators. Run() returns a plain text report that the app
+	// writes to the debugger output.
+	class SdfBenchmark
+	{
+	public:
+		static std::vector<SdfBenchmarkScene> GetScenes();
+		static std::vector<Hlsl::float3> SamplePoints(const SdfBenchmarkScene& scene, int count);
+		static void SetViewport(SdfBenchmarkScene& scene, int width, int height);
+		static SdfCamera SpheresCamera(int width, int height);
+
+		static std::wstring Run();
+		static std::wstring RunEvaluation(int pointCount);
+		static std::wstring RunCulling(int width, int height);
+		static std::wstring RunBrickMap(int width, int height);
+		static std::wstring RunConePrepass(int width, int height);
+		static std::wstring RunFlyThrough(int width, int height, int frames);
+		static std::wstring RunOverRelaxation(int width, int height);
+		static std::wstring RunPackets(int width, int height);
+		static std::wstring RunNormals(int width, int height);
+		static std::wstring RunMeshing();
+		static std::wstring RunFractals(int pointCount);
+		static std::wstring RunFootprintLod(int width, int height);
+		static std::wstring RunRepetition(int width, int height);
+		static std::wstring RunLightVolume(int width, int height);
+		static std::wstring RunProgressive(int width, int height);
+		static std::wstring RunSpheres(int width, int height);
+		static std::wstring RunSphereShadows(int width, int height);
+		static std::wstring RunSphereWavefront(int width, int height);
+		static std::wstring RunSphereAnimation(int width, int height, int frames);
+		static std::wstring RunSpherePaths(int width, int height);
+		static std::wstring RunAntialiasing(int width, int height);
+		static std::wstring RunDeferredShading(int width, int height);
+		static std::wstring RunVisibilityScale(int width, int height);
+		static std::wstring RunPartition(int width, int height, int frames);
+		static std::wstring RunRebake(int pointCount);
+	};
+}
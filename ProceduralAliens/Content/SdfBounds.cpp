@@ -0,0 +1,254 @@
+﻿#include "pch.h"
+#include "SdfBounds.h"
+#include <limits>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const float Infinity = std::numeric_limits<float>::infinity();
+
+	SdfBound MakeBound(const float3& min, const float3& max, float scale)
+	{
+		SdfBound bound;
+		bound.box.min = min;
+		bound.box.max = max;
+		bound.scale = scale;
+		return bound;
+	}
+
+	SdfBound Symmetric(const float3& half, float scale)
+	{
+		return MakeBound(-half, half, scale);
+	}
+
+	SdfBound Segment(const float3& a, const float3& b, float ra, float rb)
+	{
+		return MakeBound(
+			Hlsl::min(a - float3(ra), b - float3(rb)),
+			Hlsl::max(a + float3(ra), b + float3(rb)),
+			1.0f);
+	}
+
+	float WaveAmplitude(const SdfWave& wave)
+	{
+		return std::fabs(wave.amplitude);
+	}
+
+	// softMin2 undershoots min(x, y) by at most a/6 (softAbs2 exceeds abs by at most a/3).
+	SdfBound SmoothUnion(const SdfBound& a, const SdfBound& b, float radius)
+	{
+		SdfBound bound;
+		bound.box = a.box;
+		bound.box.Grow(b.box);
+		bound.scale = std::min(a.scale, b.scale);
+		bound.box = bound.box.Padded(radius / 6.0f / bound.scale);
+		return bound;
+	}
+}
+
+SdfAabb SdfAabb::Empty()
+{
+	SdfAabb box;
+	box.min = float3(Infinity);
+	box.max = float3(-Infinity);
+	return box;
+}
+
+SdfAabb SdfAabb::Infinite()
+{
+	SdfAabb box;
+	box.min = float3(-Infinity);
+	box.max = float3(Infinity);
+	return box;
+}
+
+bool SdfAabb::IsFinite() const
+{
+	return std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(min.z) &&
+		std::isfinite(max.x) && std::isfinite(max.y) && std::isfinite(max.z);
+}
+
+float SdfAabb::SurfaceArea() const
+{
+	if (IsEmpty())
+	{
+		return 0.0f;
+	}
+	float3 e = Extent();
+	return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void SdfAabb::Grow(const SdfAabb& other)
+{
+	min = Hlsl::min(min, other.min);
+	max = Hlsl::max(max, other.max);
+}
+
+SdfAabb SdfAabb::Padded(float amount) const
+{
+	SdfAabb box;
+	box.min = min - float3(amount);
+	box.max = max + float3(amount);
+	return box;
+}
+
+SdfAabb SdfAabb::Translated(const float3& offset) const
+{
+	SdfAabb box;
+	box.min = min + offset;
+	box.max = max + offset;
+	return box;
+}
+
+bool SdfAabb::Overlaps(const SdfAabb& other) const
+{
+	return min.x <= other.max.x && max.x >= other.min.x &&
+		min.y <= other.max.y && max.y >= other.min.y &&
+		min.z <= other.max.z && max.z >= other.min.z;
+}
+
+float SdfAabb::Distance(const float3& p) const
+{
+	float dx = std::max(std::max(min.x - p.x, p.x - max.x), 0.0f);
+	float dy = std::max(std::max(min.y - p.y, p.y - max.y), 0.0f);
+	float dz = std::max(std::max(min.z - p.z, p.z - max.z), 0.0f);
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+SdfBound SdfBounds::Compute(const SdfScene& scene, int node)
+{
+	if (node < 0 || !scene.GetNode(node).enabled)
+	{
+		return MakeBound(float3(Infinity), float3(-Infinity), 1.0f);
+	}
+
+	const SdfNode& n = scene.GetNode(node);
+	const float* k = n.params;
+
+	switch (n.type)
+	{
+	case SdfNodeType::Empty:
+		return MakeBound(float3(Infinity), float3(-Infinity), 1.0f);
+
+	case SdfNodeType::Sphere:
+		return Symmetric(float3(k[0]), 1.0f);
+	case SdfNodeType::Box:
+		return Symmetric(float3(k[0], k[1], k[2]), 1.0f);
+	case SdfNodeType::Ellipsoid:
+		// The approximated ellipsoid distance is only a rough bound.
+		return Symmetric(float3(k[0], k[1], k[2]), 0.5f);
+	case SdfNodeType::RoundBox:
+		return Symmetric(float3(k[0] + k[3], k[1] + k[3], k[2] + k[3]), 1.0f);
+	case SdfNodeType::Torus:
+		return Symmetric(float3(k[0] + k[1], k[1], k[0] + k[1]), 1.0f);
+	case SdfNodeType::Torus82:
+	case SdfNodeType::Torus88:
+		// length8 is at least 2^(-3/8) of the euclidean length.
+		return Symmetric(float3(k[0] + k[1], k[1], k[0] + k[1]), 0.77f);
+	case SdfNodeType::HexPrism:
+		return Symmetric(float3(1.1547f * k[0], 1.1547f * k[0], k[1]), 1.0f);
+	case SdfNodeType::Capsule:
+		return Segment(float3(k[0], k[1], k[2]), float3(k[3], k[4], k[5]), k[6], k[6]);
+	case SdfNodeType::RoundCone:
+		return Segment(float3(k[0], k[1], k[2]), float3(k[3], k[4], k[5]), k[6], k[7]);
+	case SdfNodeType::Cylinder:
+		return Symmetric(float3(k[0], k[1], k[0]), 1.0f);
+	case SdfNodeType::CappedCone:
+	{
+		float r = std::max(k[1], k[2]);
+		return Symmetric(float3(r, k[0], r), 1.0f);
+	}
+	case SdfNodeType::Octahedron:
+		return Symmetric(float3(k[0]), 0.57735027f);
+	case SdfNodeType::Sierpinski:
+		// Convex hull of the tetrahedron vertices, padded for the hit epsilon the fractal pass uses.
+		return MakeBound(float3(-0.6f, -0.1f, -0.97f), float3(1.1f, 1.6f, 0.97f), 0.5f);
+	case SdfNodeType::Mandelbulb:
+		// Any point further out than 2 escapes for powers of 2 and up; the power 8 bulb is smaller.
+		return Symmetric(float3(k[1] == 8.0f ? 1.25f : 2.0f), 0.5f);
+
+	case SdfNodeType::Translate:
+	{
+		SdfBound child = Compute(scene, n.children[0]);
+		child.box = child.box.Translated(float3(k[0], k[1], k[2]));
+		return child;
+	}
+	case SdfNodeType::Twist:
+	{
+		// opTwist rotates xz about y and returns (x', z', y); the child sees y in its z slot.
+		SdfBound child = Compute(scene, n.children[0]);
+		if (child.box.IsEmpty())
+		{
+			return child;
+		}
+		float rx = std::max(std::fabs(child.box.min.x), std::fabs(child.box.max.x));
+		float rz = std::max(std::fabs(child.box.min.y), std::fabs(child.box.max.y));
+		float r = std::sqrt(rx * rx + rz * rz);
+		return MakeBound(float3(-r, child.box.min.z, -r), float3(r, child.box.max.z, r), child.scale);
+	}
+	case SdfNodeType::Repeat:
+	{
+		SdfBound child = Compute(scene, n.children[0]);
+		return MakeBound(float3(-Infinity), float3(Infinity), child.scale);
+	}
+	case SdfNodeType::RepeatXZ:
+	{
+		SdfBound child = Compute(scene, n.children[0]);
+		return MakeBound(float3(-Infinity, child.box.min.y, -Infinity), float3(Infinity, child.box.max.y, Infinity), child.scale);
+	}
+	case SdfNodeType::DomainWave:
+	{
+		// p + w*(1,1,1) with |w| <= amplitude moves the point at most 'amplitude' along each axis.
+		SdfBound child = Compute(scene, n.children[0]);
+		child.box = child.box.Padded(WaveAmplitude(n.wave));
+		return child;
+	}
+
+	case SdfNodeType::Scale:
+	{
+		SdfBound child = Compute(scene, n.children[0]);
+		child.scale *= k[0];
+		return child;
+	}
+	case SdfNodeType::DistanceWave:
+	{
+		SdfBound child = Compute(scene, n.children[0]);
+		child.box = child.box.Padded(WaveAmplitude(n.wave) / child.scale);
+		return child;
+	}
+	case SdfNodeType::Material:
+		return Compute(scene, n.children[0]);
+
+	case SdfNodeType::Union:
+	{
+		SdfBound bound = MakeBound(float3(Infinity), float3(-Infinity), 1.0f);
+		for (int child : n.children)
+		{
+			SdfBound c = Compute(scene, child);
+			if (!c.box.IsEmpty())
+			{
+				bound.box.Grow(c.box);
+				bound.scale = std::min(bound.scale, c.scale);
+			}
+		}
+		return bound;
+	}
+	case SdfNodeType::Subtract:
+		// max(-b, a) >= a
+		return Compute(scene, n.children[0]);
+	case SdfNodeType::SmoothMin:
+		return SmoothUnion(Compute(scene, n.children[0]), Compute(scene, n.children[1]), std::fabs(k[0]) + std::fabs(k[1]));
+	case SdfNodeType::SmoothMax:
+		if (k[0] - std::fabs(k[1]) >= 0.0f)
+		{
+			// softMax2 >= max(a, b) >= a
+			return Compute(scene, n.children[0]);
+		}
+		// A negative radius turns softMax2 into softMin2 (primitivesPS uses -abs(sin(time))).
+		return SmoothUnion(Compute(scene, n.children[0]), Compute(scene, n.children[1]), std::fabs(k[0]) + std::fabs(k[1]));
+	}
+
+	return MakeBound(float3(-Infinity), float3(Infinity), 1.0f);
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include "SdfScene.h"
+
+namespace ProceduralAliens
+{
+	struct SdfAabb
+	{
+		Hlsl::float3 min;
+		Hlsl::float3 max;
+
+		static SdfAabb Empty();
+		static SdfAabb Infinite();
+
+		bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+		bool IsFinite() const;
+		Hlsl::float3 Centre() const { return (min + max) * 0.5f; }
+		Hlsl::float3 Extent() const { return max - min; }
+		float SurfaceArea() const;
+
+		void Grow(const SdfAabb& other);
+		SdfAabb Padded(float amount) const;
+		SdfAabb Translated(const Hlsl::float3& offset) const;
+		bool Overlaps(const SdfAabb& other) const;
+
+		// Euclidean distance from p to the box, 0 inside.
+		float Distance(const Hlsl::float3& p) const;
+	};
+
+	// Conservative bound on a subtree: wherever p is outside 'box', the subtree's distance is at least
+	// scale * box.Distance(p). The box is padded for smooth blends and displacements, and scale < 1
+	// covers distance estimates that are not exact (0.5*sdSphere, sdOctahedron, the fractals).
+	struct SdfBound
+	{
+		SdfAabb box;
+		float scale;
+	};
+
+	namespace SdfBounds
+	{
+		SdfBound Compute(const SdfScene& scene, int node);
+	}
+}
@@ -0,0 +1,427 @@
+﻿#include "pch.h"
+#include "SdfBrickMap.h"
+#include <algorithm>
+#include <chrono>
+#include <ppl.h>
+#include <unordered_map>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const int BrickVoxels = SdfBrickMap::BrickSize * SdfBrickMap::BrickSize * SdfBrickMap::BrickSize;
+
+	// Update() rebuilds from scratch once an edit dirties this share of the cells.
+	const float FullRebakeShare = 0.75f;
+}
+
+SdfBrickMap::SdfBrickMap() :
+	m_program(nullptr),
+	m_bounds(SdfAabb::Empty()),
+	m_voxelSize(0),
+	m_cellSize(0),
+	m_distanceScale(0),
+	m_exactOutside(false),
+	m_prefixSignature(0)
+{
+	m_cells[0] = m_cells[1] = m_cells[2] = 0;
+}
+
+void SdfBrickMap::Build(const SdfProgram& program, const SdfContext& context, float voxelSize)
+{
+	m_program = &program;
+	m_context = context;
+	m_voxelSize = voxelSize;
+	// Samples sit on both faces of a cell so a lookup never needs a neighbouring brick.
+	m_cellSize = voxelSize * (BrickSize - 1);
+
+	m_bounds = SdfAabb::Empty();
+	m_exactOutside = false;
+	m_prefixSignature = program.GetPrefixSignature();
+	m_terms.clear();
+	for (int i = 0; i < program.GetItemCount(); i++)
+	{
+		const SdfProgramItem& item = program.GetItem(i);
+		m_terms.push_back({ item.signature, item.bound });
+		if (item.bound.box.IsFinite())
+		{
+			m_bounds.Grow(item.bound.box);
+		}
+		else
+		{
+			m_exactOutside = true;
+		}
+	}
+	m_bounds = m_bounds.Padded(m_cellSize);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		m_cells[axis] = std::max(1, static_cast<int>(std::ceil((m_bounds.max[axis] - m_bounds.min[axis]) / m_cellSize)));
+		m_bounds.max[axis] = m_bounds.min[axis] + m_cells[axis] * m_cellSize;
+	}
+	m_distanceScale = 32767.0f / GetBand();
+
+	const int cellCount = GetCellCount();
+	std::vector<float3> centres(cellCount);
+	for (int cell = 0; cell < cellCount; cell++)
+	{
+		centres[cell] = GetCellCentre(cell);
+	}
+	std::vector<float2> centreDistances(cellCount);
+	program.EvaluateLocal(centres.data(), centreDistances.data(), cellCount, context);
+
+	const float brickThreshold = GetBrickThreshold();
+	m_brickIndex.assign(cellCount, 0);
+	m_coarse.clear();
+	m_freeBricks.clear();
+	m_freeCoarse.clear();
+	std::vector<int> brickCells;
+	for (int cell = 0; cell < cellCount; cell++)
+	{
+		if (std::fabs(centreDistances[cell].x) > brickThreshold)
+		{
+			m_brickIndex[cell] = -1 - static_cast<int32_t>(m_coarse.size());
+			m_coarse.push_back(centreDistances[cell].x);
+		}
+		else
+		{
+			m_brickIndex[cell] = static_cast<int32_t>(brickCells.size());
+			brickCells.push_back(cell);
+		}
+	}
+
+	m_distances.assign(brickCells.size() * BrickVoxels, 0);
+	m_materials.assign(brickCells.size() * BrickVoxels, 0);
+
+	Concurrency::parallel_for(0, static_cast<int>(brickCells.size()), [&](int brick)
+	{
+		SampleBrick(program, brick, brickCells[brick]);
+	});
+}
+
+SdfRebakeStats SdfBrickMap::Update(const SdfProgram& program)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	SdfRebakeStats stats;
+
+	// Terms are matched by signature; whatever is only in the old bake or only in the edited
+	// program is the edit, and counts are kept so that duplicated terms pair off one to one.
+	std::unordered_map<uint64_t, int> oldCounts, newCounts;
+	for (const Term& term : m_terms)
+	{
+		oldCounts[term.signature]++;
+	}
+	for (int i = 0; i < program.GetItemCount(); i++)
+	{
+		newCounts[program.GetItem(i).signature]++;
+	}
+	std::vector<SdfBound> changed;
+	std::vector<SdfBound> added;
+	for (const Term& term : m_terms)
+	{
+		int& count = newCounts[term.signature];
+		if (count > 0)
+		{
+			count--;
+		}
+		else
+		{
+			changed.push_back(term.bound);
+		}
+	}
+	for (int i = 0; i < program.GetItemCount(); i++)
+	{
+		const SdfProgramItem& item = program.GetItem(i);
+		int& count = oldCounts[item.signature];
+		if (count > 0)
+		{
+			count--;
+		}
+		else
+		{
+			changed.push_back(item.bound);
+			added.push_back(item.bound);
+		}
+	}
+	stats.changedTerms = static_cast<int>(changed.size());
+
+	// New content has to stay a cell inside the grid, as Build() leaves it, and a term without a
+	// bound reaches every cell.
+	const SdfAabb inner = m_bounds.Padded(-m_cellSize);
+	bool full = (program.GetPrefixSignature() != m_prefixSignature);
+	for (const SdfBound& bound : changed)
+	{
+		full = full || !bound.box.IsFinite();
+	}
+	for (const SdfBound& bound : added)
+	{
+		full = full || bound.box.min.x < inner.min.x || bound.box.min.y < inner.min.y || bound.box.min.z < inner.min.z ||
+			bound.box.max.x > inner.max.x || bound.box.max.y > inner.max.y || bound.box.max.z > inner.max.z;
+	}
+	std::vector<int> dirty;
+	if (!full)
+	{
+		// Samples are clamped to the band, so a term changes them only where it is nearer than
+		// that, which its bound rules out beyond band / scale of its box. Cells overlapping that,
+		// before or after the edit, are dirty. Materials of samples further than the band can go
+		// stale, but a lookup only uses them at a hit, where the nearest sample is within a voxel
+		// of the surface.
+		const float band = GetBand();
+		for (const SdfBound& bound : changed)
+		{
+			const SdfAabb box = bound.box.Padded(band / bound.scale);
+			int lo[3], hi[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				lo[axis] = std::max(static_cast<int>(std::floor((box.min[axis] - m_bounds.min[axis]) / m_cellSize)), 0);
+				hi[axis] = std::min(static_cast<int>(std::floor((box.max[axis] - m_bounds.min[axis]) / m_cellSize)), m_cells[axis] - 1);
+			}
+			for (int z = lo[2]; z <= hi[2]; z++)
+			{
+				for (int y = lo[1]; y <= hi[1]; y++)
+				{
+					for (int x = lo[0]; x <= hi[0]; x++)
+					{
+						dirty.push_back((z * m_cells[1] + y) * m_cells[0] + x);
+					}
+				}
+			}
+		}
+		std::sort(dirty.begin(), dirty.end());
+		dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+		stats.dirtyCells = static_cast<int>(dirty.size());
+
+		// Past this the bookkeeping costs more than it saves.
+		full = dirty.size() >= FullRebakeShare * GetCellCount();
+	}
+	if (full)
+	{
+		Build(program, m_context, m_voxelSize);
+		stats.full = true;
+		stats.dirtyCells = GetCellCount();
+		stats.sampledBricks = GetBrickCount();
+		stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return stats;
+	}
+
+	m_program = &program;
+	m_terms.clear();
+	for (int i = 0; i < program.GetItemCount(); i++)
+	{
+		m_terms.push_back({ program.GetItem(i).signature, program.GetItem(i).bound });
+	}
+
+	// Outside the dirty cells an added term is still nearer than some coarse centre distances.
+	// Its bound is a lower bound on its distance, and the minimum of that and the old value is
+	// a lower bound on the new one, which is all a coarse cell promises. No evaluation needed.
+	if (!added.empty())
+	{
+		Concurrency::parallel_for(0, m_cells[2], [&](int z)
+		{
+			for (int cell = z * m_cells[0] * m_cells[1]; cell < (z + 1) * m_cells[0] * m_cells[1]; cell++)
+			{
+				const int32_t index = m_brickIndex[cell];
+				if (index >= 0 || m_coarse[-1 - index] <= 0.0f)
+				{
+					continue;
+				}
+				const float3 centre = GetCellCentre(cell);
+				float& d = m_coarse[-1 - index];
+				for (const SdfBound& bound : added)
+				{
+					d = std::min(d, bound.scale * bound.box.Distance(centre));
+				}
+			}
+		});
+	}
+
+	std::vector<float3> centres(dirty.size());
+	for (size_t i = 0; i < dirty.size(); i++)
+	{
+		centres[i] = GetCellCentre(dirty[i]);
+	}
+	std::vector<float2> centreDistances(dirty.size());
+	program.EvaluateLocal(centres.data(), centreDistances.data(), static_cast<int>(dirty.size()), m_context);
+
+	// Cells can gain or lose their brick; freed slots are reused before the pools grow.
+	const float brickThreshold = GetBrickThreshold();
+	std::vector<int> brickCells;
+	std::vector<int> bricks;
+	for (size_t i = 0; i < dirty.size(); i++)
+	{
+		const int cell = dirty[i];
+		const int32_t index = m_brickIndex[cell];
+		const float d = centreDistances[i].x;
+		if (std::fabs(d) > brickThreshold)
+		{
+			if (index >= 0)
+			{
+				m_freeBricks.push_back(index);
+				if (m_freeCoarse.empty())
+				{
+					m_freeCoarse.push_back(static_cast<int32_t>(m_coarse.size()));
+					m_coarse.push_back(0.0f);
+				}
+				m_brickIndex[cell] = -1 - m_freeCoarse.back();
+				m_freeCoarse.pop_back();
+			}
+			m_coarse[-1 - m_brickIndex[cell]] = d;
+			continue;
+		}
+
+		if (index < 0)
+		{
+			m_freeCoarse.push_back(-1 - index);
+			if (m_freeBricks.empty())
+			{
+				m_freeBricks.push_back(static_cast<int32_t>(m_distances.size() / BrickVoxels));
+				m_distances.resize(m_distances.size() + BrickVoxels);
+				m_materials.resize(m_materials.size() + BrickVoxels);
+			}
+			m_brickIndex[cell] = m_freeBricks.back();
+			m_freeBricks.pop_back();
+		}
+		brickCells.push_back(cell);
+		bricks.push_back(m_brickIndex[cell]);
+	}
+	stats.sampledBricks = static_cast<int>(bricks.size());
+
+	Concurrency::parallel_for(0, static_cast<int>(bricks.size()), [&](int i)
+	{
+		SampleBrick(program, bricks[i], brickCells[i]);
+	});
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return stats;
+}
+
+float3 SdfBrickMap::GetCellCentre(int cell) const
+{
+	const int x = cell % m_cells[0];
+	const int y = (cell / m_cells[0]) % m_cells[1];
+	const int z = cell / (m_cells[0] * m_cells[1]);
+	return m_bounds.min + float3(x + 0.5f, y + 0.5f, z + 0.5f) * m_cellSize;
+}
+
+// A cell needs a brick if the surface could be within a couple of voxels of it; beyond that
+// the coarse bound is at least two voxels everywhere in the cell, so marching never refines there.
+float SdfBrickMap::GetBrickThreshold() const
+{
+	const float halfDiagonal = 0.5f * std::sqrt(3.0f) * m_cellSize;
+	return halfDiagonal + 2.0f * m_voxelSize;
+}
+
+void SdfBrickMap::SampleBrick(const SdfProgram& program, int brick, int cell)
+{
+	const int cx = cell % m_cells[0];
+	const int cy = (cell / m_cells[0]) % m_cells[1];
+	const int cz = cell / (m_cells[0] * m_cells[1]);
+	const float3 origin = m_bounds.min + float3(static_cast<float>(cx), static_cast<float>(cy), static_cast<float>(cz)) * m_cellSize;
+
+	float3 points[BrickVoxels];
+	float2 results[BrickVoxels];
+	for (int i = 0; i < BrickVoxels; i++)
+	{
+		points[i] = origin + float3(
+			static_cast<float>(i % BrickSize),
+			static_cast<float>((i / BrickSize) % BrickSize),
+			static_cast<float>(i / (BrickSize * BrickSize))) * m_voxelSize;
+	}
+	program.EvaluateLocal(points, results, BrickVoxels, m_context);
+
+	const float band = GetBand();
+	int16_t* distances = &m_distances[brick * BrickVoxels];
+	uint8_t* materials = &m_materials[brick * BrickVoxels];
+	for (int i = 0; i < BrickVoxels; i++)
+	{
+		distances[i] = static_cast<int16_t>(clamp(results[i].x, -band, band) * m_distanceScale);
+		materials[i] = static_cast<uint8_t>(clamp(results[i].y, 0.0f, 255.0f));
+	}
+}
+
+float2 SdfBrickMap::Lookup(const float3& local, SdfEvalStats* stats) const
+{
+	float3 g = (local - m_bounds.min) / m_cellSize;
+	int c[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		c[axis] = std::min(std::max(static_cast<int>(std::floor(g[axis])), 0), m_cells[axis] - 1);
+	}
+	const int cell = (c[2] * m_cells[1] + c[1]) * m_cells[0] + c[0];
+	const int32_t index = m_brickIndex[cell];
+
+	if (stats)
+	{
+		stats->mapCalls++;
+	}
+
+	if (index < 0)
+	{
+		const float3 centre = m_bounds.min + float3(c[0] + 0.5f, c[1] + 0.5f, c[2] + 0.5f) * m_cellSize;
+		const float d = m_coarse[-1 - index];
+		const float r = length(local - centre);
+		return float2((d > 0.0f) ? d - r : d + r, 0.0f);
+	}
+
+	// Trilinear filter of the 8 surrounding samples, material from the nearest one.
+	float3 v = (g - float3(static_cast<float>(c[0]), static_cast<float>(c[1]), static_cast<float>(c[2]))) * static_cast<float>(BrickSize - 1);
+	int i[3];
+	float f[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float x = clamp(v[axis], 0.0f, BrickSize - 1.0f);
+		i[axis] = std::min(static_cast<int>(x), BrickSize - 2);
+		f[axis] = x - i[axis];
+	}
+
+	const int16_t* distances = &m_distances[index * BrickVoxels];
+	const int base = (i[2] * BrickSize + i[1]) * BrickSize + i[0];
+	const int dy = BrickSize;
+	const int dz = BrickSize * BrickSize;
+	float d00 = lerp(distances[base], distances[base + 1], f[0]);
+	float d10 = lerp(distances[base + dy], distances[base + dy + 1], f[0]);
+	float d01 = lerp(distances[base + dz], distances[base + dz + 1], f[0]);
+	float d11 = lerp(distances[base + dz + dy], distances[base + dz + dy + 1], f[0]);
+	float d = lerp(lerp(d00, d10, f[1]), lerp(d01, d11, f[1]), f[2]) / m_distanceScale;
+
+	const int nearest = base + ((f[2] > 0.5f) ? dz : 0) + ((f[1] > 0.5f) ? dy : 0) + ((f[0] > 0.5f) ? 1 : 0);
+	return float2(d, m_materials[index * BrickVoxels + nearest]);
+}
+
+float2 SdfBrickMap::Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const float3 local = m_program->ToLocal(point, context);
+	const float outside = m_bounds.Distance(local);
+	if (outside > 0.0f)
+	{
+		if (m_exactOutside)
+		{
+			return m_program->MapLocal(local, context, stats);
+		}
+		// Every bounded surface is at least a cell inside the grid.
+		if (stats)
+		{
+			stats->mapCalls++;
+		}
+		return float2(outside + m_cellSize, 0.0f);
+	}
+	return Lookup(local, stats);
+}
+
+size_t SdfBrickMap::GetMemoryBytes() const
+{
+	return m_brickIndex.size() * sizeof(int32_t) +
+		m_coarse.size() * sizeof(float) +
+		m_distances.size() * sizeof(int16_t) +
+		m_materials.size() * sizeof(uint8_t);
+}
+
+size_t SdfBrickMap::GetDenseBytes() const
+{
+	size_t samples = 1;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		samples *= static_cast<size_t>(m_cells[axis]) * (BrickSize - 1) + 1;
+	}
+	return samples * 2 * sizeof(float);
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include "SdfProgram.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	struct SdfRebakeStats
+	{
+		double seconds = 0;
+		bool full = false;     // Update() fell back to Build()
+		int changedTerms = 0;  // terms only in the old bake or only in the edited program
+		int dirtyCells = 0;
+		int sampledBricks = 0;
+	};
+
+	// Sparse distance cache for a compiled scene, baked at one point in time. Space is split into
+	// cells; cells the surface passes through get an 8x8x8 brick of 16-bit distances and material
+	// ids sampled from map(), the rest only keep the distance at their centre and return the
+	// conservative bound centre distance - |p - centre|. Lookups are trilinear and only accurate
+	// to about a voxel, so the raymarcher switches to the exact field for the final approach
+	// (see SdfRaymarcher::SetRefineField).
+	class SdfBrickMap : public SdfField
+	{
+	public:
+		static const int BrickSize = 8;
+
+		SdfBrickMap();
+
+		// Bakes the scene over the union of its term bounds, in the program's local frame.
+		// Bricks are evaluated in parallel.
+		void Build(const SdfProgram& program, const SdfContext& context, float voxelSize);
+		// Rebakes after an edit, at the same time and voxel size. 'program' is the edited scene;
+		// its terms are matched against the baked ones by signature, and only the cells in reach
+		// of a term that changed, at its old or new bound, are sampled again, the bricks in
+		// parallel. The cost follows the size of the edit rather than of the scene. Falls back
+		// to Build() when the edit changes the prefix or a term without a bound, grows past the
+		// grid, or dirties most of the cells.
+		SdfRebakeStats Update(const SdfProgram& program);
+
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+
+		float GetVoxelSize() const { return m_voxelSize; }
+		int GetCellCount() const { return m_cells[0] * m_cells[1] * m_cells[2]; }
+		int GetBrickCount() const { return static_cast<int>(m_distances.size() / (BrickSize * BrickSize * BrickSize) - m_freeBricks.size()); }
+		size_t GetMemoryBytes() const;
+		// Size of the same grid stored densely as float distance + float material.
+		size_t GetDenseBytes() const;
+
+	private:
+		struct Term
+		{
+			uint64_t signature;
+			SdfBound bound;
+		};
+
+		Hlsl::float2 Lookup(const Hlsl::float3& local, SdfEvalStats* stats) const;
+		Hlsl::float3 GetCellCentre(int cell) const;
+		float GetBrickThreshold() const;
+		// Bricks store distances clamped to this.
+		float GetBand() const { return 2.0f * m_cellSize; }
+		void SampleBrick(const SdfProgram& program, int brick, int cell);
+
+		const SdfProgram* m_program;
+		SdfContext m_context;
+		SdfAabb m_bounds;
+		float m_voxelSize;
+		float m_cellSize;
+		float m_distanceScale; // int16 units per distance unit
+		int m_cells[3];
+		bool m_exactOutside;   // some term has no finite bound, evaluate it directly outside the grid
+
+		// Per cell: index into the brick pool, or -1 - index into m_coarse for cells without a brick.
+		std::vector<int32_t> m_brickIndex;
+		std::vector<float> m_coarse;
+		std::vector<int16_t> m_distances;
+		std::vector<uint8_t> m_materials;
+
+		// What the bake was made from, and pool slots Update() has freed.
+		std::vector<Term> m_terms;
+		uint64_t m_prefixSignature;
+		std::vector<int32_t> m_freeBricks;
+		std::vector<int32_t> m_freeCoarse;
+	};
+}
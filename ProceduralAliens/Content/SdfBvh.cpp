@@ -0,0 +1,304 @@
+﻿#include "pch.h"
+#include "SdfBvh.h"
+#include <algorithm>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const int MaxLeafItems = 2;
+	const int MaxStackDepth = 64;
+}
+
+SdfBvh::SdfBvh() :
+	m_program(nullptr)
+{
+}
+
+void SdfBvh::Build(const SdfProgram& program)
+{
+	m_program = &program;
+	m_nodes.clear();
+	m_itemOrder.clear();
+	m_unbounded.clear();
+
+	for (int i = 0; i < program.GetItemCount(); i++)
+	{
+		if (program.GetItem(i).bound.box.IsFinite())
+		{
+			m_itemOrder.push_back(i);
+		}
+		else
+		{
+			m_unbounded.push_back(i);
+		}
+	}
+
+	if (!m_itemOrder.empty())
+	{
+		m_nodes.reserve(m_itemOrder.size() * 2);
+		BuildNode(0, static_cast<uint32_t>(m_itemOrder.size()));
+	}
+}
+
+// Median split on the longest axis of the centroid bounds. Scenes have tens of terms, so the
+// build cost is irrelevant next to a single frame.
+int SdfBvh::BuildNode(uint32_t first, uint32_t count)
+{
+	int index = static_cast<int>(m_nodes.size());
+	m_nodes.push_back(SdfBvhNode());
+
+	SdfAabb box = SdfAabb::Empty();
+	SdfAabb centroids = SdfAabb::Empty();
+	float scale = 1.0f;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const SdfBound& bound = m_program->GetItem(m_itemOrder[i]).bound;
+		box.Grow(bound.box);
+		SdfAabb c;
+		c.min = c.max = bound.box.Centre();
+		centroids.Grow(c);
+		scale = std::min(scale, bound.scale);
+	}
+
+	SdfBvhNode node;
+	node.box = box;
+	node.scale = scale;
+	node.left = -1;
+	node.right = -1;
+	node.first = first;
+	node.count = count;
+
+	if (count > MaxLeafItems)
+	{
+		float3 extent = centroids.Extent();
+		int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+		uint32_t half = count / 2;
+		std::nth_element(m_itemOrder.begin() + first, m_itemOrder.begin() + first + half, m_itemOrder.begin() + first + count,
+			[this, axis](int a, int b)
+		{
+			return m_program->GetItem(a).bound.box.Centre()[axis] < m_program->GetItem(b).bound.box.Centre()[axis];
+		});
+
+		node.left = BuildNode(first, half);
+		node.right = BuildNode(first + half, count - half);
+		node.count = 0;
+	}
+
+	m_nodes[index] = node;
+	return index;
+}
+
+template <int Lanes>
+void SdfBvh::MapLanes(const float3* points, float2* results, const SdfContext& context, SdfEvalStats* stats) const
+{
+	SdfRegisters<Lanes> r;
+	for (int i = 0; i < Lanes; i++)
+	{
+		r.SetPoint(0, i, points[i]);
+	}
+	m_program->RunPrefix(r, context);
+
+	float3 p[Lanes];
+	float bestD[Lanes];
+	float bestM[Lanes];
+	for (int i = 0; i < Lanes; i++)
+	{
+		p[i] = float3(r.px[0][i], r.py[0][i], r.pz[0][i]);
+		bestD[i] = 1e10f;
+		bestM[i] = 0.0f;
+	}
+
+	uint64_t primitives = 0;
+	uint32_t sharedDone = 0;
+	auto runItem = [&](int item)
+	{
+		const SdfProgramItem& it = m_program->GetItem(item);
+		m_program->RunItem(r, item, context, sharedDone);
+		primitives += it.primitives;
+		for (int i = 0; i < Lanes; i++)
+		{
+			bool take = r.d[it.result][i] < bestD[i];
+			bestD[i] = take ? r.d[it.result][i] : bestD[i];
+			bestM[i] = take ? r.m[it.result][i] : bestM[i];
+		}
+	};
+	auto culled = [&](const SdfAabb& box, float scale)
+	{
+		for (int i = 0; i < Lanes; i++)
+		{
+			if (scale * box.Distance(p[i]) < bestD[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	for (int item : m_unbounded)
+	{
+		runItem(item);
+	}
+
+	if (!m_nodes.empty())
+	{
+		int stack[MaxStackDepth];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const SdfBvhNode& node = m_nodes[stack[--top]];
+			if (culled(node.box, node.scale))
+			{
+				continue;
+			}
+
+			if (node.left < 0)
+			{
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+				{
+					const SdfBound& bound = m_program->GetItem(m_itemOrder[i]).bound;
+					if (!culled(bound.box, bound.scale))
+					{
+						runItem(m_itemOrder[i]);
+					}
+				}
+				continue;
+			}
+
+			// Order by the first lane, the packet is small enough for it to stand for all of them.
+			const SdfBvhNode& left = m_nodes[node.left];
+			const SdfBvhNode& right = m_nodes[node.right];
+			bool leftFirst = left.box.Distance(p[0]) <= right.box.Distance(p[0]);
+			stack[top++] = leftFirst ? node.right : node.left;
+			stack[top++] = leftFirst ? node.left : node.right;
+		}
+	}
+
+	for (int i = 0; i < Lanes; i++)
+	{
+		results[i] = float2(bestD[i], bestM[i]);
+	}
+	if (stats)
+	{
+		stats->mapCalls += Lanes;
+		stats->primitiveEvaluations += primitives * Lanes;
+	}
+}
+
+template void SdfBvh::MapLanes<8>(const float3*, float2*, const SdfContext&, SdfEvalStats*) const;
+template void SdfBvh::MapLanes<16>(const float3*, float2*, const SdfContext&, SdfEvalStats*) const;
+
+float2 SdfBvh::Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	int item;
+	return FindNearest(point, false, 1e10f, context, stats, item);
+}
+
+float2 SdfBvh::MapLocal(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	int item;
+	return FindNearest(point, true, 1e10f, context, stats, item);
+}
+
+float2 SdfBvh::MapBelow(const float3& point, float limit, const SdfContext& context, SdfEvalStats* stats) const
+{
+	int item;
+	return FindNearest(point, false, limit, context, stats, item);
+}
+
+float3 SdfBvh::Gradient(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	// Cull with the float traversal, then differentiate only the term that won.
+	int item;
+	FindNearest(point, false, 1e10f, context, stats, item);
+	if (item < 0)
+	{
+		return float3(0.0f, 0.0f, 0.0f);
+	}
+	if (stats)
+	{
+		stats->primitiveEvaluations += m_program->GetItem(item).primitives;
+	}
+	return m_program->ItemGradient(point, item, context);
+}
+
+float2 SdfBvh::FindNearest(const float3& point, bool local, float limit, const SdfContext& context, SdfEvalStats* stats, int& nearest) const
+{
+	SdfRegisters<1> r;
+	r.SetPoint(0, 0, point);
+	if (!local)
+	{
+		m_program->RunPrefix(r, context);
+	}
+
+	// Queries happen in the prefix frame (inside the repeated cell for InfiniteShapes).
+	const float3 p(r.px[0][0], r.py[0][0], r.pz[0][0]);
+
+	float2 best(limit, 0.0f);
+	uint64_t primitives = 0;
+	uint32_t sharedDone = 0;
+	nearest = -1;
+
+	for (int item : m_unbounded)
+	{
+		m_program->RunItem(r, item, context, sharedDone);
+		const SdfProgramItem& it = m_program->GetItem(item);
+		primitives += it.primitives;
+		if (r.d[it.result][0] < best.x)
+		{
+			best = float2(r.d[it.result][0], r.m[it.result][0]);
+			nearest = item;
+		}
+	}
+
+	if (!m_nodes.empty())
+	{
+		int stack[MaxStackDepth];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const SdfBvhNode& node = m_nodes[stack[--top]];
+			if (node.scale * node.box.Distance(p) >= best.x)
+			{
+				continue;
+			}
+
+			if (node.left < 0)
+			{
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+				{
+					const SdfProgramItem& it = m_program->GetItem(m_itemOrder[i]);
+					if (it.bound.scale * it.bound.box.Distance(p) >= best.x)
+					{
+						continue;
+					}
+					m_program->RunItem(r, m_itemOrder[i], context, sharedDone);
+					primitives += it.primitives;
+					if (r.d[it.result][0] < best.x)
+					{
+						best = float2(r.d[it.result][0], r.m[it.result][0]);
+						nearest = m_itemOrder[i];
+					}
+				}
+				continue;
+			}
+
+			// Visit the nearer child first so the far one is more likely to be culled.
+			const SdfBvhNode& left = m_nodes[node.left];
+			const SdfBvhNode& right = m_nodes[node.right];
+			bool leftFirst = left.box.Distance(p) <= right.box.Distance(p);
+			stack[top++] = leftFirst ? node.right : node.left;
+			stack[top++] = leftFirst ? node.left : node.right;
+		}
+	}
+
+	if (stats)
+	{
+		stats->mapCalls++;
+		stats->primitiveEvaluations += primitives;
+	}
+	return best;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "SdfProgram.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	struct SdfBvhNode
+	{
+		SdfAabb box;
+		float scale;       // smallest SdfBound::scale of any item below this node
+		int32_t left;      // child index, or -1 for a leaf
+		int32_t right;
+		uint32_t first;    // leaf item range in SdfBvh::m_itemOrder
+		uint32_t count;
+	};
+
+	// Bounding volume hierarchy over the top level terms of a compiled scene. A query evaluates the
+	// nearest terms first and skips any term whose bound is further away than the best distance found
+	// so far, so only the handful of primitives near the point are evaluated.
+	class SdfBvh : public SdfField
+	{
+	public:
+		SdfBvh();
+
+		void Build(const SdfProgram& program);
+
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+		virtual Hlsl::float3 Gradient(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+		// Map for a point already in the prefix frame (SdfProgram::ToLocal), for bakers that work
+		// inside the repeated cell.
+		Hlsl::float2 MapLocal(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const;
+		// Map that starts from 'limit' instead of empty space, so terms at least that far away are
+		// culled like any other; (limit, 0) if nothing is nearer. For combining with a distance
+		// from somewhere else (SdfPartition).
+		Hlsl::float2 MapBelow(const Hlsl::float3& point, float limit, const SdfContext& context, SdfEvalStats* stats) const;
+
+		// Evaluates Lanes points with one traversal. A node or term is skipped only if it is
+		// further away than the best distance in every lane, so nearby points share the culling
+		// work and the interpreter runs each surviving term across all lanes at once.
+		template <int Lanes> void MapLanes(const Hlsl::float3* points, Hlsl::float2* results, const SdfContext& context, SdfEvalStats* stats) const;
+
+		const SdfProgram* GetProgram() const { return m_program; }
+		int GetNodeCount() const { return static_cast<int>(m_nodes.size()); }
+
+	private:
+		int BuildNode(uint32_t first, uint32_t count);
+		Hlsl::float2 FindNearest(const Hlsl::float3& point, bool local, float limit, const SdfContext& context, SdfEvalStats* stats, int& nearest) const;
+
+		const SdfProgram* m_program;
+		std::vector<SdfBvhNode> m_nodes;
+		std::vector<int> m_itemOrder;
+		std::vector<int> m_unbounded; // terms without a finite box, always evaluated
+	};
+}
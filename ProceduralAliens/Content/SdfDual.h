@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include "HlslMath.h"
+
+// Forward mode dual numbers for the SDF code: every value carries its gradient with respect to the
+// point being evaluated, so running map() once on dual inputs yields the distance and the surface
+// normal together. The vector types mirror float2/float3 so the primitives port over line for line.
+namespace ProceduralAliens
+{
+	namespace Hlsl
+	{
+		struct dual
+		{
+			float v;  // value
+			float3 g; // d(value)/d(point)
+
+			dual() : v(0) {}
+			dual(float value) : v(value) {}
+			dual(float value, const float3& gradient) : v(value), g(gradient) {}
+		};
+
+		struct dual2
+		{
+			dual x, y;
+
+			dual2() {}
+			dual2(const dual& px, const dual& py) : x(px), y(py) {}
+		};
+
+		struct dual3
+		{
+			dual x, y, z;
+
+			dual3() {}
+			dual3(const dual& px, const dual& py, const dual& pz) : x(px), y(py), z(pz) {}
+
+			// The point itself: each component has a unit gradient along its own axis.
+			static dual3 Seed(const float3& p)
+			{
+				return dual3(
+					dual(p.x, float3(1.0f, 0.0f, 0.0f)),
+					dual(p.y, float3(0.0f, 1.0f, 0.0f)),
+					dual(p.z, float3(0.0f, 0.0f, 1.0f)));
+			}
+		};
+
+		inline dual operator+(const dual& a, const dual& b) { return dual(a.v + b.v, a.g + b.g); }
+		inline dual operator-(const dual& a, const dual& b) { return dual(a.v - b.v, a.g - b.g); }
+		inline dual operator*(const dual& a, const dual& b) { return dual(a.v * b.v, a.g * b.v + b.g * a.v); }
+		inline dual operator/(const dual& a, const dual& b) { return dual(a.v / b.v, (a.g * b.v - b.g * a.v) / (b.v * b.v)); }
+		inline dual operator+(const dual& a, float s) { return dual(a.v + s, a.g); }
+		inline dual operator+(float s, const dual& a) { return dual(a.v + s, a.g); }
+		inline dual operator-(const dual& a, float s) { return dual(a.v - s, a.g); }
+		inline dual operator-(float s, const dual& a) { return dual(s - a.v, -a.g); }
+		inline dual operator*(const dual& a, float s) { return dual(a.v * s, a.g * s); }
+		inline dual operator*(float s, const dual& a) { return dual(a.v * s, a.g * s); }
+		inline dual operator/(const dual& a, float s) { return dual(a.v / s, a.g / s); }
+		inline dual operator-(const dual& a) { return dual(-a.v, -a.g); }
+		inline dual& operator+=(dual& a, const dual& b) { a = a + b; return a; }
+		inline dual& operator-=(dual& a, const dual& b) { a = a - b; return a; }
+		inline dual& operator*=(dual& a, const dual& b) { a = a * b; return a; }
+
+		// Comparisons look at the value only; branches pick the derivative of the side they take.
+		inline bool operator<(const dual& a, const dual& b) { return a.v < b.v; }
+		inline bool operator>(const dual& a, const dual& b) { return a.v > b.v; }
+		inline bool operator<(const dual& a, float s) { return a.v < s; }
+		inline bool operator>(const dual& a, float s) { return a.v > s; }
+
+		// sqrt and pow have an infinite slope at 0; report a zero gradient there rather than NaN.
+		inline dual sqrt(const dual& a)
+		{
+			float s = std::sqrt(a.v);
+			return dual(s, a.g * (s > 0.0f ? 0.5f / s : 0.0f));
+		}
+		inline dual pow(const dual& a, float e)
+		{
+			float p = std::pow(a.v, e);
+			return dual(p, a.g * (a.v != 0.0f ? e * p / a.v : 0.0f));
+		}
+		inline dual log(const dual& a) { return dual(std::log(a.v), a.g / a.v); }
+		inline dual sin(const dual& a) { return dual(std::sin(a.v), a.g * std::cos(a.v)); }
+		inline dual cos(const dual& a) { return dual(std::cos(a.v), a.g * -std::sin(a.v)); }
+		inline dual acos(const dual& a) { return dual(std::acos(a.v), a.g * (-1.0f / std::sqrt(std::max(1.0f - a.v * a.v, 1e-12f)))); }
+		inline dual atan2(const dual& y, const dual& x)
+		{
+			float r2 = x.v * x.v + y.v * y.v;
+			return dual(std::atan2(y.v, x.v), r2 > 0.0f ? (y.g * x.v - x.g * y.v) / r2 : float3(0.0f, 0.0f, 0.0f));
+		}
+		inline dual abs(const dual& a) { return a.v < 0.0f ? -a : a; }
+		inline dual min(const dual& a, const dual& b) { return b.v < a.v ? b : a; }
+		inline dual max(const dual& a, const dual& b) { return a.v < b.v ? b : a; }
+		inline dual clamp(const dual& x, float a, float b) { return min(max(x, dual(a)), dual(b)); }
+		inline float sign(const dual& a) { return sign(a.v); }
+		// floor() and fmod() shift by a piecewise constant, so the slope is unchanged.
+		inline dual frac(const dual& a) { return dual(frac(a.v), a.g); }
+		inline dual fmod(const dual& a, float b) { return dual(std::fmod(a.v, b), a.g); }
+
+		inline dual2 operator+(const dual2& a, const dual2& b) { return dual2(a.x + b.x, a.y + b.y); }
+		inline dual2 operator-(const dual2& a, const dual2& b) { return dual2(a.x - b.x, a.y - b.y); }
+		inline dual2 operator-(const dual2& a, const float2& b) { return dual2(a.x - b.x, a.y - b.y); }
+		inline dual2 operator-(const float2& a, const dual2& b) { return dual2(a.x - b.x, a.y - b.y); }
+		inline dual2 operator*(const dual2& a, const dual2& b) { return dual2(a.x * b.x, a.y * b.y); }
+		inline dual2 operator*(const float2& a, const dual& s) { return dual2(s * a.x, s * a.y); }
+
+		inline dual dot(const dual2& a, const dual2& b) { return a.x * b.x + a.y * b.y; }
+		inline dual dot(const dual2& a, const float2& b) { return a.x * b.x + a.y * b.y; }
+		inline dual dot2(const dual2& v) { return dot(v, v); }
+		inline dual length(const dual2& a) { return sqrt(dot(a, a)); }
+		inline dual2 abs(const dual2& a) { return dual2(abs(a.x), abs(a.y)); }
+		inline dual2 max(const dual2& a, float s) { return dual2(max(a.x, dual(s)), max(a.y, dual(s))); }
+
+		inline dual3 operator+(const dual3& a, const dual3& b) { return dual3(a.x + b.x, a.y + b.y, a.z + b.z); }
+		inline dual3 operator-(const dual3& a, const dual3& b) { return dual3(a.x - b.x, a.y - b.y, a.z - b.z); }
+		inline dual3 operator+(const dual3& a, const float3& b) { return dual3(a.x + b.x, a.y + b.y, a.z + b.z); }
+		inline dual3 operator-(const dual3& a, const float3& b) { return dual3(a.x - b.x, a.y - b.y, a.z - b.z); }
+		inline dual3 operator*(const dual3& a, const float3& b) { return dual3(a.x * b.x, a.y * b.y, a.z * b.z); }
+		inline dual3 operator/(const dual3& a, const float3& b) { return dual3(a.x / b.x, a.y / b.y, a.z / b.z); }
+		inline dual3 operator*(const dual3& a, float s) { return dual3(a.x * s, a.y * s, a.z * s); }
+		inline dual3 operator*(float s, const dual3& a) { return dual3(a.x * s, a.y * s, a.z * s); }
+		inline dual3 operator*(const float3& a, const dual& s) { return dual3(s * a.x, s * a.y, s * a.z); }
+
+		inline dual dot(const dual3& a, const dual3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		inline dual dot(const dual3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		inline dual dot2(const dual3& v) { return dot(v, v); }
+		inline dual length(const dual3& a) { return sqrt(dot(a, a)); }
+		inline dual3 abs(const dual3& a) { return dual3(abs(a.x), abs(a.y), abs(a.z)); }
+		inline dual3 max(const dual3& a, float s) { return dual3(max(a.x, dual(s)), max(a.y, dual(s)), max(a.z, dual(s))); }
+		inline dual3 fmod(const dual3& a, const float3& b) { return dual3(fmod(a.x, b.x), fmod(a.y, b.y), fmod(a.z, b.z)); }
+	}
+}
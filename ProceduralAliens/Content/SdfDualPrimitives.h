@@ -0,0 +1,255 @@
+﻿#pragma once
+
+#include "SdfDual.h"
+#include "SdfPrimitives.h"
+
+// Dual number overloads of the distance functions in SdfPrimitives.h. Each one follows the float
+// version statement for statement; keep them in step with it (and so with the shaders).
+namespace ProceduralAliens
+{
+	namespace Hlsl
+	{
+		inline dual sdSphere(const dual3& p, float s)
+		{
+			return length(p) - s;
+		}
+
+		inline dual sdBox(const dual3& p, const float3& b)
+		{
+			dual3 d = abs(p) - b;
+			return min(max(d.x, max(d.y, d.z)), dual(0.0f)) + length(max(d, 0.0f));
+		}
+
+		inline dual sdEllipsoid(const dual3& p, const float3& r) // approximated
+		{
+			dual k0 = length(p / r);
+			dual k1 = length(p / (r * r));
+			return k0 * (k0 - 1.0f) / k1;
+		}
+
+		inline dual sdRoundBox(const dual3& p, const float3& b, float r)
+		{
+			dual3 q = abs(p) - b;
+			return min(max(q.x, max(q.y, q.z)), dual(0.0f)) + length(max(q, 0.0f)) - r;
+		}
+
+		inline dual sdTorus(const dual3& p, const float2& t)
+		{
+			return length(dual2(length(dual2(p.x, p.z)) - t.x, p.y)) - t.y;
+		}
+
+		inline dual sdHexPrism(dual3 p, const float2& h)
+		{
+			const float3 k(-0.8660254f, 0.5f, 0.57735f);
+			p = abs(p);
+			dual kd = 2.0f * min(k.x * p.x + k.y * p.y, dual(0.0f));
+			p.x -= kd * k.x;
+			p.y -= kd * k.y;
+			dual2 d(
+				length(dual2(p.x - clamp(p.x, -k.z * h.x, k.z * h.x), p.y - h.x)) * sign(p.y - h.x),
+				p.z - h.y);
+			return min(max(d.x, d.y), dual(0.0f)) + length(max(d, 0.0f));
+		}
+
+		inline dual sdCapsule(const dual3& p, const float3& a, const float3& b, float r)
+		{
+			dual3 pa = p - a;
+			float3 ba = b - a;
+			dual h = clamp(dot(pa, ba) / dot(ba, ba), 0.0f, 1.0f);
+			return length(pa - ba * h) - r;
+		}
+
+		inline dual sdRoundCone(const dual3& p, const float3& a, const float3& b, float r1, float r2)
+		{
+			// sampling independent computations (only depend on shape)
+			float3 ba = b - a;
+			float l2 = dot(ba, ba);
+			float rr = r1 - r2;
+			float a2 = l2 - rr * rr;
+			float il2 = 1.0f / l2;
+
+			// sampling dependant computations
+			dual3 pa = p - a;
+			dual y = dot(pa, ba);
+			dual z = y - l2;
+			dual x2 = dot2(pa * l2 - ba * y);
+			dual y2 = y * y * l2;
+			dual z2 = z * z * l2;
+
+			// single square root!
+			dual k = sign(rr) * rr * rr * x2;
+			if (sign(z) * a2 * z2 > k) return sqrt(x2 + z2) * il2 - r2;
+			if (sign(y) * a2 * y2 < k) return sqrt(x2 + y2) * il2 - r1;
+			return (sqrt(x2 * a2 * il2) + y * rr) * il2 - r1;
+		}
+
+		// vertical
+		inline dual sdCylinder(const dual3& p, const float2& h)
+		{
+			dual2 d = abs(dual2(length(dual2(p.x, p.z)), p.y)) - h;
+			return min(max(d.x, d.y), dual(0.0f)) + length(max(d, 0.0f));
+		}
+
+		inline dual sdCappedCone(const dual3& p, float h, float r1, float r2)
+		{
+			dual2 q(length(dual2(p.x, p.z)), p.y);
+
+			float2 k1(r2, h);
+			float2 k2(r2 - r1, 2.0f * h);
+			dual2 ca(q.x - min(q.x, dual((q.y < 0.0f) ? r1 : r2)), abs(q.y) - h);
+			dual2 cb = q - k1 + k2 * clamp(dot(k1 - q, k2) / dot2(k2), 0.0f, 1.0f);
+			float s = (cb.x < 0.0f && ca.y < 0.0f) ? -1.0f : 1.0f;
+			return s * sqrt(min(dot2(ca), dot2(cb)));
+		}
+
+		inline dual sdOctahedron(dual3 p, float s)
+		{
+			p = abs(p);
+			return (p.x + p.y + p.z - s) * 0.57735027f;
+		}
+
+		inline dual length2(const dual2& p)
+		{
+			return sqrt(p.x * p.x + p.y * p.y);
+		}
+
+		inline dual length8(dual2 p)
+		{
+			p = p * p; p = p * p; p = p * p;
+			return pow(p.x + p.y, 1.0f / 8.0f);
+		}
+
+		inline dual sdTorus82(const dual3& p, const float2& t)
+		{
+			dual2 q(length2(dual2(p.x, p.z)) - t.x, p.y);
+			return length8(q) - t.y;
+		}
+
+		inline dual sdTorus88(const dual3& p, const float2& t)
+		{
+			dual2 q(length8(dual2(p.x, p.z)) - t.x, p.y);
+			return length8(q) - t.y;
+		}
+
+		inline dual sdSierpinski(dual3 z, float scale, float iterations)
+		{
+			//tetra-vertices
+			const float3 v1(0.0f, 1.5f, 0.0f);
+			const float3 v2(1.0f, 0.0f, 0.0f);
+			const float3 v3(std::cos(2.0f * 3.1415f / 3.0f), 0.0f, std::sin(2.0f * 3.1415f / 3.0f));
+			const float3 v4(std::cos(4.0f * 3.1415f / 3.0f), 0.0f, std::sin(4.0f * 3.1415f / 3.0f));
+			int n = 0;
+			while (n < iterations)
+			{
+				// Only the choice of vertex depends on these distances, so they stay plain floats.
+				float3 zv(z.x.v, z.y.v, z.z.v);
+				float3 c = v1;
+				float dist = length(zv - v1);
+				float d = length(zv - v2);
+				if (d < dist) { c = v2; dist = d; }
+				d = length(zv - v3);
+				if (d < dist) { c = v3; dist = d; }
+				d = length(zv - v4);
+				if (d < dist) { c = v4; dist = d; }
+				z = scale * (z - c) + c;
+				n++;
+			}
+			return length(z) * std::pow(scale, float(-n));
+		}
+
+		inline dual sdMandelbulb(const dual3& p, int iterations)
+		{
+			dual3 w = p;
+			dual m = dot(w, w);
+			dual dz = 1.0f;
+
+			for (int i = 0; i < iterations; i++)
+			{
+				dual m2 = m * m;
+				dual m4 = m2 * m2;
+				dz = 8.0f * sqrt(m4 * m2 * m) * dz + 1.0f;
+
+				dual x = w.x; dual x2 = x * x; dual x4 = x2 * x2;
+				dual y = w.y; dual y2 = y * y; dual y4 = y2 * y2;
+				dual z = w.z; dual z2 = z * z; dual z4 = z2 * z2;
+
+				dual k3 = x2 + z2;
+				dual k2 = 1.0f / sqrt(k3 * k3 * k3 * k3 * k3 * k3 * k3);
+				dual k1 = x4 + y4 + z4 - 6.0f * y2 * z2 - 6.0f * x2 * y2 + 2.0f * z2 * x2;
+				dual k4 = x2 - y2 + z2;
+
+				w.x = p.x + 64.0f * x * y * z * (x2 - z2) * k4 * (x4 - 6.0f * x2 * z2 + z4) * k1 * k2;
+				w.y = p.y + -16.0f * y2 * k3 * k4 * k4 + k1 * k1;
+				w.z = p.z + -8.0f * y * k4 * (x4 * x4 - 28.0f * x4 * x2 * z2 + 70.0f * x4 * z4 - 28.0f * x2 * z2 * z4 + z4 * z4) * k1 * k2;
+
+				m = dot(w, w);
+				if (m > 256.0f)
+					break;
+			}
+
+			return 0.25f * log(m) * sqrt(m) / dz;
+		}
+
+		inline dual sdMandelbulb(const dual3& p, int iterations, float power)
+		{
+			dual3 w = p;
+			dual m = dot(w, w);
+			dual dz = 1.0f;
+
+			for (int i = 0; i < iterations; i++)
+			{
+				dual r = sqrt(m);
+				dual theta = power * acos(clamp(r > 0.0f ? w.y / r : dual(1.0f), -1.0f, 1.0f));
+				dual phi = power * atan2(w.x, w.z);
+				dual rp = pow(r, power - 1.0f);
+				dz = power * rp * dz + 1.0f;
+				dual zr = rp * r;
+
+				w = dual3(p.x + zr * sin(theta) * sin(phi), p.y + zr * cos(theta), p.z + zr * sin(theta) * cos(phi));
+
+				m = dot(w, w);
+				if (m > 256.0f)
+					break;
+			}
+
+			return 0.25f * log(m) * sqrt(m) / dz;
+		}
+
+		//------------------------------------------------------------------
+
+		inline dual opS(const dual& d1, const dual& d2)
+		{
+			return max(-d2, d1);
+		}
+
+		inline dual3 opRep(const dual3& p, const float3& c)
+		{
+			return fmod(p, c) - 0.5f * c;
+		}
+
+		inline dual3 opTwist(const dual3& p)
+		{
+			dual c = cos(10.0f * p.y + 10.0f);
+			dual s = sin(10.0f * p.y + 10.0f);
+			return dual3(c * p.x + s * p.z, -s * p.x + c * p.z, p.y);
+		}
+
+		inline dual softAbs2(const dual& x, float a)
+		{
+			dual xx = 2.0f * x / a; dual abs2 = abs(xx);
+			if (abs2 < 2.0f)
+				abs2 = 0.5f * xx * xx * (1.0f - abs2 / 6.0f) + 2.0f / 3.0f;
+			return abs2 * a / 2.0f;
+		}
+
+		inline dual softMax2(const dual& x, const dual& y, float a)
+		{
+			return 0.5f * (x + y + softAbs2(x - y, a));
+		}
+
+		inline dual softMin2(const dual& x, const dual& y, float a)
+		{
+			return -0.5f * (-x - y + softAbs2(x - y, a));
+		}
+	}
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "HlslMath.h"
+#include <cstdint>
+
+namespace ProceduralAliens
+{
+	// Per-evaluation inputs shared by every SDF evaluator.
+	struct SdfContext
+	{
+		float time = 0;
+		// Radius of the ray's pixel cone at the point being evaluated, 0 for full detail. Fields may
+		// drop detail smaller than this, as long as the distance they return only gets shorter.
+		float footprint = 0;
+	};
+
+	// Work counters. Each thread keeps its own and they are summed afterwards.
+	struct SdfEvalStats
+	{
+		uint64_t mapCalls = 0;
+		uint64_t primitiveEvaluations = 0;
+		uint64_t partitionCalls = 0; // SdfPartition::Map() calls
+		uint64_t staticCalls = 0;    // the ones the static half answered alone
+
+		void Add(const SdfEvalStats& other)
+		{
+			mapCalls += other.mapCalls;
+			primitiveEvaluations += other.primitiveEvaluations;
+			partitionCalls += other.partitionCalls;
+			staticCalls += other.staticCalls;
+		}
+	};
+
+	// Anything that can stand in for a shader map(): returns (distance, material id).
+	class SdfField
+	{
+	public:
+		virtual ~SdfField() {}
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const = 0;
+
+		// Gradient of the distance. The default is calcNormal()'s tetrahedral difference scaled back
+		// to a gradient (the four taps sum to 4 e^2 grad); fields that can do better override it.
+		virtual Hlsl::float3 Gradient(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const
+		{
+			const float e = 0.5773f * 0.0005f;
+			const Hlsl::float3 xyy(e, -e, -e);
+			const Hlsl::float3 yyx(-e, -e, e);
+			const Hlsl::float3 yxy(-e, e, -e);
+			const Hlsl::float3 xxx(e, e, e);
+			return (
+				xyy * Map(point + xyy, context, stats).x +
+				yyx * Map(point + yyx, context, stats).x +
+				yxy * Map(point + yxy, context, stats).x +
+				xxx * Map(point + xxx, context, stats).x) / (4.0f * e * e);
+		}
+
+		// Furthest distance along the ray from t that is known to be empty without evaluating
+		// anything (SdfRepeatField's cell walk), tmax if nothing is left. Ray marchers jump there
+		// before their next sample.
+		virtual float SkipEmpty(const Hlsl::float3& /*origin*/, const Hlsl::float3& /*direction*/, float t, float /*tmax*/) const
+		{
+			return t;
+		}
+	};
+
+	// Wraps one of the hand-written map() ports in SdfScenes.
+	class SdfFunctionField : public SdfField
+	{
+	public:
+		typedef Hlsl::float2(*MapFunction)(const Hlsl::float3&, float);
+
+		SdfFunctionField(MapFunction map) : m_map(map) {}
+
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override
+		{
+			if (stats)
+			{
+				stats->mapCalls++;
+			}
+			return m_map(point, context.time);
+		}
+
+	private:
+		MapFunction m_map;
+	};
+}
@@ -0,0 +1,250 @@
+﻿#include "pch.h"
+#include "SdfFractals.h"
+#include <algorithm>
+#include <limits>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+// The loops below are written lane by lane with selects instead of branches so the compiler can
+// keep a whole packet in vector registers; the masked lanes still do the arithmetic, they just
+// throw the result away.
+
+namespace
+{
+	// Largest distance of a DE1 tetrahedron vertex from the origin (v1).
+	const float SierpinskiVertexRadius = 1.5f;
+	// The bulb fits in a sphere of about this radius at power 8.
+	const float MandelbulbRadius = 1.25f;
+	// Iterations kept beyond the ones the footprint asks for. Each iteration multiplies detail by
+	// roughly the power, but the estimate itself is only approximate, so err on the side of more.
+	const int MandelbulbLodMargin = 6;
+}
+
+SdfMandelbulbParams SdfMandelbulbParams::AtFootprint(float footprint) const
+{
+	SdfMandelbulbParams params = *this;
+	if (footprint > 0.0f && power > 1.0f)
+	{
+		const float needed = std::ceil(std::log(MandelbulbRadius / footprint) / std::log(power)) + MandelbulbLodMargin;
+		params.iterations = std::max(1, std::min(iterations, static_cast<int>(std::max(needed, 0.0f))));
+	}
+	return params;
+}
+
+SdfSierpinskiParams SdfSierpinskiParams::AtFootprint(float footprint) const
+{
+	SdfSierpinskiParams params = *this;
+	if (footprint > 0.0f && scale > 1.0f)
+	{
+		const float needed = std::ceil(std::log(SierpinskiVertexRadius / footprint) / std::log(scale));
+		const int n = std::max(0, std::min(iterations, static_cast<int>(std::max(needed, 0.0f))));
+		if (n < iterations)
+		{
+			params.iterations = n;
+			params.slack = slack + SierpinskiVertexRadius * std::pow(scale, static_cast<float>(-n));
+		}
+	}
+	return params;
+}
+
+template <int Lanes>
+void SdfFractals::Mandelbulb(const float* x, const float* y, const float* z, float* distance, const SdfMandelbulbParams& params, SdfFractalStats* stats)
+{
+	float wx[Lanes], wy[Lanes], wz[Lanes], m[Lanes], dz[Lanes];
+	float nx[Lanes], ny[Lanes], nz[Lanes], ndz[Lanes];
+	int live[Lanes];
+	for (int i = 0; i < Lanes; i++)
+	{
+		wx[i] = x[i];
+		wy[i] = y[i];
+		wz[i] = z[i];
+		m[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+		dz[i] = 1.0f;
+		live[i] = 1;
+	}
+
+	const bool polynomial = params.power == 8.0f;
+	const float power = params.power;
+	const float bailout = params.bailout;
+	int laneIterations = 0;
+	uint64_t trips = 0;
+	for (int iteration = 0; iteration < params.iterations; iteration++)
+	{
+		trips++;
+		if (polynomial)
+		{
+			for (int i = 0; i < Lanes; i++)
+			{
+				float m2 = m[i] * m[i];
+				float m4 = m2 * m2;
+				ndz[i] = 8.0f * std::sqrt(m4 * m2 * m[i]) * dz[i] + 1.0f;
+
+				float px = wx[i]; float x2 = px * px; float x4 = x2 * x2;
+				float py = wy[i]; float y2 = py * py; float y4 = y2 * y2;
+				float pz = wz[i]; float z2 = pz * pz; float z4 = z2 * z2;
+
+				float k3 = x2 + z2;
+				float k2 = 1.0f / std::sqrt(k3 * k3 * k3 * k3 * k3 * k3 * k3);
+				float k1 = x4 + y4 + z4 - 6.0f * y2 * z2 - 6.0f * x2 * y2 + 2.0f * z2 * x2;
+				float k4 = x2 - y2 + z2;
+
+				nx[i] = x[i] + 64.0f * px * py * pz * (x2 - z2) * k4 * (x4 - 6.0f * x2 * z2 + z4) * k1 * k2;
+				ny[i] = y[i] + -16.0f * y2 * k3 * k4 * k4 + k1 * k1;
+				nz[i] = z[i] + -8.0f * py * k4 * (x4 * x4 - 28.0f * x4 * x2 * z2 + 70.0f * x4 * z4 - 28.0f * x2 * z2 * z4 + z4 * z4) * k1 * k2;
+			}
+		}
+		else
+		{
+			// acos, atan2 and pow are library calls per lane either way, so retired lanes skip them.
+			for (int i = 0; i < Lanes; i++)
+			{
+				if (!live[i])
+				{
+					nx[i] = wx[i]; ny[i] = wy[i]; nz[i] = wz[i]; ndz[i] = dz[i];
+					continue;
+				}
+				float r = std::sqrt(m[i]);
+				float theta = power * std::acos(clamp(r > 0.0f ? wy[i] / r : 1.0f, -1.0f, 1.0f));
+				float phi = power * std::atan2(wx[i], wz[i]);
+				float rp = std::pow(r, power - 1.0f);
+				ndz[i] = power * rp * dz[i] + 1.0f;
+				float zr = rp * r;
+
+				nx[i] = x[i] + zr * (std::sin(theta) * std::sin(phi));
+				ny[i] = y[i] + zr * std::cos(theta);
+				nz[i] = z[i] + zr * (std::sin(theta) * std::cos(phi));
+			}
+		}
+
+		// Blend in a separate pass: kept apart from the arithmetic, the selects stay selects
+		// instead of being turned back into branches around it.
+		int alive = 0;
+		for (int i = 0; i < Lanes; i++)
+		{
+			const int l = live[i];
+			const float nm = nx[i] * nx[i] + ny[i] * ny[i] + nz[i] * nz[i];
+			wx[i] = l ? nx[i] : wx[i];
+			wy[i] = l ? ny[i] : wy[i];
+			wz[i] = l ? nz[i] : wz[i];
+			dz[i] = l ? ndz[i] : dz[i];
+			m[i] = l ? nm : m[i];
+			laneIterations += l;
+			const int next = l & static_cast<int>(!(nm > bailout));
+			live[i] = next;
+			alive += next;
+		}
+		if (alive == 0)
+		{
+			break;
+		}
+	}
+
+	for (int i = 0; i < Lanes; i++)
+	{
+		distance[i] = 0.25f * std::log(m[i]) * std::sqrt(m[i]) / dz[i];
+	}
+
+	if (stats)
+	{
+		stats->laneIterations += laneIterations;
+		stats->packetIterations += trips * Lanes;
+	}
+}
+
+template <int Lanes>
+void SdfFractals::Sierpinski(const float* x, const float* y, const float* z, float* distance, const SdfSierpinskiParams& params, SdfFractalStats* stats)
+{
+	//tetra-vertices
+	const float3 v1(0.0f, 1.5f, 0.0f);
+	const float3 v2(1.0f, 0.0f, 0.0f);
+	const float3 v3(std::cos(2.0f * 3.1415f / 3.0f), 0.0f, std::sin(2.0f * 3.1415f / 3.0f));
+	const float3 v4(std::cos(4.0f * 3.1415f / 3.0f), 0.0f, std::sin(4.0f * 3.1415f / 3.0f));
+
+	float zx[Lanes], zy[Lanes], zz[Lanes], factor[Lanes];
+	float nx[Lanes], ny[Lanes], nz[Lanes];
+	int live[Lanes];
+	for (int i = 0; i < Lanes; i++)
+	{
+		zx[i] = x[i];
+		zy[i] = y[i];
+		zz[i] = z[i];
+		factor[i] = 1.0f;
+		live[i] = 1;
+	}
+
+	// scale^-n is accumulated per lane, since lanes stop after different n.
+	const float scale = params.scale;
+	const float inverseScale = 1.0f / scale;
+	const float bailout = params.bailout > 0.0f ? params.bailout : std::numeric_limits<float>::infinity();
+	int laneIterations = 0;
+	uint64_t trips = 0;
+	for (int iteration = 0; iteration < params.iterations; iteration++)
+	{
+		trips++;
+		for (int i = 0; i < Lanes; i++)
+		{
+			// Nearest vertex by squared distance, with DE1's tie breaking (first one wins).
+			const float px = zx[i], py = zy[i], pz = zz[i];
+			const float d1 = (px - v1.x) * (px - v1.x) + (py - v1.y) * (py - v1.y) + (pz - v1.z) * (pz - v1.z);
+			const float d2 = (px - v2.x) * (px - v2.x) + (py - v2.y) * (py - v2.y) + (pz - v2.z) * (pz - v2.z);
+			const float d3 = (px - v3.x) * (px - v3.x) + (py - v3.y) * (py - v3.y) + (pz - v3.z) * (pz - v3.z);
+			const float d4 = (px - v4.x) * (px - v4.x) + (py - v4.y) * (py - v4.y) + (pz - v4.z) * (pz - v4.z);
+			const bool take2 = d2 < d1;
+			const float best2 = take2 ? d2 : d1;
+			const bool take3 = d3 < best2;
+			const float best3 = take3 ? d3 : best2;
+			const bool take4 = d4 < best3;
+
+			float cx = take2 ? v2.x : v1.x;
+			float cy = take2 ? v2.y : v1.y;
+			float cz = take2 ? v2.z : v1.z;
+			cx = take3 ? v3.x : cx;
+			cy = take3 ? v3.y : cy;
+			cz = take3 ? v3.z : cz;
+			cx = take4 ? v4.x : cx;
+			cy = take4 ? v4.y : cy;
+			cz = take4 ? v4.z : cz;
+
+			nx[i] = scale * (zx[i] - cx) + cx;
+			ny[i] = scale * (zy[i] - cy) + cy;
+			nz[i] = scale * (zz[i] - cz) + cz;
+		}
+
+		int alive = 0;
+		for (int i = 0; i < Lanes; i++)
+		{
+			const int l = live[i];
+			zx[i] = l ? nx[i] : zx[i];
+			zy[i] = l ? ny[i] : zy[i];
+			zz[i] = l ? nz[i] : zz[i];
+			factor[i] = l ? factor[i] * inverseScale : factor[i];
+			laneIterations += l;
+			const int next = l & static_cast<int>(!(nx[i] * nx[i] + ny[i] * ny[i] + nz[i] * nz[i] > bailout));
+			live[i] = next;
+			alive += next;
+		}
+		if (alive == 0)
+		{
+			break;
+		}
+	}
+
+	for (int i = 0; i < Lanes; i++)
+	{
+		distance[i] = std::sqrt(zx[i] * zx[i] + zy[i] * zy[i] + zz[i] * zz[i]) * factor[i] - params.slack;
+	}
+
+	if (stats)
+	{
+		stats->laneIterations += laneIterations;
+		stats->packetIterations += trips * Lanes;
+	}
+}
+
+template void SdfFractals::Mandelbulb<1>(const float*, const float*, const float*, float*, const SdfMandelbulbParams&, SdfFractalStats*);
+template void SdfFractals::Mandelbulb<8>(const float*, const float*, const float*, float*, const SdfMandelbulbParams&, SdfFractalStats*);
+template void SdfFractals::Mandelbulb<16>(const float*, const float*, const float*, float*, const SdfMandelbulbParams&, SdfFractalStats*);
+template void SdfFractals::Sierpinski<1>(const float*, const float*, const float*, float*, const SdfSierpinskiParams&, SdfFractalStats*);
+template void SdfFractals::Sierpinski<8>(const float*, const float*, const float*, float*, const SdfSierpinskiParams&, SdfFractalStats*);
+template void SdfFractals::Sierpinski<16>(const float*, const float*, const float*, float*, const SdfSierpinskiParams&, SdfFractalStats*);
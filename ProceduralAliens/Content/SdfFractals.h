@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include "HlslMath.h"
+#include <cstdint>
+
+namespace ProceduralAliens
+{
+	// Mandelbulb in FractalPS. Power 8 runs the shader's trigonometry free polynomial, any other
+	// power the spherical coordinate form it was derived from.
+	struct SdfMandelbulbParams
+	{
+		float power = 8.0f;
+		int iterations = 25;
+		float bailout = 256.0f; // on |w|^2, the shader's m > 256
+
+		// Enough iterations to resolve detail down to footprint. A point that escapes within them
+		// gets the same estimate as before; one that would have escaped later is now treated as
+		// inside, so the surface can only grow outwards and distances only get shorter.
+		SdfMandelbulbParams AtFootprint(float footprint) const;
+	};
+
+	// DE1 in FractalPS, the tetrahedral IFS.
+	struct SdfSierpinskiParams
+	{
+		float scale = 2.0f;
+		int iterations = 15;
+		// On |z|^2. 0 runs every iteration like the shader; a finite value retires points that have
+		// clearly escaped. Their estimate then differs from the full run by about the vertex radius
+		// times scale^-n, which only matters far from the surface where steps are long anyway.
+		float bailout = 0.0f;
+		// Subtracted from every estimate.
+		float slack = 0.0f;
+
+		// Enough iterations to resolve detail down to footprint. Estimates n and infinitely many
+		// iterations apart differ by at most the largest vertex radius times scale^-n, which goes
+		// into slack so the shorter run never overestimates.
+		SdfSierpinskiParams AtFootprint(float footprint) const;
+	};
+
+	// Iterations run by live lanes against iterations the packet ran, lanes times loop trips.
+	struct SdfFractalStats
+	{
+		uint64_t laneIterations = 0;
+		uint64_t packetIterations = 0;
+
+		void Add(const SdfFractalStats& other)
+		{
+			laneIterations += other.laneIterations;
+			packetIterations += other.packetIterations;
+		}
+	};
+
+	// Distance estimates for Lanes points at a time, structure of arrays in and out. Every lane
+	// runs the same instruction stream; a lane that bails out is masked and keeps its values while
+	// the rest carry on, and the loop exits as soon as no lane is left. Instantiated for 1, 8 and 16.
+	// The file builds with the project's /fp:precise, like the rest of the evaluator. Whether the
+	// lane loops vectorise under it is up to the compiler: GCC keeps them scalar until sqrt may skip
+	// errno and compares may skip FP exceptions, and then the batches are slower than scalar.
+	namespace SdfFractals
+	{
+		template <int Lanes>
+		void Mandelbulb(const float* x, const float* y, const float* z, float* distance, const SdfMandelbulbParams& params, SdfFractalStats* stats);
+
+		template <int Lanes>
+		void Sierpinski(const float* x, const float* y, const float* z, float* distance, const SdfSierpinskiParams& params, SdfFractalStats* stats);
+	}
+}
@@ -0,0 +1,331 @@
+﻿#include "pch.h"
+#include "SdfLightVolume.h"
+#include "SdfRaymarcher.h"
+#include <algorithm>
+#include <chrono>
+#include <ppl.h>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	// calcAO() looks at most 0.13 along the normal and calcSoftshadow() at most 0.02 + 16 * 0.1
+	// along the light. A 1-Lipschitz distance of at least 9/8 of that at the start keeps every
+	// tap's 8h/t above 1, and every AO tap's distance above its offset, so both are exactly 1.
+	const float ClearDistance = 1.125f * (0.02f + 16.0f * 0.1f);
+
+	// The same for the live terms, split so that each part is only evaluated when it can matter.
+	// An AO tap hr along the normal is clear if the term's distance there is at least hr. The
+	// shadow taps lie within ShadowRadius of the middle of the shadow ray and are clear while
+	// their distance is at least t / 8.
+	const float AoReach = 0.13f;
+	const float ShadowMiddle = 0.82f;
+	const float ShadowRadius = 0.8f;
+	const float ShadowClearance = 0.2f;
+
+	// Fill passes for the samples inside the content; trilinear lookups on the surface only
+	// reach one sample in.
+	const int FillPasses = 2;
+
+	// Largest difference, in quantised steps, between the AO or sun values of the eight samples
+	// around a lookup before it is left to the live taps. Where they differ more, something
+	// between the samples is thinner than a voxel or casts a sharp shadow edge, and the
+	// interpolated value can be off by nearly the whole range; at 32 steps the worst InfiniteShapes
+	// pixel was still 0.85 out.
+	const int MaxSpread = 8;
+
+	// The static terms in the prefix frame, where the volume lives.
+	class LocalField : public SdfField
+	{
+	public:
+		LocalField(const SdfBvh& bvh) : m_bvh(bvh) {}
+
+		virtual float2 Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const override
+		{
+			return m_bvh.MapLocal(point, context, stats);
+		}
+
+	private:
+		const SdfBvh& m_bvh;
+	};
+
+	// Union of the finite term boxes and the smallest bound scale; 'unbounded' is set if some term
+	// has no finite box.
+	SdfAabb ContentBox(const SdfProgram& program, float& scale, bool& unbounded)
+	{
+		SdfAabb content = SdfAabb::Empty();
+		scale = 1.0f;
+		unbounded = false;
+		for (int i = 0; i < program.GetItemCount(); i++)
+		{
+			const SdfBound& bound = program.GetItem(i).bound;
+			if (bound.box.IsFinite())
+			{
+				content.Grow(bound.box);
+				scale = std::min(scale, bound.scale);
+			}
+			else
+			{
+				unbounded = true;
+			}
+		}
+		return content;
+	}
+
+	uint8_t Quantise(float v)
+	{
+		return static_cast<uint8_t>(clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	uint8_t QuantiseSlope(float v)
+	{
+		return static_cast<uint8_t>(clamp(127.0f + 254.0f * v, 0.0f, 254.0f) + 0.5f);
+	}
+}
+
+SdfLightVolume::SdfLightVolume() :
+	m_program(nullptr),
+	m_dynamic(nullptr),
+	m_dynamicBox(SdfAabb::Empty()),
+	m_dynamicScale(1.0f),
+	m_dynamicUnbounded(false),
+	m_sunDirection(0.0f, 1.0f, 0.0f),
+	m_bounds(SdfAabb::Empty()),
+	m_voxelSize(0),
+	m_exactOutside(false),
+	m_traced(0),
+	m_bakeSeconds(0)
+{
+	m_samples[0] = m_samples[1] = m_samples[2] = 0;
+}
+
+void SdfLightVolume::Build(const SdfBvh& staticBvh, const SdfBvh* dynamicBvh, const SdfContext& context, const float3& sunDirection, float voxelSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const SdfProgram& program = *staticBvh.GetProgram();
+	m_program = &program;
+	m_voxelSize = voxelSize;
+	m_sunDirection = normalize(sunDirection);
+
+	m_dynamic = (dynamicBvh && dynamicBvh->GetProgram()->GetItemCount() > 0) ? dynamicBvh : nullptr;
+	if (m_dynamic)
+	{
+		m_dynamicBox = ContentBox(*m_dynamic->GetProgram(), m_dynamicScale, m_dynamicUnbounded);
+	}
+
+	// Bounds only promise scale * box distance, so pad by ClearDistance / scale.
+	float scale;
+	SdfAabb content = ContentBox(program, scale, m_exactOutside);
+
+	m_data.clear();
+	m_traced = 0;
+	m_bakeStats = SdfEvalStats();
+	if (content.IsEmpty())
+	{
+		m_bounds = SdfAabb::Empty();
+		m_samples[0] = m_samples[1] = m_samples[2] = 0;
+		m_bakeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
+
+	m_bounds = content.Padded(ClearDistance / scale);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		m_samples[axis] = static_cast<int>(std::ceil((m_bounds.max[axis] - m_bounds.min[axis]) / voxelSize)) + 1;
+		m_bounds.max[axis] = m_bounds.min[axis] + (m_samples[axis] - 1) * voxelSize;
+	}
+
+	const float3 lig = m_sunDirection;
+	const float3 axes[3] = { float3(1.0f, 0.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f) };
+	const LocalField field(staticBvh);
+	const int sx = m_samples[0];
+	const int sy = m_samples[1];
+	const int sz = m_samples[2];
+	m_data.resize(GetSampleCount());
+	std::vector<uint8_t> inside(GetSampleCount(), 0);
+	std::vector<SdfEvalStats> rowStats(sy * sz);
+	std::vector<int> rowTraced(sy * sz, 0);
+
+	Concurrency::parallel_for(0, sy * sz, [&](int row)
+	{
+		const int y = row % sy;
+		const int z = row / sy;
+		SdfEvalStats& stats = rowStats[row];
+		for (int x = 0; x < sx; x++)
+		{
+			const int i = row * sx + x;
+			const float3 p = m_bounds.min + float3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)) * voxelSize;
+			const float d = field.Map(p, context, &stats).x;
+			Texel& texel = m_data[i];
+			if (d >= ClearDistance)
+			{
+				texel.occlusion = 255;
+				texel.slope[0] = texel.slope[1] = texel.slope[2] = 127;
+				texel.sun = 255;
+				continue;
+			}
+
+			float mean = 0.0f;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const float positive = SdfRaymarcher::CalcOcclusion(field, p, axes[axis], context, &stats);
+				const float negative = SdfRaymarcher::CalcOcclusion(field, p, -axes[axis], context, &stats);
+				mean += positive + negative;
+				texel.slope[axis] = QuantiseSlope(0.5f * (positive - negative));
+			}
+			texel.occlusion = Quantise(mean / 6.0f);
+			texel.sun = Quantise(SdfRaymarcher::CalcSoftshadow(field, p, lig, 0.02f, context, &stats));
+			inside[i] = (d < 0.0f) ? 1 : 0;
+			rowTraced[row]++;
+		}
+	});
+
+	for (int row = 0; row < sy * sz; row++)
+	{
+		m_bakeStats.Add(rowStats[row]);
+		m_traced += rowTraced[row];
+	}
+
+	// Replace samples inside the content with the mean of their outside neighbours, a layer at a time.
+	const int offsets[3] = { 1, sx, sx * sy };
+	for (int pass = 0; pass < FillPasses; pass++)
+	{
+		std::vector<Texel> filled = m_data;
+		std::vector<uint8_t> stillInside = inside;
+		for (int z = 0; z < sz; z++)
+		{
+			for (int y = 0; y < sy; y++)
+			{
+				for (int x = 0; x < sx; x++)
+				{
+					const int i = (z * sy + y) * sx + x;
+					if (!inside[i])
+					{
+						continue;
+					}
+					const int coords[3] = { x, y, z };
+					int sum[5] = { 0, 0, 0, 0, 0 };
+					int count = 0;
+					for (int axis = 0; axis < 3; axis++)
+					{
+						for (int side = -1; side <= 1; side += 2)
+						{
+							const int c = coords[axis] + side;
+							const int j = i + side * offsets[axis];
+							if (c < 0 || c >= m_samples[axis] || inside[j])
+							{
+								continue;
+							}
+							sum[0] += m_data[j].occlusion;
+							sum[1] += m_data[j].slope[0];
+							sum[2] += m_data[j].slope[1];
+							sum[3] += m_data[j].slope[2];
+							sum[4] += m_data[j].sun;
+							count++;
+						}
+					}
+					if (count > 0)
+					{
+						filled[i].occlusion = static_cast<uint8_t>((sum[0] + count / 2) / count);
+						filled[i].slope[0] = static_cast<uint8_t>((sum[1] + count / 2) / count);
+						filled[i].slope[1] = static_cast<uint8_t>((sum[2] + count / 2) / count);
+						filled[i].slope[2] = static_cast<uint8_t>((sum[3] + count / 2) / count);
+						filled[i].sun = static_cast<uint8_t>((sum[4] + count / 2) / count);
+						stillInside[i] = 0;
+					}
+				}
+			}
+		}
+		m_data.swap(filled);
+		inside.swap(stillInside);
+	}
+
+	m_bakeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool SdfLightVolume::Sample(const float3& point, const float3& normal, const SdfContext& context, float& occlusion, float& sun, SdfEvalStats* stats) const
+{
+	occlusion = 1.0f;
+	sun = 1.0f;
+	if (!m_program)
+	{
+		return false;
+	}
+
+	const float3 local = m_program->ToLocal(point, context);
+	if (!m_data.empty() && m_bounds.Distance(local) <= 0.0f)
+	{
+		if (!SampleStatic(local, normal, occlusion, sun))
+		{
+			return false;
+		}
+	}
+	else if (m_exactOutside)
+	{
+		return false;
+	}
+
+	if (m_dynamic)
+	{
+		const SdfProgram& dynamic = *m_dynamic->GetProgram();
+		const float aoClear = m_dynamicScale * m_dynamicBox.Distance(dynamic.ToLocal(point, context)) - AoReach * (1.0f + m_dynamicScale);
+		if (m_dynamicUnbounded || aoClear < 0.0f)
+		{
+			occlusion *= SdfRaymarcher::CalcOcclusion(*m_dynamic, point, normal, context, stats);
+		}
+		const float3 middle = point + m_sunDirection * ShadowMiddle;
+		const float shadowClear = m_dynamicScale * (m_dynamicBox.Distance(dynamic.ToLocal(middle, context)) - ShadowRadius) - ShadowClearance;
+		if (m_dynamicUnbounded || shadowClear < 0.0f)
+		{
+			sun = std::min(sun, SdfRaymarcher::CalcSoftshadow(*m_dynamic, point, m_sunDirection, 0.02f, context, stats));
+		}
+	}
+	return true;
+}
+
+bool SdfLightVolume::SampleStatic(const float3& local, const float3& normal, float& occlusion, float& sun) const
+{
+	const float3 g = (local - m_bounds.min) / m_voxelSize;
+	int base[3];
+	float f[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		base[axis] = std::min(static_cast<int>(g[axis]), m_samples[axis] - 2);
+		base[axis] = std::max(base[axis], 0);
+		f[axis] = clamp(g[axis] - base[axis], 0.0f, 1.0f);
+	}
+
+	float channels[5] = { 0, 0, 0, 0, 0 };
+	int low[2] = { 255, 255 };
+	int high[2] = { 0, 0 };
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const int cx = corner & 1;
+		const int cy = (corner >> 1) & 1;
+		const int cz = (corner >> 2) & 1;
+		const float w = (cx ? f[0] : 1.0f - f[0]) * (cy ? f[1] : 1.0f - f[1]) * (cz ? f[2] : 1.0f - f[2]);
+		const int x = std::min(base[0] + cx, m_samples[0] - 1);
+		const int y = std::min(base[1] + cy, m_samples[1] - 1);
+		const int z = std::min(base[2] + cz, m_samples[2] - 1);
+		const Texel& texel = m_data[(z * m_samples[1] + y) * m_samples[0] + x];
+		channels[0] += w * texel.occlusion;
+		channels[1] += w * texel.slope[0];
+		channels[2] += w * texel.slope[1];
+		channels[3] += w * texel.slope[2];
+		channels[4] += w * texel.sun;
+		low[0] = std::min<int>(low[0], texel.occlusion);
+		high[0] = std::max<int>(high[0], texel.occlusion);
+		low[1] = std::min<int>(low[1], texel.sun);
+		high[1] = std::max<int>(high[1], texel.sun);
+	}
+	if (high[0] - low[0] > MaxSpread || high[1] - low[1] > MaxSpread)
+	{
+		return false;
+	}
+
+	const float3 slope(channels[1] - 127.0f, channels[2] - 127.0f, channels[3] - 127.0f);
+	occlusion = clamp(channels[0] / 255.0f + dot(slope, normal) / 254.0f, 0.0f, 1.0f);
+	sun = channels[4] / 255.0f;
+	return true;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include "SdfBvh.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// calcAO() and the sun's calcSoftshadow() baked on a grid around static content, in the
+	// program's local frame (one repeated cell for InfiniteShapes). AO depends on the normal, so
+	// each sample keeps it for the six axis normals as a constant plus a linear term in the
+	// normal; the sun is a fixed direction, so its visibility is a single value. Lookups are
+	// trilinear. Samples inside the content are filled from their neighbours outside it, since a
+	// surface point always sits between the two. Terms that move can't be baked; they are
+	// evaluated live, but only where they are in reach of the point being shaded. Lookups whose
+	// eight samples disagree strongly fall back to the live taps altogether.
+	// Opt-in through SdfRaymarcher::SetLightVolume. At the benchmark's voxel size (0.1) the
+	// InfiniteShapes pylons and aliens are thinner than a voxel, so nearly every lookup there falls
+	// back and the volume saves nothing; Primitives saves about a tenth of the shading map calls.
+	class SdfLightVolume
+	{
+	public:
+		SdfLightVolume();
+
+		// Bakes the terms of 'staticBvh', which must not change with time; 'dynamicBvh' holds the
+		// rest (SdfScene::KeepTerms) and may be null. Rows are baked in parallel.
+		void Build(const SdfBvh& staticBvh, const SdfBvh* dynamicBvh, const SdfContext& context, const Hlsl::float3& sunDirection, float voxelSize);
+
+		// AO without calcAO()'s sky factor, and sun visibility. The baked and live parts combine the
+		// way the taps would if they never overlapped: AO multiplies, shadows take the darker.
+		// Outside the grid nothing static is in reach and the static part is 1, unless some static
+		// term has no bound: then this returns false and the caller has to evaluate everything live.
+		bool Sample(const Hlsl::float3& point, const Hlsl::float3& normal, const SdfContext& context, float& occlusion, float& sun, SdfEvalStats* stats) const;
+
+		int GetSampleCount() const { return m_samples[0] * m_samples[1] * m_samples[2]; }
+		// Samples close enough to the content to need the AO and shadow taps.
+		int GetTracedCount() const { return m_traced; }
+		size_t GetMemoryBytes() const { return m_data.size() * sizeof(m_data[0]); }
+		double GetBakeSeconds() const { return m_bakeSeconds; }
+		const SdfEvalStats& GetBakeStats() const { return m_bakeStats; }
+
+	private:
+		// Quantised to bytes; the linear AO terms are in [-0.5, 0.5] around 127.
+		struct Texel
+		{
+			uint8_t occlusion;
+			uint8_t slope[3];
+			uint8_t sun;
+		};
+
+		// False where the samples around 'local' disagree too much to interpolate.
+		bool SampleStatic(const Hlsl::float3& local, const Hlsl::float3& normal, float& occlusion, float& sun) const;
+
+		const SdfProgram* m_program;
+		const SdfBvh* m_dynamic;
+		SdfAabb m_dynamicBox; // in the dynamic program's local frame
+		float m_dynamicScale;
+		bool m_dynamicUnbounded;
+		Hlsl::float3 m_sunDirection;
+		SdfAabb m_bounds;
+		float m_voxelSize;
+		int m_samples[3];
+		bool m_exactOutside;
+		std::vector<Texel> m_data;
+
+		int m_traced;
+		double m_bakeSeconds;
+		SdfEvalStats m_bakeStats;
+	};
+}
@@ -0,0 +1,337 @@
+﻿#include "pch.h"
+#include "SdfMesher.h"
+#include <chrono>
+#include <ppl.h>
+#include <unordered_map>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	// Cells per parallel work item for the vertex and quad passes.
+	const int ChunkSize = 256;
+
+	// Pulls the quadric minimiser towards the mass point so flat or edge-only cells stay put.
+	const float QefRegularisation = 0.05f;
+
+	// The twelve cell edges as corner pairs.
+	const int Edges[12][2] =
+	{
+		{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, // x
+		{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, // y
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }  // z
+	};
+
+	float3 CornerOffset(int corner)
+	{
+		return float3(static_cast<float>(corner & 1), static_cast<float>(corner >> 1 & 1), static_cast<float>(corner >> 2 & 1));
+	}
+
+	uint64_t CellKey(int32_t x, int32_t y, int32_t z)
+	{
+		return (static_cast<uint64_t>(x) & 0x1fffff) | (static_cast<uint64_t>(y) & 0x1fffff) << 21 | (static_cast<uint64_t>(z) & 0x1fffff) << 42;
+	}
+
+	float Determinant(const float3& a, const float3& b, const float3& c)
+	{
+		return dot(a, cross(b, c));
+	}
+}
+
+void SdfMesh::Clear()
+{
+	positions.clear();
+	normals.clear();
+	materials.clear();
+	indices.clear();
+}
+
+void SdfMeshStats::Add(const SdfMeshStats& other)
+{
+	nodes += other.nodes;
+	cells += other.cells;
+	surfaceCells += other.surfaceCells;
+	holes += other.holes;
+	eval.Add(other.eval);
+}
+
+SdfMesher::SdfMesher(const SdfField& field, const SdfMeshSettings& settings) :
+	m_field(field),
+	m_settings(settings)
+{
+}
+
+bool SdfMesher::MayContainSurface(const Grid& grid, const Node& node, const SdfContext& context, SdfMeshStats& stats) const
+{
+	const float half = 0.5f * node.size;
+	const float3 centre = grid.Point(node.x + half, node.y + half, node.z + half);
+	const float radius = 1.7320508f * half * grid.cellSize;
+	stats.nodes++;
+	if (std::fabs(m_field.Map(centre, context, &stats.eval).x) <= m_settings.margin * radius)
+	{
+		return true;
+	}
+
+	// The centre test only holds for fields that never overestimate distance. opTwist and the
+	// Mandelbulb do, and a node pruned with the surface inside leaves a hole in the quads of
+	// the cells around it, so a node whose corners disagree in sign is kept anyway.
+	bool anyInside = false;
+	bool anyOutside = false;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const float3 offset = CornerOffset(corner) * static_cast<float>(node.size);
+		const bool inside = m_field.Map(grid.Point(node.x + offset.x, node.y + offset.y, node.z + offset.z), context, &stats.eval).x < 0.0f;
+		anyInside |= inside;
+		anyOutside |= !inside;
+	}
+	return anyInside && anyOutside;
+}
+
+void SdfMesher::CollectTasks(const Grid& grid, const Node& node, int taskSize, const SdfContext& context, std::vector<Node>& tasks, SdfMeshStats& stats) const
+{
+	if (!MayContainSurface(grid, node, context, stats))
+	{
+		return;
+	}
+	if (node.size <= taskSize)
+	{
+		tasks.push_back(node);
+		return;
+	}
+
+	const int32_t half = node.size / 2;
+	for (int child = 0; child < 8; child++)
+	{
+		Node c = { node.x + (child & 1) * half, node.y + (child >> 1 & 1) * half, node.z + (child >> 2 & 1) * half, half };
+		CollectTasks(grid, c, taskSize, context, tasks, stats);
+	}
+}
+
+void SdfMesher::Subdivide(const Grid& grid, const Node& node, const SdfContext& context, std::vector<Cell>& cells, SdfMeshStats& stats) const
+{
+	if (!MayContainSurface(grid, node, context, stats))
+	{
+		return;
+	}
+
+	if (node.size > 1)
+	{
+		const int32_t half = node.size / 2;
+		for (int child = 0; child < 8; child++)
+		{
+			Node c = { node.x + (child & 1) * half, node.y + (child >> 1 & 1) * half, node.z + (child >> 2 & 1) * half, half };
+			Subdivide(grid, c, context, cells, stats);
+		}
+		return;
+	}
+
+	Cell cell;
+	cell.x = node.x;
+	cell.y = node.y;
+	cell.z = node.z;
+	int inside = 0;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float3 offset = CornerOffset(corner);
+		cell.corners[corner] = m_field.Map(grid.Point(node.x + offset.x, node.y + offset.y, node.z + offset.z), context, &stats.eval).x;
+		inside += cell.corners[corner] < 0.0f ? 1 : 0;
+	}
+	stats.cells++;
+	if (inside > 0 && inside < 8)
+	{
+		cells.push_back(cell);
+	}
+}
+
+// Minimises the sum of squared distances to the tangent planes at the edge crossings, solved
+// relative to their mean. Falls back to the mean if the solution leaves the cell.
+float3 SdfMesher::PlaceVertex(const Grid& grid, const Cell& cell, const SdfContext& context, SdfEvalStats* stats) const
+{
+	float3 points[12];
+	float3 normals[12];
+	int count = 0;
+	float3 mass(0.0f, 0.0f, 0.0f);
+	for (const auto& edge : Edges)
+	{
+		float d0 = cell.corners[edge[0]];
+		float d1 = cell.corners[edge[1]];
+		if ((d0 < 0.0f) == (d1 < 0.0f))
+		{
+			continue;
+		}
+		float3 a = CornerOffset(edge[0]);
+		float3 b = CornerOffset(edge[1]);
+		float3 p = lerp(a, b, d0 / (d0 - d1));
+		float3 g = m_field.Gradient(grid.Point(cell.x + p.x, cell.y + p.y, cell.z + p.z), context, stats);
+		float len = length(g);
+		points[count] = p;
+		normals[count] = len > 0.0f ? g / len : float3(0.0f, 0.0f, 0.0f);
+		mass += p;
+		count++;
+	}
+	mass = mass / static_cast<float>(count);
+
+	// Normal equations (A^T A + r I) y = A^T b, with y = vertex - mass.
+	float3 c0(QefRegularisation, 0.0f, 0.0f);
+	float3 c1(0.0f, QefRegularisation, 0.0f);
+	float3 c2(0.0f, 0.0f, QefRegularisation);
+	float3 rhs(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < count; i++)
+	{
+		const float3& n = normals[i];
+		c0 += n * n.x;
+		c1 += n * n.y;
+		c2 += n * n.z;
+		rhs += n * dot(n, points[i] - mass);
+	}
+
+	float3 vertex = mass;
+	float det = Determinant(c0, c1, c2);
+	if (std::fabs(det) > 1e-12f)
+	{
+		float3 y(Determinant(rhs, c1, c2) / det, Determinant(c0, rhs, c2) / det, Determinant(c0, c1, rhs) / det);
+		float3 v = mass + y;
+		if (v.x >= -0.5f && v.x <= 1.5f && v.y >= -0.5f && v.y <= 1.5f && v.z >= -0.5f && v.z <= 1.5f)
+		{
+			vertex = v;
+		}
+	}
+	return grid.Point(cell.x + vertex.x, cell.y + vertex.y, cell.z + vertex.z);
+}
+
+void SdfMesher::Extract(const SdfAabb& region, const SdfContext& context, SdfMesh& mesh, SdfMeshStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	mesh.Clear();
+
+	// Cube octree over the region; cells past the far side of a shorter axis are pruned like any other.
+	const int resolution = 1 << m_settings.depth;
+	const float3 extent = region.Extent();
+	Grid grid;
+	grid.origin = region.min;
+	grid.cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / resolution;
+
+	// Top levels serially, down to the task level, then one task per surviving node.
+	SdfMeshStats total;
+	std::vector<Node> tasks;
+	const Node root = { 0, 0, 0, resolution };
+	CollectTasks(grid, root, resolution >> std::min(m_settings.taskDepth, m_settings.depth), context, tasks, total);
+
+	std::vector<std::vector<Cell>> taskCells(tasks.size());
+	std::vector<SdfMeshStats> taskStats(tasks.size());
+	Concurrency::parallel_for(0, static_cast<int>(tasks.size()), [&](int task)
+	{
+		Subdivide(grid, tasks[task], context, taskCells[task], taskStats[task]);
+	});
+
+	std::vector<Cell> cells;
+	for (size_t task = 0; task < tasks.size(); task++)
+	{
+		cells.insert(cells.end(), taskCells[task].begin(), taskCells[task].end());
+		total.Add(taskStats[task]);
+	}
+	total.surfaceCells = cells.size();
+
+	std::unordered_map<uint64_t, uint32_t> cellIndex;
+	cellIndex.reserve(cells.size() * 2);
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		cellIndex[CellKey(cells[i].x, cells[i].y, cells[i].z)] = static_cast<uint32_t>(i);
+	}
+
+	// One vertex per surface cell.
+	const int chunks = static_cast<int>((cells.size() + ChunkSize - 1) / ChunkSize);
+	mesh.positions.resize(cells.size());
+	mesh.normals.resize(cells.size());
+	mesh.materials.resize(cells.size());
+	std::vector<SdfEvalStats> chunkEval(chunks);
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		const size_t end = std::min(cells.size(), static_cast<size_t>(chunk + 1) * ChunkSize);
+		for (size_t i = static_cast<size_t>(chunk) * ChunkSize; i < end; i++)
+		{
+			float3 p = PlaceVertex(grid, cells[i], context, &chunkEval[chunk]);
+			float3 g = m_field.Gradient(p, context, &chunkEval[chunk]);
+			float len = length(g);
+			mesh.positions[i] = p;
+			mesh.normals[i] = len > 0.0f ? g / len : float3(0.0f, 1.0f, 0.0f);
+			mesh.materials[i] = m_field.Map(p, context, &chunkEval[chunk]).y;
+		}
+	});
+
+	// One quad per sign changing edge, emitted by the cell at the edge's min corner. The other
+	// three cells around the edge are its neighbours below along the two remaining axes.
+	std::vector<std::vector<uint32_t>> chunkIndices(chunks);
+	std::vector<uint64_t> chunkHoles(chunks, 0);
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		const size_t end = std::min(cells.size(), static_cast<size_t>(chunk + 1) * ChunkSize);
+		for (size_t i = static_cast<size_t>(chunk) * ChunkSize; i < end; i++)
+		{
+			const Cell& cell = cells[i];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const float d0 = cell.corners[0];
+				const float d1 = cell.corners[1 << axis];
+				if ((d0 < 0.0f) == (d1 < 0.0f))
+				{
+					continue;
+				}
+
+				// Edges on the min faces of the grid have no cells below them; the mesh is open there.
+				const int u = (axis + 1) % 3;
+				const int v = (axis + 2) % 3;
+				const int32_t coords[3] = { cell.x, cell.y, cell.z };
+				if (coords[u] == 0 || coords[v] == 0)
+				{
+					continue;
+				}
+
+				int32_t quad[4];
+				bool complete = true;
+				for (int k = 0; k < 4 && complete; k++)
+				{
+					int32_t c[3] = { coords[0], coords[1], coords[2] };
+					c[u] -= (k == 1 || k == 2) ? 1 : 0;
+					c[v] -= (k >= 2) ? 1 : 0;
+					auto it = cellIndex.find(CellKey(c[0], c[1], c[2]));
+					complete = it != cellIndex.end();
+					quad[k] = complete ? static_cast<int32_t>(it->second) : -1;
+				}
+				if (!complete)
+				{
+					chunkHoles[chunk]++;
+					continue;
+				}
+
+				// quad winds counter-clockwise about +axis. Front faces are clockwise seen from outside,
+				// so reverse it when outside is the +axis end of the edge.
+				std::vector<uint32_t>& out = chunkIndices[chunk];
+				if (d0 < 0.0f)
+				{
+					out.insert(out.end(), { static_cast<uint32_t>(quad[0]), static_cast<uint32_t>(quad[2]), static_cast<uint32_t>(quad[1]) });
+					out.insert(out.end(), { static_cast<uint32_t>(quad[0]), static_cast<uint32_t>(quad[3]), static_cast<uint32_t>(quad[2]) });
+				}
+				else
+				{
+					out.insert(out.end(), { static_cast<uint32_t>(quad[0]), static_cast<uint32_t>(quad[1]), static_cast<uint32_t>(quad[2]) });
+					out.insert(out.end(), { static_cast<uint32_t>(quad[0]), static_cast<uint32_t>(quad[2]), static_cast<uint32_t>(quad[3]) });
+				}
+			}
+		}
+	});
+
+	for (int chunk = 0; chunk < chunks; chunk++)
+	{
+		mesh.indices.insert(mesh.indices.end(), chunkIndices[chunk].begin(), chunkIndices[chunk].end());
+		total.holes += chunkHoles[chunk];
+		total.eval.Add(chunkEval[chunk]);
+	}
+
+	if (stats)
+	{
+		*stats = total;
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "SdfField.h"
+#include "SdfBounds.h"
+#include <cstdint>
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// Indexed triangle mesh with per vertex material ids, laid out for a D3D11 vertex buffer.
+	// Triangles are clockwise seen from outside, the D3D11 default front face.
+	struct SdfMesh
+	{
+		std::vector<Hlsl::float3> positions;
+		std::vector<Hlsl::float3> normals;
+		std::vector<float> materials;
+		std::vector<uint32_t> indices;
+
+		void Clear();
+		size_t GetTriangleCount() const { return indices.size() / 3; }
+	};
+
+	struct SdfMeshSettings
+	{
+		// The region is split into 2^depth cells along its longest side.
+		int depth = 6;
+		// Octree nodes at this level are subdivided as independent parallel tasks.
+		int taskDepth = 3;
+		// A node is pruned when |map(centre)| exceeds margin times its bounding radius and its
+		// corners agree in sign. Above 1 keeps cells for fields that slightly overestimate
+		// distance (the wave displacements).
+		float margin = 1.25f;
+	};
+
+	struct SdfMeshStats
+	{
+		double seconds = 0;
+		uint64_t nodes = 0;        // octree nodes tested, all levels
+		uint64_t cells = 0;        // finest level cells whose corners were evaluated
+		uint64_t surfaceCells = 0; // cells with a sign change, one vertex each
+		uint64_t holes = 0;        // quads dropped because a neighbouring cell was pruned
+		SdfEvalStats eval;
+
+		void Add(const SdfMeshStats& other);
+	};
+
+	// Dual contouring over a sparse octree. Nodes are subdivided only where the surface can pass
+	// through them, every finest level cell with a sign change gets one vertex placed by a
+	// quadric fit to the edge crossings and their SdfField::Gradient normals, and each sign
+	// changing edge becomes a quad joining the four cells around it.
+	class SdfMesher
+	{
+	public:
+		SdfMesher(const SdfField& field, const SdfMeshSettings& settings);
+
+		void Extract(const SdfAabb& region, const SdfContext& context, SdfMesh& mesh, SdfMeshStats* stats) const;
+
+	private:
+		struct Cell
+		{
+			int32_t x, y, z;
+			float corners[8]; // corner i is at (x + (i & 1), y + (i >> 1 & 1), z + (i >> 2 & 1))
+		};
+
+		struct Grid
+		{
+			Hlsl::float3 origin;
+			float cellSize;
+
+			Hlsl::float3 Point(float x, float y, float z) const
+			{
+				return origin + Hlsl::float3(x, y, z) * cellSize;
+			}
+		};
+
+		struct Node
+		{
+			int32_t x, y, z; // min corner, in finest cells
+			int32_t size;
+		};
+
+		bool MayContainSurface(const Grid& grid, const Node& node, const SdfContext& context, SdfMeshStats& stats) const;
+		void CollectTasks(const Grid& grid, const Node& node, int taskSize, const SdfContext& context, std::vector<Node>& tasks, SdfMeshStats& stats) const;
+		void Subdivide(const Grid& grid, const Node& node, const SdfContext& context, std::vector<Cell>& cells, SdfMeshStats& stats) const;
+		Hlsl::float3 PlaceVertex(const Grid& grid, const Cell& cell, const SdfContext& context, SdfEvalStats* stats) const;
+
+		const SdfField& m_field;
+		SdfMeshSettings m_settings;
+	};
+}
@@ -0,0 +1,196 @@
+﻿#include "pch.h"
+#include "SdfPacketMarcher.h"
+#include <chrono>
+#include <ppl.h>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const int TileSize = 16;
+
+}
+
+template <int Lanes>
+SdfPacketMarcher<Lanes>::SdfPacketMarcher(const SdfBvh& bvh, const SdfRaymarcher& raymarcher) :
+	m_bvh(bvh),
+	m_raymarcher(raymarcher)
+{
+}
+
+template <int Lanes>
+void SdfPacketMarcher<Lanes>::MarchTile(const SdfCamera& camera, const SdfContext& context, int x0, int y0, SdfImage& image, SdfRenderStats& stats) const
+{
+	const SdfMarchSettings& settings = m_raymarcher.GetSettings();
+
+	int queue[TileSize * TileSize];
+	int queued = 0;
+	for (int code = 0; code < TileSize * TileSize; code++)
+	{
+		int x = 0;
+		int y = 0;
+		for (int bit = 0; bit < 4; bit++)
+		{
+			x |= ((code >> (2 * bit)) & 1) << bit;
+			y |= ((code >> (2 * bit + 1)) & 1) << bit;
+		}
+		if (x0 + x < camera.width && y0 + y < camera.height)
+		{
+			queue[queued++] = (y0 + y) * camera.width + x0 + x;
+		}
+	}
+
+	SdfMarchState state[Lanes];
+	float3 direction[Lanes];
+	int pixel[Lanes];
+	int active = 0;
+	int next = 0;
+
+	auto finish = [&](int lane)
+	{
+		const int i = pixel[lane];
+		float2 hit = state[lane].Result();
+		image.steps[i] = static_cast<uint16_t>(std::min(state[lane].steps, 65535));
+		stats.rays++;
+		stats.steps += state[lane].steps;
+		stats.capped += state[lane].Capped() ? 1 : 0;
+		if (hit.y > -0.5f)
+		{
+			image.t[i] = hit.x;
+			image.material[i] = hit.y;
+			stats.hits++;
+		}
+	};
+
+	// Fills lane with the next queued ray that needs marching.
+	auto refill = [&](int lane)
+	{
+		while (next < queued)
+		{
+			const int i = queue[next++];
+			const int x = i % camera.width;
+			const int y = i / camera.width;
+			SdfRay ray;
+			ray.origin = camera.eye;
+			ray.direction = camera.RayDirection(static_cast<float>(x), static_cast<float>(y));
+			ray.maxSteps = settings.maxSteps;
+			ray.pixelRadius = camera.PixelRadius(static_cast<float>(x), static_cast<float>(y));
+			pixel[lane] = i;
+			direction[lane] = ray.direction;
+			if (state[lane].Begin(ray, settings) && state[lane].Running())
+			{
+				return true;
+			}
+			finish(lane);
+		}
+		return false;
+	};
+
+	while (active < Lanes && refill(active))
+	{
+		active++;
+	}
+
+	float3 points[Lanes];
+	float2 results[Lanes];
+	SdfContext stepContext = context;
+	while (active > 0)
+	{
+		if (next >= queued && active <= Lanes / 4)
+		{
+			for (int lane = 0; lane < active; lane++)
+			{
+				while (state[lane].Running())
+				{
+					stepContext.footprint = state[lane].Footprint();
+					state[lane].Advance(m_bvh.Map(camera.eye + direction[lane] * state[lane].t, stepContext, &stats.march));
+				}
+				finish(lane);
+			}
+			break;
+		}
+
+		// Unused lanes repeat lane 0 so they never widen the culling bounds.
+		for (int lane = 0; lane < Lanes; lane++)
+		{
+			const int source = (lane < active) ? lane : 0;
+			points[lane] = camera.eye + direction[source] * state[source].t;
+		}
+		// One footprint for the whole packet, the smallest, so no lane loses detail it can resolve.
+		stepContext.footprint = state[0].Footprint();
+		for (int lane = 1; lane < active; lane++)
+		{
+			stepContext.footprint = std::min(stepContext.footprint, state[lane].Footprint());
+		}
+		m_bvh.MapLanes<Lanes>(points, results, stepContext, &stats.march);
+
+		for (int lane = 0; lane < active; lane++)
+		{
+			state[lane].Advance(results[lane]);
+			if (state[lane].Running())
+			{
+				continue;
+			}
+			finish(lane);
+			if (!refill(lane))
+			{
+				// Compact: move the last active lane into this one and look at it again.
+				active--;
+				state[lane] = state[active];
+				direction[lane] = direction[active];
+				pixel[lane] = pixel[active];
+				results[lane] = results[active];
+				lane--;
+			}
+		}
+	}
+}
+
+template <int Lanes>
+void SdfPacketMarcher<Lanes>::Render(const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	image.Resize(camera.width, camera.height);
+
+	const int tilesX = (camera.width + TileSize - 1) / TileSize;
+	const int tilesY = (camera.height + TileSize - 1) / TileSize;
+	std::vector<SdfRenderStats> tileStats(tilesX * tilesY);
+
+	Concurrency::parallel_for(0, tilesX * tilesY, [&](int tile)
+	{
+		SdfRenderStats& s = tileStats[tile];
+		const int x0 = (tile % tilesX) * TileSize;
+		const int y0 = (tile / tilesX) * TileSize;
+		MarchTile(camera, context, x0, y0, image, s);
+
+		if (m_raymarcher.GetSettings().shade)
+		{
+			for (int y = y0; y < std::min(y0 + TileSize, camera.height); y++)
+			{
+				for (int x = x0; x < std::min(x0 + TileSize, camera.width); x++)
+				{
+					const int i = y * camera.width + x;
+					if (image.t[i] >= 0.0f)
+					{
+						float3 rd = camera.RayDirection(static_cast<float>(x), static_cast<float>(y));
+						image.colour[i] = m_raymarcher.Shade(camera.eye, rd, float2(image.t[i], image.material[i]), context, &s.shading);
+					}
+				}
+			}
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SdfRenderStats();
+		for (const SdfRenderStats& s : tileStats)
+		{
+			stats->Add(s);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+template class SdfPacketMarcher<8>;
+template class SdfPacketMarcher<16>;
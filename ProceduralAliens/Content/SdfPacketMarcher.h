@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include "SdfBvh.h"
+#include "SdfRaymarcher.h"
+
+namespace ProceduralAliens
+{
+	// Marches primary rays in packets of Lanes (8 or 16) through an SdfBvh. The screen is cut into
+	// 16x16 tiles, each tile's rays are queued in Morton order so a packet covers a compact block of
+	// pixels, and lanes whose ray has finished are refilled from the queue. Once the queue is empty
+	// and only a few lanes are left, they are compacted and finished one ray at a time.
+	// Shading is left to the SdfRaymarcher, which also supplies the march settings.
+	template <int Lanes>
+	class SdfPacketMarcher
+	{
+	public:
+		SdfPacketMarcher(const SdfBvh& bvh, const SdfRaymarcher& raymarcher);
+
+		void Render(const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats) const;
+
+	private:
+		void MarchTile(const SdfCamera& camera, const SdfContext& context, int x0, int y0, SdfImage& image, SdfRenderStats& stats) const;
+
+		const SdfBvh& m_bvh;
+		const SdfRaymarcher& m_raymarcher;
+	};
+}
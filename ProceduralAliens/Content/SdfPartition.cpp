@@ -0,0 +1,60 @@
+﻿#include "pch.h"
+#include "SdfPartition.h"
+#include "SdfPrimitives.h"
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+SdfPartition::SdfPartition() :
+	m_static(nullptr),
+	m_dynamic(nullptr)
+{
+}
+
+void SdfPartition::Build(const SdfField* staticField, const SdfBvh* dynamicBvh, const SdfSplit& split)
+{
+	m_static = staticField;
+	m_dynamic = (dynamicBvh && dynamicBvh->GetProgram()->GetItemCount() > 0) ? dynamicBvh : nullptr;
+	m_split = split;
+}
+
+float2 SdfPartition::Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	if (stats)
+	{
+		stats->partitionCalls++;
+	}
+	if (!m_dynamic)
+	{
+		if (stats)
+		{
+			stats->staticCalls++;
+		}
+		return m_static ? m_static->Map(point, context, stats) : float2(1e10f, 0.0f);
+	}
+	if (!m_static)
+	{
+		return m_dynamic->Map(point, context, stats);
+	}
+
+	// softMin2 is the plain min once its operands are a radius apart, so dynamic terms at least
+	// s + blend away leave the static distance as it is. Not its material, though, when the
+	// dynamic half is the blend's first operand.
+	const float2 s = m_static->Map(point, context, stats);
+	const float limit = m_split.dynamicMaterial ? 1e10f : s.x + m_split.blend;
+	const float2 d = m_dynamic->MapBelow(point, limit, context, stats);
+	if (d.x >= limit)
+	{
+		if (stats)
+		{
+			stats->staticCalls++;
+		}
+		return s;
+	}
+
+	if (m_split.blend <= 0.0f)
+	{
+		return (d.x < s.x) ? d : s;
+	}
+	return float2(softMin2(s.x, d.x, m_split.blend), m_split.dynamicMaterial ? d.y : s.y);
+}
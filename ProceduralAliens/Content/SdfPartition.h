@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "SdfBvh.h"
+
+namespace ProceduralAliens
+{
+	// A scene evaluated as the two halves of SdfScene::Split(): the static half through any field
+	// that stands for it, its SdfBvh or a bake of it such as SdfBrickMap, and the dynamic half live
+	// through its own SdfBvh. The halves combine with the split's min or softMin2. The dynamic
+	// BVH is queried below the static distance, so its terms are culled wherever they can't change
+	// the result, which is most of space for scenes where little moves; SdfEvalStats counts how
+	// often the static half answers alone.
+	class SdfPartition : public SdfField
+	{
+	public:
+		SdfPartition();
+
+		// Either half may be null, or a BVH over an empty program, if the split left it empty.
+		void Build(const SdfField* staticField, const SdfBvh* dynamicBvh, const SdfSplit& split);
+
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+
+	private:
+		const SdfField* m_static;
+		const SdfBvh* m_dynamic;
+		SdfSplit m_split;
+	};
+}
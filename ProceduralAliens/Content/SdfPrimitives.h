@@ -0,0 +1,274 @@
+﻿#pragma once
+
+#include "HlslMath.h"
+
+// CPU ports of the distance functions shared by InfiniteShapesPS, primitivesPS and FractalPS.
+// Keep these in step with the shader versions.
+namespace ProceduralAliens
+{
+	namespace Hlsl
+	{
+		inline float sdSphere(const float3& p, float s)
+		{
+			return length(p) - s;
+		}
+
+		inline float sdBox(const float3& p, const float3& b)
+		{
+			float3 d = abs(p) - b;
+			return std::min(std::max(d.x, std::max(d.y, d.z)), 0.0f) + length(max(d, 0.0f));
+		}
+
+		inline float sdEllipsoid(const float3& p, const float3& r) // approximated
+		{
+			float k0 = length(p / r);
+			float k1 = length(p / (r * r));
+			return k0 * (k0 - 1.0f) / k1;
+		}
+
+		inline float sdRoundBox(const float3& p, const float3& b, float r)
+		{
+			float3 q = abs(p) - b;
+			return std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f) + length(max(q, 0.0f)) - r;
+		}
+
+		inline float sdTorus(const float3& p, const float2& t)
+		{
+			return length(float2(length(float2(p.x, p.z)) - t.x, p.y)) - t.y;
+		}
+
+		inline float sdHexPrism(float3 p, const float2& h)
+		{
+			const float3 k(-0.8660254f, 0.5f, 0.57735f);
+			p = abs(p);
+			float kd = 2.0f * std::min(k.x * p.x + k.y * p.y, 0.0f);
+			p.x -= kd * k.x;
+			p.y -= kd * k.y;
+			float2 d(
+				length(float2(p.x - clamp(p.x, -k.z * h.x, k.z * h.x), p.y - h.x)) * sign(p.y - h.x),
+				p.z - h.y);
+			return std::min(std::max(d.x, d.y), 0.0f) + length(max(d, 0.0f));
+		}
+
+		inline float sdCapsule(const float3& p, const float3& a, const float3& b, float r)
+		{
+			float3 pa = p - a, ba = b - a;
+			float h = clamp(dot(pa, ba) / dot(ba, ba), 0.0f, 1.0f);
+			return length(pa - ba * h) - r;
+		}
+
+		inline float dot2(const float2& v) { return dot(v, v); }
+		inline float dot2(const float3& v) { return dot(v, v); }
+
+		inline float sdRoundCone(const float3& p, const float3& a, const float3& b, float r1, float r2)
+		{
+			// sampling independent computations (only depend on shape)
+			float3 ba = b - a;
+			float l2 = dot(ba, ba);
+			float rr = r1 - r2;
+			float a2 = l2 - rr * rr;
+			float il2 = 1.0f / l2;
+
+			// sampling dependant computations
+			float3 pa = p - a;
+			float y = dot(pa, ba);
+			float z = y - l2;
+			float x2 = dot2(pa * l2 - ba * y);
+			float y2 = y * y * l2;
+			float z2 = z * z * l2;
+
+			// single square root!
+			float k = sign(rr) * rr * rr * x2;
+			if (sign(z) * a2 * z2 > k) return std::sqrt(x2 + z2) * il2 - r2;
+			if (sign(y) * a2 * y2 < k) return std::sqrt(x2 + y2) * il2 - r1;
+			return (std::sqrt(x2 * a2 * il2) + y * rr) * il2 - r1;
+		}
+
+		// vertical
+		inline float sdCylinder(const float3& p, const float2& h)
+		{
+			float2 d = abs(float2(length(float2(p.x, p.z)), p.y)) - h;
+			return std::min(std::max(d.x, d.y), 0.0f) + length(max(d, 0.0f));
+		}
+
+		inline float sdCappedCone(const float3& p, float h, float r1, float r2)
+		{
+			float2 q(length(float2(p.x, p.z)), p.y);
+
+			float2 k1(r2, h);
+			float2 k2(r2 - r1, 2.0f * h);
+			float2 ca(q.x - std::min(q.x, (q.y < 0.0f) ? r1 : r2), std::fabs(q.y) - h);
+			float2 cb = q - k1 + k2 * clamp(dot(k1 - q, k2) / dot2(k2), 0.0f, 1.0f);
+			float s = (cb.x < 0.0f && ca.y < 0.0f) ? -1.0f : 1.0f;
+			return s * std::sqrt(std::min(dot2(ca), dot2(cb)));
+		}
+
+		inline float sdOctahedron(float3 p, float s)
+		{
+			p = abs(p);
+			return (p.x + p.y + p.z - s) * 0.57735027f;
+		}
+
+		inline float length2(const float2& p)
+		{
+			return std::sqrt(p.x * p.x + p.y * p.y);
+		}
+
+		inline float length8(float2 p)
+		{
+			p = p * p; p = p * p; p = p * p;
+			return std::pow(p.x + p.y, 1.0f / 8.0f);
+		}
+
+		inline float sdTorus82(const float3& p, const float2& t)
+		{
+			float2 q(length2(float2(p.x, p.z)) - t.x, p.y);
+			return length8(q) - t.y;
+		}
+
+		inline float sdTorus88(const float3& p, const float2& t)
+		{
+			float2 q(length8(float2(p.x, p.z)) - t.x, p.y);
+			return length8(q) - t.y;
+		}
+
+		// Tetrahedral IFS (DE1 in FractalPS).
+		inline float sdSierpinski(float3 z, float scale, float iterations)
+		{
+			//tetra-vertices
+			const float3 v1(0.0f, 1.5f, 0.0f);
+			const float3 v2(1.0f, 0.0f, 0.0f);
+			const float3 v3(std::cos(2.0f * 3.1415f / 3.0f), 0.0f, std::sin(2.0f * 3.1415f / 3.0f));
+			const float3 v4(std::cos(4.0f * 3.1415f / 3.0f), 0.0f, std::sin(4.0f * 3.1415f / 3.0f));
+			int n = 0;
+			while (n < iterations)
+			{
+				float3 c = v1;
+				float dist = length(z - v1);
+				float d = length(z - v2);
+				if (d < dist) { c = v2; dist = d; }
+				d = length(z - v3);
+				if (d < dist) { c = v3; dist = d; }
+				d = length(z - v4);
+				if (d < dist) { c = v4; dist = d; }
+				z = scale * (z - c) + c;
+				n++;
+			}
+			return length(z) * std::pow(scale, float(-n));
+		}
+
+		// Power 8 Mandelbulb (Mandelbulb in FractalPS).
+		inline float sdMandelbulb(const float3& p, int iterations)
+		{
+			float3 w = p;
+			float m = dot(w, w);
+			float dz = 1.0f;
+
+			for (int i = 0; i < iterations; i++)
+			{
+				float m2 = m * m;
+				float m4 = m2 * m2;
+				dz = 8.0f * std::sqrt(m4 * m2 * m) * dz + 1.0f;
+
+				float x = w.x; float x2 = x * x; float x4 = x2 * x2;
+				float y = w.y; float y2 = y * y; float y4 = y2 * y2;
+				float z = w.z; float z2 = z * z; float z4 = z2 * z2;
+
+				float k3 = x2 + z2;
+				float k2 = 1.0f / std::sqrt(k3 * k3 * k3 * k3 * k3 * k3 * k3);
+				float k1 = x4 + y4 + z4 - 6.0f * y2 * z2 - 6.0f * x2 * y2 + 2.0f * z2 * x2;
+				float k4 = x2 - y2 + z2;
+
+				w.x = p.x + 64.0f * x * y * z * (x2 - z2) * k4 * (x4 - 6.0f * x2 * z2 + z4) * k1 * k2;
+				w.y = p.y + -16.0f * y2 * k3 * k4 * k4 + k1 * k1;
+				w.z = p.z + -8.0f * y * k4 * (x4 * x4 - 28.0f * x4 * x2 * z2 + 70.0f * x4 * z4 - 28.0f * x2 * z2 * z4 + z4 * z4) * k1 * k2;
+
+				m = dot(w, w);
+				if (m > 256.0f)
+					break;
+			}
+
+			return 0.25f * std::log(m) * std::sqrt(m) / dz;
+		}
+
+		// Any power, in the spherical coordinates the power 8 polynomial above is expanded from.
+		inline float sdMandelbulb(const float3& p, int iterations, float power)
+		{
+			float3 w = p;
+			float m = dot(w, w);
+			float dz = 1.0f;
+
+			for (int i = 0; i < iterations; i++)
+			{
+				float r = std::sqrt(m);
+				float theta = power * std::acos(clamp(r > 0.0f ? w.y / r : 1.0f, -1.0f, 1.0f));
+				float phi = power * std::atan2(w.x, w.z);
+				float rp = std::pow(r, power - 1.0f);
+				dz = power * rp * dz + 1.0f;
+				float zr = rp * r;
+
+				w = p + zr * float3(std::sin(theta) * std::sin(phi), std::cos(theta), std::sin(theta) * std::cos(phi));
+
+				m = dot(w, w);
+				if (m > 256.0f)
+					break;
+			}
+
+			return 0.25f * std::log(m) * std::sqrt(m) / dz;
+		}
+
+		//------------------------------------------------------------------
+
+		inline float opS(float d1, float d2)
+		{
+			return std::max(-d2, d1);
+		}
+
+		inline float2 opU(const float2& d1, const float2& d2)
+		{
+			return (d1.x < d2.x) ? d1 : d2;
+		}
+
+		inline float3 opRep(const float3& p, const float3& c)
+		{
+			return fmod(p, c) - 0.5f * c;
+		}
+
+		inline float3 opTwist(const float3& p)
+		{
+			float c = std::cos(10.0f * p.y + 10.0f);
+			float s = std::sin(10.0f * p.y + 10.0f);
+			return float3(c * p.x + s * p.z, -s * p.x + c * p.z, p.y);
+		}
+
+		inline float softAbs2(float x, float a)
+		{
+			float xx = 2.0f * x / a; float abs2 = std::fabs(xx);
+			if (abs2 < 2.0f)
+				abs2 = 0.5f * xx * xx * (1.0f - abs2 / 6.0f) + 2.0f / 3.0f;
+			return abs2 * a / 2.0f;
+		}
+
+		inline float softMax2(float x, float y, float a)
+		{
+			return 0.5f * (x + y + softAbs2(x - y, a));
+		}
+
+		inline float softMin2(float x, float y, float a)
+		{
+			return -0.5f * (-x - y + softAbs2(x - y, a));
+		}
+
+		// http://iquilezles.org/www/articles/boxfunctions/boxfunctions.htm
+		inline float2 iBox(const float3& ro, const float3& rd, const float3& rad)
+		{
+			float3 m = float3(1.0f, 1.0f, 1.0f) / rd;
+			float3 n = m * ro;
+			float3 k = abs(m) * rad;
+			float3 t1 = -n - k;
+			float3 t2 = -n + k;
+			return float2(std::max(std::max(t1.x, t1.y), t1.z),
+				std::min(std::min(t2.x, t2.y), t2.z));
+		}
+	}
+}
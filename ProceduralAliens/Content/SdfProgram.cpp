@@ -0,0 +1,899 @@
+﻿#include "pch.h"
+#include "SdfProgram.h"
+#include "SdfDualPrimitives.h"
+#include "SdfFractals.h"
+#include <stdexcept>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const float EmptyDistance = 1e10f;
+	const int WaveConstantCount = 14;
+	// A primitive's eight parameters, then the factor its point's slack is multiplied by.
+	const int SlackFactorConstant = 8;
+	const int PrimitiveConstantCount = 9;
+	// A domain wave adds w to all three coordinates, which moves the point sqrt(3) |w|.
+	const float Sqrt3 = 1.7320508f;
+
+	// Point is float3 or dual3; the wave has the same number type as the point.
+	template <typename Point>
+	auto EvaluateWave(const float* c, const Point& p, float time) -> decltype(p.x)
+	{
+		using std::sin;
+		decltype(p.x) w = c[0];
+		int terms = static_cast<int>(c[1]);
+		for (int k = 0; k < terms; k++)
+		{
+			const float* f = c + 2 + k * 4;
+			w *= sin(f[0] * p.x + f[1] * p.y + f[2] * p.z + f[3] * time);
+		}
+		return w;
+	}
+
+	// The fractals run as one batch per packet so lanes that bail out early are masked instead of
+	// each lane looping on its own. Dual registers hold a single point and use the scalar ports.
+	SdfSierpinskiParams SierpinskiParams(const float* c, float footprint)
+	{
+		SdfSierpinskiParams params;
+		params.scale = c[3];
+		params.iterations = static_cast<int>(c[4]);
+		return params.AtFootprint(footprint);
+	}
+
+	SdfMandelbulbParams MandelbulbParams(const float* c, float footprint)
+	{
+		SdfMandelbulbParams params;
+		params.iterations = static_cast<int>(c[3]);
+		params.power = c[4];
+		return params.AtFootprint(footprint);
+	}
+
+	template <int Lanes>
+	void RunSierpinski(SdfRegisters<Lanes>& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfSierpinskiParams params = SierpinskiParams(c, footprint);
+		float x[Lanes], y[Lanes], z[Lanes];
+		for (int i = 0; i < Lanes; i++)
+		{
+			x[i] = r.px[ins.a][i] - c[0];
+			y[i] = r.py[ins.a][i] - c[1];
+			z[i] = r.pz[ins.a][i] - c[2];
+			r.m[ins.dst][i] = ins.material;
+		}
+		SdfFractals::Sierpinski<Lanes>(x, y, z, r.d[ins.dst], params, nullptr);
+	}
+
+	// A single point has nothing to mask, so it runs the scalar port like the dual registers do.
+	void RunSierpinski(SdfRegisters<1>& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfSierpinskiParams params = SierpinskiParams(c, footprint);
+		r.d[ins.dst][0] = sdSierpinski(r.Point(ins.a, 0, c), params.scale, static_cast<float>(params.iterations)) - params.slack;
+		r.m[ins.dst][0] = ins.material;
+	}
+
+	void RunSierpinski(SdfDualRegisters& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfSierpinskiParams params = SierpinskiParams(c, footprint);
+		r.d[ins.dst][0] = sdSierpinski(r.Point(ins.a, 0, c), params.scale, static_cast<float>(params.iterations)) - params.slack;
+		r.m[ins.dst][0] = ins.material;
+	}
+
+	template <int Lanes>
+	void RunMandelbulb(SdfRegisters<Lanes>& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfMandelbulbParams params = MandelbulbParams(c, footprint);
+		float x[Lanes], y[Lanes], z[Lanes];
+		for (int i = 0; i < Lanes; i++)
+		{
+			x[i] = r.px[ins.a][i] - c[0];
+			y[i] = r.py[ins.a][i] - c[1];
+			z[i] = r.pz[ins.a][i] - c[2];
+			r.m[ins.dst][i] = ins.material;
+		}
+		SdfFractals::Mandelbulb<Lanes>(x, y, z, r.d[ins.dst], params, nullptr);
+	}
+
+	void RunMandelbulb(SdfRegisters<1>& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfMandelbulbParams params = MandelbulbParams(c, footprint);
+		const float3 p = r.Point(ins.a, 0, c);
+		r.d[ins.dst][0] = (params.power == 8.0f) ? sdMandelbulb(p, params.iterations) : sdMandelbulb(p, params.iterations, params.power);
+		r.m[ins.dst][0] = ins.material;
+	}
+
+	void RunMandelbulb(SdfDualRegisters& r, const SdfInstruction& ins, const float* c, float footprint)
+	{
+		const SdfMandelbulbParams params = MandelbulbParams(c, footprint);
+		const dual3 p = r.Point(ins.a, 0, c);
+		r.d[ins.dst][0] = (params.power == 8.0f) ? sdMandelbulb(p, params.iterations) : sdMandelbulb(p, params.iterations, params.power);
+		r.m[ins.dst][0] = ins.material;
+	}
+}
+
+SdfProgram::SdfProgram() :
+	m_prefixCount(0),
+	m_prefixSignature(0),
+	m_sharedCount(0),
+	m_primitiveCount(0),
+	m_pointRegisters(1),
+	m_distanceRegisters(0),
+	m_itemShared(0),
+	m_distanceScale(1.0f),
+	m_upperBound(false)
+{
+}
+
+//------------------------------------------------------------------
+// Compiler
+
+bool SdfProgram::IsLive(const SdfScene& scene, int node) const
+{
+	if (node < 0)
+	{
+		return false;
+	}
+	const SdfNode& n = scene.GetNode(node);
+	return n.enabled && n.type != SdfNodeType::Empty;
+}
+
+void SdfProgram::CollectItems(const SdfScene& scene, int node, std::vector<int>& items) const
+{
+	if (!IsLive(scene, node))
+	{
+		return;
+	}
+	const SdfNode& n = scene.GetNode(node);
+	if (n.type == SdfNodeType::Union)
+	{
+		for (int child : n.children)
+		{
+			CollectItems(scene, child, items);
+		}
+	}
+	else
+	{
+		items.push_back(node);
+	}
+}
+
+int SdfProgram::AllocatePoint()
+{
+	if (!m_freePoints.empty())
+	{
+		int reg = m_freePoints.back();
+		m_freePoints.pop_back();
+		return reg;
+	}
+	if (m_pointRegisters >= SdfMaxRegisters)
+	{
+		throw std::length_error("SdfProgram: scene needs more point registers than SdfMaxRegisters");
+	}
+	return m_pointRegisters++;
+}
+
+int SdfProgram::AllocateDistance()
+{
+	if (!m_freeDistances.empty())
+	{
+		int reg = m_freeDistances.back();
+		m_freeDistances.pop_back();
+		return reg;
+	}
+	if (m_distanceRegisters >= SdfMaxRegisters)
+	{
+		throw std::length_error("SdfProgram: scene needs more distance registers than SdfMaxRegisters");
+	}
+	return m_distanceRegisters++;
+}
+
+void SdfProgram::FreePoint(int reg)
+{
+	// Point register 0 holds the (prefix transformed) input and lives for the whole program.
+	if (reg > 0)
+	{
+		m_freePoints.push_back(reg);
+	}
+}
+
+void SdfProgram::FreeDistance(int reg)
+{
+	m_freeDistances.push_back(reg);
+}
+
+uint32_t SdfProgram::AddConstants(const float3& offset, const float* params, int count)
+{
+	uint32_t first = static_cast<uint32_t>(m_constants.size());
+	m_constants.push_back(offset.x);
+	m_constants.push_back(offset.y);
+	m_constants.push_back(offset.z);
+	m_constants.insert(m_constants.end(), params, params + count);
+	return first;
+}
+
+uint32_t SdfProgram::AddWave(const float3& offset, const SdfWave& wave)
+{
+	float c[WaveConstantCount] = { wave.amplitude, static_cast<float>(wave.terms) };
+	for (int k = 0; k < 3; k++)
+	{
+		c[2 + k * 4 + 0] = wave.frequency[k].x;
+		c[2 + k * 4 + 1] = wave.frequency[k].y;
+		c[2 + k * 4 + 2] = wave.frequency[k].z;
+		c[2 + k * 4 + 3] = wave.timeScale[k];
+	}
+	return AddConstants(offset, c, WaveConstantCount);
+}
+
+int SdfProgram::SharePoint(SdfOp op, uint32_t constants)
+{
+	const int count = (op == SdfOp::DomainWave) ? 3 + WaveConstantCount : 6;
+	for (size_t i = 0; i < m_shared.size(); i++)
+	{
+		const SdfInstruction& instruction = m_shared[i];
+		if (instruction.op == op &&
+			std::equal(m_constants.begin() + constants, m_constants.begin() + constants + count, m_constants.begin() + instruction.constants))
+		{
+			m_itemShared |= 1u << i;
+			return instruction.dst;
+		}
+	}
+
+	if (m_pointRegisters >= SdfMaxRegisters)
+	{
+		throw std::length_error("SdfProgram: scene needs more point registers than SdfMaxRegisters");
+	}
+	int reg = m_pointRegisters++;
+	m_reservedPoints.push_back(reg);
+
+	SdfInstruction instruction;
+	instruction.op = op;
+	instruction.dst = static_cast<uint8_t>(reg);
+	instruction.a = 0;
+	instruction.b = 0;
+	instruction.unite = false;
+	instruction.upperBound = false;
+	instruction.constants = constants;
+	instruction.material = 0.0f;
+	m_itemShared |= 1u << m_shared.size();
+	m_shared.push_back(instruction);
+	return reg;
+}
+
+void SdfProgram::Append(SdfOp op, int dst, int a, int b, uint32_t constants, float material)
+{
+	SdfInstruction instruction;
+	instruction.op = op;
+	instruction.dst = static_cast<uint8_t>(dst);
+	instruction.a = static_cast<uint8_t>(a);
+	instruction.b = static_cast<uint8_t>(b);
+	instruction.unite = false;
+	instruction.upperBound = m_upperBound;
+	instruction.constants = constants;
+	instruction.material = material;
+	m_instructions.push_back(instruction);
+}
+
+// Returns the distance register holding the node's result, or -1 if the subtree is empty.
+// Code emitted for a subtree that turns out to contribute nothing is dropped again.
+int SdfProgram::Emit(const SdfScene& scene, int node, int point, const float3& offset, float material)
+{
+	size_t mark = m_instructions.size();
+	int result = EmitNode(scene, node, point, offset, material);
+	if (result < 0)
+	{
+		m_instructions.resize(mark);
+	}
+	return result;
+}
+
+int SdfProgram::EmitNode(const SdfScene& scene, int node, int point, const float3& offset, float material)
+{
+	if (!IsLive(scene, node))
+	{
+		return -1;
+	}
+
+	const SdfNode& n = scene.GetNode(node);
+
+	if (SdfScene::IsPrimitive(n.type))
+	{
+		int dst = AllocateDistance();
+		SdfOp op = static_cast<SdfOp>(static_cast<int>(n.type) - static_cast<int>(SdfNodeType::Sphere) + static_cast<int>(SdfOp::Sphere));
+		// The point's slack is in the units of the scaled distance: a Scale below 1 stands for a
+		// field that may change faster than 1 per unit, so the primitive subtracts slack / scale
+		// and the scaled result comes out exactly slack short. Scales above 1 already shrink it.
+		// Under a Subtract's right-hand operand the factor is negative and the slack is added.
+		float k[PrimitiveConstantCount];
+		std::copy(n.params, n.params + 8, k);
+		k[SlackFactorConstant] = (m_upperBound ? -1.0f : 1.0f) / std::min(m_distanceScale, 1.0f);
+		Append(op, dst, point, 0, AddConstants(offset, k, PrimitiveConstantCount), (material >= 0.0f) ? material : 0.0f);
+		return dst;
+	}
+
+	switch (n.type)
+	{
+	case SdfNodeType::Translate:
+		// Folded: the offset is carried down and applied by whichever instruction reads the point.
+		return Emit(scene, n.children[0], point, offset + float3(n.params[0], n.params[1], n.params[2]), material);
+
+	case SdfNodeType::Twist:
+	case SdfNodeType::Repeat:
+	case SdfNodeType::RepeatXZ:
+	case SdfNodeType::DomainWave:
+	{
+		if (n.type == SdfNodeType::DomainWave && n.wave.amplitude == 0.0f)
+		{
+			return Emit(scene, n.children[0], point, offset, material);
+		}
+		SdfOp op = (n.type == SdfNodeType::Twist) ? SdfOp::Twist :
+			(n.type == SdfNodeType::Repeat) ? SdfOp::Repeat :
+			(n.type == SdfNodeType::RepeatXZ) ? SdfOp::RepeatXZ : SdfOp::DomainWave;
+		uint32_t constants = (op == SdfOp::DomainWave) ? AddWave(offset, n.wave) : AddConstants(offset, n.params, 3);
+		if (point == 0)
+		{
+			// Transforms of the input point are shared between terms (the six legs all wobble the
+			// same way), so they are computed once in the prefix.
+			int shared = SharePoint(op, constants);
+			return Emit(scene, n.children[0], shared, float3(), material);
+		}
+		int q = AllocatePoint();
+		Append(op, q, point, 0, constants, 0.0f);
+		int result = Emit(scene, n.children[0], q, float3(), material);
+		FreePoint(q);
+		return result;
+	}
+
+	case SdfNodeType::Scale:
+	{
+		// Collapse chains of scales into a single multiply.
+		float factor = n.params[0];
+		int child = n.children[0];
+		while (IsLive(scene, child) && scene.GetNode(child).type == SdfNodeType::Scale)
+		{
+			factor *= scene.GetNode(child).params[0];
+			child = scene.GetNode(child).children[0];
+		}
+		const float outerScale = m_distanceScale;
+		m_distanceScale *= factor;
+		int d = Emit(scene, child, point, offset, material);
+		m_distanceScale = outerScale;
+		if (d >= 0 && factor != 1.0f)
+		{
+			Append(SdfOp::Scale, d, d, 0, AddConstants(float3(), &factor, 1), 0.0f);
+		}
+		return d;
+	}
+
+	case SdfNodeType::DistanceWave:
+	{
+		int d = Emit(scene, n.children[0], point, offset, material);
+		if (d >= 0 && n.wave.amplitude != 0.0f)
+		{
+			Append(SdfOp::DistanceWave, d, d, point, AddWave(offset, n.wave), 0.0f);
+		}
+		return d;
+	}
+
+	case SdfNodeType::Material:
+		// The outermost material wins, as with float2(d, id) wrapping in the shaders.
+		return Emit(scene, n.children[0], point, offset, (material >= 0.0f) ? material : n.material);
+
+	case SdfNodeType::Union:
+	{
+		int result = -1;
+		for (int child : n.children)
+		{
+			const size_t mark = m_instructions.size();
+			int d = Emit(scene, child, point, offset, material);
+			if (d < 0)
+			{
+				continue;
+			}
+			if (result < 0)
+			{
+				result = d;
+				continue;
+			}
+			// A child that is a lone primitive unions itself in, which saves a dispatch.
+			SdfInstruction& last = m_instructions.back();
+			if (m_instructions.size() == mark + 1 && last.op <= SdfOp::Mandelbulb)
+			{
+				last.b = static_cast<uint8_t>(result);
+				last.unite = true;
+			}
+			else
+			{
+				Append(SdfOp::Union, result, result, d, 0, 0.0f);
+			}
+			FreeDistance(d);
+		}
+		return result;
+	}
+
+	case SdfNodeType::Subtract:
+	{
+		int a = Emit(scene, n.children[0], point, offset, material);
+		if (a < 0)
+		{
+			return -1;
+		}
+		// opS(a, b) = max(-b, a) shrinks as b grows, so b must never come out shorter than it is.
+		m_upperBound = !m_upperBound;
+		int b = Emit(scene, n.children[1], point, offset, material);
+		m_upperBound = !m_upperBound;
+		if (b >= 0)
+		{
+			Append(SdfOp::Subtract, a, a, b, 0, 0.0f);
+			FreeDistance(b);
+		}
+		return a;
+	}
+
+	case SdfNodeType::SmoothMin:
+	case SdfNodeType::SmoothMax:
+	{
+		bool isMin = (n.type == SdfNodeType::SmoothMin);
+		int a = Emit(scene, n.children[0], point, offset, material);
+		int b = Emit(scene, n.children[1], point, offset, material);
+		if (a < 0 || b < 0)
+		{
+			// Blending with empty space: softMin2 returns the other operand, softMax2 returns empty space.
+			if (isMin)
+			{
+				return (a >= 0) ? a : b;
+			}
+			if (a >= 0) FreeDistance(a);
+			if (b >= 0) FreeDistance(b);
+			return -1;
+		}
+		if (n.params[0] == 0.0f && n.params[1] == 0.0f)
+		{
+			Append(isMin ? SdfOp::Min : SdfOp::Max, a, a, b, 0, 0.0f);
+		}
+		else
+		{
+			Append(isMin ? SdfOp::SmoothMin : SdfOp::SmoothMax, a, a, b, AddConstants(float3(), n.params, 2), 0.0f);
+		}
+		FreeDistance(b);
+		return a;
+	}
+
+	default:
+		return -1;
+	}
+}
+
+void SdfProgram::Compile(const SdfScene& scene)
+{
+	m_instructions.clear();
+	m_constants.clear();
+	m_items.clear();
+	m_pointRegisters = 1;
+	m_distanceRegisters = 0;
+	m_sharedCount = 0;
+	m_primitiveCount = 0;
+	m_freePoints.clear();
+	m_freeDistances.clear();
+	m_shared.clear();
+	m_reservedPoints.clear();
+
+	// Domain transforms above the top level union (the xz cell repetition in InfiniteShapesPS)
+	// are shared by every term, so they run once, in place, on the input register.
+	int root = scene.GetRoot();
+	float3 offset;
+	m_prefixSignature = 0;
+	while (IsLive(scene, root) && SdfScene::IsDomainTransform(scene.GetNode(root).type))
+	{
+		const SdfNode& n = scene.GetNode(root);
+		m_prefixSignature = m_prefixSignature * 31 + scene.Hash(root, false);
+		if (n.type == SdfNodeType::Translate)
+		{
+			offset += float3(n.params[0], n.params[1], n.params[2]);
+		}
+		else if (n.type != SdfNodeType::DomainWave || n.wave.amplitude != 0.0f)
+		{
+			SdfOp op = (n.type == SdfNodeType::Twist) ? SdfOp::Twist :
+				(n.type == SdfNodeType::Repeat) ? SdfOp::Repeat :
+				(n.type == SdfNodeType::RepeatXZ) ? SdfOp::RepeatXZ : SdfOp::DomainWave;
+			uint32_t constants = (op == SdfOp::DomainWave) ? AddWave(offset, n.wave) : AddConstants(offset, n.params, 3);
+			Append(op, 0, 0, 0, constants, 0.0f);
+			offset = float3();
+		}
+		root = n.children[0];
+	}
+	m_prefixCount = static_cast<uint32_t>(m_instructions.size());
+
+	std::vector<int> items;
+	CollectItems(scene, root, items);
+	for (int node : items)
+	{
+		m_freePoints.clear();
+		for (int reg = m_pointRegisters - 1; reg > 0; reg--)
+		{
+			if (std::find(m_reservedPoints.begin(), m_reservedPoints.end(), reg) == m_reservedPoints.end())
+			{
+				m_freePoints.push_back(reg);
+			}
+		}
+		m_freeDistances.clear();
+		for (int reg = m_distanceRegisters - 1; reg >= 0; reg--)
+		{
+			m_freeDistances.push_back(reg);
+		}
+
+		SdfProgramItem item;
+		item.first = static_cast<uint32_t>(m_instructions.size());
+		m_itemShared = 0;
+		int result = Emit(scene, node, 0, offset, -1.0f);
+		item.count = static_cast<uint32_t>(m_instructions.size()) - item.first;
+		if (result >= 0)
+		{
+			item.result = static_cast<uint8_t>(result);
+			item.shared = m_itemShared;
+			item.primitives = 0;
+			for (uint32_t pc = item.first; pc < item.first + item.count; pc++)
+			{
+				if (m_instructions[pc].op <= SdfOp::Mandelbulb)
+				{
+					item.primitives++;
+				}
+			}
+			m_primitiveCount += item.primitives;
+			item.bound = SdfBounds::Compute(scene, node);
+			item.bound.box = item.bound.box.Translated(offset);
+			item.signature = scene.Hash(node);
+			m_items.push_back(item);
+		}
+	}
+
+	// Shared transforms sit between the prefix and the first term. Evaluate() runs all of them,
+	// RunItem() only the ones the term reads.
+	m_instructions.insert(m_instructions.begin() + m_prefixCount, m_shared.begin(), m_shared.end());
+	for (SdfProgramItem& item : m_items)
+	{
+		item.first += static_cast<uint32_t>(m_shared.size());
+	}
+	m_sharedCount = static_cast<uint32_t>(m_shared.size());
+
+	m_freePoints.clear();
+	m_freeDistances.clear();
+	m_shared.clear();
+	m_reservedPoints.clear();
+}
+
+//------------------------------------------------------------------
+// Interpreter
+
+template <typename Registers>
+void SdfProgram::Run(Registers& r, uint32_t first, uint32_t count, const SdfContext& context) const
+{
+	const int Lanes = Registers::LaneCount;
+	for (uint32_t pc = first; pc < first + count; pc++)
+	{
+		const SdfInstruction& ins = m_instructions[pc];
+		const float* c = m_constants.data() + ins.constants;
+		const float* k = c + 3;
+		auto* d = r.d[ins.dst];
+		float* m = r.m[ins.dst];
+		const int a = ins.a;
+
+		switch (ins.op)
+		{
+		case SdfOp::Sphere:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdSphere(r.Point(a, i, c), k[0]); m[i] = ins.material; }
+			break;
+		case SdfOp::Box:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdBox(r.Point(a, i, c), float3(k[0], k[1], k[2])); m[i] = ins.material; }
+			break;
+		case SdfOp::Ellipsoid:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdEllipsoid(r.Point(a, i, c), float3(k[0], k[1], k[2])); m[i] = ins.material; }
+			break;
+		case SdfOp::RoundBox:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdRoundBox(r.Point(a, i, c), float3(k[0], k[1], k[2]), k[3]); m[i] = ins.material; }
+			break;
+		case SdfOp::Torus:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdTorus(r.Point(a, i, c), float2(k[0], k[1])); m[i] = ins.material; }
+			break;
+		case SdfOp::Torus82:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdTorus82(r.Point(a, i, c), float2(k[0], k[1])); m[i] = ins.material; }
+			break;
+		case SdfOp::Torus88:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdTorus88(r.Point(a, i, c), float2(k[0], k[1])); m[i] = ins.material; }
+			break;
+		case SdfOp::HexPrism:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdHexPrism(r.Point(a, i, c), float2(k[0], k[1])); m[i] = ins.material; }
+			break;
+		case SdfOp::Capsule:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdCapsule(r.Point(a, i, c), float3(k[0], k[1], k[2]), float3(k[3], k[4], k[5]), k[6]); m[i] = ins.material; }
+			break;
+		case SdfOp::RoundCone:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdRoundCone(r.Point(a, i, c), float3(k[0], k[1], k[2]), float3(k[3], k[4], k[5]), k[6], k[7]); m[i] = ins.material; }
+			break;
+		case SdfOp::Cylinder:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdCylinder(r.Point(a, i, c), float2(k[0], k[1])); m[i] = ins.material; }
+			break;
+		case SdfOp::CappedCone:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdCappedCone(r.Point(a, i, c), k[0], k[1], k[2]); m[i] = ins.material; }
+			break;
+		case SdfOp::Octahedron:
+			for (int i = 0; i < Lanes; i++) { d[i] = sdOctahedron(r.Point(a, i, c), k[0]); m[i] = ins.material; }
+			break;
+		case SdfOp::Sierpinski:
+			RunSierpinski(r, ins, c, ins.upperBound ? 0.0f : context.footprint);
+			break;
+		case SdfOp::Mandelbulb:
+			RunMandelbulb(r, ins, c, ins.upperBound ? 0.0f : context.footprint);
+			break;
+
+		case SdfOp::Twist:
+			for (int i = 0; i < Lanes; i++) { r.SetPoint(ins.dst, i, opTwist(r.Point(a, i, c))); }
+			r.slack[ins.dst] = r.slack[a];
+			break;
+		case SdfOp::Repeat:
+			for (int i = 0; i < Lanes; i++) { r.SetPoint(ins.dst, i, opRep(r.Point(a, i, c), float3(k[0], k[1], k[2]))); }
+			r.slack[ins.dst] = r.slack[a];
+			break;
+		case SdfOp::RepeatXZ:
+			for (int i = 0; i < Lanes; i++)
+			{
+				auto p = r.Point(a, i, c);
+				p.x = (frac(p.x / k[0]) - 0.5f) * k[0];
+				p.z = (frac(p.z / k[0]) - 0.5f) * k[0];
+				r.SetPoint(ins.dst, i, p);
+			}
+			r.slack[ins.dst] = r.slack[a];
+			break;
+		case SdfOp::DomainWave:
+			if (Sqrt3 * std::fabs(k[0]) <= context.footprint)
+			{
+				// The child is evaluated at the undisplaced point; its distances can be off by
+				// as much as the point would have moved.
+				for (int i = 0; i < Lanes; i++) { r.SetPoint(ins.dst, i, r.Point(a, i, c)); }
+				r.slack[ins.dst] = r.slack[a] + Sqrt3 * std::fabs(k[0]);
+				break;
+			}
+			for (int i = 0; i < Lanes; i++)
+			{
+				auto p = r.Point(a, i, c);
+				auto w = EvaluateWave(k, p, context.time);
+				p.x += w;
+				p.y += w;
+				p.z += w;
+				r.SetPoint(ins.dst, i, p);
+			}
+			r.slack[ins.dst] = r.slack[a];
+			break;
+
+		case SdfOp::Scale:
+			for (int i = 0; i < Lanes; i++) { d[i] = r.d[a][i] * k[0]; }
+			break;
+		case SdfOp::DistanceWave:
+			if (std::fabs(k[0]) <= context.footprint)
+			{
+				const float bound = ins.upperBound ? std::fabs(k[0]) : -std::fabs(k[0]);
+				for (int i = 0; i < Lanes; i++) { d[i] = r.d[a][i] + bound; }
+				break;
+			}
+			for (int i = 0; i < Lanes; i++) { d[i] = r.d[a][i] + EvaluateWave(k, r.Point(ins.b, i, c), context.time); }
+			break;
+
+		case SdfOp::Union:
+			for (int i = 0; i < Lanes; i++)
+			{
+				bool takeB = r.d[ins.b][i] < r.d[a][i];
+				d[i] = takeB ? r.d[ins.b][i] : r.d[a][i];
+				m[i] = takeB ? r.m[ins.b][i] : r.m[a][i];
+			}
+			break;
+		case SdfOp::Min:
+			for (int i = 0; i < Lanes; i++) { d[i] = std::min(r.d[a][i], r.d[ins.b][i]); }
+			break;
+		case SdfOp::Max:
+			for (int i = 0; i < Lanes; i++) { d[i] = std::max(r.d[a][i], r.d[ins.b][i]); }
+			break;
+		case SdfOp::Subtract:
+			for (int i = 0; i < Lanes; i++) { d[i] = opS(r.d[a][i], r.d[ins.b][i]); }
+			break;
+		case SdfOp::SmoothMin:
+		{
+			float radius = k[0] + k[1] * std::fabs(std::sin(context.time));
+			for (int i = 0; i < Lanes; i++) { d[i] = softMin2(r.d[a][i], r.d[ins.b][i], radius); }
+			break;
+		}
+		case SdfOp::SmoothMax:
+		{
+			float radius = k[0] + k[1] * std::fabs(std::sin(context.time));
+			for (int i = 0; i < Lanes; i++) { d[i] = softMax2(r.d[a][i], r.d[ins.b][i], radius); }
+			break;
+		}
+		}
+
+		if (ins.op <= SdfOp::Mandelbulb)
+		{
+			if (r.slack[a] > 0.0f)
+			{
+				for (int i = 0; i < Lanes; i++) { d[i] = d[i] - r.slack[a] * k[SlackFactorConstant]; }
+			}
+			if (ins.unite)
+			{
+				auto* u = r.d[ins.b];
+				float* um = r.m[ins.b];
+				for (int i = 0; i < Lanes; i++)
+				{
+					bool take = d[i] < u[i];
+					u[i] = take ? d[i] : u[i];
+					um[i] = take ? m[i] : um[i];
+				}
+			}
+		}
+	}
+}
+
+template <int Lanes>
+void SdfProgram::EvaluateLanes(const float3* points, float2* results, const SdfContext& context, uint32_t first) const
+{
+	SdfRegisters<Lanes> r;
+	for (int i = 0; i < Lanes; i++)
+	{
+		r.SetPoint(0, i, points[i]);
+	}
+
+	Run(r, first, m_prefixCount + m_sharedCount - first, context);
+
+	float bestD[Lanes];
+	float bestM[Lanes];
+	for (int i = 0; i < Lanes; i++)
+	{
+		bestD[i] = EmptyDistance;
+		bestM[i] = 0.0f;
+	}
+
+	for (const SdfProgramItem& item : m_items)
+	{
+		Run(r, item.first, item.count, context);
+		for (int i = 0; i < Lanes; i++)
+		{
+			bool take = r.d[item.result][i] < bestD[i];
+			bestD[i] = take ? r.d[item.result][i] : bestD[i];
+			bestM[i] = take ? r.m[item.result][i] : bestM[i];
+		}
+	}
+
+	for (int i = 0; i < Lanes; i++)
+	{
+		results[i] = float2(bestD[i], bestM[i]);
+	}
+}
+
+void SdfProgram::Evaluate(const float3* points, float2* results, int count, const SdfContext& context) const
+{
+	EvaluateBatch(points, results, count, context, 0);
+}
+
+void SdfProgram::EvaluateLocal(const float3* points, float2* results, int count, const SdfContext& context) const
+{
+	EvaluateBatch(points, results, count, context, m_prefixCount);
+}
+
+void SdfProgram::EvaluateBatch(const float3* points, float2* results, int count, const SdfContext& context, uint32_t first) const
+{
+	int i = 0;
+	for (; i + SdfLanes <= count; i += SdfLanes)
+	{
+		EvaluateLanes<SdfLanes>(points + i, results + i, context, first);
+	}
+
+	if (i < count)
+	{
+		// Pad the tail packet by repeating the last point.
+		float3 tailPoints[SdfLanes];
+		float2 tailResults[SdfLanes];
+		for (int lane = 0; lane < SdfLanes; lane++)
+		{
+			tailPoints[lane] = points[std::min(i + lane, count - 1)];
+		}
+		EvaluateLanes<SdfLanes>(tailPoints, tailResults, context, first);
+		for (int lane = 0; i + lane < count; lane++)
+		{
+			results[i + lane] = tailResults[lane];
+		}
+	}
+}
+
+float2 SdfProgram::Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	float2 result;
+	EvaluateLanes<1>(&point, &result, context, 0);
+	if (stats)
+	{
+		stats->mapCalls++;
+		stats->primitiveEvaluations += m_primitiveCount;
+	}
+	return result;
+}
+
+float2 SdfProgram::MapLocal(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	float2 result;
+	EvaluateLanes<1>(&point, &result, context, m_prefixCount);
+	if (stats)
+	{
+		stats->mapCalls++;
+		stats->primitiveEvaluations += m_primitiveCount;
+	}
+	return result;
+}
+
+float3 SdfProgram::ToLocal(const float3& point, const SdfContext& context) const
+{
+	SdfRegisters<1> r;
+	r.SetPoint(0, 0, point);
+	RunPrefix(r, context);
+	return float3(r.px[0][0], r.py[0][0], r.pz[0][0]);
+}
+
+template <typename Registers>
+void SdfProgram::RunPrefix(Registers& registers, const SdfContext& context) const
+{
+	Run(registers, 0, m_prefixCount, context);
+}
+
+template <typename Registers>
+void SdfProgram::RunItem(Registers& registers, int item, const SdfContext& context, uint32_t& sharedDone) const
+{
+	const SdfProgramItem& it = m_items[item];
+	for (uint32_t missing = it.shared & ~sharedDone; missing != 0; missing &= missing - 1)
+	{
+		uint32_t bit = 0;
+		while (!(missing & (1u << bit)))
+		{
+			bit++;
+		}
+		Run(registers, m_prefixCount + bit, 1, context);
+	}
+	sharedDone |= it.shared;
+	Run(registers, it.first, it.count, context);
+}
+
+template void SdfProgram::RunPrefix(SdfRegisters<1>&, const SdfContext&) const;
+template void SdfProgram::RunPrefix(SdfRegisters<SdfLanes>&, const SdfContext&) const;
+template void SdfProgram::RunItem(SdfRegisters<1>&, int, const SdfContext&, uint32_t&) const;
+template void SdfProgram::RunItem(SdfRegisters<SdfLanes>&, int, const SdfContext&, uint32_t&) const;
+// 16 lane packets for SdfPacketMarcher.
+template void SdfProgram::RunPrefix(SdfRegisters<16>&, const SdfContext&) const;
+template void SdfProgram::RunItem(SdfRegisters<16>&, int, const SdfContext&, uint32_t&) const;
+
+//------------------------------------------------------------------
+// Gradients
+
+float3 SdfProgram::Gradient(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	SdfDualRegisters r;
+	r.SetPoint(0, 0, dual3::Seed(point));
+	Run(r, 0, m_prefixCount + m_sharedCount, context);
+
+	dual best(EmptyDistance);
+	for (const SdfProgramItem& item : m_items)
+	{
+		Run(r, item.first, item.count, context);
+		best = min(best, r.d[item.result][0]);
+	}
+
+	if (stats)
+	{
+		stats->mapCalls++;
+		stats->primitiveEvaluations += m_primitiveCount;
+	}
+	return best.g;
+}
+
+float3 SdfProgram::ItemGradient(const float3& point, int item, const SdfContext& context) const
+{
+	SdfDualRegisters r;
+	r.SetPoint(0, 0, dual3::Seed(point));
+	RunPrefix(r, context);
+	uint32_t sharedDone = 0;
+	RunItem(r, item, context, sharedDone);
+	return r.d[m_items[item].result][0].g;
+}
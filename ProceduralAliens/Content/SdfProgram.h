@@ -0,0 +1,223 @@
+﻿#pragma once
+
+#include "SdfScene.h"
+#include "SdfField.h"
+#include "SdfBounds.h"
+#include "SdfDual.h"
+#include <cstdint>
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// Number of points the interpreter evaluates per instruction.
+	static const int SdfLanes = 8;
+	static const int SdfMaxRegisters = 32;
+
+	enum class SdfOp : uint8_t
+	{
+		// Primitives: dist[dst] = sd(point[a] - offset), material = instruction material.
+		Sphere,
+		Box,
+		Ellipsoid,
+		RoundBox,
+		Torus,
+		Torus82,
+		Torus88,
+		HexPrism,
+		Capsule,
+		RoundCone,
+		Cylinder,
+		CappedCone,
+		Octahedron,
+		Sierpinski,
+		Mandelbulb,
+
+		// Domain transforms: point[dst] = f(point[a] - offset). Plain translations never need an
+		// instruction, they are folded into the offset of the next instruction that reads the point.
+		// With a footprint in the context, waves whose displacement is smaller are skipped.
+		Twist,
+		Repeat,
+		RepeatXZ,
+		DomainWave,
+
+		// Distance modifiers: dist[dst] = f(dist[a]) (DistanceWave also reads point[b]). A wave under
+		// the footprint is replaced by its most negative value, -|amplitude| (or +|amplitude| for an
+		// upperBound instruction).
+		// Material nodes never reach the bytecode, their id is pushed down into the primitives.
+		Scale,
+		DistanceWave,
+
+		// Combinators: dist[dst] = f(dist[a], dist[b]).
+		Union,
+		Min,
+		Max,
+		Subtract,
+		SmoothMin,
+		SmoothMax
+	};
+
+	struct SdfInstruction
+	{
+		SdfOp op;
+		uint8_t dst;
+		uint8_t a;
+		uint8_t b;
+		// Primitives only: the Union that would follow is folded in, dist[b] = opU(dist[b], dist[dst]).
+		bool unite;
+		// Inside the subtracted operand of an odd number of Subtracts, where a shorter distance makes
+		// the result longer. The footprint may only lengthen distances here: point slack is added
+		// instead of subtracted, a skipped DistanceWave adds |amplitude| and fractals keep every
+		// iteration.
+		bool upperBound;
+		uint32_t constants; // offset into the program constant pool
+		float material;
+	};
+
+	// One term of the top level union. Terms are evaluated independently and combined with opU,
+	// which lets later passes cull or cache them individually.
+	struct SdfProgramItem
+	{
+		uint32_t first;
+		uint32_t count;
+		uint8_t result;
+		uint32_t shared;     // bit i set if the term reads shared transform i
+		uint32_t primitives;
+		SdfBound bound; // in the frame of point register 0 after the prefix
+		uint64_t signature; // SdfScene::Hash() of the term, for finding what an edit changed
+	};
+
+	// Structure of arrays register file for Lanes points.
+	template <int Lanes>
+	struct SdfRegisters
+	{
+		static const int LaneCount = Lanes;
+
+		float px[SdfMaxRegisters][Lanes];
+		float py[SdfMaxRegisters][Lanes];
+		float pz[SdfMaxRegisters][Lanes];
+		float d[SdfMaxRegisters][Lanes];
+		float m[SdfMaxRegisters][Lanes];
+		// Per point register, how far the domain waves dropped for the footprint on the way to it
+		// may have moved a surface. Distances computed from the point are shortened by it.
+		float slack[SdfMaxRegisters] = {};
+
+		// Reads point register r for lane i, minus the translation folded into the instruction.
+		Hlsl::float3 Point(int r, int i, const float* offset) const
+		{
+			return Hlsl::float3(px[r][i] - offset[0], py[r][i] - offset[1], pz[r][i] - offset[2]);
+		}
+
+		void SetPoint(int r, int i, const Hlsl::float3& p)
+		{
+			px[r][i] = p.x;
+			py[r][i] = p.y;
+			pz[r][i] = p.z;
+		}
+	};
+
+	// Register file for one point carried as dual numbers, so the same bytecode produces the
+	// distance and its gradient in a single pass.
+	struct SdfDualRegisters
+	{
+		static const int LaneCount = 1;
+
+		Hlsl::dual3 p[SdfMaxRegisters][1];
+		Hlsl::dual d[SdfMaxRegisters][1];
+		float m[SdfMaxRegisters][1];
+		float slack[SdfMaxRegisters] = {};
+
+		Hlsl::dual3 Point(int r, int i, const float* offset) const
+		{
+			return p[r][i] - Hlsl::float3(offset[0], offset[1], offset[2]);
+		}
+
+		void SetPoint(int r, int i, const Hlsl::dual3& point)
+		{
+			p[r][i] = point;
+		}
+	};
+
+	// A scene compiled to flat, register allocated bytecode. Translations are folded into the
+	// primitives that use them, nested materials and scales are collapsed and disabled or
+	// empty subtrees are removed before any code is emitted.
+	class SdfProgram : public SdfField
+	{
+	public:
+		SdfProgram();
+
+		void Compile(const SdfScene& scene);
+
+		// Evaluates count points, SdfLanes at a time. Results are (distance, material) like map().
+		void Evaluate(const Hlsl::float3* points, Hlsl::float2* results, int count, const SdfContext& context) const;
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+
+		// The local frame is the frame of point register 0 after the prefix, i.e. inside the repeated
+		// cell for InfiniteShapes. Item bounds are in this frame; the Local variants skip the prefix.
+		Hlsl::float3 ToLocal(const Hlsl::float3& point, const SdfContext& context) const;
+		void EvaluateLocal(const Hlsl::float3* points, Hlsl::float2* results, int count, const SdfContext& context) const;
+		Hlsl::float2 MapLocal(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const;
+
+		// Distance gradient from one dual number pass instead of four finite difference taps.
+		// ItemGradient differentiates a single term, which is all a normal needs once the nearest
+		// term is known (the gradient of a union is the gradient of the term that wins).
+		virtual Hlsl::float3 Gradient(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+		Hlsl::float3 ItemGradient(const Hlsl::float3& point, int item, const SdfContext& context) const;
+
+		// Building blocks for evaluators that pick which terms to run (SdfBvh). Load the points
+		// into register 0, run the prefix once, then any subset of items; an item's result is
+		// left in distance register GetItem(i).result. sharedDone starts at 0 for each point and
+		// tracks which shared transforms have already been computed. Registers is SdfRegisters<Lanes>
+		// or SdfDualRegisters.
+		template <typename Registers> void RunPrefix(Registers& registers, const SdfContext& context) const;
+		template <typename Registers> void RunItem(Registers& registers, int item, const SdfContext& context, uint32_t& sharedDone) const;
+		const SdfProgramItem& GetItem(int item) const { return m_items[item]; }
+
+		int GetInstructionCount() const { return static_cast<int>(m_instructions.size()); }
+		// Hash of the prefix nodes, which every term's code and bound depend on.
+		uint64_t GetPrefixSignature() const { return m_prefixSignature; }
+		int GetItemCount() const { return static_cast<int>(m_items.size()); }
+		int GetPrimitiveCount() const { return static_cast<int>(m_primitiveCount); }
+		int GetPointRegisterCount() const { return m_pointRegisters; }
+		int GetDistanceRegisterCount() const { return m_distanceRegisters; }
+
+	private:
+		template <typename Registers> void Run(Registers& registers, uint32_t first, uint32_t count, const SdfContext& context) const;
+		template <int Lanes> void EvaluateLanes(const Hlsl::float3* points, Hlsl::float2* results, const SdfContext& context, uint32_t first) const;
+		void EvaluateBatch(const Hlsl::float3* points, Hlsl::float2* results, int count, const SdfContext& context, uint32_t first) const;
+
+		// Code generation. 'offset' is a pending translation not yet applied to point register 'point';
+		// every instruction that reads a point subtracts its own folded offset first.
+		int Emit(const SdfScene& scene, int node, int point, const Hlsl::float3& offset, float material);
+		int EmitNode(const SdfScene& scene, int node, int point, const Hlsl::float3& offset, float material);
+		int SharePoint(SdfOp op, uint32_t constants);
+		void Append(SdfOp op, int dst, int a, int b, uint32_t constants, float material);
+		uint32_t AddConstants(const Hlsl::float3& offset, const float* params, int count);
+		uint32_t AddWave(const Hlsl::float3& offset, const SdfWave& wave);
+		bool IsLive(const SdfScene& scene, int node) const;
+		void CollectItems(const SdfScene& scene, int node, std::vector<int>& items) const;
+
+		int AllocatePoint();
+		int AllocateDistance();
+		void FreePoint(int reg);
+		void FreeDistance(int reg);
+
+		std::vector<SdfInstruction> m_instructions;
+		std::vector<float> m_constants;
+		std::vector<SdfProgramItem> m_items;
+		uint32_t m_prefixCount;
+		uint64_t m_prefixSignature;
+		uint32_t m_sharedCount;
+		uint32_t m_primitiveCount;
+		int m_pointRegisters;
+		int m_distanceRegisters;
+
+		// Register allocator state, only used while compiling.
+		std::vector<int> m_freePoints;
+		std::vector<int> m_freeDistances;
+		std::vector<SdfInstruction> m_shared;
+		std::vector<int> m_reservedPoints;
+		uint32_t m_itemShared;
+		float m_distanceScale; // product of the Scale nodes around the node being emitted
+		bool m_upperBound;     // SdfInstruction::upperBound for the node being emitted
+	};
+}
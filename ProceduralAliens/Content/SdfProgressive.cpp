@@ -0,0 +1,115 @@
+﻿#include "pch.h"
+#include "SdfProgressive.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	bool SameView(const SdfCamera& a, const SdfCamera& b)
+	{
+		return a.eye.x == b.eye.x && a.eye.y == b.eye.y && a.eye.z == b.eye.z &&
+			a.canvasHalfSize.x == b.canvasHalfSize.x && a.canvasHalfSize.y == b.canvasHalfSize.y &&
+			a.nearPlane == b.nearPlane && a.zoom == b.zoom && a.width == b.width && a.height == b.height;
+	}
+}
+
+SdfProgressive::SdfProgressive(SdfUpsample upsample) :
+	m_upsample(upsample),
+	m_time(0),
+	m_level(0)
+{
+}
+
+void SdfProgressive::Reset()
+{
+	m_level = 0;
+}
+
+bool SdfProgressive::Refine(const SdfRaymarcher& raymarcher, const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (m_level > 0 && (!SameView(camera, m_camera) || context.time != m_time))
+	{
+		Reset();
+	}
+
+	SdfRenderStats levelStats;
+	if (m_level < Levels)
+	{
+		if (m_level == 0)
+		{
+			m_samples.Resize(camera.width, camera.height);
+		}
+		const int stride = GetStride(m_level);
+		raymarcher.RenderInterleaved(camera, context, stride, (m_level == 0) ? 0 : 2 * stride, m_samples, &levelStats);
+		m_camera = camera;
+		m_time = context.time;
+		m_level++;
+	}
+	Fill(GetStride(m_level - 1), image);
+
+	if (stats)
+	{
+		*stats = levelStats;
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	return m_level == Levels;
+}
+
+// Every pixel takes its hit, material and step count from the nearest rendered pixel, so edges
+// stay hard. Bilinear filtering blends the colours of the (up to) four rendered pixels around it,
+// leaving out misses, which have no colour to blend.
+void SdfProgressive::Fill(int stride, SdfImage& image) const
+{
+	const int width = m_samples.width;
+	const int height = m_samples.height;
+	if (stride == 1)
+	{
+		image = m_samples;
+		return;
+	}
+
+	image.Resize(width, height);
+	const int lastX = ((width - 1) / stride) * stride;
+	const int lastY = ((height - 1) / stride) * stride;
+	for (int y = 0; y < height; y++)
+	{
+		const int y0 = std::min((y / stride) * stride, lastY);
+		const int y1 = std::min(y0 + stride, lastY);
+		const float fy = (y1 > y0) ? static_cast<float>(y - y0) / (y1 - y0) : 0.0f;
+		for (int x = 0; x < width; x++)
+		{
+			const int x0 = std::min((x / stride) * stride, lastX);
+			const int x1 = std::min(x0 + stride, lastX);
+			const float fx = (x1 > x0) ? static_cast<float>(x - x0) / (x1 - x0) : 0.0f;
+
+			const int i = y * width + x;
+			const int nearest = ((fy < 0.5f) ? y0 : y1) * width + ((fx < 0.5f) ? x0 : x1);
+			image.t[i] = m_samples.t[nearest];
+			image.material[i] = m_samples.material[nearest];
+			image.steps[i] = m_samples.steps[nearest];
+			if (m_samples.t[nearest] < 0.0f || m_upsample == SdfUpsample::Nearest)
+			{
+				image.colour[i] = m_samples.colour[nearest];
+				continue;
+			}
+
+			const int corners[4] = { y0 * width + x0, y0 * width + x1, y1 * width + x0, y1 * width + x1 };
+			const float weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+			float3 colour(0.0f, 0.0f, 0.0f);
+			float total = 0.0f;
+			for (int corner = 0; corner < 4; corner++)
+			{
+				if (m_samples.t[corners[corner]] >= 0.0f)
+				{
+					colour += m_samples.colour[corners[corner]] * weights[corner];
+					total += weights[corner];
+				}
+			}
+			image.colour[i] = (total > 0.0f) ? colour / total : m_samples.colour[nearest];
+		}
+	}
+}
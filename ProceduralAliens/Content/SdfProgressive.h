@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "SdfRaymarcher.h"
+
+namespace ProceduralAliens
+{
+	// How SdfProgressive fills the pixels it hasn't rendered yet.
+	enum class SdfUpsample
+	{
+		Nearest,
+		Bilinear
+	};
+
+	// Progressive refinement for the CPU raymarcher. Each Refine() renders one more level of an
+	// interleaved pixel order: 1 pixel in 16, then the rest of 1 in 4, then the rest of the frame.
+	// The pixels not rendered yet are filled from the rendered ones, so there is a whole image
+	// after a sixteenth of the work, and the three levels together are exactly the full render.
+	// A new camera or time starts again from the first level.
+	class SdfProgressive
+	{
+	public:
+		static const int Levels = 3;
+
+		SdfProgressive(SdfUpsample upsample = SdfUpsample::Bilinear);
+
+		void Reset();
+		// Renders the next level and writes the filled image. Returns true once every pixel has
+		// been rendered; after that it only copies the finished image until the view changes.
+		bool Refine(const SdfRaymarcher& raymarcher, const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats);
+
+		// Levels rendered so far, 0 after Reset().
+		int GetLevel() const { return m_level; }
+		// Spacing of the pixels rendered by 'level': 4, 2, 1.
+		static int GetStride(int level) { return 1 << (Levels - 1 - level); }
+
+	private:
+		void Fill(int stride, SdfImage& image) const;
+
+		SdfUpsample m_upsample;
+		SdfCamera m_camera;
+		float m_time;
+		SdfImage m_samples;
+		int m_level;
+	};
+}
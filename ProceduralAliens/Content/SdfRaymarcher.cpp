@@ -0,0 +1,942 @@
+﻿#include "pch.h"
+#include "SdfRaymarcher.h"
+#include "SdfAntialias.h"
+#include "SdfPrimitives.h"
+#include <chrono>
+#include <ppl.h>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	// Block sizes of the cone prepass levels, coarse to fine. The last level is followed by
+	// the full resolution march.
+	const int ConeBlockSizes[] = { 16, 4 };
+
+	// A seeded ray starts this fraction of the seed distance before it and gets this many steps
+	// to converge before it is marched again from the start. The way up to there is checked
+	// with the same fraction as its epsilon, in at most SeedCheckSteps.
+	const float SeedBackoff = 0.005f;
+	const int SeedSteps = 12;
+	const int SeedCheckSteps = 24;
+
+	// Listed pixels per parallel work item in RenderSupersampled().
+	const int SupersampleChunk = 64;
+	// G-buffer hits per parallel work item when filling it, and when shading it: a multiple of
+	// every lane count.
+	const int GBufferChunk = 256;
+	const int ShadeChunk = 1024;
+
+	// Joint bilateral upsampling of the visibility terms: a low resolution sample counts for
+	// less the further its depth is from the pixel's, relative to the pixel's depth, and the
+	// more its normal turns away. Below MinUpsampleWeight in all the pixel is evaluated itself,
+	// and so is one whose samples disagree by more than MaxUpsampleSpread on any term: depth and
+	// normal can't see a shadow edge.
+	const float DepthSigma = 0.02f;
+	const float NormalPower = 8.0f;
+	const float MinUpsampleWeight = 0.05f;
+	const float MaxUpsampleSpread = 0.1f;
+}
+
+float3 SdfCamera::RayDirection(float x, float y) const
+{
+	// Pixel centres, y down like SV_POSITION.
+	float2 canvas(
+		((x + 0.5f) / width * 2.0f - 1.0f) * canvasHalfSize.x,
+		(1.0f - (y + 0.5f) / height * 2.0f) * canvasHalfSize.y);
+	float3 pixelPos(zoom * canvas.x, zoom * canvas.y, -nearPlane);
+	return normalize(pixelPos - eye);
+}
+
+float SdfCamera::PixelRadius(float x, float y) const
+{
+	float2 canvas(
+		((x + 0.5f) / width * 2.0f - 1.0f) * canvasHalfSize.x,
+		(1.0f - (y + 0.5f) / height * 2.0f) * canvasHalfSize.y);
+	float3 pixelPos(zoom * canvas.x, zoom * canvas.y, -nearPlane);
+	return 0.5f * zoom * (2.0f * canvasHalfSize.x / width) / length(pixelPos - eye);
+}
+
+bool SdfCamera::Project(const float3& position, float2& pixel) const
+{
+	float3 v = position - eye;
+	float planeZ = -nearPlane - eye.z;
+	if (v.z * planeZ <= 0.0f)
+	{
+		return false;
+	}
+	float3 onPlane = eye + v * (planeZ / v.z);
+	float2 canvas(onPlane.x / (zoom * canvasHalfSize.x), onPlane.y / (zoom * canvasHalfSize.y));
+	pixel = float2((canvas.x + 1.0f) * 0.5f * width - 0.5f, (1.0f - canvas.y) * 0.5f * height - 0.5f);
+	return true;
+}
+
+void SdfImage::Resize(int w, int h)
+{
+	width = w;
+	height = h;
+	colour.assign(w * h, float3(0.0f, 0.0f, 0.0f));
+	t.assign(w * h, -1.0f);
+	material.assign(w * h, -1.0f);
+	steps.assign(w * h, 0);
+}
+
+void SdfRenderStats::Add(const SdfRenderStats& other)
+{
+	rays += other.rays;
+	hits += other.hits;
+	steps += other.steps;
+	prepassSteps += other.prepassSteps;
+	reused += other.reused;
+	capped += other.capped;
+	unmatched += other.unmatched;
+	march.Add(other.march);
+	shading.Add(other.shading);
+}
+
+SdfRaymarcher::SdfRaymarcher(const SdfField& field, const SdfMarchSettings& settings) :
+	m_field(field),
+	m_refineField(nullptr),
+	m_refineDistance(0),
+	m_lightVolume(nullptr),
+	m_settings(settings)
+{
+}
+
+void SdfRaymarcher::SetRefineField(const SdfField* field, float distance)
+{
+	m_refineField = field;
+	m_refineDistance = distance;
+}
+
+void SdfRaymarcher::SetLightVolume(const SdfLightVolume* volume)
+{
+	m_lightVolume = volume;
+}
+
+// Same loop as castRay() in InfiniteShapesPS/primitivesPS. With omega > 1 each step is stretched;
+// if the unbounding spheres at the two ends of a step don't overlap the step may have jumped a
+// surface, so the ray goes back to a plain step from the previous point and stops relaxing.
+// The hit is the sample with the smallest distance relative to t, as long as it is under epsilon.
+bool SdfMarchState::Begin(const SdfRay& ray, const SdfMarchSettings& settings)
+{
+	steps = 0;
+	maxSteps = ray.maxSteps;
+	hit = false;
+	epsilon = (settings.footprintEpsilon && ray.pixelRadius > 0.0f) ? ray.pixelRadius : settings.hitEpsilon;
+	pixelRadius = ray.pixelRadius;
+	lod = settings.footprintLod && ray.pixelRadius > 0.0f;
+	omega = settings.omega;
+	previousRadius = 0.0f;
+	stepLength = 0.0f;
+	candidateError = 1e10f;
+	candidate = float2(-1.0f, -1.0f);
+
+	float2 tb = iBox(ray.origin, ray.direction, float3(settings.boxSize, settings.boxSize, settings.boxSize));
+	if (tb.x < tb.y && tb.y > 0.0f && tb.x < settings.tmax)
+	{
+		t = std::max(std::max(tb.x, settings.tmin), ray.tstart);
+		tmax = std::min(tb.y, settings.tmax);
+		previousT = t;
+		return true;
+	}
+
+	t = tmax = 0.0f;
+	return false;
+}
+
+void SdfMarchState::Advance(const float2& h)
+{
+	steps++;
+
+	float radius = std::fabs(h.x);
+	if (omega > 1.0f && radius + previousRadius < stepLength)
+	{
+		t = previousT + stepLength / omega;
+		omega = 1.0f;
+		return;
+	}
+
+	float error = radius / t;
+	if (error < candidateError)
+	{
+		candidateError = error;
+		candidate = float2(t, h.y);
+	}
+	if (error < epsilon)
+	{
+		if (lod)
+		{
+			// Hit the coarse surface: stay at t and look again with full detail. Only full detail
+			// samples may become the result.
+			lod = false;
+			candidateError = 1e10f;
+			candidate = float2(-1.0f, -1.0f);
+			return;
+		}
+		hit = true;
+		return;
+	}
+
+	previousT = t;
+	previousRadius = radius;
+	stepLength = h.x * omega;
+	t += stepLength;
+}
+
+void SdfMarchState::Skip(float to)
+{
+	if (to > t)
+	{
+		t = to;
+		previousT = to;
+		previousRadius = 0.0f;
+		stepLength = 0.0f;
+	}
+}
+
+float2 SdfRaymarcher::CastRay(const SdfRay& ray, const SdfContext& context, int& steps, bool& capped, SdfEvalStats* stats) const
+{
+	SdfMarchState state;
+	if (!state.Begin(ray, m_settings))
+	{
+		steps = 0;
+		capped = false;
+		return float2(-1.0f, -1.0f);
+	}
+
+	const SdfField* field = &m_field;
+	SdfContext stepContext = context;
+	while (state.Running())
+	{
+		state.Skip(field->SkipEmpty(ray.origin, ray.direction, state.t, state.tmax));
+		if (!state.Running())
+		{
+			break;
+		}
+		stepContext.footprint = state.Footprint();
+		float2 h = field->Map(ray.origin + ray.direction * state.t, stepContext, stats);
+		if (m_refineField && field != m_refineField && h.x < m_refineDistance)
+		{
+			field = m_refineField;
+			state.steps++;
+			continue;
+		}
+		state.Advance(h);
+	}
+
+	steps = state.steps;
+	capped = state.Capped();
+	return state.Result();
+}
+
+float SdfRaymarcher::MarchEmpty(const SdfRay& ray, float to, float relative, const SdfContext& context, int& steps, SdfEvalStats* stats) const
+{
+	steps = 0;
+	float t = std::max(ray.tstart, m_settings.tmin);
+	const SdfField* field = &m_field;
+	SdfContext stepContext = context;
+	while (t < to && steps < SeedCheckSteps)
+	{
+		t = std::max(t, std::min(field->SkipEmpty(ray.origin, ray.direction, t, to), to));
+		if (t >= to)
+		{
+			break;
+		}
+		// Detail under the epsilon can only shorten the distances, which is all the check needs.
+		stepContext.footprint = relative * t;
+		const float d = field->Map(ray.origin + ray.direction * t, stepContext, stats).x;
+		steps++;
+		if (m_refineField && field != m_refineField && d < m_refineDistance)
+		{
+			field = m_refineField;
+			continue;
+		}
+		if (d < relative * t)
+		{
+			break;
+		}
+		t += d;
+	}
+	return t;
+}
+
+// Every point of the cone at axial depth t lies within t * tan(angle) of the axis point, so if
+// map() there returns d, each ray in the cone is free for another d - t * tan(angle) along itself,
+// which advances the axial depth by at least that times cos(angle).
+float SdfRaymarcher::MarchCone(const float3& ro, const float3& axis, float cosAngle, float tstart, const SdfContext& context, int& steps, SdfEvalStats* stats) const
+{
+	const float tanAngle = std::sqrt(std::max(1.0f - cosAngle * cosAngle, 0.0f)) / cosAngle;
+	float t = std::max(tstart, m_settings.tmin);
+	SdfContext stepContext = context;
+	for (int i = 0; i < m_settings.maxSteps && t < m_settings.tmax; i++)
+	{
+		if (m_settings.footprintLod)
+		{
+			stepContext.footprint = t * tanAngle;
+		}
+		float d = m_field.Map(ro + axis * t, stepContext, stats).x;
+		steps++;
+		float free = d - t * tanAngle;
+		if (free < m_settings.hitEpsilon * t)
+		{
+			break;
+		}
+		t += free * cosAngle;
+	}
+	return t;
+}
+
+void SdfRaymarcher::ConePrepass(const SdfCamera& camera, const SdfContext& context, std::vector<float>& start, SdfRenderStats& stats) const
+{
+	// start holds, per pixel, a distance along that pixel's ray that is known to be empty. A cone
+	// march result is a depth along the cone axis, which is never further than the same depth along
+	// any other ray of the cone, so it can be used as is.
+	start.assign(camera.width * camera.height, 0.0f);
+
+	for (int blockSize : ConeBlockSizes)
+	{
+		const int blocksX = (camera.width + blockSize - 1) / blockSize;
+		const int blocksY = (camera.height + blockSize - 1) / blockSize;
+		std::vector<float> levelStart(blocksX * blocksY);
+		std::vector<SdfRenderStats> rowStats(blocksY);
+
+		Concurrency::parallel_for(0, blocksY, [&](int by)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				const int x0 = bx * blockSize;
+				const int y0 = by * blockSize;
+				const int x1 = std::min(x0 + blockSize, camera.width);
+				const int y1 = std::min(y0 + blockSize, camera.height);
+
+				// RayDirection samples pixel centres, so -0.5 lands on the pixel edges.
+				float3 axis = camera.RayDirection(0.5f * (x0 + x1) - 0.5f, 0.5f * (y0 + y1) - 0.5f);
+				float cosAngle = 1.0f;
+				const float cornersX[2] = { x0 - 0.5f, x1 - 0.5f };
+				const float cornersY[2] = { y0 - 0.5f, y1 - 0.5f };
+				for (float cx : cornersX)
+				{
+					for (float cy : cornersY)
+					{
+						cosAngle = std::min(cosAngle, dot(axis, camera.RayDirection(cx, cy)));
+					}
+				}
+
+				// The parent result holds along each ray; as an axial depth for this cone it has to
+				// be scaled by cos so the rays furthest from the axis stay inside the empty range.
+				float parent = start[y0 * camera.width + x0] * cosAngle;
+				int steps = 0;
+				levelStart[by * blocksX + bx] = MarchCone(camera.eye, axis, cosAngle, parent, context, steps, &rowStats[by].march);
+				rowStats[by].prepassSteps += steps;
+			}
+		});
+
+		for (int y = 0; y < camera.height; y++)
+		{
+			for (int x = 0; x < camera.width; x++)
+			{
+				start[y * camera.width + x] = levelStart[(y / blockSize) * blocksX + x / blockSize];
+			}
+		}
+		for (const SdfRenderStats& row : rowStats)
+		{
+			stats.Add(row);
+		}
+	}
+}
+
+float3 SdfRaymarcher::CalcNormal(const float3& pos, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const SdfField& field = m_refineField ? *m_refineField : m_field;
+	if (m_settings.gradientNormals)
+	{
+		return normalize(field.Gradient(pos, context, stats));
+	}
+
+	const float e = 0.5773f * 0.0005f;
+	const float3 xyy(e, -e, -e);
+	const float3 yyx(-e, -e, e);
+	const float3 yxy(-e, e, -e);
+	const float3 xxx(e, e, e);
+	return normalize(
+		xyy * field.Map(pos + xyy, context, stats).x +
+		yyx * field.Map(pos + yyx, context, stats).x +
+		yxy * field.Map(pos + yxy, context, stats).x +
+		xxx * field.Map(pos + xxx, context, stats).x);
+}
+
+float SdfRaymarcher::CalcAO(const float3& pos, const float3& nor, const SdfContext& context, SdfEvalStats* stats) const
+{
+	return CalcOcclusion(m_field, pos, nor, context, stats) * (0.5f + 0.5f * nor.y);
+}
+
+float SdfRaymarcher::CalcSoftshadow(const float3& ro, const float3& rd, float mint, const SdfContext& context, SdfEvalStats* stats) const
+{
+	return CalcSoftshadow(m_field, ro, rd, mint, context, stats);
+}
+
+float SdfRaymarcher::CalcOcclusion(const SdfField& field, const float3& pos, const float3& nor, const SdfContext& context, SdfEvalStats* stats)
+{
+	float occ = 0.0f;
+	float sca = 1.0f;
+	for (int i = 0; i < 5; i++)
+	{
+		float hr = 0.01f + 0.12f * i / 4.0f;
+		float dd = field.Map(nor * hr + pos, context, stats).x;
+		occ += -(dd - hr) * sca;
+		sca *= 0.95f;
+	}
+	return clamp(1.0f - 3.0f * occ, 0.0f, 1.0f);
+}
+
+float SdfRaymarcher::CalcSoftshadow(const SdfField& field, const float3& ro, const float3& rd, float mint, const SdfContext& context, SdfEvalStats* stats)
+{
+	float res = 1.0f;
+	float t = mint;
+	for (int i = 0; i < 16; i++)
+	{
+		float h = field.Map(ro + rd * t, context, stats).x;
+		res = std::min(res, 8.0f * h / t);
+		t += clamp(h, 0.02f, 0.10f);
+	}
+	return clamp(res, 0.0f, 1.0f);
+}
+
+// render() after castRay(). The floor plane branch (material 1) is disabled in the shaders and left out.
+float3 SdfRaymarcher::Shade(const float3& ro, const float3& rd, const float2& hit, const SdfContext& context, SdfEvalStats* stats) const
+{
+	float t = hit.x;
+	float m = hit.y;
+	float3 pos = ro + rd * t;
+	float3 nor = CalcNormal(pos, context, stats);
+	float3 ref = reflect(rd, nor);
+
+	float3 col = float3(0.45f, 0.45f, 0.45f) + float3(
+		0.35f * std::sin(0.05f * (m - 1.0f)),
+		0.35f * std::sin(0.08f * (m - 1.0f)),
+		0.35f * std::sin(0.10f * (m - 1.0f)));
+
+	float3 lig = normalize(m_settings.sunDirection);
+	float occ;
+	float sun;
+	float reflection;
+	Visibility(pos, nor, ref, context, stats, occ, sun, reflection);
+	float3 hal = normalize(lig - rd);
+	float amb = clamp(0.5f + 0.5f * nor.y, 0.0f, 1.0f);
+	float dif = clamp(dot(nor, lig), 0.0f, 1.0f);
+	float bac = clamp(dot(nor, normalize(float3(-lig.x, 0.0f, -lig.z))), 0.0f, 1.0f) * clamp(1.0f - pos.y, 0.0f, 1.0f);
+	float dom = smoothstep(-0.2f, 0.2f, ref.y);
+	float fre = std::pow(clamp(1.0f + dot(nor, rd), 0.0f, 1.0f), 2.0f);
+
+	dif *= sun;
+	dom *= reflection;
+
+	float spe = std::pow(clamp(dot(nor, hal), 0.0f, 1.0f), 16.0f) *
+		dif *
+		(0.04f + 0.96f * std::pow(clamp(1.0f + dot(hal, rd), 0.0f, 1.0f), 5.0f));
+
+	float3 lin(0.0f, 0.0f, 0.0f);
+	lin += float3(1.00f, 0.80f, 0.55f) * (1.30f * dif);
+	lin += float3(0.40f, 0.60f, 1.00f) * (0.30f * amb * occ);
+	lin += float3(0.40f, 0.60f, 1.00f) * (0.40f * dom * occ);
+	lin += float3(0.25f, 0.25f, 0.25f) * (0.50f * bac * occ);
+	lin += float3(1.00f, 1.00f, 1.00f) * (0.25f * fre * occ);
+	col = col * lin;
+	col += float3(1.00f, 0.90f, 0.70f) * (9.00f * spe);
+
+	col = lerp(col, m_settings.fogColour, 1.0f - std::exp(-0.0002f * t * t));
+	return clamp(col, 0.0f, 1.0f);
+}
+
+void SdfRaymarcher::Visibility(const float3& pos, const float3& nor, const float3& ref, const SdfContext& context, SdfEvalStats* stats,
+	float& occ, float& sun, float& reflection) const
+{
+	if (m_lightVolume && m_lightVolume->Sample(pos, nor, context, occ, sun, stats))
+	{
+		occ *= 0.5f + 0.5f * nor.y;
+	}
+	else
+	{
+		occ = CalcAO(pos, nor, context, stats);
+		sun = CalcSoftshadow(pos, normalize(m_settings.sunDirection), 0.02f, context, stats);
+	}
+	reflection = CalcSoftshadow(pos, ref, 0.02f, context, stats);
+}
+
+void SdfRaymarcher::Render(const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats, const std::vector<float2>* seeds) const
+{
+	March(camera, context, m_settings.shade, image, stats, seeds);
+}
+
+void SdfRaymarcher::March(const SdfCamera& camera, const SdfContext& context, bool shade, SdfImage& image, SdfRenderStats* stats, const std::vector<float2>* seeds) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	image.Resize(camera.width, camera.height);
+	std::vector<SdfRenderStats> rowStats(camera.height);
+
+	SdfRenderStats prepassStats;
+	std::vector<float> tstart;
+	if (m_settings.conePrepass)
+	{
+		ConePrepass(camera, context, tstart, prepassStats);
+	}
+
+	Concurrency::parallel_for(0, camera.height, [&](int y)
+	{
+		for (int x = 0; x < camera.width; x++)
+		{
+			const int i = y * camera.width + x;
+			RenderPixel(camera, context, x, y, tstart.empty() ? 0.0f : tstart[i], seeds ? (*seeds)[i] : float2(0.0f, -1.0f), shade, image, rowStats[y]);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = prepassStats;
+		for (const SdfRenderStats& row : rowStats)
+		{
+			stats->Add(row);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void SdfRaymarcher::RenderInterleaved(const SdfCamera& camera, const SdfContext& context, int stride, int skipStride, SdfImage& image, SdfRenderStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (image.width != camera.width || image.height != camera.height)
+	{
+		image.Resize(camera.width, camera.height);
+	}
+	const int rows = (camera.height + stride - 1) / stride;
+	std::vector<SdfRenderStats> rowStats(rows);
+
+	Concurrency::parallel_for(0, rows, [&](int row)
+	{
+		const int y = row * stride;
+		const bool skipRow = skipStride > 0 && y % skipStride == 0;
+		for (int x = 0; x < camera.width; x += stride)
+		{
+			if (skipRow && x % skipStride == 0)
+			{
+				continue;
+			}
+			RenderPixel(camera, context, x, y, 0.0f, float2(0.0f, -1.0f), m_settings.shade, image, rowStats[row]);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SdfRenderStats();
+		for (const SdfRenderStats& row : rowStats)
+		{
+			stats->Add(row);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void SdfGBuffer::Resize(int count)
+{
+	pixel.resize(count);
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	nx.resize(count);
+	ny.resize(count);
+	nz.resize(count);
+	t.resize(count);
+	material.resize(count);
+	occ.resize(count);
+	sun.resize(count);
+	reflection.resize(count);
+}
+
+void SdfRaymarcher::RenderGBuffer(const SdfCamera& camera, const SdfContext& context, SdfGBuffer& gbuffer, SdfImage& image, SdfRenderStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	SdfRenderStats marchStats;
+	March(camera, context, false, image, &marchStats, nullptr);
+
+	int count = 0;
+	for (float m : image.material)
+	{
+		count += (m > -0.5f) ? 1 : 0;
+	}
+	gbuffer.Resize(count);
+	for (int i = 0, k = 0; i < camera.width * camera.height; i++)
+	{
+		if (image.material[i] > -0.5f)
+		{
+			gbuffer.pixel[k++] = i;
+		}
+	}
+
+	// With a visibility scale the pixels on the coarse grid get their visibility first, and the
+	// rest are upsampled from them once they are all done.
+	const int scale = std::max(m_settings.visibilityScale, 1);
+	auto onGrid = [&](int i)
+	{
+		return (i % camera.width) % scale == 0 && (i / camera.width) % scale == 0;
+	};
+	std::vector<int> entries;
+	if (scale > 1)
+	{
+		entries.assign(camera.width * camera.height, -1);
+		for (int k = 0; k < count; k++)
+		{
+			entries[gbuffer.pixel[k]] = k;
+		}
+	}
+
+	const int chunks = (count + GBufferChunk - 1) / GBufferChunk;
+	std::vector<SdfEvalStats> chunkStats(chunks);
+	std::vector<uint64_t> chunkUnmatched(chunks, 0);
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		for (int k = chunk * GBufferChunk; k < std::min(count, (chunk + 1) * GBufferChunk); k++)
+		{
+			const int i = gbuffer.pixel[k];
+			const float3 rd = camera.RayDirection(static_cast<float>(i % camera.width), static_cast<float>(i / camera.width));
+			const float t = image.t[i];
+			const float3 pos = camera.eye + rd * t;
+			const float3 nor = CalcNormal(pos, context, &chunkStats[chunk]);
+			if (scale == 1 || onGrid(i))
+			{
+				Visibility(pos, nor, reflect(rd, nor), context, &chunkStats[chunk], gbuffer.occ[k], gbuffer.sun[k], gbuffer.reflection[k]);
+			}
+			gbuffer.x[k] = pos.x;
+			gbuffer.y[k] = pos.y;
+			gbuffer.z[k] = pos.z;
+			gbuffer.nx[k] = nor.x;
+			gbuffer.ny[k] = nor.y;
+			gbuffer.nz[k] = nor.z;
+			gbuffer.t[k] = t;
+			gbuffer.material[k] = image.material[i];
+		}
+	});
+
+	if (scale > 1)
+	{
+		Concurrency::parallel_for(0, chunks, [&](int chunk)
+		{
+			for (int k = chunk * GBufferChunk; k < std::min(count, (chunk + 1) * GBufferChunk); k++)
+			{
+				const int i = gbuffer.pixel[k];
+				if (onGrid(i) || UpsampleVisibility(gbuffer, entries, camera.width, camera.height, k))
+				{
+					continue;
+				}
+				const float3 pos(gbuffer.x[k], gbuffer.y[k], gbuffer.z[k]);
+				const float3 nor(gbuffer.nx[k], gbuffer.ny[k], gbuffer.nz[k]);
+				const float3 rd = normalize(pos - camera.eye);
+				Visibility(pos, nor, reflect(rd, nor), context, &chunkStats[chunk], gbuffer.occ[k], gbuffer.sun[k], gbuffer.reflection[k]);
+				chunkUnmatched[chunk]++;
+			}
+		});
+	}
+
+	if (stats)
+	{
+		*stats = marchStats;
+		for (int chunk = 0; chunk < chunks; chunk++)
+		{
+			stats->shading.Add(chunkStats[chunk]);
+			stats->unmatched += chunkUnmatched[chunk];
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+// The (up to) four grid pixels around entry k, weighted bilinearly and by how alike their depth
+// and normal are to its own. Grid pixels that missed have nothing to give. Returns false, and
+// leaves the entry alone, if they don't add up to enough weight to trust.
+bool SdfRaymarcher::UpsampleVisibility(SdfGBuffer& gbuffer, const std::vector<int>& entries, int width, int height, int k) const
+{
+	const int scale = m_settings.visibilityScale;
+	const int i = gbuffer.pixel[k];
+	const int x = i % width;
+	const int y = i / width;
+	const int x0 = (x / scale) * scale;
+	const int y0 = (y / scale) * scale;
+	const float fx = static_cast<float>(x - x0) / scale;
+	const float fy = static_cast<float>(y - y0) / scale;
+	const float t = gbuffer.t[k];
+
+	float occ = 0.0f, sun = 0.0f, reflection = 0.0f, total = 0.0f;
+	float3 low(1e30f, 1e30f, 1e30f), high(-1e30f, -1e30f, -1e30f);
+	for (int corner = 0; corner < 4; corner++)
+	{
+		const int cx = x0 + ((corner & 1) ? scale : 0);
+		const int cy = y0 + ((corner & 2) ? scale : 0);
+		const int q = (cx < width && cy < height) ? entries[cy * width + cx] : -1;
+		if (q < 0)
+		{
+			continue;
+		}
+		const float bilinear = ((corner & 1) ? fx : 1.0f - fx) * ((corner & 2) ? fy : 1.0f - fy);
+		const float depth = (gbuffer.t[q] - t) / (DepthSigma * t);
+		const float facing = std::max(gbuffer.nx[k] * gbuffer.nx[q] + gbuffer.ny[k] * gbuffer.ny[q] + gbuffer.nz[k] * gbuffer.nz[q], 0.0f);
+		const float weight = bilinear * std::exp(-depth * depth) * std::pow(facing, NormalPower);
+		if (weight <= 0.0f)
+		{
+			continue;
+		}
+		const float3 terms(gbuffer.occ[q], gbuffer.sun[q], gbuffer.reflection[q]);
+		low = min(low, terms);
+		high = max(high, terms);
+		occ += gbuffer.occ[q] * weight;
+		sun += gbuffer.sun[q] * weight;
+		reflection += gbuffer.reflection[q] * weight;
+		total += weight;
+	}
+	const float3 spread = high - low;
+	if (total < MinUpsampleWeight || std::max(spread.x, std::max(spread.y, spread.z)) > MaxUpsampleSpread)
+	{
+		return false;
+	}
+
+	gbuffer.occ[k] = occ / total;
+	gbuffer.sun[k] = sun / total;
+	gbuffer.reflection[k] = reflection / total;
+	return true;
+}
+
+// Shade() after Visibility(), a lane at a time in plain loops the compiler can vectorise. The
+// view direction is rebuilt from the position, which saves storing it. sin() and exp() are
+// library calls per lane either way; the integer powers are multiplies here.
+template <int Lanes>
+void SdfRaymarcher::ShadeLanes(const float3& eye, const SdfGBuffer& gbuffer, int first, float3* colours) const
+{
+	const float3 lig = normalize(m_settings.sunDirection);
+	const float3 back = normalize(float3(-lig.x, 0.0f, -lig.z));
+	const float3 fog = m_settings.fogColour;
+	float r[Lanes], g[Lanes], b[Lanes];
+	for (int i = 0; i < Lanes; i++)
+	{
+		const int k = first + i;
+		const float px = gbuffer.x[k], py = gbuffer.y[k], pz = gbuffer.z[k];
+		const float nx = gbuffer.nx[k], ny = gbuffer.ny[k], nz = gbuffer.nz[k];
+		const float t = gbuffer.t[k];
+		const float m = gbuffer.material[k];
+		const float occ = gbuffer.occ[k];
+
+		float rx = px - eye.x, ry = py - eye.y, rz = pz - eye.z;
+		const float inverseLength = 1.0f / std::sqrt(rx * rx + ry * ry + rz * rz);
+		rx *= inverseLength;
+		ry *= inverseLength;
+		rz *= inverseLength;
+		const float nDotR = nx * rx + ny * ry + nz * rz;
+		const float refY = ry - 2.0f * nDotR * ny;
+
+		float hx = lig.x - rx, hy = lig.y - ry, hz = lig.z - rz;
+		const float inverseHal = 1.0f / std::sqrt(hx * hx + hy * hy + hz * hz);
+		hx *= inverseHal;
+		hy *= inverseHal;
+		hz *= inverseHal;
+
+		const float amb = clamp(0.5f + 0.5f * ny, 0.0f, 1.0f);
+		const float dif = clamp(nx * lig.x + ny * lig.y + nz * lig.z, 0.0f, 1.0f) * gbuffer.sun[k];
+		const float bac = clamp(nx * back.x + ny * back.y + nz * back.z, 0.0f, 1.0f) * clamp(1.0f - py, 0.0f, 1.0f);
+		const float dom = smoothstep(-0.2f, 0.2f, refY) * gbuffer.reflection[k];
+		const float f = clamp(1.0f + nDotR, 0.0f, 1.0f);
+		const float fre = f * f;
+
+		const float nDotH = clamp(nx * hx + ny * hy + nz * hz, 0.0f, 1.0f);
+		const float h2 = nDotH * nDotH, h4 = h2 * h2, h8 = h4 * h4;
+		const float s = clamp(1.0f + hx * rx + hy * ry + hz * rz, 0.0f, 1.0f);
+		const float s2 = s * s;
+		const float spe = h8 * h8 * dif * (0.04f + 0.96f * s2 * s2 * s);
+
+		// The terms of lin that share a colour are summed first.
+		const float sky = 0.30f * amb * occ + 0.40f * dom * occ;
+		const float grey = 0.25f * 0.50f * bac * occ + 0.25f * fre * occ;
+		const float sunLight = 1.30f * dif;
+		const float linR = 1.00f * sunLight + 0.40f * sky + grey;
+		const float linG = 0.80f * sunLight + 0.60f * sky + grey;
+		const float linB = 0.55f * sunLight + 1.00f * sky + grey;
+
+		float cr = (0.45f + 0.35f * std::sin(0.05f * (m - 1.0f))) * linR + 1.00f * 9.00f * spe;
+		float cg = (0.45f + 0.35f * std::sin(0.08f * (m - 1.0f))) * linG + 0.90f * 9.00f * spe;
+		float cb = (0.45f + 0.35f * std::sin(0.10f * (m - 1.0f))) * linB + 0.70f * 9.00f * spe;
+
+		const float fogAmount = 1.0f - std::exp(-0.0002f * t * t);
+		r[i] = clamp(cr + (fog.x - cr) * fogAmount, 0.0f, 1.0f);
+		g[i] = clamp(cg + (fog.y - cg) * fogAmount, 0.0f, 1.0f);
+		b[i] = clamp(cb + (fog.z - cb) * fogAmount, 0.0f, 1.0f);
+	}
+	for (int i = 0; i < Lanes; i++)
+	{
+		colours[i] = float3(r[i], g[i], b[i]);
+	}
+}
+
+void SdfRaymarcher::ShadeGBuffer(const SdfCamera& camera, const SdfGBuffer& gbuffer, int lanes, SdfImage& image, SdfRenderStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const int count = gbuffer.GetCount();
+	const int chunks = (count + ShadeChunk - 1) / ShadeChunk;
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		const int end = std::min(count, (chunk + 1) * ShadeChunk);
+		float3 colours[8];
+		int k = chunk * ShadeChunk;
+		auto store = [&](int n)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				image.colour[gbuffer.pixel[k + i]] = colours[i];
+			}
+			k += n;
+		};
+		if (lanes == 8)
+		{
+			while (k + 8 <= end)
+			{
+				ShadeLanes<8>(camera.eye, gbuffer, k, colours);
+				store(8);
+			}
+		}
+		else if (lanes == 4)
+		{
+			while (k + 4 <= end)
+			{
+				ShadeLanes<4>(camera.eye, gbuffer, k, colours);
+				store(4);
+			}
+		}
+		while (k < end)
+		{
+			ShadeLanes<1>(camera.eye, gbuffer, k, colours);
+			store(1);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SdfRenderStats();
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void SdfRaymarcher::RenderSupersampled(const SdfCamera& camera, const SdfContext& context, const std::vector<int>& pixels, int grid, SdfImage& image, SdfRenderStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const int count = static_cast<int>(pixels.size());
+	const int chunks = (count + SupersampleChunk - 1) / SupersampleChunk;
+	const int samples = grid * grid;
+	std::vector<SdfRenderStats> chunkStats(chunks);
+
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		SdfRenderStats& s = chunkStats[chunk];
+		for (int p = chunk * SupersampleChunk; p < std::min(count, (chunk + 1) * SupersampleChunk); p++)
+		{
+			const int i = pixels[p];
+			const float x = static_cast<float>(i % camera.width);
+			const float y = static_cast<float>(i / camera.width);
+			float3 colour(0.0f, 0.0f, 0.0f);
+			for (int sample = 0; sample < samples; sample++)
+			{
+				const float2 offset = SdfAntialias::GridOffset(sample, grid);
+				SdfRay ray;
+				ray.origin = camera.eye;
+				ray.direction = camera.RayDirection(x + offset.x, y + offset.y);
+				ray.pixelRadius = camera.PixelRadius(x, y) / grid;
+				ray.maxSteps = m_settings.maxSteps;
+
+				int steps;
+				bool capped;
+				const float2 hit = CastRay(ray, context, steps, capped, &s.march);
+				s.rays++;
+				s.steps += steps;
+				s.capped += capped ? 1 : 0;
+				if (hit.y > -0.5f)
+				{
+					s.hits++;
+					if (m_settings.shade)
+					{
+						colour += Shade(camera.eye, ray.direction, hit, context, &s.shading);
+					}
+				}
+			}
+			image.colour[i] = colour / static_cast<float>(samples);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SdfRenderStats();
+		for (const SdfRenderStats& s : chunkStats)
+		{
+			stats->Add(s);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void SdfRaymarcher::RenderPixel(const SdfCamera& camera, const SdfContext& context, int x, int y, float coneStart, const float2& seed, bool shade, SdfImage& image, SdfRenderStats& row) const
+{
+	const int i = y * camera.width + x;
+	float3 rd = camera.RayDirection(static_cast<float>(x), static_cast<float>(y));
+	SdfRay ray;
+	ray.origin = camera.eye;
+	ray.direction = rd;
+	ray.pixelRadius = camera.PixelRadius(static_cast<float>(x), static_cast<float>(y));
+
+	int steps = 0;
+	bool capped = false;
+	float2 hit(-1.0f, -1.0f);
+	// A seed in front of the cone result can't be right, there is no surface there. Behind it,
+	// something may have moved in front of last frame's surface, so the ray only starts next to
+	// the seed once the way there is known to be empty. Any seed that fails is marched in full
+	// from the cone result, like an unseeded ray.
+	if (seed.x > coneStart)
+	{
+		const float seedStart = std::max(seed.x * (1.0f - SeedBackoff), coneStart);
+		int checkSteps;
+		ray.tstart = coneStart;
+		const bool empty = MarchEmpty(ray, seedStart, SeedBackoff, context, checkSteps, &row.march) >= seedStart;
+		steps += checkSteps;
+		if (empty)
+		{
+			int seedSteps;
+			ray.tstart = seedStart;
+			ray.maxSteps = SeedSteps;
+			hit = CastRay(ray, context, seedSteps, capped, &row.march);
+			steps += seedSteps;
+			if (hit.y != seed.y)
+			{
+				hit = float2(-1.0f, -1.0f);
+			}
+			row.reused += (hit.y > -0.5f) ? 1 : 0;
+		}
+	}
+	if (hit.y < -0.5f)
+	{
+		int marchSteps;
+		ray.tstart = coneStart;
+		ray.maxSteps = m_settings.maxSteps;
+		hit = CastRay(ray, context, marchSteps, capped, &row.march);
+		steps += marchSteps;
+	}
+	image.steps[i] = static_cast<uint16_t>(std::min(steps, 65535));
+	row.rays++;
+	row.steps += steps;
+	row.capped += capped ? 1 : 0;
+	image.t[i] = -1.0f;
+	image.material[i] = -1.0f;
+	image.colour[i] = float3(0.0f, 0.0f, 0.0f);
+	if (hit.y > -0.5f)
+	{
+		image.t[i] = hit.x;
+		image.material[i] = hit.y;
+		if (shade)
+		{
+			image.colour[i] = Shade(camera.eye, rd, hit, context, &row.shading);
+		}
+		row.hits++;
+	}
+}
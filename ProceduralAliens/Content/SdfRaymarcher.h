@@ -0,0 +1,232 @@
+﻿#pragma once
+
+#include "SdfField.h"
+#include "SdfLightVolume.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// The full screen quad camera used by the raymarching pixel shaders: the quad spans
+	// canvasHalfSize in view units, is scaled by zoom and sits nearPlane in front of the origin.
+	struct SdfCamera
+	{
+		Hlsl::float3 eye = Hlsl::float3(0.0f, 0.0f, -15.0f);
+		Hlsl::float2 canvasHalfSize = Hlsl::float2(1.0f, 1.0f);
+		float nearPlane = 1.0f;
+		float zoom = 10.0f;
+		int width = 0;
+		int height = 0;
+
+		Hlsl::float3 RayDirection(float x, float y) const;
+		// Half the angle covered by the pixel, the radius of its footprint at distance 1.
+		float PixelRadius(float x, float y) const;
+
+		// Inverse of RayDirection: the pixel whose ray passes through a world position. This camera
+		// has no rotation, so it stands in for the view and projection matrices.
+		bool Project(const Hlsl::float3& position, Hlsl::float2& pixel) const;
+	};
+
+	// castRay() and render() constants that differ between the layers.
+	struct SdfMarchSettings
+	{
+		int maxSteps = 250;
+		float hitEpsilon = 0.00001f; // relative to t
+
+		// Over-relaxation factor for sphere tracing (Keinert et al. 2014), 1 for plain steps.
+		float omega = 1.0f;
+		// Hit when the distance is below the pixel footprint instead of hitEpsilon * t.
+		bool footprintEpsilon = false;
+		// Pass the pixel footprint at t to the field as SdfContext::footprint, so detail the pixel
+		// can't resolve is skipped (cones pass their radius). The coarse surface is never behind
+		// the real one, so a ray that hits it carries on at full detail for the last few steps.
+		bool footprintLod = false;
+		// Normals from SdfField::Gradient (one dual number pass for compiled scenes) instead of
+		// calcNormal()'s four tetrahedral taps.
+		bool gradientNormals = false;
+
+		// Off to only march primary rays and leave the colours black, for timing the march.
+		bool shade = true;
+		float tmin = 1.0f;
+		float tmax = 200.0f;
+		float boxSize = 100.0f;
+		Hlsl::float3 fogColour = Hlsl::float3(0.8f, 0.8f, 0.8f);
+		// render()'s lig, normalised where it is used.
+		Hlsl::float3 sunDirection = Hlsl::float3(-0.4f, 0.7f, -0.6f);
+
+		// March cones for 16x16 then 4x4 pixel blocks first; each level gives the next a
+		// conservative start distance so full resolution rays begin near the surface.
+		bool conePrepass = false;
+
+		// RenderGBuffer() only: AO and the soft shadows for one pixel in visibilityScale x
+		// visibilityScale (1, 2 or 4), filled in for the rest by a joint bilateral upsample
+		// guided by depth and normal.
+		int visibilityScale = 1;
+	};
+
+	struct SdfImage
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<Hlsl::float3> colour;
+		std::vector<float> t;        // hit distance along the ray, -1 where the shader would discard
+		std::vector<float> material;
+		std::vector<uint16_t> steps;
+
+		void Resize(int w, int h);
+	};
+
+	// What Shade() needs of each hit pixel, for shading after the whole frame has been marched.
+	// Only hits are kept, in pixel order, as a structure of arrays. The map() based terms (AO and
+	// the two soft shadows) are evaluated with the hit, so shading is arithmetic only.
+	struct SdfGBuffer
+	{
+		std::vector<int> pixel;
+		std::vector<float> x;       // position
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> nx;      // normal
+		std::vector<float> ny;
+		std::vector<float> nz;
+		std::vector<float> t;
+		std::vector<float> material;
+		std::vector<float> occ;     // ambient occlusion, with its sky factor
+		std::vector<float> sun;     // sun visibility
+		std::vector<float> reflection; // visibility along the reflected ray
+
+		void Resize(int count);
+		int GetCount() const { return static_cast<int>(pixel.size()); }
+	};
+
+	struct SdfRenderStats
+	{
+		double seconds = 0;
+		uint64_t rays = 0;
+		uint64_t hits = 0;
+		uint64_t steps = 0;
+		uint64_t prepassSteps = 0; // cone steps, summed over all blocks of all levels
+		uint64_t reused = 0;       // seeded rays that verified their seed
+		uint64_t capped = 0;       // rays that ran out of steps before reaching a surface or tmax
+		uint64_t unmatched = 0;    // hits with no similar low resolution visibility sample to upsample
+		SdfEvalStats march;  // primary ray and cone map() calls only
+		SdfEvalStats shading; // normals, AO and soft shadows
+
+		void Add(const SdfRenderStats& other);
+	};
+
+	struct SdfRay
+	{
+		Hlsl::float3 origin;
+		Hlsl::float3 direction;
+		float tstart = 0;      // the march starts here if that is further than tmin
+		int maxSteps = 0;
+		float pixelRadius = 0; // see SdfCamera::PixelRadius
+	};
+
+	// One ray's sphere tracing state, the body of the castRay() loop. Shared by
+	// SdfRaymarcher::CastRay and SdfPacketMarcher, which feed it distances one at a time.
+	struct SdfMarchState
+	{
+		float t;
+		float tmax;
+		float epsilon;
+		float pixelRadius;
+		float omega;
+		float previousT;
+		float previousRadius;
+		float stepLength;
+		float candidateError;
+		Hlsl::float2 candidate;
+		int steps;
+		int maxSteps;
+		bool hit;
+		bool lod;
+
+		// Returns false if the ray misses the bounding box and needs no steps at all.
+		bool Begin(const SdfRay& ray, const SdfMarchSettings& settings);
+		bool Running() const { return !hit && steps < maxSteps && t < tmax; }
+		void Advance(const Hlsl::float2& h);
+		// Jumps ahead to a distance SdfField::SkipEmpty vouched for; over-relaxation starts afresh.
+		void Skip(float to);
+		bool Capped() const { return !hit && steps == maxSteps && t < tmax; }
+		// SdfContext::footprint for the next sample, 0 once the ray is refining its hit.
+		float Footprint() const { return lod ? pixelRadius * t : 0.0f; }
+		// (t, material), material -1 on a miss.
+		Hlsl::float2 Result() const { return (candidateError < epsilon) ? candidate : Hlsl::float2(-1.0f, -1.0f); }
+	};
+
+	// CPU port of castRay()/render() from the raymarching pixel shaders, evaluating any SdfField.
+	// Rows are rendered in parallel.
+	class SdfRaymarcher
+	{
+	public:
+		SdfRaymarcher(const SdfField& field, const SdfMarchSettings& settings);
+
+		// For approximate fields (SdfBrickMap): once the marched distance drops below 'distance' the
+		// ray continues on 'field', which is also used for normals.
+		void SetRefineField(const SdfField* field, float distance);
+
+		// Shade with AO and sun visibility from 'volume' instead of calcAO() and the sun's
+		// calcSoftshadow() wherever the volume can answer (SdfLightVolume::Sample), live elsewhere.
+		// The reflection shadow still marches, its direction is per pixel. Off unless set.
+		void SetLightVolume(const SdfLightVolume* volume);
+
+		// seeds, if given, holds a guessed hit per pixel, (t, material) with t 0 for none. A seeded
+		// ray first checks that nothing lies in front of the guess, then marches a few steps from
+		// just before it. It falls back to a full march if the check fails, if it doesn't converge
+		// or if it converges on another material.
+		void Render(const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats, const std::vector<Hlsl::float2>* seeds = nullptr) const;
+
+		// Renders only the pixels whose x and y are both multiples of stride, leaving the rest of the
+		// image as it is, and skipping those that are also on the skipStride grid (0 for none): one
+		// level of SdfProgressive. No cone prepass; its blocks are coarser than the levels.
+		void RenderInterleaved(const SdfCamera& camera, const SdfContext& context, int stride, int skipStride, SdfImage& image, SdfRenderStats* stats) const;
+
+		// Render() as two phases. RenderGBuffer() marches every pixel, then takes the normal and
+		// the map() based terms of each hit into the G-buffer; image gets the hits, materials and
+		// steps, and stays black. ShadeGBuffer() runs the rest of Shade(), the lighting terms and
+		// fog, over the G-buffer lanes (1, 4 or 8) hits at a time.
+		void RenderGBuffer(const SdfCamera& camera, const SdfContext& context, SdfGBuffer& gbuffer, SdfImage& image, SdfRenderStats* stats) const;
+		void ShadeGBuffer(const SdfCamera& camera, const SdfGBuffer& gbuffer, int lanes, SdfImage& image, SdfRenderStats* stats) const;
+
+		// Replaces the colour of each listed pixel with the mean of a grid x grid pattern of rays
+		// inside it (SdfAntialias), keeping its hit and material. The listed pixels are split into
+		// chunks rendered in parallel.
+		void RenderSupersampled(const SdfCamera& camera, const SdfContext& context, const std::vector<int>& pixels, int grid, SdfImage& image, SdfRenderStats* stats) const;
+
+		// Returns (t, material), material -1 on a miss. capped is set when the ray ran out of steps.
+		Hlsl::float2 CastRay(const SdfRay& ray, const SdfContext& context, int& steps, bool& capped, SdfEvalStats* stats) const;
+		const SdfMarchSettings& GetSettings() const { return m_settings; }
+
+		// Marches a cone of half angle acos(cosAngle) around axis and returns a distance along
+		// the axis that every ray inside the cone can safely start from.
+		float MarchCone(const Hlsl::float3& ro, const Hlsl::float3& axis, float cosAngle, float tstart, const SdfContext& context, int& steps, SdfEvalStats* stats) const;
+		Hlsl::float3 Shade(const Hlsl::float3& ro, const Hlsl::float3& rd, const Hlsl::float2& hit, const SdfContext& context, SdfEvalStats* stats) const;
+
+		Hlsl::float3 CalcNormal(const Hlsl::float3& pos, const SdfContext& context, SdfEvalStats* stats) const;
+		float CalcAO(const Hlsl::float3& pos, const Hlsl::float3& nor, const SdfContext& context, SdfEvalStats* stats) const;
+		float CalcSoftshadow(const Hlsl::float3& ro, const Hlsl::float3& rd, float mint, const SdfContext& context, SdfEvalStats* stats) const;
+
+		// calcAO() on any field, without its (0.5 + 0.5 * nor.y) sky factor, and calcSoftshadow().
+		static float CalcOcclusion(const SdfField& field, const Hlsl::float3& pos, const Hlsl::float3& nor, const SdfContext& context, SdfEvalStats* stats);
+		static float CalcSoftshadow(const SdfField& field, const Hlsl::float3& ro, const Hlsl::float3& rd, float mint, const SdfContext& context, SdfEvalStats* stats);
+
+	private:
+		void ConePrepass(const SdfCamera& camera, const SdfContext& context, std::vector<float>& start, SdfRenderStats& stats) const;
+		void March(const SdfCamera& camera, const SdfContext& context, bool shade, SdfImage& image, SdfRenderStats* stats, const std::vector<Hlsl::float2>* seeds) const;
+		void RenderPixel(const SdfCamera& camera, const SdfContext& context, int x, int y, float coneStart, const Hlsl::float2& seed, bool shade, SdfImage& image, SdfRenderStats& row) const;
+		// Sphere traces from ray.tstart towards 'to' at a coarse footprint and returns how far the
+		// ray is known to be empty: 'to' if it gets there, less if it passes within 'relative' * t
+		// of something first or runs out of steps.
+		float MarchEmpty(const SdfRay& ray, float to, float relative, const SdfContext& context, int& steps, SdfEvalStats* stats) const;
+		bool UpsampleVisibility(SdfGBuffer& gbuffer, const std::vector<int>& entries, int width, int height, int k) const;
+		void Visibility(const Hlsl::float3& pos, const Hlsl::float3& nor, const Hlsl::float3& ref, const SdfContext& context, SdfEvalStats* stats,
+			float& occ, float& sun, float& reflection) const;
+		template <int Lanes> void ShadeLanes(const Hlsl::float3& eye, const SdfGBuffer& gbuffer, int first, Hlsl::float3* colours) const;
+
+		const SdfField& m_field;
+		const SdfField* m_refineField;
+		float m_refineDistance;
+		const SdfLightVolume* m_lightVolume;
+		SdfMarchSettings m_settings;
+	};
+}
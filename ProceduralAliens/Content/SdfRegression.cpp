@@ -0,0 +1,335 @@
+﻿#include "pch.h"
+#include "SdfRegression.h"
+#include "SdfBvh.h"
+#include "SphereTracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const int Width = 160;
+	const int Height = 90;
+
+	// Best of a few renders, so one slow frame doesn't fail the time budget.
+	const int TimingRuns = 3;
+
+	// Fixed views and budgets. The budgets are what the reference machine (one core) measured,
+	// with 25% headroom on the time and 5% on the work, which only changes with the code.
+	struct CaseDefinition
+	{
+		const wchar_t* layer;
+		const wchar_t* name;
+		float3 eyeOffset;
+		float time;
+		double budgetMs;
+		double budgetStepsPerPixel;
+		double budgetMapCallsPerPixel;
+	};
+
+	const CaseDefinition CaseDefinitions[] =
+	{
+		{ L"InfiniteShapes", L"default", float3(0.0f, 0.0f, 0.0f), 1.25f, 235.0, 29.1, 30.6 },
+		{ L"InfiniteShapes", L"moved", float3(1.5f, 1.0f, 3.0f), 4.0f, 210.0, 27.4, 28.3 },
+		{ L"Primitives", L"default", float3(0.0f, 0.0f, 0.0f), 1.25f, 32.0, 11.6, 12.6 },
+		{ L"Primitives", L"moved", float3(1.5f, 1.0f, 3.0f), 4.0f, 34.0, 11.5, 12.6 },
+		{ L"Fractal", L"default", float3(0.0f, 0.0f, 0.0f), 1.25f, 50.0, 8.4, 9.3 },
+		{ L"Fractal", L"moved", float3(1.5f, 1.0f, 3.0f), 4.0f, 63.0, 9.9, 11.5 },
+		// The three spheres trace in about half a millisecond, where timer noise is larger than
+		// 25%, so they get 1 ms.
+		{ L"ShinySpheres", L"default", float3(0.0f, 0.0f, 0.0f), 0.0f, 1.0, 1.06, 3.18 },
+		{ L"ShinySpheres", L"moved", float3(0.5f, 2.0f, -25.0f), 0.0f, 1.0, 1.08, 3.24 },
+	};
+
+	// The names are all ASCII.
+	std::string Narrow(const std::wstring& text)
+	{
+		return std::string(text.begin(), text.end());
+	}
+
+	std::wstring Widen(const std::string& text)
+	{
+		return std::wstring(text.begin(), text.end());
+	}
+
+	// The layers write their colour straight to a UNORM target, so it is taken as sRGB.
+	float3 ToLab(const uint8_t* rgb)
+	{
+		float linear[3];
+		for (int c = 0; c < 3; c++)
+		{
+			const float v = rgb[c] / 255.0f;
+			linear[c] = (v <= 0.04045f) ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+		}
+		// XYZ relative to the D65 white point.
+		const float xyz[3] =
+		{
+			(0.4124f * linear[0] + 0.3576f * linear[1] + 0.1805f * linear[2]) / 0.95047f,
+			0.2126f * linear[0] + 0.7152f * linear[1] + 0.0722f * linear[2],
+			(0.0193f * linear[0] + 0.1192f * linear[1] + 0.9505f * linear[2]) / 1.08883f
+		};
+		float f[3];
+		for (int c = 0; c < 3; c++)
+		{
+			f[c] = (xyz[c] > 0.008856f) ? std::cbrt(xyz[c]) : 7.787f * xyz[c] + 16.0f / 116.0f;
+		}
+		return float3(116.0f * f[1] - 16.0f, 500.0f * (f[0] - f[1]), 200.0f * (f[1] - f[2]));
+	}
+
+	std::vector<uint8_t> Quantise(const SdfImage& image)
+	{
+		std::vector<uint8_t> rgb(image.colour.size() * 3);
+		for (size_t i = 0; i < image.colour.size(); i++)
+		{
+			const float3& c = image.colour[i];
+			rgb[3 * i + 0] = static_cast<uint8_t>(clamp(c.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+			rgb[3 * i + 1] = static_cast<uint8_t>(clamp(c.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+			rgb[3 * i + 2] = static_cast<uint8_t>(clamp(c.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+		return rgb;
+	}
+
+	// Fills in the image part of result.
+	void Compare(const SdfRegressionSettings& settings, int width, int height, const std::vector<uint8_t>& actual, const std::vector<uint8_t>& golden, SdfRegressionResult& result)
+	{
+		const int pixels = width * height;
+		std::vector<float3> actualLab(pixels), goldenLab(pixels);
+		for (int i = 0; i < pixels; i++)
+		{
+			actualLab[i] = ToLab(&actual[3 * i]);
+			goldenLab[i] = ToLab(&golden[3 * i]);
+		}
+
+		double sum = 0.0;
+		result.maxDeltaE = 0.0;
+		result.wrongPixels = 0;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const int i = y * width + x;
+				const float deltaE = length(actualLab[i] - goldenLab[i]);
+				sum += deltaE;
+				result.maxDeltaE = std::max(result.maxDeltaE, static_cast<double>(deltaE));
+
+				float nearest = deltaE;
+				for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++)
+				{
+					for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++)
+					{
+						nearest = std::min(nearest, length(actualLab[i] - goldenLab[ny * width + nx]));
+					}
+				}
+				result.wrongPixels += (nearest > settings.pixelDeltaE) ? 1 : 0;
+			}
+		}
+		result.meanDeltaE = sum / pixels;
+		result.imagePassed = result.wrongPixels <= settings.maxWrongFraction * pixels && result.meanDeltaE <= settings.maxMeanDeltaE;
+	}
+}
+
+std::vector<SdfRegressionCase> SdfRegression::GetCases()
+{
+	std::vector<SdfBenchmarkScene> scenes = SdfBenchmark::GetScenes();
+	std::vector<SdfRegressionCase> cases;
+	for (const CaseDefinition& definition : CaseDefinitions)
+	{
+		if (std::wstring(definition.layer) == L"ShinySpheres")
+		{
+			SdfRegressionCase regressionCase;
+			regressionCase.layer = definition.layer;
+			regressionCase.name = definition.name;
+			regressionCase.spheres = true;
+			regressionCase.camera = SdfBenchmark::SpheresCamera(Width, Height);
+			regressionCase.camera.eye += definition.eyeOffset;
+			regressionCase.time = definition.time;
+			regressionCase.budgetMs = definition.budgetMs;
+			regressionCase.budgetStepsPerPixel = definition.budgetStepsPerPixel;
+			regressionCase.budgetMapCallsPerPixel = definition.budgetMapCallsPerPixel;
+			cases.push_back(regressionCase);
+			continue;
+		}
+		for (SdfBenchmarkScene& scene : scenes)
+		{
+			if (scene.name != definition.layer)
+			{
+				continue;
+			}
+			SdfBenchmark::SetViewport(scene, Width, Height);
+
+			SdfRegressionCase regressionCase;
+			regressionCase.layer = definition.layer;
+			regressionCase.name = definition.name;
+			regressionCase.scene = scene.scene;
+			regressionCase.camera = scene.camera;
+			regressionCase.camera.eye += definition.eyeOffset;
+			regressionCase.march = scene.march;
+			regressionCase.time = definition.time;
+			regressionCase.budgetMs = definition.budgetMs;
+			regressionCase.budgetStepsPerPixel = definition.budgetStepsPerPixel;
+			regressionCase.budgetMapCallsPerPixel = definition.budgetMapCallsPerPixel;
+			cases.push_back(regressionCase);
+		}
+	}
+	return cases;
+}
+
+std::vector<std::wstring> SdfRegression::GetLayersWithoutCpuPath()
+{
+	return { L"Terrain", L"Plants", L"Snake" };
+}
+
+std::wstring SdfRegression::Run(const SdfRegressionSettings& settings, std::vector<SdfRegressionResult>& results, bool& passed)
+{
+	const long long run = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	std::ostringstream lines;
+	results.clear();
+	passed = true;
+
+	for (const SdfRegressionCase& regressionCase : GetCases())
+	{
+		SdfImage image;
+		double seconds = 1e30;
+		double steps = 0.0;
+		double mapCalls = 0.0;
+		double pixels = 0.0;
+		if (regressionCase.spheres)
+		{
+			// The shader's linear loop over the spheres, as ShinySpheresPS has no BVH.
+			const SphereScene spheres = SphereScene::ShinySpheres();
+			SphereTracer tracer(spheres, nullptr, SphereLighting());
+			SphereTraceStats stats;
+			for (int timing = 0; timing < TimingRuns; timing++)
+			{
+				tracer.Render(regressionCase.camera, image, &stats);
+				seconds = std::min(seconds, stats.seconds);
+			}
+			steps = static_cast<double>(stats.GetRayCount());
+			mapCalls = static_cast<double>(stats.queries.sphereTests + stats.shadowQueries.sphereTests);
+			pixels = static_cast<double>(stats.primaryRays);
+		}
+		else
+		{
+			SdfProgram program;
+			program.Compile(regressionCase.scene);
+			SdfBvh bvh;
+			bvh.Build(program);
+			SdfRaymarcher raymarcher(bvh, regressionCase.march);
+			SdfContext context;
+			context.time = regressionCase.time;
+
+			SdfRenderStats stats;
+			for (int timing = 0; timing < TimingRuns; timing++)
+			{
+				raymarcher.Render(regressionCase.camera, context, image, &stats);
+				seconds = std::min(seconds, stats.seconds);
+			}
+			steps = static_cast<double>(stats.steps);
+			mapCalls = static_cast<double>(stats.march.mapCalls + stats.shading.mapCalls);
+			pixels = static_cast<double>(stats.rays);
+		}
+
+		SdfRegressionResult result;
+		result.layer = regressionCase.layer;
+		result.name = regressionCase.name;
+		result.ms = seconds * 1e3;
+		result.stepsPerPixel = steps / pixels;
+		result.mapCallsPerPixel = mapCalls / pixels;
+		result.timePassed = result.ms <= regressionCase.budgetMs * settings.timeScale;
+		result.workPassed = result.stepsPerPixel <= regressionCase.budgetStepsPerPixel && result.mapCallsPerPixel <= regressionCase.budgetMapCallsPerPixel;
+
+		const std::wstring file = regressionCase.layer + L"_" + regressionCase.name + L".ppm";
+		const std::vector<uint8_t> rgb = Quantise(image);
+		int goldenWidth, goldenHeight;
+		std::vector<uint8_t> golden;
+		if (settings.updateGoldens)
+		{
+			WriteImage(settings.goldenDirectory + L"/" + file, image.width, image.height, rgb);
+			result.status = L"updated";
+		}
+		else if (!ReadImage(settings.goldenDirectory + L"/" + file, goldenWidth, goldenHeight, golden) ||
+			goldenWidth != image.width || goldenHeight != image.height)
+		{
+			result.imagePassed = false;
+			result.status = L"missing golden";
+		}
+		else
+		{
+			Compare(settings, image.width, image.height, rgb, golden, result);
+			result.status = (result.imagePassed && result.timePassed && result.workPassed) ? L"pass" : L"fail";
+		}
+
+		if (!result.imagePassed || !result.timePassed || !result.workPassed)
+		{
+			passed = false;
+			if (!settings.outputDirectory.empty())
+			{
+				WriteImage(settings.outputDirectory + L"/" + file, image.width, image.height, rgb);
+			}
+		}
+
+		lines << "{\"run\":" << run << ",\"layer\":\"" << Narrow(result.layer) << "\",\"case\":\"" << Narrow(result.name)
+			<< "\",\"status\":\"" << Narrow(result.status) << "\",\"width\":" << image.width << ",\"height\":" << image.height
+			<< ",\"ms\":" << result.ms << ",\"budgetMs\":" << regressionCase.budgetMs * settings.timeScale
+			<< ",\"stepsPerPixel\":" << result.stepsPerPixel << ",\"budgetStepsPerPixel\":" << regressionCase.budgetStepsPerPixel
+			<< ",\"mapCallsPerPixel\":" << result.mapCallsPerPixel << ",\"budgetMapCallsPerPixel\":" << regressionCase.budgetMapCallsPerPixel
+			<< ",\"meanDeltaE\":" << result.meanDeltaE << ",\"maxDeltaE\":" << result.maxDeltaE << ",\"wrongPixels\":" << result.wrongPixels
+			<< ",\"imagePassed\":" << (result.imagePassed ? "true" : "false") << ",\"timePassed\":" << (result.timePassed ? "true" : "false")
+			<< ",\"workPassed\":" << (result.workPassed ? "true" : "false") << "}\n";
+		results.push_back(result);
+	}
+
+	for (const std::wstring& layer : GetLayersWithoutCpuPath())
+	{
+		SdfRegressionResult result;
+		result.layer = layer;
+		result.status = L"no cpu path";
+		lines << "{\"run\":" << run << ",\"layer\":\"" << Narrow(layer) << "\",\"status\":\"no cpu path\"}\n";
+		results.push_back(result);
+	}
+
+	const std::string text = lines.str();
+	FILE* file = nullptr;
+	if (!settings.outputDirectory.empty() && _wfopen_s(&file, (settings.outputDirectory + L"/regression.jsonl").c_str(), L"ab") == 0 && file)
+	{
+		fwrite(text.data(), 1, text.size(), file);
+		fclose(file);
+	}
+	return Widen(text);
+}
+
+bool SdfRegression::ReadImage(const std::wstring& path, int& width, int& height, std::vector<uint8_t>& rgb)
+{
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"rb") != 0 || !file)
+	{
+		return false;
+	}
+	int maxValue = 0;
+	const bool ok = fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && maxValue == 255 && width > 0 && height > 0 &&
+		fgetc(file) != EOF;
+	if (ok)
+	{
+		rgb.resize(static_cast<size_t>(width) * height * 3);
+	}
+	const bool read = ok && fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	fclose(file);
+	return read;
+}
+
+bool SdfRegression::WriteImage(const std::wstring& path, int width, int height, const std::vector<uint8_t>& rgb)
+{
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"wb") != 0 || !file)
+	{
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	const bool written = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	fclose(file);
+	return written;
+}
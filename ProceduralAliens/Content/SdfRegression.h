@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include "SdfBenchmark.h"
+#include <string>
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// One fixed camera and time for one layer, and what rendering it may cost. The work budgets
+	// are per pixel and the same on any machine; the time budget is for the machine the goldens
+	// were made on, see SdfRegressionSettings::timeScale.
+	struct SdfRegressionCase
+	{
+		std::wstring layer;
+		std::wstring name; // the golden image is <layer>_<name>.ppm
+		// Traced by SphereTracer instead of marched; scene, march and time are unused. Its steps
+		// are rays (primary, reflection and shadow) and its map calls are sphere tests.
+		bool spheres = false;
+		SdfScene scene;
+		SdfCamera camera;
+		SdfMarchSettings march;
+		float time;
+		double budgetMs;
+		double budgetStepsPerPixel;
+		double budgetMapCallsPerPixel;
+	};
+
+	struct SdfRegressionSettings
+	{
+		std::wstring goldenDirectory;
+		// regression.jsonl gets a line per case per run; renders that fail are written here too.
+		std::wstring outputDirectory;
+		// Write every render as its new golden instead of comparing.
+		bool updateGoldens = false;
+		// Multiplies every time budget, for machines slower or faster than the reference one.
+		double timeScale = 1.0;
+
+		// Perceptual tolerance, in CIE76 delta E (Lab), where 2.3 is about one just noticeable
+		// difference. A pixel only counts as wrong if no golden pixel in its 3x3 neighbourhood is
+		// within pixelDeltaE, so edges moving by less than a pixel don't fail the image.
+		float pixelDeltaE = 2.3f;
+		float maxWrongFraction = 0.002f;
+		float maxMeanDeltaE = 0.5f;
+	};
+
+	struct SdfRegressionResult
+	{
+		std::wstring layer;
+		std::wstring name;
+		// "pass", "fail", "updated", "missing golden" or "no cpu path".
+		std::wstring status;
+		double ms = 0;
+		double stepsPerPixel = 0;
+		double mapCallsPerPixel = 0;
+		double meanDeltaE = 0;
+		double maxDeltaE = 0;
+		int wrongPixels = 0;
+		bool imagePassed = true;
+		bool timePassed = true;
+		bool workPassed = true;
+	};
+
+	// Golden image and performance budget checks for the layers, rendered on the CPU so they run
+	// without a window or GPU. ShinySpheres is traced by SphereTracer. Terrain, plants and snakes
+	// are rasterised and have no CPU path; they are listed in the results as such rather than
+	// left out.
+	class SdfRegression
+	{
+	public:
+		static std::vector<SdfRegressionCase> GetCases();
+		static std::vector<std::wstring> GetLayersWithoutCpuPath();
+
+		// Runs every case, appends the results to regression.jsonl and returns the same lines.
+		// passed is false if any case failed its image or a budget.
+		static std::wstring Run(const SdfRegressionSettings& settings, std::vector<SdfRegressionResult>& results, bool& passed);
+
+		// Binary PPM (P6), 8 bits per channel.
+		static bool ReadImage(const std::wstring& path, int& width, int& height, std::vector<uint8_t>& rgb);
+		static bool WriteImage(const std::wstring& path, int width, int height, const std::vector<uint8_t>& rgb);
+	};
+}
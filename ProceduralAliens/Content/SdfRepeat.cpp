@@ -0,0 +1,287 @@
+﻿#include "pch.h"
+#include "SdfRepeat.h"
+#include <algorithm>
+#include <limits>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const float Infinity = std::numeric_limits<float>::infinity();
+	const float TwoPi = 6.2831853f;
+
+	// Hash() from InfiniteShapesPS, so the CPU and the shader pick the same variants.
+	float Hash(const float2& grid)
+	{
+		float h = dot(grid, float2(127.1f, 311.7f));
+		return frac(std::sin(h) * 43758.5453123f);
+	}
+
+	// Slab test against a box relative to the ray origin, (near, far); near > far on a miss.
+	float2 IntersectBox(const float3& origin, const float3& inverseDirection, const SdfAabb& box)
+	{
+		float3 t1 = (box.min - origin) * inverseDirection;
+		float3 t2 = (box.max - origin) * inverseDirection;
+		float3 tnear = min(t1, t2);
+		float3 tfar = max(t1, t2);
+		return float2(std::max(std::max(tnear.x, tnear.y), tnear.z), std::min(std::min(tfar.x, tfar.y), tfar.z));
+	}
+
+	// 1/x, but never infinite, so a zero direction component can't turn a slab test into 0 * inf.
+	float SafeInverse(float x)
+	{
+		const float tiny = 1e-20f;
+		return 1.0f / ((std::fabs(x) < tiny) ? (x < 0.0f ? -tiny : tiny) : x);
+	}
+}
+
+SdfRepeatField::SdfRepeatField(const SdfRepeatSettings& settings) :
+	m_settings(settings),
+	m_minY(Infinity),
+	m_maxY(-Infinity),
+	m_gap(0.5f * settings.period)
+{
+}
+
+void SdfRepeatField::AddVariant(const SdfField& field, const SdfBound& bound)
+{
+	Variant variant;
+	variant.field = &field;
+	variant.bound = bound;
+	m_variants.push_back(variant);
+
+	const SdfAabb& box = bound.box;
+	m_minY = std::min(m_minY, std::min(box.min.y * m_settings.minScale, box.min.y * m_settings.maxScale));
+	m_maxY = std::max(m_maxY, std::max(box.max.y * m_settings.minScale, box.max.y * m_settings.maxScale));
+
+	// How far from the cell centre the content reaches in x and z, in any rotation.
+	float reach;
+	if (m_settings.rotate)
+	{
+		float rx = std::max(std::fabs(box.min.x), std::fabs(box.max.x));
+		float rz = std::max(std::fabs(box.min.z), std::fabs(box.max.z));
+		reach = std::sqrt(rx * rx + rz * rz);
+	}
+	else
+	{
+		reach = std::max(std::max(std::fabs(box.min.x), std::fabs(box.max.x)), std::max(std::fabs(box.min.z), std::fabs(box.max.z)));
+	}
+	m_gap = std::min(m_gap, 0.5f * m_settings.period - reach * m_settings.maxScale);
+}
+
+SdfRepeatCell SdfRepeatField::GetCell(int x, int z) const
+{
+	SdfRepeatCell cell;
+	cell.x = x;
+	cell.z = z;
+
+	const float2 grid(static_cast<float>(x), static_cast<float>(z));
+	const int count = static_cast<int>(m_variants.size());
+	cell.variant = std::min(static_cast<int>(Hash(grid) * count), count - 1);
+	cell.scale = lerp(m_settings.minScale, m_settings.maxScale, Hash(grid + float2(0.5f, 0.5f)));
+	const float angle = m_settings.rotate ? TwoPi * Hash(grid + float2(0.25f, 0.75f)) : 0.0f;
+	cell.cosAngle = std::cos(angle);
+	cell.sinAngle = std::sin(angle);
+
+	// The variant's box turned and scaled into cell space. Distances scale with the content, so
+	// the bound's own scale factor carries over unchanged.
+	const SdfBound& bound = m_variants[cell.variant].bound;
+	const float3 centre = bound.box.Centre();
+	const float3 half = bound.box.Extent() * 0.5f;
+	const float c = cell.cosAngle;
+	const float s = cell.sinAngle;
+	const float3 turnedCentre(c * centre.x - s * centre.z, centre.y, s * centre.x + c * centre.z);
+	const float3 turnedHalf(std::fabs(c) * half.x + std::fabs(s) * half.z, half.y, std::fabs(s) * half.x + std::fabs(c) * half.z);
+	cell.bound.box.min = (turnedCentre - turnedHalf) * cell.scale;
+	cell.bound.box.max = (turnedCentre + turnedHalf) * cell.scale;
+	cell.bound.scale = bound.scale;
+	return cell;
+}
+
+float2 SdfRepeatField::Map(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const float period = m_settings.period;
+	const int x = static_cast<int>(std::floor(point.x / period));
+	const int z = static_cast<int>(std::floor(point.z / period));
+	const float3 q(point.x - (x + 0.5f) * period, point.y, point.z - (z + 0.5f) * period);
+	float2 res = CellDistance(GetCell(x, z), q, context, stats);
+
+	// The neighbours' content may be nearer than this cell's once the point is closer to the cell's
+	// edge than to its content, or, when that content spills over the edge, to the spill.
+	const float border = 0.5f * period - std::max(std::fabs(q.x), std::fabs(q.z));
+	if (res.x > border + std::min(m_gap, 0.0f))
+	{
+		if (m_gap >= 0.0f)
+		{
+			res.x = std::min(res.x, border + m_gap);
+		}
+		else
+		{
+			res = NeighbourDistance(point, x, z, res, context, stats);
+		}
+	}
+	return res;
+}
+
+float3 SdfRepeatField::Gradient(const float3& point, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const float period = m_settings.period;
+	int x = static_cast<int>(std::floor(point.x / period));
+	int z = static_cast<int>(std::floor(point.z / period));
+
+	// Spilled content may belong to a neighbour: take the gradient of whichever cell is nearest.
+	if (m_gap < 0.0f)
+	{
+		float best = Infinity;
+		int bestX = x;
+		int bestZ = z;
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				const float3 q(point.x - (x + dx + 0.5f) * period, point.y, point.z - (z + dz + 0.5f) * period);
+				const float d = CellDistance(GetCell(x + dx, z + dz), q, context, stats).x;
+				if (d < best)
+				{
+					best = d;
+					bestX = x + dx;
+					bestZ = z + dz;
+				}
+			}
+		}
+		x = bestX;
+		z = bestZ;
+	}
+
+	const float3 q(point.x - (x + 0.5f) * period, point.y, point.z - (z + 0.5f) * period);
+	const SdfRepeatCell cell = GetCell(x, z);
+	if (m_settings.cellCulling && cell.bound.box.Distance(q) > m_settings.cullDistance)
+	{
+		return SdfField::Gradient(point, context, stats);
+	}
+
+	// The scale cancels: d = s * f(R q / s) has gradient R^T grad f.
+	const float c = cell.cosAngle;
+	const float s = cell.sinAngle;
+	const float3 local(c * q.x + s * q.z, q.y, -s * q.x + c * q.z);
+	SdfContext localContext = context;
+	localContext.footprint = context.footprint / cell.scale;
+	const float3 g = m_variants[cell.variant].field->Gradient(local / cell.scale, localContext, stats);
+	return float3(c * g.x - s * g.z, g.y, s * g.x + c * g.z);
+}
+
+float2 SdfRepeatField::CellDistance(const SdfRepeatCell& cell, const float3& q, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const float boxDistance = cell.bound.box.Distance(q);
+	if (m_settings.cellCulling && boxDistance > m_settings.cullDistance)
+	{
+		if (stats)
+		{
+			stats->mapCalls++;
+		}
+		return float2(cell.bound.scale * boxDistance, 0.0f);
+	}
+
+	// Into the variant's own space: undo the rotation, then the scale.
+	const float c = cell.cosAngle;
+	const float s = cell.sinAngle;
+	const float3 local(c * q.x + s * q.z, q.y, -s * q.x + c * q.z);
+	SdfContext localContext = context;
+	localContext.footprint = context.footprint / cell.scale;
+	float2 res = m_variants[cell.variant].field->Map(local / cell.scale, localContext, stats);
+	res.x *= cell.scale;
+	return res;
+}
+
+float2 SdfRepeatField::NeighbourDistance(const float3& point, int x, int z, float2 best, const SdfContext& context, SdfEvalStats* stats) const
+{
+	const float period = m_settings.period;
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			if (dx == 0 && dz == 0)
+			{
+				continue;
+			}
+			const SdfRepeatCell cell = GetCell(x + dx, z + dz);
+			const float3 q(point.x - (x + dx + 0.5f) * period, point.y, point.z - (z + dz + 0.5f) * period);
+			if (cell.bound.scale * cell.bound.box.Distance(q) >= best.x)
+			{
+				continue;
+			}
+			const float2 res = CellDistance(cell, q, context, stats);
+			if (res.x < best.x)
+			{
+				best = res;
+			}
+		}
+	}
+	return best;
+}
+
+// Walks the cells the ray crosses, in order, until one whose box the ray goes through. Above and
+// below the band every variant fits in there is nothing at all. When the content spills over the
+// cell edges (negative gap) the neighbours' boxes reach into the cell too, so each step tests all
+// nine; spill past the neighbours would need a wider ring, so the walk is off then.
+float SdfRepeatField::SkipEmpty(const float3& origin, const float3& direction, float t, float tmax) const
+{
+	if (!m_settings.cellCulling || m_variants.empty() || m_gap < -m_settings.period)
+	{
+		return t;
+	}
+
+	const float3 inverse(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+	const float ty1 = (m_minY - origin.y) * inverse.y;
+	const float ty2 = (m_maxY - origin.y) * inverse.y;
+	t = std::max(t, std::min(ty1, ty2));
+	const float tend = std::min(tmax, std::max(ty1, ty2));
+	if (t >= tend)
+	{
+		return tmax;
+	}
+
+	const float period = m_settings.period;
+	const float3 start = origin + direction * t;
+	int x = static_cast<int>(std::floor(start.x / period));
+	int z = static_cast<int>(std::floor(start.z / period));
+	const int stepX = direction.x < 0.0f ? -1 : 1;
+	const int stepZ = direction.z < 0.0f ? -1 : 1;
+	const int ring = (m_gap < 0.0f) ? 1 : 0;
+	while (t < tend)
+	{
+		const float exitX = ((x + 0.5f + 0.5f * stepX) * period - origin.x) * inverse.x;
+		const float exitZ = ((z + 0.5f + 0.5f * stepZ) * period - origin.z) * inverse.z;
+		const float exit = std::min(exitX, exitZ);
+
+		float hit = Infinity;
+		for (int dz = -ring; dz <= ring; dz++)
+		{
+			for (int dx = -ring; dx <= ring; dx++)
+			{
+				const float3 centre((x + dx + 0.5f) * period, 0.0f, (z + dz + 0.5f) * period);
+				const float2 span = IntersectBox(origin - centre, inverse, GetCell(x + dx, z + dz).bound.box);
+				if (span.x <= span.y && span.y >= t && span.x <= exit)
+				{
+					hit = std::min(hit, std::max(t, span.x));
+				}
+			}
+		}
+		if (hit < Infinity)
+		{
+			return hit;
+		}
+
+		t = std::max(t, exit);
+		if (exitX < exitZ)
+		{
+			x += stepX;
+		}
+		else
+		{
+			z += stepZ;
+		}
+	}
+	return tmax;
+}
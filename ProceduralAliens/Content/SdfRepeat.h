@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include "SdfBounds.h"
+#include "SdfField.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// How each cell of an SdfRepeatField varies its content. Everything is derived from Hash() of
+	// the cell coordinates, the same way InfiniteShapesPS does with CELL_VARIANTS.
+	struct SdfRepeatSettings
+	{
+		float period = 15.0f;
+		float minScale = 1.0f;
+		float maxScale = 1.0f;
+		bool rotate = false;
+
+		// Off to evaluate every cell's field at every point, as map() does: the reference for the
+		// culled version.
+		bool cellCulling = true;
+		// Points further than this from their cell's bound get the bound distance instead of a
+		// field evaluation. The bound is a box, so close to it the field steps much further.
+		float cullDistance = 1.0f;
+	};
+
+	// One cell's variant, scale and rotation about y, and the bound of its content in cell space
+	// (relative to the cell centre).
+	struct SdfRepeatCell
+	{
+		int x;
+		int z;
+		int variant;
+		float scale;
+		float cosAngle;
+		float sinAngle;
+		SdfBound bound;
+	};
+
+	// RepeatXZ(period, content) where each cell picks one of several contents (variants), a scale
+	// and a rotation from a hash of its coordinates. Every variant has a bound, so a point far from
+	// its cell's content costs a box distance instead of a field evaluation, and a ray that misses
+	// a cell's box skips the cell entirely (SkipEmpty).
+	class SdfRepeatField : public SdfField
+	{
+	public:
+		SdfRepeatField(const SdfRepeatSettings& settings);
+
+		// bound must hold for field in the field's own space; SdfBounds::Compute of the scene root.
+		void AddVariant(const SdfField& field, const SdfBound& bound);
+
+		SdfRepeatCell GetCell(int x, int z) const;
+
+		virtual Hlsl::float2 Map(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+		virtual Hlsl::float3 Gradient(const Hlsl::float3& point, const SdfContext& context, SdfEvalStats* stats) const override;
+		virtual float SkipEmpty(const Hlsl::float3& origin, const Hlsl::float3& direction, float t, float tmax) const override;
+
+		const SdfRepeatSettings& GetSettings() const { return m_settings; }
+
+	private:
+		struct Variant
+		{
+			const SdfField* field;
+			SdfBound bound;
+		};
+
+		// Distance to one cell's content at q, relative to the cell centre: the box distance when
+		// culling allows it, the variant's field otherwise.
+		Hlsl::float2 CellDistance(const SdfRepeatCell& cell, const Hlsl::float3& q, const SdfContext& context, SdfEvalStats* stats) const;
+		// best, or the content of one of the eight cells around (x, z) if that is nearer. For content
+		// that spills over the cell edges.
+		Hlsl::float2 NeighbourDistance(const Hlsl::float3& point, int x, int z, Hlsl::float2 best, const SdfContext& context, SdfEvalStats* stats) const;
+
+		SdfRepeatSettings m_settings;
+		std::vector<Variant> m_variants;
+		// Every variant at every scale and rotation fits in [minY, maxY], and at least m_gap inside
+		// its cell's edges in x and z (negative if it spills over).
+		float m_minY;
+		float m_maxY;
+		float m_gap;
+	};
+}
@@ -0,0 +1,82 @@
+﻿#include "pch.h"
+#include "SdfReprojection.h"
+#include <chrono>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+SdfReprojection::SdfReprojection() :
+	m_valid(false)
+{
+}
+
+void SdfReprojection::Reset()
+{
+	m_valid = false;
+}
+
+// Scatters every previous hit to the four pixels around where it lands, keeping the nearest,
+// so surfaces that grow on screen as the camera moves in don't leave holes.
+void SdfReprojection::Reproject(const SdfCamera& camera, std::vector<float2>& seeds) const
+{
+	seeds.assign(camera.width * camera.height, float2(0.0f, -1.0f));
+	if (!m_valid || m_camera.width != camera.width || m_camera.height != camera.height)
+	{
+		return;
+	}
+
+	for (int y = 0; y < m_previous.height; y++)
+	{
+		for (int x = 0; x < m_previous.width; x++)
+		{
+			const float t = m_previous.t[y * m_previous.width + x];
+			const float material = m_previous.material[y * m_previous.width + x];
+			if (t < 0.0f)
+			{
+				continue;
+			}
+
+			float3 position = m_camera.eye + m_camera.RayDirection(static_cast<float>(x), static_cast<float>(y)) * t;
+			float2 pixel;
+			if (!camera.Project(position, pixel))
+			{
+				continue;
+			}
+
+			const float distance = length(position - camera.eye);
+			const int px = static_cast<int>(std::floor(pixel.x));
+			const int py = static_cast<int>(std::floor(pixel.y));
+			for (int sy = py; sy <= py + 1; sy++)
+			{
+				for (int sx = px; sx <= px + 1; sx++)
+				{
+					if (sx < 0 || sy < 0 || sx >= camera.width || sy >= camera.height)
+					{
+						continue;
+					}
+					float2& seed = seeds[sy * camera.width + sx];
+					if (seed.x <= 0.0f || distance < seed.x)
+					{
+						seed = float2(distance, material);
+					}
+				}
+			}
+		}
+	}
+}
+
+void SdfReprojection::Render(const SdfRaymarcher& raymarcher, const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<float2> seeds;
+	Reproject(camera, seeds);
+	raymarcher.Render(camera, context, image, stats, &seeds);
+	if (stats)
+	{
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	m_camera = camera;
+	m_previous = image;
+	m_valid = true;
+}
@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include "SdfRaymarcher.h"
+
+namespace ProceduralAliens
+{
+	// Temporal cache for the CPU raymarcher. Keeps the previous frame's camera, hit distances and
+	// materials; each new frame reprojects the previous hits into the new view and uses them to
+	// seed the rays, which then only need a few steps to verify. Pixels nothing reprojects to
+	// (disocclusions, the frame edge, last frame's misses) are marched in full.
+	class SdfReprojection
+	{
+	public:
+		SdfReprojection();
+
+		void Reset();
+		void Render(const SdfRaymarcher& raymarcher, const SdfCamera& camera, const SdfContext& context, SdfImage& image, SdfRenderStats* stats);
+
+	private:
+		void Reproject(const SdfCamera& camera, std::vector<Hlsl::float2>& seeds) const;
+
+		SdfCamera m_camera;
+		SdfImage m_previous;
+		bool m_valid;
+	};
+}
@@ -0,0 +1,401 @@
+﻿#include "pch.h"
+#include "SdfScene.h"
+#include <cstring>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	// FNV-1a, 64 bit.
+	const uint64_t HashBasis = 14695981039346656037ull;
+	const uint64_t HashPrime = 1099511628211ull;
+
+	template <typename T>
+	void HashValue(uint64_t& hash, const T& value)
+	{
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		for (unsigned char byte : bytes)
+		{
+			hash = (hash ^ byte) * HashPrime;
+		}
+	}
+}
+
+SdfScene::SdfScene() :
+	m_root(-1)
+{
+}
+
+int SdfScene::AddNode(SdfNodeType type, std::initializer_list<float> params)
+{
+	SdfNode node;
+	node.type = type;
+	int i = 0;
+	for (float param : params)
+	{
+		node.params[i++] = param;
+	}
+	m_nodes.push_back(node);
+	return static_cast<int>(m_nodes.size()) - 1;
+}
+
+int SdfScene::AddUnary(SdfNodeType type, int child, std::initializer_list<float> params)
+{
+	int node = AddNode(type, params);
+	m_nodes[node].children.push_back(child);
+	return node;
+}
+
+int SdfScene::Empty()
+{
+	return AddNode(SdfNodeType::Empty, {});
+}
+
+// params: radius
+int SdfScene::Sphere(float radius)
+{
+	return AddNode(SdfNodeType::Sphere, { radius });
+}
+
+// params: half size xyz
+int SdfScene::Box(const float3& halfSize)
+{
+	return AddNode(SdfNodeType::Box, { halfSize.x, halfSize.y, halfSize.z });
+}
+
+// params: radii xyz
+int SdfScene::Ellipsoid(const float3& radii)
+{
+	return AddNode(SdfNodeType::Ellipsoid, { radii.x, radii.y, radii.z });
+}
+
+// params: half size xyz, rounding radius
+int SdfScene::RoundBox(const float3& halfSize, float radius)
+{
+	return AddNode(SdfNodeType::RoundBox, { halfSize.x, halfSize.y, halfSize.z, radius });
+}
+
+// params: major radius, minor radius
+int SdfScene::Torus(const float2& t)
+{
+	return AddNode(SdfNodeType::Torus, { t.x, t.y });
+}
+
+int SdfScene::Torus82(const float2& t)
+{
+	return AddNode(SdfNodeType::Torus82, { t.x, t.y });
+}
+
+int SdfScene::Torus88(const float2& t)
+{
+	return AddNode(SdfNodeType::Torus88, { t.x, t.y });
+}
+
+// params: radius, half height
+int SdfScene::HexPrism(const float2& h)
+{
+	return AddNode(SdfNodeType::HexPrism, { h.x, h.y });
+}
+
+// params: a xyz, b xyz, radius
+int SdfScene::Capsule(const float3& a, const float3& b, float radius)
+{
+	return AddNode(SdfNodeType::Capsule, { a.x, a.y, a.z, b.x, b.y, b.z, radius });
+}
+
+// params: a xyz, b xyz, r1, r2
+int SdfScene::RoundCone(const float3& a, const float3& b, float r1, float r2)
+{
+	return AddNode(SdfNodeType::RoundCone, { a.x, a.y, a.z, b.x, b.y, b.z, r1, r2 });
+}
+
+// params: radius, half height
+int SdfScene::Cylinder(const float2& h)
+{
+	return AddNode(SdfNodeType::Cylinder, { h.x, h.y });
+}
+
+// params: half height, bottom radius, top radius
+int SdfScene::CappedCone(float h, float r1, float r2)
+{
+	return AddNode(SdfNodeType::CappedCone, { h, r1, r2 });
+}
+
+// params: size
+int SdfScene::Octahedron(float s)
+{
+	return AddNode(SdfNodeType::Octahedron, { s });
+}
+
+// params: scale, iterations
+int SdfScene::Sierpinski(float scale, float iterations)
+{
+	return AddNode(SdfNodeType::Sierpinski, { scale, iterations });
+}
+
+// params: iterations, power
+int SdfScene::Mandelbulb(int iterations, float power)
+{
+	return AddNode(SdfNodeType::Mandelbulb, { static_cast<float>(iterations), power });
+}
+
+int SdfScene::Translate(const float3& offset, int child)
+{
+	return AddUnary(SdfNodeType::Translate, child, { offset.x, offset.y, offset.z });
+}
+
+int SdfScene::Twist(int child)
+{
+	return AddUnary(SdfNodeType::Twist, child, {});
+}
+
+int SdfScene::Repeat(const float3& period, int child)
+{
+	return AddUnary(SdfNodeType::Repeat, child, { period.x, period.y, period.z });
+}
+
+int SdfScene::RepeatXZ(float period, int child)
+{
+	return AddUnary(SdfNodeType::RepeatXZ, child, { period });
+}
+
+int SdfScene::DomainWave(const SdfWave& wave, int child)
+{
+	int node = AddUnary(SdfNodeType::DomainWave, child, {});
+	m_nodes[node].wave = wave;
+	return node;
+}
+
+int SdfScene::Scale(float factor, int child)
+{
+	return AddUnary(SdfNodeType::Scale, child, { factor });
+}
+
+int SdfScene::DistanceWave(const SdfWave& wave, int child)
+{
+	int node = AddUnary(SdfNodeType::DistanceWave, child, {});
+	m_nodes[node].wave = wave;
+	return node;
+}
+
+int SdfScene::Material(float id, int child)
+{
+	int node = AddUnary(SdfNodeType::Material, child, {});
+	m_nodes[node].material = id;
+	return node;
+}
+
+int SdfScene::Union(std::initializer_list<int> children)
+{
+	return Union(std::vector<int>(children));
+}
+
+int SdfScene::Union(const std::vector<int>& children)
+{
+	int node = AddNode(SdfNodeType::Union, {});
+	m_nodes[node].children = children;
+	return node;
+}
+
+int SdfScene::Subtract(int a, int b)
+{
+	int node = AddNode(SdfNodeType::Subtract, {});
+	m_nodes[node].children = { a, b };
+	return node;
+}
+
+int SdfScene::SmoothMin(int a, int b, float radius, float radiusTimeAmplitude)
+{
+	int node = AddNode(SdfNodeType::SmoothMin, { radius, radiusTimeAmplitude });
+	m_nodes[node].children = { a, b };
+	return node;
+}
+
+int SdfScene::SmoothMax(int a, int b, float radius, float radiusTimeAmplitude)
+{
+	int node = AddNode(SdfNodeType::SmoothMax, { radius, radiusTimeAmplitude });
+	m_nodes[node].children = { a, b };
+	return node;
+}
+
+int SdfScene::Disabled(int node)
+{
+	m_nodes[node].enabled = false;
+	return node;
+}
+
+bool SdfScene::IsTimeVarying(const SdfNode& n)
+{
+	for (int i = 0; i < n.wave.terms; i++)
+	{
+		if (n.wave.timeScale[i] != 0.0f)
+		{
+			return true;
+		}
+	}
+	return (n.type == SdfNodeType::SmoothMin || n.type == SdfNodeType::SmoothMax) && n.params[1] != 0.0f;
+}
+
+bool SdfScene::IsAnimated(int node) const
+{
+	const SdfNode& n = m_nodes[node];
+	if (!n.enabled)
+	{
+		return false;
+	}
+	if (IsTimeVarying(n))
+	{
+		return true;
+	}
+	for (int child : n.children)
+	{
+		if (IsAnimated(child))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+SdfScene SdfScene::KeepTerms(bool animated) const
+{
+	SdfScene scene = *this;
+	int node = m_root;
+	while (node >= 0 && (IsDomainTransform(m_nodes[node].type) || IsDistanceModifier(m_nodes[node].type)))
+	{
+		node = m_nodes[node].children[0];
+	}
+	if (node < 0)
+	{
+		return scene;
+	}
+
+	if (m_nodes[node].type == SdfNodeType::Union)
+	{
+		for (int term : m_nodes[node].children)
+		{
+			if (IsAnimated(term) != animated)
+			{
+				scene.m_nodes[term].enabled = false;
+			}
+		}
+	}
+	else if (IsAnimated(node) != animated)
+	{
+		scene.m_nodes[node].enabled = false;
+	}
+	return scene;
+}
+
+void SdfScene::SplitNode(int node, SdfScene& staticPart, SdfScene& dynamicPart) const
+{
+	const SdfNode& n = m_nodes[node];
+	if (!n.enabled)
+	{
+		return;
+	}
+	if (!IsAnimated(node))
+	{
+		dynamicPart.m_nodes[node].enabled = false;
+		return;
+	}
+
+	// min(a, b, ...) splits term by term, f(min(s, d)) = min(f(s), f(d)) for a static unary f,
+	// and max(min(s, d), -b) = min(max(s, -b), max(d, -b)), so b stays in both halves.
+	if (n.type == SdfNodeType::Union)
+	{
+		for (int child : n.children)
+		{
+			SplitNode(child, staticPart, dynamicPart);
+		}
+	}
+	else if ((IsDomainTransform(n.type) || IsDistanceModifier(n.type)) && !IsTimeVarying(n))
+	{
+		SplitNode(n.children[0], staticPart, dynamicPart);
+	}
+	else if (n.type == SdfNodeType::Subtract && !IsAnimated(n.children[1]))
+	{
+		SplitNode(n.children[0], staticPart, dynamicPart);
+	}
+	else
+	{
+		staticPart.m_nodes[node].enabled = false;
+	}
+}
+
+SdfSplit SdfScene::Split(SdfScene& staticPart, SdfScene& dynamicPart) const
+{
+	staticPart = *this;
+	dynamicPart = *this;
+	SdfSplit split;
+	if (m_root < 0)
+	{
+		return split;
+	}
+
+	// softMin2(a, b, k) shifts with a and b and scales with k, so a smooth union under the
+	// root's static unary nodes can be split too, with the radius scaled on the way.
+	float scale = 1.0f;
+	bool material = false;
+	int node = m_root;
+	while (m_nodes[node].enabled && (IsDomainTransform(m_nodes[node].type) || IsDistanceModifier(m_nodes[node].type)) &&
+		!IsTimeVarying(m_nodes[node]))
+	{
+		if (m_nodes[node].type == SdfNodeType::Scale)
+		{
+			scale *= m_nodes[node].params[0];
+		}
+		material = material || (m_nodes[node].type == SdfNodeType::Material);
+		node = m_nodes[node].children[0];
+	}
+
+	const SdfNode& n = m_nodes[node];
+	if (n.enabled && n.type == SdfNodeType::SmoothMin && !IsTimeVarying(n) && n.params[0] > 0.0f && scale > 0.0f &&
+		IsAnimated(n.children[0]) != IsAnimated(n.children[1]))
+	{
+		const bool firstAnimated = IsAnimated(n.children[0]);
+		staticPart.m_nodes[n.children[firstAnimated ? 0 : 1]].enabled = false;
+		dynamicPart.m_nodes[n.children[firstAnimated ? 1 : 0]].enabled = false;
+		split.blend = n.params[0] * scale;
+		split.dynamicMaterial = firstAnimated && !material;
+		return split;
+	}
+
+	SplitNode(m_root, staticPart, dynamicPart);
+	return split;
+}
+
+uint64_t SdfScene::Hash(int node, bool children) const
+{
+	uint64_t hash = HashBasis;
+	if (node < 0 || !m_nodes[node].enabled)
+	{
+		HashValue(hash, -1);
+		return hash;
+	}
+
+	const SdfNode& n = m_nodes[node];
+	HashValue(hash, n.type);
+	for (float param : n.params)
+	{
+		HashValue(hash, param);
+	}
+	HashValue(hash, n.material);
+	HashValue(hash, n.wave.amplitude);
+	HashValue(hash, n.wave.terms);
+	for (int i = 0; i < n.wave.terms; i++)
+	{
+		HashValue(hash, n.wave.frequency[i]);
+		HashValue(hash, n.wave.timeScale[i]);
+	}
+	if (children)
+	{
+		for (int child : n.children)
+		{
+			HashValue(hash, Hash(child));
+		}
+	}
+	return hash;
+}
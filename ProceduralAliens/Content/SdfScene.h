@@ -0,0 +1,165 @@
+﻿#pragma once
+
+#include "HlslMath.h"
+#include <cstdint>
+#include <vector>
+#include <initializer_list>
+
+namespace ProceduralAliens
+{
+	enum class SdfNodeType : uint8_t
+	{
+		Empty,
+
+		// Primitives (leaves). Parameter layout is listed next to each builder below.
+		Sphere,
+		Box,
+		Ellipsoid,
+		RoundBox,
+		Torus,
+		Torus82,
+		Torus88,
+		HexPrism,
+		Capsule,
+		RoundCone,
+		Cylinder,
+		CappedCone,
+		Octahedron,
+		Sierpinski,
+		Mandelbulb,
+
+		// Domain transforms (one child, change the point the child sees).
+		Translate,
+		Twist,
+		Repeat,
+		RepeatXZ,
+		DomainWave,
+
+		// Distance modifiers (one child, change the distance the child returns).
+		Scale,
+		DistanceWave,
+		Material,
+
+		// Combinators.
+		Union,
+		Subtract,
+		SmoothMin,
+		SmoothMax
+	};
+
+	// amplitude * product of sin(dot(frequency[i], p) + timeScale[i] * time) over the first 'terms' factors.
+	// Covers the leg wobble, the brain ripple and the sin(45x)sin(45y)sin(45z) surface noise in InfiniteShapesPS.
+	struct SdfWave
+	{
+		float amplitude = 0;
+		int terms = 0;
+		Hlsl::float3 frequency[3];
+		float timeScale[3] = { 0, 0, 0 };
+	};
+
+	struct SdfNode
+	{
+		SdfNodeType type = SdfNodeType::Empty;
+		bool enabled = true;
+		float params[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		float material = 0;
+		SdfWave wave;
+		std::vector<int> children;
+	};
+
+	// How the two halves of SdfScene::Split() combine back into the scene: min, or softMin2 with
+	// radius 'blend' when the split is at a smooth union. A smooth union keeps its first operand's
+	// material, so dynamicMaterial says whether that has to come from the dynamic half.
+	struct SdfSplit
+	{
+		float blend = 0;
+		bool dynamicMaterial = false;
+	};
+
+	// Data-driven description of an SDF scene: a tree of primitives, domain transforms,
+	// CSG/smooth operators and material ids. Compile it with SdfProgram to evaluate it.
+	class SdfScene
+	{
+	public:
+		SdfScene();
+
+		// Primitives. Material ids are usually assigned with Material() around a subtree,
+		// the way the shaders wrap a distance in float2(d, id).
+		int Empty();
+		int Sphere(float radius);
+		int Box(const Hlsl::float3& halfSize);
+		int Ellipsoid(const Hlsl::float3& radii);
+		int RoundBox(const Hlsl::float3& halfSize, float radius);
+		int Torus(const Hlsl::float2& t);
+		int Torus82(const Hlsl::float2& t);
+		int Torus88(const Hlsl::float2& t);
+		int HexPrism(const Hlsl::float2& h);
+		int Capsule(const Hlsl::float3& a, const Hlsl::float3& b, float radius);
+		int RoundCone(const Hlsl::float3& a, const Hlsl::float3& b, float r1, float r2);
+		int Cylinder(const Hlsl::float2& h);
+		int CappedCone(float h, float r1, float r2);
+		int Octahedron(float s);
+		int Sierpinski(float scale, float iterations);
+		int Mandelbulb(int iterations, float power = 8.0f);
+
+		// Domain transforms. Translate(offset, child) evaluates child at p - offset.
+		int Translate(const Hlsl::float3& offset, int child);
+		int Twist(int child);
+		int Repeat(const Hlsl::float3& period, int child);
+		int RepeatXZ(float period, int child);
+		int DomainWave(const SdfWave& wave, int child);
+
+		// Distance modifiers.
+		int Scale(float factor, int child);
+		int DistanceWave(const SdfWave& wave, int child);
+		int Material(float id, int child);
+
+		// Combinators. Subtract, SmoothMin and SmoothMax keep the material of the first operand.
+		// The smooth radius is radius + radiusTimeAmplitude * abs(sin(time)).
+		int Union(std::initializer_list<int> children);
+		int Union(const std::vector<int>& children);
+		int Subtract(int a, int b);
+		int SmoothMin(int a, int b, float radius, float radiusTimeAmplitude = 0);
+		int SmoothMax(int a, int b, float radius, float radiusTimeAmplitude = 0);
+
+		// Marks a subtree as disabled; the compiler removes it. Used for the commented out
+		// parts of the shader scenes (arms, lasers) so they can be toggled without editing code.
+		int Disabled(int node);
+
+		// Whether the subtree changes with time: waves with a time scale or pulsing smooth radii.
+		bool IsAnimated(int node) const;
+		// Copy in which only the top level terms (the union under the root's unary nodes)
+		// whose IsAnimated() matches 'animated' stay enabled: the static or the moving part.
+		SdfScene KeepTerms(bool animated) const;
+		// Splits the scene into a static half, which can be baked or cached, and a dynamic half that
+		// has to be evaluated live. Unlike KeepTerms() this looks through nested unions, through
+		// time invariant unary nodes and through subtractions of static shapes, all of which
+		// distribute over the min; anything else that moves goes to the dynamic half whole. A
+		// smooth union with a constant radius at the top is split with the blend recorded instead.
+		SdfSplit Split(SdfScene& staticPart, SdfScene& dynamicPart) const;
+		// Hash of what a node compiles to, with its subtree or without, so that an edited copy of
+		// the scene can be told apart from the original term by term. Disabled subtrees all hash
+		// the same.
+		uint64_t Hash(int node, bool children = true) const;
+
+		void SetRoot(int node) { m_root = node; }
+		int GetRoot() const { return m_root; }
+		const SdfNode& GetNode(int node) const { return m_nodes[node]; }
+		SdfNode& GetNode(int node) { return m_nodes[node]; }
+		int GetNodeCount() const { return static_cast<int>(m_nodes.size()); }
+
+		static bool IsPrimitive(SdfNodeType type) { return type >= SdfNodeType::Sphere && type <= SdfNodeType::Mandelbulb; }
+		static bool IsDomainTransform(SdfNodeType type) { return type >= SdfNodeType::Translate && type <= SdfNodeType::DomainWave; }
+		static bool IsDistanceModifier(SdfNodeType type) { return type >= SdfNodeType::Scale && type <= SdfNodeType::Material; }
+
+	private:
+		int AddNode(SdfNodeType type, std::initializer_list<float> params);
+		int AddUnary(SdfNodeType type, int child, std::initializer_list<float> params);
+		// Whether the node's own parameters change with time, not counting its children.
+		static bool IsTimeVarying(const SdfNode& n);
+		void SplitNode(int node, SdfScene& staticPart, SdfScene& dynamicPart) const;
+
+		std::vector<SdfNode> m_nodes;
+		int m_root;
+	};
+}
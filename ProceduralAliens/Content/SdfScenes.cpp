@@ -0,0 +1,270 @@
+﻿#include "pch.h"
+#include "SdfScenes.h"
+#include "SdfPrimitives.h"
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	SdfWave MakeWave(float amplitude, std::initializer_list<float3> frequencies, float timeScale)
+	{
+		SdfWave wave;
+		wave.amplitude = amplitude;
+		for (const float3& frequency : frequencies)
+		{
+			wave.frequency[wave.terms] = frequency;
+			wave.timeScale[wave.terms] = timeScale;
+			wave.terms++;
+		}
+		return wave;
+	}
+
+	// 0.03*sin(45.0*pos.x)*sin(45.0*pos.y)*sin(45.0*pos.z) style surface noise.
+	SdfWave SurfaceNoise(float amplitude)
+	{
+		return MakeWave(amplitude, { float3(45, 0, 0), float3(0, 45, 0), float3(0, 0, 45) }, 0.0f);
+	}
+
+	// One cell of InfiniteShapes, the union under RepeatXZ: a pylon, and optionally the alien and
+	// the spaceship that hovers over it.
+	int AddInfiniteShapesCell(SdfScene& s, bool alien, bool spaceship)
+	{
+		std::vector<int> terms;
+
+		//pylons
+		terms.push_back(s.Material(90, s.Translate(float3(0, 2.5f, 0), s.Torus(float2(0.2f, 0.01f)))));
+		terms.push_back(s.Material(65, s.Translate(float3(0, 2.5f, 0), s.Sphere(0.1f))));
+		terms.push_back(s.Material(90, s.Translate(float3(0, 2, 0),
+			s.Subtract(s.Torus82(float2(0.5f, 0.1f)), s.Cylinder(float2(2, 0.05f))))));
+		terms.push_back(s.Material(65, s.Translate(float3(0, 2, 0),
+			s.Subtract(s.Sphere(0.2f), s.Cylinder(float2(2, 0.05f))))));
+		terms.push_back(s.Material(90, s.Translate(float3(0, 1, 0), s.Cylinder(float2(0.03f, 2)))));
+		terms.push_back(s.Material(65, s.DistanceWave(SurfaceNoise(0.03f),
+			s.Scale(0.5f, s.Translate(float3(0, 3, 0), s.Sphere(0.1f))))));
+
+		if (alien)
+		{
+			//aliens
+			//body
+			terms.push_back(s.Material(100, s.Subtract(
+				s.Translate(float3(2, 0, 1), s.Sphere(0.25f)),
+				s.Union({
+					s.Translate(float3(1.75f, 0, 1), s.Capsule(float3(-0.5f, 0, 0), float3(0.5f, 0, 0), 0.15f)),
+					s.Translate(float3(2, -0.25f, 1), s.Capsule(float3(0, -0.5f, 0), float3(0, 0.5f, 0), 0.15f)),
+					s.Translate(float3(2, 0, 0.75f), s.Capsule(float3(0, 0, -0.5f), float3(0, 0, 0.5f), 0.15f)) }))));
+
+			//eye
+			terms.push_back(s.Material(20, s.Translate(float3(2, 0, 1), s.Sphere(0.2f))));
+			terms.push_back(s.Material(82, s.Translate(float3(2, 0, 1), s.Capsule(float3(0, 0, 0), float3(0, 0, -0.12f), 0.1f))));
+
+			//arms
+			terms.push_back(s.Disabled(s.Material(80, s.DomainWave(MakeWave(0.02f, { float3(45, 0, 0), float3(0, 0, 45) }, 0.0f),
+				s.Translate(float3(2, 0, 1), s.Capsule(float3(-0.5f, 0, 0), float3(0.5f, 0, 0), 0.05f))))));
+
+			//legs
+			const float3 feet[] = {
+				float3(0.5f, -1, 0), float3(0, -1, -0.4f), float3(-0.5f, -1, 0.2f),
+				float3(0.25f, -1, 0.4f), float3(0, -1, 0), float3(-0.25f, -1, 0.7f) };
+			SdfWave legWave = MakeWave(0.02f, { float3(0, 20, 0) }, 1.0f);
+			for (const float3& foot : feet)
+			{
+				terms.push_back(s.Material(100, s.DomainWave(legWave,
+					s.Translate(float3(2, 0, 1), s.Capsule(float3(0, 0, 0), foot, 0.05f)))));
+			}
+
+			//brain
+			terms.push_back(s.Material(90, s.SmoothMin(
+				s.DomainWave(MakeWave(0.005f, { float3(20, 0, 0), float3(0, 0, 45) }, 1.0f),
+					s.Translate(float3(2, 0, 1), s.RoundCone(float3(0, 0.5f, 0), float3(0, 0, 0), 0.3f, 0.01f))),
+				s.Translate(float3(2, 0.5f, 1), s.Twist(s.Torus(float2(0.25f, 0.1f)))),
+				0.2f)));
+
+			//laser
+			const float laserZ[] = { 0.5f, 0.0f, -0.5f };
+			const float laserRadius[] = { 0.02f, 0.03f, 0.04f };
+			for (int i = 0; i < 3; i++)
+			{
+				terms.push_back(s.Disabled(s.Material(65, s.DomainWave(SurfaceNoise(0.02f),
+					s.Translate(float3(2, 0, laserZ[i]), s.Capsule(float3(0, 0, 0), float3(0, 0, -0.25f), laserRadius[i]))))));
+			}
+		}
+
+		if (spaceship)
+		{
+			//spaceship
+			terms.push_back(s.Material(90, s.Subtract(s.Subtract(
+				s.SmoothMax(
+					s.Translate(float3(2, 3, -1), s.Sphere(0.7f)),
+					s.Translate(float3(2, 3, -1.2f), s.Torus88(float2(0.6f, 0.3f))),
+					0.8f),
+				s.Translate(float3(2, 3, -2), s.Repeat(float3(1, 1, 0.1f), s.Cylinder(float2(0.02f, 6))))),
+				s.Translate(float3(1, 3, -2), s.Repeat(float3(1, 1, 0.1f), s.Cylinder(float2(0.02f, 6)))))));
+
+			terms.push_back(s.Material(65, s.DomainWave(SurfaceNoise(0.02f),
+				s.Translate(float3(2, 3, -1.2f), s.Sphere(0.2f)))));
+		}
+
+		return s.Union(terms);
+	}
+}
+
+SdfScene SdfScenes::BuildInfiniteShapes()
+{
+	SdfScene s;
+	s.SetRoot(s.RepeatXZ(15, AddInfiniteShapesCell(s, true, true)));
+	return s;
+}
+
+SdfScene SdfScenes::BuildInfiniteShapesCell(bool alien, bool spaceship)
+{
+	SdfScene s;
+	s.SetRoot(AddInfiniteShapesCell(s, alien, spaceship));
+	return s;
+}
+
+SdfScene SdfScenes::BuildPrimitives()
+{
+	SdfScene s;
+
+	//simple primitive examples
+	s.SetRoot(s.Material(50, s.Union({
+		s.Translate(float3(-4, -3, 0), s.Octahedron(0.5f)),
+		s.Translate(float3(-3, -3, 0), s.Ellipsoid(float3(0.5f, 0.2f, 0.7f))),
+		s.Translate(float3(-2, -3, 0), s.Box(float3(0.3f, 0.7f, 0.5f))),
+		s.Translate(float3(-1, -3, 0), s.HexPrism(float2(0.5f, 0.7f))),
+		s.Translate(float3(0, -3, 0), s.CappedCone(0.5f, 0.4f, 0.1f)),
+		s.Translate(float3(2, -3, 0), s.SmoothMax(
+			s.Ellipsoid(float3(0.5f, 0.2f, 0.7f)),
+			s.CappedCone(0.5f, 0.4f, 0.1f),
+			0.0f, -1.0f)),
+		s.Translate(float3(4, -3, 0), s.SmoothMax(
+			s.Octahedron(0.2f),
+			s.Box(float3(0.5f, 0.5f, 0.5f)),
+			0.0f, -1.0f)) })));
+
+	return s;
+}
+
+SdfScene SdfScenes::BuildFractal()
+{
+	SdfScene s;
+
+	s.SetRoot(s.Union({
+		s.Material(5, s.Translate(float3(-2, -1, -7), s.Sierpinski(2, 15))),
+		s.Material(40, s.Translate(float3(2, -1, -7), s.Mandelbulb(25))) }));
+
+	return s;
+}
+
+//------------------------------------------------------------------
+// Hand-written references, ported from the map() functions in the shaders.
+
+float2 SdfScenes::InfiniteShapesMap(const float3& inpos, float time)
+{
+	float3 pos = inpos;
+	pos.x = (frac(inpos.x / 15) - 0.5f) * 15;
+	pos.z = (frac(inpos.z / 15) - 0.5f) * 15;
+
+	float2 res;
+	const float noise = std::sin(45.0f * pos.x) * std::sin(45.0f * pos.y) * std::sin(45.0f * pos.z);
+
+	//pylons
+	res = opU(
+		float2(sdTorus(pos - float3(0, 2.5f, 0), float2(0.2f, 0.01f)), 90),
+		float2(sdSphere(pos - float3(0, 2.5f, 0), 0.1f), 65));
+
+	res = opU(res, float2(opS(
+		sdTorus82(pos - float3(0, 2, 0), float2(0.5f, 0.1f)),
+		sdCylinder(pos - float3(0, 2, 0), float2(2, 0.05f))), 90));
+
+	res = opU(res, float2(opS(
+		sdSphere(pos - float3(0, 2, 0), 0.2f),
+		sdCylinder(pos - float3(0, 2, 0), float2(2, 0.05f))), 65));
+
+	res = opU(res, float2(sdCylinder(pos - float3(0, 1, 0), float2(0.03f, 2)), 90));
+
+	res = opU(res, float2(0.5f * sdSphere(pos - float3(0, 3, 0), 0.1f) + 0.03f * noise, 65));
+
+	//aliens
+	//body
+	res = opU(res, float2(opS(
+		sdSphere(pos - float3(2, 0, 1), 0.25f),
+		std::min(std::min(
+			sdCapsule(pos - float3(1.75f, 0, 1), float3(-0.5f, 0, 0), float3(0.5f, 0, 0), 0.15f),
+			sdCapsule(pos - float3(2, -0.25f, 1), float3(0, -0.5f, 0), float3(0, 0.5f, 0), 0.15f)),
+			sdCapsule(pos - float3(2, 0, 0.75f), float3(0, 0, -0.5f), float3(0, 0, 0.5f), 0.15f))),
+		100));
+
+	//eye
+	res = opU(res, float2(sdSphere(pos - float3(2, 0, 1), 0.2f), 20));
+	res = opU(res, float2(sdCapsule(pos - float3(2, 0, 1), float3(0, 0, 0), float3(0, 0, -0.12f), 0.1f), 82));
+
+	//legs
+	const float wobble = 0.02f * std::sin(20 * pos.y + time);
+	const float3 legPos = pos - float3(2, 0, 1) + float3(wobble, wobble, wobble);
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(0.5f, -1, 0), 0.05f), 100));
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(0, -1, -0.4f), 0.05f), 100));
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(-0.5f, -1, 0.2f), 0.05f), 100));
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(0.25f, -1, 0.4f), 0.05f), 100));
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(0, -1, 0), 0.05f), 100));
+	res = opU(res, float2(sdCapsule(legPos, float3(0, 0, 0), float3(-0.25f, -1, 0.7f), 0.05f), 100));
+
+	//brain
+	const float ripple = 0.005f * std::sin(20 * pos.x + time) * std::sin(45 * pos.z + time);
+	res = opU(res, float2(softMin2(
+		sdRoundCone(pos - float3(2, 0, 1) + float3(ripple, ripple, ripple), float3(0, 0.5f, 0), float3(0, 0, 0), 0.3f, 0.01f),
+		sdTorus(opTwist(pos - float3(2, 0.5f, 1)), float2(0.25f, 0.1f)), 0.2f), 90));
+
+	//spaceship
+	res = opU(res, float2(opS(opS(
+		softMax2(sdSphere(pos - float3(2, 3, -1), 0.7f),
+			sdTorus88(pos - float3(2, 3, -1.2f), float2(0.6f, 0.3f)),
+			0.8f),
+		sdCylinder(opRep(pos - float3(2, 3, -2), float3(1, 1, 0.1f)), float2(0.02f, 6))),
+		sdCylinder(opRep(pos - float3(1, 3, -2), float3(1, 1, 0.1f)), float2(0.02f, 6))),
+		90));
+
+	const float hullNoise = 0.02f * noise;
+	res = opU(res, float2(sdSphere(pos - float3(2, 3, -1.2f) + float3(hullNoise, hullNoise, hullNoise), 0.2f), 65));
+
+	return res;
+}
+
+float2 SdfScenes::PrimitivesMap(const float3& inpos, float time)
+{
+	float3 pos = inpos;
+
+	float2 res(1e10f, 0.0f);
+	const float blend = -std::fabs(std::sin(time));
+
+	//simple primitive examples
+	res = opU(res, float2(sdOctahedron(pos - float3(-4, -3, 0), 0.5f), 50));
+	res = opU(res, float2(sdEllipsoid(pos - float3(-3, -3, 0), float3(0.5f, 0.2f, 0.7f)), 50));
+	res = opU(res, float2(sdBox(pos - float3(-2, -3, 0), float3(0.3f, 0.7f, 0.5f)), 50));
+	res = opU(res, float2(sdHexPrism(pos - float3(-1, -3, 0), float2(0.5f, 0.7f)), 50));
+	res = opU(res, float2(sdCappedCone(pos - float3(0, -3, 0), 0.5f, 0.4f, 0.1f), 50));
+
+	res = opU(res, float2(softMax2(sdEllipsoid(pos - float3(2, -3, 0), float3(0.5f, 0.2f, 0.7f)),
+		sdCappedCone(pos - float3(2, -3, 0), 0.5f, 0.4f, 0.1f),
+		blend), 50));
+
+	res = opU(res, float2(softMax2(sdOctahedron(pos - float3(4, -3, 0), 0.2f),
+		sdBox(pos - float3(4, -3, 0), float3(0.5f, 0.5f, 0.5f)),
+		blend), 50));
+
+	return res;
+}
+
+float2 SdfScenes::FractalMap(const float3& inpos, float /*time*/)
+{
+	float3 pos = inpos;
+
+	float2 res(1e10f, 0.0f);
+
+	res = opU(res, float2(sdSierpinski(pos - float3(-2, -1, -7), 2, 15), 5));
+
+	res = opU(res, float2(sdMandelbulb(pos - float3(2, -1, -7), 25), 40));
+
+	return res;
+}
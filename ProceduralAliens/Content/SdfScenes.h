@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include "SdfScene.h"
+
+namespace ProceduralAliens
+{
+	// The three raymarched layers described as SdfScene graphs, plus direct C++ ports of their
+	// hand-written map() functions used as the reference for correctness and speed.
+	namespace SdfScenes
+	{
+		SdfScene BuildInfiniteShapes();
+		// The content of one InfiniteShapes cell without the repetition, optionally leaving out the
+		// creatures: the variants of an SdfRepeatField.
+		SdfScene BuildInfiniteShapesCell(bool alien, bool spaceship);
+		SdfScene BuildPrimitives();
+		SdfScene BuildFractal();
+
+		Hlsl::float2 InfiniteShapesMap(const Hlsl::float3& inpos, float time);
+		Hlsl::float2 PrimitivesMap(const Hlsl::float3& inpos, float time);
+		Hlsl::float2 FractalMap(const Hlsl::float3& inpos, float time);
+	}
+}
@@ -167,15 +167,16 @@ float4 Phong(float3 n, float3 l, float3 v, float shininess, float4 diffuseColour
 	return diff * diffuseColour + spec * specularColour;
 }
 
-bool Shadow(Ray ray)
+// Any-hit query for shadow rays: true if the ray enters some sphere at tmin <= t < tmax. It
+// returns at the first such sphere, which needn't be the nearest. A ray leaving a surface towards
+// the light can't re-enter its own sphere, so shadow rays start at tmin 0.
+bool Occluded(Ray ray, float tmin, float tmax)
 {
-	bool anyHit = false;
-	int hits = 0;
-	float minT = farPlane;
 	for (int i = 0; i < NOBJECTS; i++)
 	{
-		float t = SphereIntersect(object[i], ray, anyHit);
-		if (anyHit)
+		bool hit = false;
+		float t = SphereIntersect(object[i], ray, hit);
+		if (hit && t >= tmin && t < tmax)
 		{
 			return true;
 		}
@@ -185,7 +186,9 @@ bool Shadow(Ray ray)
 
 float4 Shade(float3 hitPos, float3 normal, float3 viewDir, int hitObj, float lightIntensity)
 {
-	float3 lightDir = normalize(lightPos.xyz - hitPos);
+	float3 toLight = lightPos.xyz - hitPos;
+	float lightDistance = length(toLight);
+	float3 lightDir = toLight / lightDistance;
 	float4 diff = object[hitObj].colour * object[hitObj].Kd * FractalNoise(hitPos.xy);
 	float4 spec = object[hitObj].colour * object[hitObj].Ks;
 
@@ -193,7 +196,7 @@ float4 Shade(float3 hitPos, float3 normal, float3 viewDir, int hitObj, float lig
 	lightRay.o = hitPos;
 	lightRay.d = lightDir;
 
-	return !Shadow(lightRay) * lightColour * lightIntensity * Phong(normal, lightDir, viewDir, object[hitObj].shininess, diff, spec);
+	return !Occluded(lightRay, 0, lightDistance) * lightColour * lightIntensity * Phong(normal, lightDir, viewDir, object[hitObj].shininess, diff, spec);
 }
 
 
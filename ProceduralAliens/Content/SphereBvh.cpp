@@ -0,0 +1,698 @@
+﻿#include "pch.h"
+#include "SphereBvh.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <ppl.h>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const float Infinity = std::numeric_limits<float>::infinity();
+	const int Bins = 16;
+	// SAH costs, in units of one leaf test of Lanes spheres.
+	const float TraversalCost = 1.0f;
+	const float IntersectCost = 1.0f;
+	// Past this depth nodes split at the median, which keeps every path short enough for the
+	// traversal stack whatever the spheres look like.
+	const int MaxSahDepth = 32;
+	const int MaxStackDepth = 64;
+	// Levels narrower than this are refitted on one thread.
+	const int SerialRefitNodes = 256;
+
+	// 1/x, but never infinite, so a zero direction component can't turn a slab test into 0 * inf.
+	float SafeInverse(float x)
+	{
+		const float tiny = 1e-20f;
+		return 1.0f / ((std::fabs(x) < tiny) ? (x < 0.0f ? -tiny : tiny) : x);
+	}
+
+	// Entry distance of the ray into box within [tmin, tmax), Infinity if it doesn't get there.
+	float EnterBox(const float3& origin, const float3& inverseDirection, const SdfAabb& box, float tmin, float tmax)
+	{
+		const float3 t1 = (box.min - origin) * inverseDirection;
+		const float3 t2 = (box.max - origin) * inverseDirection;
+		const float3 tnear = min(t1, t2);
+		const float3 tfar = max(t1, t2);
+		const float enter = std::max(std::max(std::max(tnear.x, tnear.y), tnear.z), tmin);
+		const float exit = std::min(std::min(std::min(tfar.x, tfar.y), tfar.z), tmax);
+		return (enter <= exit) ? enter : Infinity;
+	}
+
+	float LeafCost(uint32_t count, int lanes)
+	{
+		return IntersectCost * static_cast<float>((count + lanes - 1) / lanes);
+	}
+}
+
+SphereBvh::SphereBvh() :
+	m_lanes(1),
+	m_depth(0),
+	m_buildSeconds(0),
+	m_fullBuildCost(0)
+{
+}
+
+void SphereBvh::Build(const SphereScene& scene, int lanes)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	m_lanes = lanes;
+	m_depth = 0;
+	m_nodes.clear();
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_radius2.clear();
+	m_sphere.clear();
+	m_cost.clear();
+	m_buildCost.clear();
+
+	const int count = scene.GetCount();
+	std::vector<int> order(count);
+	std::vector<SdfAabb> boxes(count);
+	for (int i = 0; i < count; i++)
+	{
+		order[i] = i;
+		boxes[i] = scene.GetBox(i);
+	}
+
+	if (count > 0)
+	{
+		m_nodes.reserve(2 * (count / lanes + 1));
+		BuildNode(scene, order, boxes, 0, static_cast<uint32_t>(count), 0);
+	}
+	Index();
+	m_fullBuildCost = GetSahCost();
+	m_buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Binned SAH (Wald 2007): the centroids are sorted into Bins slabs along each axis and every
+// boundary between slabs is costed. A leaf's cost is the number of Lanes wide tests it takes.
+int SphereBvh::BuildNode(const SphereScene& scene, std::vector<int>& order, const std::vector<SdfAabb>& boxes, uint32_t first, uint32_t count, int depth)
+{
+	const int index = static_cast<int>(m_nodes.size());
+	m_nodes.push_back(SphereBvhNode());
+	m_cost.push_back(0.0f);
+	m_buildCost.push_back(0.0f);
+	m_depth = std::max(m_depth, depth + 1);
+
+	SdfAabb box = SdfAabb::Empty();
+	SdfAabb centroids = SdfAabb::Empty();
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		const SdfAabb& b = boxes[order[i]];
+		box.Grow(b);
+		SdfAabb c;
+		c.min = c.max = b.Centre();
+		centroids.Grow(c);
+	}
+
+	SphereBvhNode node;
+	node.box = box;
+	node.left = -1;
+	node.right = -1;
+	node.first = 0;
+	node.count = count;
+
+	const uint32_t maxLeaf = static_cast<uint32_t>(std::max(m_lanes, 4));
+	const float3 extent = centroids.Extent();
+	int bestAxis = -1;
+	int bestBin = 0;
+	float bestCost = Infinity;
+	if (count > 1 && depth < MaxSahDepth)
+	{
+		const float area = box.SurfaceArea();
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+			{
+				continue;
+			}
+			SdfAabb binBoxes[Bins];
+			uint32_t binCounts[Bins] = {};
+			for (int b = 0; b < Bins; b++)
+			{
+				binBoxes[b] = SdfAabb::Empty();
+			}
+			const float binScale = Bins / extent[axis];
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const SdfAabb& b = boxes[order[i]];
+				const int bin = std::min(static_cast<int>((b.Centre()[axis] - centroids.min[axis]) * binScale), Bins - 1);
+				binBoxes[bin].Grow(b);
+				binCounts[bin]++;
+			}
+
+			// Areas and counts right of each boundary, then a sweep from the left.
+			float rightArea[Bins];
+			uint32_t rightCount[Bins];
+			SdfAabb right = SdfAabb::Empty();
+			uint32_t n = 0;
+			for (int b = Bins - 1; b > 0; b--)
+			{
+				right.Grow(binBoxes[b]);
+				n += binCounts[b];
+				rightArea[b] = right.IsEmpty() ? 0.0f : right.SurfaceArea();
+				rightCount[b] = n;
+			}
+			SdfAabb left = SdfAabb::Empty();
+			n = 0;
+			for (int b = 1; b < Bins; b++)
+			{
+				left.Grow(binBoxes[b - 1]);
+				n += binCounts[b - 1];
+				if (n == 0 || rightCount[b] == 0)
+				{
+					continue;
+				}
+				const float cost = TraversalCost + (left.SurfaceArea() * LeafCost(n, m_lanes) + rightArea[b] * LeafCost(rightCount[b], m_lanes)) / area;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	uint32_t half = 0;
+	if (count > maxLeaf || (bestAxis >= 0 && bestCost < LeafCost(count, m_lanes)))
+	{
+		if (bestAxis >= 0)
+		{
+			const int axis = bestAxis;
+			const float binScale = Bins / extent[axis];
+			const float minimum = centroids.min[axis];
+			auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](int i)
+			{
+				return std::min(static_cast<int>((boxes[i].Centre()[axis] - minimum) * binScale), Bins - 1) < bestBin;
+			});
+			half = static_cast<uint32_t>(middle - (order.begin() + first));
+		}
+		else
+		{
+			// Coincident centroids, or too deep for the SAH: split the range in two.
+			const int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+			half = count / 2;
+			std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](int a, int b)
+			{
+				return boxes[a].Centre()[axis] < boxes[b].Centre()[axis];
+			});
+		}
+	}
+
+	if (half == 0)
+	{
+		// Leaf: copy the spheres out and pad them to a whole number of tests.
+		node.first = static_cast<uint32_t>(m_radius2.size());
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const int sphere = order[i];
+			const float3 centre = scene.GetCentre(sphere);
+			m_x.push_back(centre.x);
+			m_y.push_back(centre.y);
+			m_z.push_back(centre.z);
+			m_radius2.push_back(scene.GetRadius2(sphere));
+			m_sphere.push_back(sphere);
+		}
+		while (m_radius2.size() % m_lanes != 0)
+		{
+			m_x.push_back(0.0f);
+			m_y.push_back(0.0f);
+			m_z.push_back(0.0f);
+			m_radius2.push_back(-1.0f);
+			m_sphere.push_back(-1);
+		}
+	}
+	else
+	{
+		node.left = BuildNode(scene, order, boxes, first, half, depth + 1);
+		node.right = BuildNode(scene, order, boxes, first + half, count - half, depth + 1);
+		node.count = 0;
+	}
+
+	m_nodes[index] = node;
+	if (node.left < 0)
+	{
+		m_cost[index] = box.SurfaceArea() * LeafCost(count, m_lanes);
+	}
+	else
+	{
+		m_cost[index] = box.SurfaceArea() * TraversalCost + m_cost[node.left] + m_cost[node.right];
+	}
+	m_buildCost[index] = m_cost[index];
+	return index;
+}
+
+void SphereBvh::Index()
+{
+	m_levelNodes.clear();
+	m_levelStarts.clear();
+	m_parent.assign(m_nodes.size(), -1);
+	m_levelStarts.push_back(0);
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	m_levelNodes.push_back(0);
+	size_t begin = 0;
+	while (begin < m_levelNodes.size())
+	{
+		const size_t end = m_levelNodes.size();
+		for (size_t i = begin; i < end; i++)
+		{
+			const int index = m_levelNodes[i];
+			const SphereBvhNode& node = m_nodes[index];
+			if (node.left >= 0)
+			{
+				m_levelNodes.push_back(node.left);
+				m_levelNodes.push_back(node.right);
+				m_parent[node.left] = index;
+				m_parent[node.right] = index;
+			}
+		}
+		m_levelStarts.push_back(static_cast<int>(end));
+		begin = end;
+	}
+	m_depth = static_cast<int>(m_levelStarts.size()) - 1;
+}
+
+void SphereBvh::Refit(const SphereScene& scene)
+{
+	RefitLevels(&scene);
+}
+
+// The children of a level's nodes are all on the level below, so each level only waits for the
+// one under it and its nodes are independent of each other.
+void SphereBvh::RefitLevels(const SphereScene* scene)
+{
+	auto refit = [&](int index)
+	{
+		SphereBvhNode& node = m_nodes[index];
+		if (node.left >= 0)
+		{
+			node.box = m_nodes[node.left].box;
+			node.box.Grow(m_nodes[node.right].box);
+			m_cost[index] = node.box.SurfaceArea() * TraversalCost + m_cost[node.left] + m_cost[node.right];
+			return;
+		}
+		if (scene != nullptr)
+		{
+			SdfAabb box = SdfAabb::Empty();
+			for (uint32_t k = node.first; k < node.first + node.count; k++)
+			{
+				const int sphere = m_sphere[k];
+				const float3 centre = scene->GetCentre(sphere);
+				m_x[k] = centre.x;
+				m_y[k] = centre.y;
+				m_z[k] = centre.z;
+				m_radius2[k] = scene->GetRadius2(sphere);
+				box.Grow(scene->GetBox(sphere));
+			}
+			node.box = box;
+			m_cost[index] = box.SurfaceArea() * LeafCost(node.count, m_lanes);
+		}
+	};
+
+	for (int level = static_cast<int>(m_levelStarts.size()) - 2; level >= 0; level--)
+	{
+		const int begin = m_levelStarts[level];
+		const int end = m_levelStarts[level + 1];
+		if (end - begin < SerialRefitNodes)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				refit(m_levelNodes[i]);
+			}
+		}
+		else
+		{
+			Concurrency::parallel_for(begin, end, [&](int i)
+			{
+				refit(m_levelNodes[i]);
+			});
+		}
+	}
+}
+
+// Refitting keeps traversal correct however far the spheres move, but boxes built around spheres
+// that have since drifted apart overlap more and more. The SAH cost measures that: every box's
+// area is in it, so its growth since a subtree was built is how much slower that subtree has got.
+// Only the treelets that have degraded are rebuilt, from the spheres their leaves hold, and their
+// new nodes are appended; the ones they replace are left unreachable until the next full build.
+SphereBvhUpdateStats SphereBvh::Update(const SphereScene& scene, const SphereBvhUpdateSettings& settings)
+{
+	SphereBvhUpdateStats stats;
+	auto start = std::chrono::high_resolution_clock::now();
+	Refit(scene);
+	auto refitted = std::chrono::high_resolution_clock::now();
+	stats.refitSeconds = std::chrono::duration<double>(refitted - start).count();
+	if (m_nodes.empty())
+	{
+		return stats;
+	}
+
+	const bool degraded = GetSahCost() > settings.fullGrowth * m_fullBuildCost;
+	const bool wasteful = m_nodes.size() > 2 * m_levelNodes.size();
+	if (degraded || wasteful)
+	{
+		Build(scene, m_lanes);
+		stats.fullRebuild = true;
+	}
+	else if (std::max(settings.treeletDepth, 1) < static_cast<int>(m_levelStarts.size()) - 1)
+	{
+		// The root has no parent to hang a rebuilt treelet from, so depth 0 means 1.
+		const int depth = std::max(settings.treeletDepth, 1);
+		std::vector<int> treelets;
+		for (int i = m_levelStarts[depth]; i < m_levelStarts[depth + 1]; i++)
+		{
+			const int index = m_levelNodes[i];
+			if (m_cost[index] > settings.treeletGrowth * m_buildCost[index])
+			{
+				treelets.push_back(index);
+			}
+		}
+		if (!treelets.empty())
+		{
+			std::vector<SdfAabb> boxes(scene.GetCount());
+			Concurrency::parallel_for(0, scene.GetCount(), [&](int i)
+			{
+				boxes[i] = scene.GetBox(i);
+			});
+			for (int index : treelets)
+			{
+				RebuildSubtree(scene, index, depth, boxes);
+			}
+			Index();
+			RefitLevels(nullptr);
+			stats.treeletsRebuilt = static_cast<int>(treelets.size());
+		}
+	}
+	stats.rebuildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - refitted).count();
+	stats.growth = GetSahCost() / m_fullBuildCost;
+	return stats;
+}
+
+void SphereBvh::RebuildSubtree(const SphereScene& scene, int node, int depth, const std::vector<SdfAabb>& boxes)
+{
+	std::vector<int> order;
+	std::vector<int> stack(1, node);
+	while (!stack.empty())
+	{
+		const SphereBvhNode& n = m_nodes[stack.back()];
+		stack.pop_back();
+		if (n.left >= 0)
+		{
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+			continue;
+		}
+		for (uint32_t k = n.first; k < n.first + n.count; k++)
+		{
+			order.push_back(m_sphere[k]);
+		}
+	}
+
+	const int rebuilt = BuildNode(scene, order, boxes, 0, static_cast<uint32_t>(order.size()), depth);
+	SphereBvhNode& parent = m_nodes[m_parent[node]];
+	if (parent.left == node)
+	{
+		parent.left = rebuilt;
+	}
+	else
+	{
+		parent.right = rebuilt;
+	}
+}
+
+float SphereBvh::GetSahCost() const
+{
+	if (m_nodes.empty())
+	{
+		return 0.0f;
+	}
+	return m_cost[0] / m_nodes[0].box.SurfaceArea();
+}
+
+SphereHit SphereBvh::Intersect(const float3& origin, const float3& direction, float tmax, SphereQueryStats* stats) const
+{
+	switch (m_lanes)
+	{
+	case 4:
+		return IntersectLanes<4>(origin, direction, tmax, stats);
+	case 8:
+		return IntersectLanes<8>(origin, direction, tmax, stats);
+	default:
+		return IntersectLanes<1>(origin, direction, tmax, stats);
+	}
+}
+
+// Nearer child first, and nodes are dropped as soon as their entry is beyond the nearest hit. The
+// sphere test is SphereIntersect() written lane by lane with selects, so the compiler can keep
+// a whole leaf in vector registers.
+template <int Lanes>
+SphereHit SphereBvh::IntersectLanes(const float3& origin, const float3& direction, float tmax, SphereQueryStats* stats) const
+{
+	SphereHit hit;
+	hit.t = tmax;
+	hit.sphere = -1;
+	if (m_nodes.empty())
+	{
+		return hit;
+	}
+
+	const float3 inverse(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+	uint64_t nodes = 1;
+	uint64_t tests = 0;
+	int stack[MaxStackDepth];
+	float stackEnter[MaxStackDepth];
+	int top = 0;
+	const float rootEnter = EnterBox(origin, inverse, m_nodes[0].box, 0.0f, tmax);
+	if (rootEnter < Infinity)
+	{
+		stack[top] = 0;
+		stackEnter[top] = rootEnter;
+		top++;
+	}
+
+	while (top > 0)
+	{
+		top--;
+		if (stackEnter[top] >= hit.t)
+		{
+			continue;
+		}
+		const SphereBvhNode& node = m_nodes[stack[top]];
+		if (node.left < 0)
+		{
+			const uint32_t end = node.first + node.count;
+			for (uint32_t base = node.first; base < end; base += Lanes)
+			{
+				float t[Lanes];
+				for (int i = 0; i < Lanes; i++)
+				{
+					const float vx = m_x[base + i] - origin.x;
+					const float vy = m_y[base + i] - origin.y;
+					const float vz = m_z[base + i] - origin.z;
+					const float a = vx * direction.x + vy * direction.y + vz * direction.z;
+					const float b = vx * vx + vy * vy + vz * vz - a * a;
+					const float disc = m_radius2[base + i] - b;
+					const float ti = a - std::sqrt(std::max(disc, 0.0f));
+					t[i] = (disc >= 0.0f && ti >= 0.0f) ? ti : Infinity;
+				}
+				for (int i = 0; i < Lanes; i++)
+				{
+					if (t[i] < hit.t)
+					{
+						hit.t = t[i];
+						hit.sphere = m_sphere[base + i];
+					}
+				}
+				tests += Lanes;
+			}
+			continue;
+		}
+
+		const float enterLeft = EnterBox(origin, inverse, m_nodes[node.left].box, 0.0f, hit.t);
+		const float enterRight = EnterBox(origin, inverse, m_nodes[node.right].box, 0.0f, hit.t);
+		nodes += 2;
+		const bool leftFirst = enterLeft <= enterRight;
+		const int nearChild = leftFirst ? node.left : node.right;
+		const int farChild = leftFirst ? node.right : node.left;
+		const float nearEnter = leftFirst ? enterLeft : enterRight;
+		const float farEnter = leftFirst ? enterRight : enterLeft;
+		if (farEnter < Infinity)
+		{
+			stack[top] = farChild;
+			stackEnter[top] = farEnter;
+			top++;
+		}
+		if (nearEnter < Infinity)
+		{
+			stack[top] = nearChild;
+			stackEnter[top] = nearEnter;
+			top++;
+		}
+	}
+
+	if (stats)
+	{
+		stats->nodes += nodes;
+		stats->sphereTests += tests;
+	}
+	if (hit.sphere < 0)
+	{
+		hit.t = tmax;
+	}
+	return hit;
+}
+
+bool SphereBvh::Occluded(const float3& origin, const float3& direction, float tmin, float tmax, SphereQueryStats* stats) const
+{
+	switch (m_lanes)
+	{
+	case 4:
+		return OccludedLanes<4>(origin, direction, tmin, tmax, stats);
+	case 8:
+		return OccludedLanes<8>(origin, direction, tmin, tmax, stats);
+	default:
+		return OccludedLanes<1>(origin, direction, tmin, tmax, stats);
+	}
+}
+
+// IntersectLanes without the nearest hit to keep: the range never shrinks, so there is nothing to
+// recheck on the stack, and a leaf only has to find one lane that hits. Children still go nearer
+// first; shadow rays start on a surface, and the spheres crowding it are the likeliest blockers.
+template <int Lanes>
+bool SphereBvh::OccludedLanes(const float3& origin, const float3& direction, float tmin, float tmax, SphereQueryStats* stats) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	const float3 inverse(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+	uint64_t nodes = 1;
+	uint64_t tests = 0;
+	const float start = std::max(tmin, 0.0f);
+	bool occluded = false;
+	int stack[MaxStackDepth];
+	int top = 0;
+	if (EnterBox(origin, inverse, m_nodes[0].box, tmin, tmax) < Infinity)
+	{
+		stack[top++] = 0;
+	}
+
+	while (top > 0)
+	{
+		const SphereBvhNode& node = m_nodes[stack[--top]];
+		if (node.left < 0)
+		{
+			const uint32_t end = node.first + node.count;
+			for (uint32_t base = node.first; base < end; base += Lanes)
+			{
+				float t[Lanes];
+				for (int i = 0; i < Lanes; i++)
+				{
+					const float vx = m_x[base + i] - origin.x;
+					const float vy = m_y[base + i] - origin.y;
+					const float vz = m_z[base + i] - origin.z;
+					const float a = vx * direction.x + vy * direction.y + vz * direction.z;
+					const float b = vx * vx + vy * vy + vz * vz - a * a;
+					const float disc = m_radius2[base + i] - b;
+					const float ti = a - std::sqrt(std::max(disc, 0.0f));
+					t[i] = (disc >= 0.0f && ti >= start) ? ti : Infinity;
+				}
+				for (int i = 0; i < Lanes; i++)
+				{
+					if (t[i] < tmax)
+					{
+						occluded = true;
+					}
+				}
+				tests += Lanes;
+				if (occluded)
+				{
+					break;
+				}
+			}
+			if (occluded)
+			{
+				break;
+			}
+			continue;
+		}
+
+		const float enterLeft = EnterBox(origin, inverse, m_nodes[node.left].box, tmin, tmax);
+		const float enterRight = EnterBox(origin, inverse, m_nodes[node.right].box, tmin, tmax);
+		nodes += 2;
+		// Both children are read before the first push; the compiler reloads node after a store
+		// to the stack, which costs about a tenth of the query.
+		const bool leftFirst = enterLeft <= enterRight;
+		const int nearChild = leftFirst ? node.left : node.right;
+		const int farChild = leftFirst ? node.right : node.left;
+		if ((leftFirst ? enterRight : enterLeft) < Infinity)
+		{
+			stack[top++] = farChild;
+		}
+		if ((leftFirst ? enterLeft : enterRight) < Infinity)
+		{
+			stack[top++] = nearChild;
+		}
+	}
+
+	if (stats)
+	{
+		stats->nodes += nodes;
+		stats->sphereTests += tests;
+	}
+	return occluded;
+}
+
+SphereHit SphereBvh::IntersectLinear(const SphereScene& scene, const float3& origin, const float3& direction, float tmax)
+{
+	SphereHit hit;
+	hit.t = tmax;
+	hit.sphere = -1;
+	for (int i = 0; i < scene.GetCount(); i++)
+	{
+		const float3 v = scene.GetCentre(i) - origin;
+		const float a = dot(v, direction);
+		const float b = dot(v, v) - a * a;
+		if (b > scene.GetRadius2(i))
+		{
+			continue;
+		}
+		const float t = a - std::sqrt(scene.GetRadius2(i) - b);
+		if (t >= 0.0f && t < hit.t)
+		{
+			hit.t = t;
+			hit.sphere = i;
+		}
+	}
+	return hit;
+}
+
+bool SphereBvh::OccludedLinear(const SphereScene& scene, const float3& origin, const float3& direction, float tmin, float tmax)
+{
+	for (int i = 0; i < scene.GetCount(); i++)
+	{
+		const float3 v = scene.GetCentre(i) - origin;
+		const float a = dot(v, direction);
+		const float b = dot(v, v) - a * a;
+		if (b > scene.GetRadius2(i))
+		{
+			continue;
+		}
+		const float t = a - std::sqrt(scene.GetRadius2(i) - b);
+		if (t >= 0.0f && t >= tmin && t < tmax)
+		{
+			return true;
+		}
+	}
+	return false;
+}
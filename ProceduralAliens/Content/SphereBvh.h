@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "SphereScene.h"
+#include <vector>
+
+namespace ProceduralAliens
+{
+	struct SphereBvhNode
+	{
+		SdfAabb box;
+		int32_t left;      // child index, or -1 for a leaf
+		int32_t right;
+		uint32_t first;    // leaf sphere range in SphereBvh's own arrays, padded to a lane multiple
+		uint32_t count;    // spheres in the leaf, not counting the padding
+	};
+
+	// Nearest hit along a ray, sphere -1 on a miss.
+	struct SphereHit
+	{
+		float t;
+		int sphere;
+	};
+
+	struct SphereQueryStats
+	{
+		uint64_t nodes = 0;       // boxes tested
+		uint64_t sphereTests = 0; // lanes tested, padding included
+
+		void Add(const SphereQueryStats& other)
+		{
+			nodes += other.nodes;
+			sphereTests += other.sphereTests;
+		}
+	};
+
+	struct SphereBvhUpdateSettings
+	{
+		// Subtrees rooted this deep are what partial rebuilds replace.
+		int treeletDepth = 6;
+		// A treelet is rebuilt once its SAH cost has grown by this factor since it was built, and
+		// the whole tree once its own cost has grown by fullGrowth since the last full build, or
+		// half its nodes are left over from partial rebuilds.
+		float treeletGrowth = 1.3f;
+		float fullGrowth = 1.6f;
+	};
+
+	struct SphereBvhUpdateStats
+	{
+		double refitSeconds = 0;
+		double rebuildSeconds = 0;
+		int treeletsRebuilt = 0;
+		bool fullRebuild = false;
+		float growth = 1.0f; // SAH cost after the update over the cost after the last full build
+	};
+
+	// Bounding volume hierarchy over a SphereScene, built with the surface area heuristic over
+	// binned centroids. The leaves keep their own copy of the spheres as a structure of arrays in
+	// traversal order, padded so that a leaf is a whole number of Lanes wide tests.
+	class SphereBvh
+	{
+	public:
+		SphereBvh();
+
+		// lanes is 1, 4 or 8, the width of the leaf tests.
+		void Build(const SphereScene& scene, int lanes);
+
+		// Moves the bounds to where the spheres are now, keeping the tree as it was built. Runs a
+		// level at a time from the bottom up, with the nodes of each level in parallel.
+		void Refit(const SphereScene& scene);
+		// Refit, then rebuild whatever the settings say has grown too much: some treelets, or
+		// everything. For scenes that move every frame.
+		SphereBvhUpdateStats Update(const SphereScene& scene, const SphereBvhUpdateSettings& settings);
+		// Expected cost of a ray through the root box: node visits plus leaf tests, each weighted
+		// by the chance the ray enters the node, its area over the root's.
+		float GetSahCost() const;
+
+		// NearestHit() from ShinySpheresPS: the sphere the ray enters first at 0 <= t < tmax. A ray
+		// that starts inside a sphere doesn't hit it, as in SphereIntersect().
+		SphereHit Intersect(const Hlsl::float3& origin, const Hlsl::float3& direction, float tmax, SphereQueryStats* stats) const;
+
+		// Occluded() from ShinySpheresPS, the any-hit query for shadow rays: true if the ray enters
+		// some sphere at tmin <= t < tmax. Stops at the first one it finds.
+		bool Occluded(const Hlsl::float3& origin, const Hlsl::float3& direction, float tmin, float tmax, SphereQueryStats* stats) const;
+
+		// The shader's loops over every sphere, to check and time the BVH against.
+		static SphereHit IntersectLinear(const SphereScene& scene, const Hlsl::float3& origin, const Hlsl::float3& direction, float tmax);
+		static bool OccludedLinear(const SphereScene& scene, const Hlsl::float3& origin, const Hlsl::float3& direction, float tmin, float tmax);
+
+		int GetLanes() const { return m_lanes; }
+		int GetNodeCount() const { return static_cast<int>(m_levelNodes.size()); }
+		int GetDepth() const { return m_depth; }
+		double GetBuildSeconds() const { return m_buildSeconds; }
+
+	private:
+		int BuildNode(const SphereScene& scene, std::vector<int>& order, const std::vector<SdfAabb>& boxes, uint32_t first, uint32_t count, int depth);
+		void RebuildSubtree(const SphereScene& scene, int node, int depth, const std::vector<SdfAabb>& boxes);
+		// Lists the nodes reachable from the root level by level; nodes replaced by a partial
+		// rebuild stay in m_nodes but drop out of the lists.
+		void Index();
+		// scene null refits the interior nodes only.
+		void RefitLevels(const SphereScene* scene);
+		template <int Lanes> SphereHit IntersectLanes(const Hlsl::float3& origin, const Hlsl::float3& direction, float tmax, SphereQueryStats* stats) const;
+		template <int Lanes> bool OccludedLanes(const Hlsl::float3& origin, const Hlsl::float3& direction, float tmin, float tmax, SphereQueryStats* stats) const;
+
+		int m_lanes;
+		int m_depth;
+		double m_buildSeconds;
+		std::vector<SphereBvhNode> m_nodes;
+		std::vector<float> m_x;
+		std::vector<float> m_y;
+		std::vector<float> m_z;
+		std::vector<float> m_radius2; // -1 for padding, which nothing can hit
+		std::vector<int> m_sphere;    // index in the scene
+
+		std::vector<float> m_cost;       // area weighted SAH cost of each node's subtree
+		std::vector<float> m_buildCost;  // the same when the subtree was built
+		float m_fullBuildCost;           // GetSahCost() after Build()
+		std::vector<int> m_parent;
+		std::vector<int> m_levelNodes;
+		std::vector<int> m_levelStarts;  // where each level starts in m_levelNodes, and where the last ends
+	};
+}
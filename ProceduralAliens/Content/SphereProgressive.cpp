@@ -0,0 +1,54 @@
+﻿#include "pch.h"
+#include "SphereProgressive.h"
+#include <chrono>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	bool SameView(const SdfCamera& a, const SdfCamera& b)
+	{
+		return a.eye.x == b.eye.x && a.eye.y == b.eye.y && a.eye.z == b.eye.z &&
+			a.canvasHalfSize.x == b.canvasHalfSize.x && a.canvasHalfSize.y == b.canvasHalfSize.y &&
+			a.nearPlane == b.nearPlane && a.zoom == b.zoom && a.width == b.width && a.height == b.height;
+	}
+}
+
+SphereProgressive::SphereProgressive() :
+	m_samples(0)
+{
+}
+
+void SphereProgressive::Reset()
+{
+	m_samples = 0;
+	m_sum.clear();
+}
+
+int SphereProgressive::Refine(const SphereTracer& tracer, const SdfCamera& camera, const SpherePathSettings& settings, SdfImage& image, SphereTraceStats* stats)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (m_samples > 0 && !SameView(camera, m_camera))
+	{
+		Reset();
+	}
+
+	// The first pass also finds the hits, which don't change until the view does.
+	tracer.RenderPaths(camera, settings, static_cast<uint32_t>(m_samples), m_sum, (m_samples == 0) ? &m_hits : nullptr, stats);
+	m_camera = camera;
+	m_samples += settings.samples;
+
+	image = m_hits;
+	const float scale = 1.0f / m_samples;
+	for (size_t i = 0; i < m_sum.size(); i++)
+	{
+		image.colour[i] = m_sum[i] * scale;
+	}
+
+	if (stats)
+	{
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	return m_samples;
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "SphereTracer.h"
+
+namespace ProceduralAliens
+{
+	// Progressive path tracing for ShinySpheres. Each Refine() adds more paths per pixel to an
+	// accumulation buffer and writes their mean, so the image converges while the view holds
+	// still. A different camera starts again from nothing, the way a change to mCameraCB would.
+	class SphereProgressive
+	{
+	public:
+		SphereProgressive();
+
+		void Reset();
+		// Traces settings.samples more paths per pixel and writes the image so far. Returns the
+		// paths per pixel it has averaged.
+		int Refine(const SphereTracer& tracer, const SdfCamera& camera, const SpherePathSettings& settings, SdfImage& image, SphereTraceStats* stats);
+
+		int GetSampleCount() const { return m_samples; }
+
+	private:
+		SdfCamera m_camera;
+		std::vector<Hlsl::float3> m_sum;
+		SdfImage m_hits;
+		int m_samples;
+	};
+}
@@ -0,0 +1,141 @@
+﻿#include "pch.h"
+#include "SphereScene.h"
+#include <algorithm>
+#include <cmath>
+#include <ppl.h>
+#include <random>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	// The region Generate() fills: what the default camera (eye at z -15, zoom 5) sees behind the
+	// shader's spheres at z 30.
+	const float3 FillMin(-30.0f, -17.0f, 33.0f);
+	const float3 FillMax(30.0f, 17.0f, 81.0f);
+	// Sphere radius as a fraction of the spacing between sphere centres.
+	const float FillRadius = 0.35f;
+	const float MaxFillRadius = 2.0f;
+	// Angular speeds of the bobbing, in radians per second.
+	const float MinSpeed = 0.5f;
+	const float MaxSpeed = 2.0f;
+	// Moving spheres per parallel work item in Animate().
+	const int AnimateChunk = 4096;
+}
+
+void SphereScene::Clear()
+{
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_radius2.clear();
+	m_materials.clear();
+	m_motions.clear();
+}
+
+int SphereScene::Add(const float3& centre, float radius2, const SphereMaterial& material)
+{
+	m_x.push_back(centre.x);
+	m_y.push_back(centre.y);
+	m_z.push_back(centre.z);
+	m_radius2.push_back(radius2);
+	m_materials.push_back(material);
+	return GetCount() - 1;
+}
+
+SdfAabb SphereScene::GetBox(int i) const
+{
+	const float r = std::sqrt(m_radius2[i]);
+	SdfAabb box;
+	box.min = float3(m_x[i] - r, m_y[i] - r, m_z[i] - r);
+	box.max = float3(m_x[i] + r, m_y[i] + r, m_z[i] + r);
+	return box;
+}
+
+void SphereScene::SetMotion(int i, const float3& amplitude, float speed, float phase)
+{
+	Motion motion;
+	motion.sphere = i;
+	motion.rest = GetCentre(i);
+	motion.amplitude = amplitude;
+	motion.speed = speed;
+	motion.phase = phase;
+	m_motions.push_back(motion);
+}
+
+void SphereScene::Animate(float time)
+{
+	const int count = static_cast<int>(m_motions.size());
+	const int chunks = (count + AnimateChunk - 1) / AnimateChunk;
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		for (int m = chunk * AnimateChunk; m < std::min(count, (chunk + 1) * AnimateChunk); m++)
+		{
+			const Motion& motion = m_motions[m];
+			const float3 centre = motion.rest + motion.amplitude * std::sin(motion.speed * time + motion.phase);
+			m_x[motion.sphere] = centre.x;
+			m_y[motion.sphere] = centre.y;
+			m_z[motion.sphere] = centre.z;
+		}
+	});
+}
+
+SphereScene SphereScene::ShinySpheres()
+{
+	const float shininess = 40.0f;
+	SphereScene scene;
+	scene.Add(float3(0.0f, 0.0f, 30.0f), 1.0f, { float3(1.0f, 0.0f, 0.0f), 0.3f, 0.5f, 0.7f, shininess });
+	scene.Add(float3(2.0f, 3.0f, 30.0f), 0.25f, { float3(0.0f, 1.0f, 0.0f), 0.5f, 0.7f, 0.4f, shininess });
+	scene.Add(float3(0.0f, 4.0f, 30.0f), 2.0f, { float3(0.8f, 0.4f, 0.4f), 0.5f, 0.3f, 0.3f, shininess });
+	return scene;
+}
+
+SphereScene SphereScene::Generate(int count, uint32_t seed, float motion)
+{
+	SphereScene scene = ShinySpheres();
+	const int shader = scene.GetCount();
+	const int extra = count - shader;
+	if (extra <= 0)
+	{
+		return scene;
+	}
+
+	const float3 size = FillMax - FillMin;
+	const float spacing = std::cbrt(size.x * size.y * size.z / extra);
+	const float radius = std::min(FillRadius * spacing, MaxFillRadius);
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> u(0.0f, 1.0f);
+	for (int i = 0; i < extra; i++)
+	{
+		// Drawn up front, since the order function arguments are evaluated in is unspecified.
+		float v[7];
+		for (float& value : v)
+		{
+			value = u(rng);
+		}
+		const float3 centre = FillMin + float3(v[0], v[1], v[2]) * size;
+		const float r = radius * (0.5f + v[3]);
+		SphereMaterial material = scene.m_materials[i % shader];
+		material.colour = float3(v[4], v[5], v[6]);
+		scene.Add(centre, r * r, material);
+	}
+
+	// Drawn from their own sequence, so the spheres are the same with and without motion.
+	if (motion > 0.0f)
+	{
+		std::mt19937 motionRng(seed + 1);
+		for (int i = shader; i < scene.GetCount(); i++)
+		{
+			float v[4];
+			for (float& value : v)
+			{
+				value = u(motionRng);
+			}
+			const float3 direction = normalize(float3(2.0f * v[0] - 1.0f, 2.0f * v[1] - 1.0f, 2.0f * v[2] - 1.0f) + float3(1e-3f, 0.0f, 0.0f));
+			scene.SetMotion(i, direction * (motion * spacing), lerp(MinSpeed, MaxSpeed, v[3]), 0.0f);
+		}
+	}
+	return scene;
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include "SdfBounds.h"
+#include <cstdint>
+#include <vector>
+
+namespace ProceduralAliens
+{
+	// The shading half of ShinySpheresPS's Sphere struct.
+	struct SphereMaterial
+	{
+		Hlsl::float3 colour;
+		float kd;
+		float ks;
+		float kr;
+		float shininess;
+	};
+
+	// The light and camera constant buffer values ShinySpheresPS shades with, as
+	// Sample3DSceneRenderer sets them.
+	struct SphereLighting
+	{
+		Hlsl::float3 lightPosition = Hlsl::float3(100.0f, 20.0f, 0.0f);
+		Hlsl::float3 lightColour = Hlsl::float3(1.0f, 1.0f, 1.0f);
+		Hlsl::float3 backgroundColour = Hlsl::float3(1.0f, 1.0f, 1.0f);
+		float farPlane = 1000.0f;
+	};
+
+	// Spheres as a structure of arrays. The centres and squared radii (the shader's rad2) are what
+	// every intersection test reads, so they are kept apart from the materials, which are only
+	// read for a hit.
+	class SphereScene
+	{
+	public:
+		void Clear();
+		int Add(const Hlsl::float3& centre, float radius2, const SphereMaterial& material);
+
+		int GetCount() const { return static_cast<int>(m_radius2.size()); }
+		Hlsl::float3 GetCentre(int i) const { return Hlsl::float3(m_x[i], m_y[i], m_z[i]); }
+		float GetRadius2(int i) const { return m_radius2[i]; }
+		const SphereMaterial& GetMaterial(int i) const { return m_materials[i]; }
+		SdfAabb GetBox(int i) const;
+
+		// Moves sphere i by amplitude * sin(speed * time + phase) from where it was added.
+		void SetMotion(int i, const Hlsl::float3& amplitude, float speed, float phase);
+		// Puts every moving sphere where it is at 'time', in parallel.
+		void Animate(float time);
+		int GetMovingCount() const { return static_cast<int>(m_motions.size()); }
+
+		// The NOBJECTS spheres of ShinySpheresPS's object[].
+		static SphereScene ShinySpheres();
+		// ShinySpheres followed by count - 3 random spheres filling the view behind them, sized so
+		// the view is covered at any count. The same count and seed give the same scene. With
+		// motion above 0 the random spheres also bob along random directions, up to motion times
+		// the spacing between them, and are where they would be without it at time 0.
+		static SphereScene Generate(int count, uint32_t seed, float motion = 0.0f);
+
+	private:
+		struct Motion
+		{
+			int sphere;
+			Hlsl::float3 rest;
+			Hlsl::float3 amplitude;
+			float speed;
+			float phase;
+		};
+
+		std::vector<float> m_x;
+		std::vector<float> m_y;
+		std::vector<float> m_z;
+		std::vector<float> m_radius2;
+		std::vector<SphereMaterial> m_materials;
+		std::vector<Motion> m_motions;
+	};
+}
@@ -0,0 +1,650 @@
+﻿#include "pch.h"
+#include "SphereTracer.h"
+#include "SdfAntialias.h"
+#include <algorithm>
+#include <chrono>
+#include <ppl.h>
+
+using namespace ProceduralAliens;
+using namespace ProceduralAliens::Hlsl;
+
+namespace
+{
+	const int TileSize = 16;
+	// Rays per parallel work item in a wavefront batch.
+	const int StreamChunk = 256;
+	// Listed pixels per parallel work item in RenderSupersampled().
+	const int SupersampleChunk = 64;
+	// Origin cells per axis for sorting wavefront rays, 9 bits so that octant, Morton code and
+	// ray index fit one 64 bit key.
+	const float SortCells = 511.0f;
+	const float TwoPi = 6.2831853f;
+
+	// Hash(), Noise() and FractalNoise() from ShinySpheresPS, which modulate the diffuse colour.
+	float Hash(const float2& grid)
+	{
+		float h = dot(grid, float2(127.1f, 311.7f));
+		return frac(std::sin(h) * 43758.5453123f);
+	}
+
+	float Noise(const float2& p)
+	{
+		const float2 grid(std::floor(p.x), std::floor(p.y));
+		const float2 f(p.x - grid.x, p.y - grid.y);
+		const float2 uv = f * f * (float2(3.0f, 3.0f) - 2.0f * f);
+		float n1 = Hash(grid + float2(0.0f, 0.0f));
+		float n2 = Hash(grid + float2(1.0f, 0.0f));
+		float n3 = Hash(grid + float2(0.0f, 1.0f));
+		float n4 = Hash(grid + float2(1.0f, 1.0f));
+		n1 = lerp(n1, n2, uv.x);
+		n2 = lerp(n3, n4, uv.x);
+		return lerp(n1, n2, uv.y);
+	}
+
+	float FractalNoise(float2 xy)
+	{
+		float w = 0.7f;
+		float f = 0.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			f += Noise(xy) * w;
+			w *= 0.5f;
+			xy = xy * 2.7f;
+		}
+		return f;
+	}
+
+	// Spreads the low 10 bits of v out to every third bit.
+	uint32_t SpreadBits(uint32_t v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	// Direction octant first, then the Morton code of the origin's cell.
+	void SortRays(std::vector<SphereWaveRay>& rays)
+	{
+		if (rays.size() < 2)
+		{
+			return;
+		}
+
+		float3 low = rays[0].origin;
+		float3 high = rays[0].origin;
+		for (const SphereWaveRay& ray : rays)
+		{
+			low = min(low, ray.origin);
+			high = max(high, ray.origin);
+		}
+		const float3 scale = float3(SortCells, SortCells, SortCells) / max(high - low, 1e-6f);
+
+		std::vector<uint64_t> keys(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			const SphereWaveRay& ray = rays[i];
+			const uint32_t octant = (ray.direction.x < 0.0f ? 1 : 0) | (ray.direction.y < 0.0f ? 2 : 0) | (ray.direction.z < 0.0f ? 4 : 0);
+			const float3 cell = (ray.origin - low) * scale;
+			const uint32_t morton = SpreadBits(static_cast<uint32_t>(cell.x)) | (SpreadBits(static_cast<uint32_t>(cell.y)) << 1) | (SpreadBits(static_cast<uint32_t>(cell.z)) << 2);
+			keys[i] = (static_cast<uint64_t>((octant << 27) | morton) << 32) | i;
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<SphereWaveRay> sorted(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			sorted[i] = rays[static_cast<size_t>(keys[i] & 0xffffffffu)];
+		}
+		rays.swap(sorted);
+	}
+
+	double SecondsSince(const std::chrono::high_resolution_clock::time_point& start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Tangent and bitangent for a unit normal (Duff et al. 2017).
+	void Basis(const float3& n, float3& tangent, float3& bitangent)
+	{
+		const float sign = std::copysign(1.0f, n.z);
+		const float a = -1.0f / (sign + n.z);
+		const float b = n.x * n.y * a;
+		tangent = float3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+		bitangent = float3(b, sign + n.y * n.y * a, -n.y);
+	}
+
+	// A direction around axis, with density proportional to cos^exponent of the angle to it: 1 is
+	// the cosine weighted hemisphere, the shininess Phong()'s specular lobe.
+	float3 SampleLobe(const float3& axis, float exponent, float u1, float u2)
+	{
+		const float cosTheta = std::pow(u1, 1.0f / (exponent + 1.0f));
+		const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+		const float phi = TwoPi * u2;
+		float3 tangent, bitangent;
+		Basis(axis, tangent, bitangent);
+		return tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + axis * cosTheta;
+	}
+
+	float Average(const float3& c)
+	{
+		return (c.x + c.y + c.z) / 3.0f;
+	}
+
+	float3 Phong(const float3& n, const float3& l, const float3& v, float shininess, const float3& diffuseColour, const float3& specularColour)
+	{
+		const float NdotL = dot(n, l);
+		const float diff = saturate(NdotL);
+		const float3 r = reflect(l, n);
+		const float spec = std::pow(saturate(dot(v, r)), shininess) * (NdotL > 0.0f ? 1.0f : 0.0f);
+		return diff * diffuseColour + spec * specularColour;
+	}
+}
+
+void SphereTraceStats::Add(const SphereTraceStats& other)
+{
+	primaryRays += other.primaryRays;
+	reflectionRays += other.reflectionRays;
+	shadowRays += other.shadowRays;
+	hits += other.hits;
+	queries.Add(other.queries);
+	shadowQueries.Add(other.shadowQueries);
+}
+
+SphereRandom::SphereRandom(uint32_t seed, uint32_t pixel, uint32_t sample) :
+	m_key(Hash(Hash(Hash(seed + 0x9e3779b9u) ^ pixel) ^ sample)),
+	m_counter(0)
+{
+}
+
+float SphereRandom::Next()
+{
+	return static_cast<float>(Hash(m_key ^ Hash(m_counter++)) >> 8) * (1.0f / 16777216.0f);
+}
+
+// lowbias32 from Chris Wellons' hash prospector.
+uint32_t SphereRandom::Hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+SphereTracer::SphereTracer(const SphereScene& scene, const SphereBvh* bvh, const SphereLighting& lighting) :
+	m_scene(scene),
+	m_bvh(bvh),
+	m_lighting(lighting)
+{
+}
+
+void SphereTracer::Render(const SdfCamera& camera, SdfImage& image, SphereTraceStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	image.Resize(camera.width, camera.height);
+
+	const int tilesX = (camera.width + TileSize - 1) / TileSize;
+	const int tilesY = (camera.height + TileSize - 1) / TileSize;
+	std::vector<SphereTraceStats> tileStats(tilesX * tilesY);
+
+	Concurrency::parallel_for(0, tilesX * tilesY, [&](int tile)
+	{
+		SphereTraceStats& s = tileStats[tile];
+		const int x0 = (tile % tilesX) * TileSize;
+		const int y0 = (tile / tilesX) * TileSize;
+		for (int y = y0; y < std::min(y0 + TileSize, camera.height); y++)
+		{
+			for (int x = x0; x < std::min(x0 + TileSize, camera.width); x++)
+			{
+				const int i = y * camera.width + x;
+				SphereHit primary;
+				image.colour[i] = Trace(camera.eye, camera.RayDirection(static_cast<float>(x), static_cast<float>(y)), primary, s);
+				if (primary.sphere >= 0)
+				{
+					image.t[i] = primary.t;
+					image.material[i] = static_cast<float>(primary.sphere);
+				}
+			}
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SphereTraceStats();
+		for (const SphereTraceStats& s : tileStats)
+		{
+			stats->Add(s);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+// Primary rays go in the order Render() traces them. After each batch is shaded, the reflections
+// of the rays that hit are gathered chunk by chunk, which compacts away the rays that missed, and
+// become the next batch. A pixel gets its terms in the same order as from Trace(), so with no
+// cutoff the colours match to the bit.
+void SphereTracer::RenderWavefront(const SdfCamera& camera, const SphereWavefrontSettings& settings, SdfImage& image, SphereTraceStats* stats,
+	SphereBounceStats* bounces, std::vector<std::vector<SphereWaveRay>>* batches) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	image.Resize(camera.width, camera.height);
+	if (batches)
+	{
+		batches->clear();
+	}
+
+	std::vector<SphereWaveRay> rays;
+	rays.reserve(camera.width * camera.height);
+	const int tilesX = (camera.width + TileSize - 1) / TileSize;
+	const int tilesY = (camera.height + TileSize - 1) / TileSize;
+	for (int tile = 0; tile < tilesX * tilesY; tile++)
+	{
+		const int x0 = (tile % tilesX) * TileSize;
+		const int y0 = (tile / tilesX) * TileSize;
+		for (int y = y0; y < std::min(y0 + TileSize, camera.height); y++)
+		{
+			for (int x = x0; x < std::min(x0 + TileSize, camera.width); x++)
+			{
+				SphereWaveRay ray;
+				ray.origin = camera.eye;
+				ray.direction = camera.RayDirection(static_cast<float>(x), static_cast<float>(y));
+				ray.pixel = y * camera.width + x;
+				ray.lightIntensity = 1.0f;
+				rays.push_back(ray);
+			}
+		}
+	}
+
+	SphereTraceStats total;
+	SphereBounceStats bounceStats[SphereMaxDepth];
+	std::vector<SphereHit> hits;
+	for (int depth = 1; depth <= SphereMaxDepth && !rays.empty(); depth++)
+	{
+		SphereBounceStats& bounce = bounceStats[depth - 1];
+		auto phase = std::chrono::high_resolution_clock::now();
+		if (depth > 1 && settings.sort)
+		{
+			SortRays(rays);
+			bounce.sortSeconds = SecondsSince(phase);
+		}
+		if (batches)
+		{
+			batches->push_back(rays);
+		}
+
+		phase = std::chrono::high_resolution_clock::now();
+		TraceStream(rays, hits, total);
+		bounce.traceSeconds = SecondsSince(phase);
+		bounce.rays = rays.size();
+		if (depth == 1)
+		{
+			total.primaryRays += rays.size();
+		}
+		else
+		{
+			total.reflectionRays += rays.size();
+		}
+
+		phase = std::chrono::high_resolution_clock::now();
+		const int count = static_cast<int>(rays.size());
+		const int chunks = (count + StreamChunk - 1) / StreamChunk;
+		std::vector<std::vector<SphereWaveRay>> survivors(chunks);
+		std::vector<SphereTraceStats> chunkStats(chunks);
+		std::vector<uint64_t> dropped(chunks, 0);
+		Concurrency::parallel_for(0, chunks, [&](int chunk)
+		{
+			SphereTraceStats& s = chunkStats[chunk];
+			for (int i = chunk * StreamChunk; i < std::min(count, (chunk + 1) * StreamChunk); i++)
+			{
+				const SphereWaveRay& ray = rays[i];
+				const SphereHit& hit = hits[i];
+				float3& colour = image.colour[ray.pixel];
+				if (hit.sphere < 0)
+				{
+					// Every depth left adds the background; a primary miss is discarded.
+					if (depth > 1)
+					{
+						for (int d = depth; d <= SphereMaxDepth; d++)
+						{
+							colour += m_lighting.backgroundColour / static_cast<float>(d * d);
+						}
+					}
+					continue;
+				}
+
+				if (depth == 1)
+				{
+					image.t[ray.pixel] = hit.t;
+					image.material[ray.pixel] = static_cast<float>(hit.sphere);
+					s.hits++;
+				}
+				const float3 p = ray.origin + ray.direction * hit.t;
+				const float3 n = normalize(p - m_scene.GetCentre(hit.sphere));
+				colour += Shade(p, n, ray.direction, hit.sphere, ray.lightIntensity, s);
+
+				if (depth < SphereMaxDepth)
+				{
+					SphereWaveRay reflected;
+					reflected.origin = p;
+					reflected.direction = reflect(ray.direction, n);
+					reflected.pixel = ray.pixel;
+					reflected.lightIntensity = ray.lightIntensity * m_scene.GetMaterial(hit.sphere).kr;
+					if (reflected.lightIntensity < settings.cutoff)
+					{
+						dropped[chunk]++;
+					}
+					else
+					{
+						survivors[chunk].push_back(reflected);
+					}
+				}
+			}
+		});
+
+		rays.clear();
+		for (int chunk = 0; chunk < chunks; chunk++)
+		{
+			rays.insert(rays.end(), survivors[chunk].begin(), survivors[chunk].end());
+			total.Add(chunkStats[chunk]);
+			bounce.dropped += dropped[chunk];
+		}
+		bounce.shadeSeconds = SecondsSince(phase);
+	}
+
+	if (bounces)
+	{
+		std::copy(bounceStats, bounceStats + SphereMaxDepth, bounces);
+	}
+	if (stats)
+	{
+		*stats = total;
+		stats->seconds = SecondsSince(start);
+	}
+}
+
+void SphereTracer::TraceStream(const std::vector<SphereWaveRay>& rays, std::vector<SphereHit>& hits, SphereTraceStats& stats) const
+{
+	const int count = static_cast<int>(rays.size());
+	const int chunks = (count + StreamChunk - 1) / StreamChunk;
+	hits.resize(rays.size());
+	std::vector<SphereTraceStats> chunkStats(chunks);
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		for (int i = chunk * StreamChunk; i < std::min(count, (chunk + 1) * StreamChunk); i++)
+		{
+			hits[i] = NearestHit(rays[i].origin, rays[i].direction, chunkStats[chunk]);
+		}
+	});
+	for (const SphereTraceStats& s : chunkStats)
+	{
+		stats.Add(s);
+	}
+}
+
+void SphereTracer::RenderSupersampled(const SdfCamera& camera, const std::vector<int>& pixels, int grid, SdfImage& image, SphereTraceStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const int count = static_cast<int>(pixels.size());
+	const int chunks = (count + SupersampleChunk - 1) / SupersampleChunk;
+	const int samples = grid * grid;
+	std::vector<SphereTraceStats> chunkStats(chunks);
+
+	Concurrency::parallel_for(0, chunks, [&](int chunk)
+	{
+		SphereTraceStats& s = chunkStats[chunk];
+		for (int p = chunk * SupersampleChunk; p < std::min(count, (chunk + 1) * SupersampleChunk); p++)
+		{
+			const int i = pixels[p];
+			const float x = static_cast<float>(i % camera.width);
+			const float y = static_cast<float>(i / camera.width);
+			float3 colour(0.0f, 0.0f, 0.0f);
+			for (int sample = 0; sample < samples; sample++)
+			{
+				const float2 offset = SdfAntialias::GridOffset(sample, grid);
+				SphereHit primary;
+				colour += Trace(camera.eye, camera.RayDirection(x + offset.x, y + offset.y), primary, s);
+			}
+			image.colour[i] = colour / static_cast<float>(samples);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SphereTraceStats();
+		for (const SphereTraceStats& s : chunkStats)
+		{
+			stats->Add(s);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void SphereTracer::RenderPaths(const SdfCamera& camera, const SpherePathSettings& settings, uint32_t firstSample, std::vector<float3>& sum, SdfImage* hits,
+	SphereTraceStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (hits)
+	{
+		hits->Resize(camera.width, camera.height);
+	}
+	sum.resize(camera.width * camera.height, float3(0.0f, 0.0f, 0.0f));
+
+	const int tilesX = (camera.width + TileSize - 1) / TileSize;
+	const int tilesY = (camera.height + TileSize - 1) / TileSize;
+	std::vector<SphereTraceStats> tileStats(tilesX * tilesY);
+
+	Concurrency::parallel_for(0, tilesX * tilesY, [&](int tile)
+	{
+		SphereTraceStats& s = tileStats[tile];
+		const int x0 = (tile % tilesX) * TileSize;
+		const int y0 = (tile / tilesX) * TileSize;
+		for (int y = y0; y < std::min(y0 + TileSize, camera.height); y++)
+		{
+			for (int x = x0; x < std::min(x0 + TileSize, camera.width); x++)
+			{
+				const int i = y * camera.width + x;
+				if (hits)
+				{
+					const SphereHit primary = NearestHit(camera.eye, camera.RayDirection(static_cast<float>(x), static_cast<float>(y)), s);
+					if (primary.sphere >= 0)
+					{
+						hits->t[i] = primary.t;
+						hits->material[i] = static_cast<float>(primary.sphere);
+					}
+				}
+
+				float3 c(0.0f, 0.0f, 0.0f);
+				for (int sample = 0; sample < settings.samples; sample++)
+				{
+					SphereRandom random(settings.seed, static_cast<uint32_t>(i), firstSample + sample);
+					const float jitterX = random.Next() - 0.5f;
+					const float jitterY = random.Next() - 0.5f;
+					c += TracePath(camera.eye, camera.RayDirection(x + jitterX, y + jitterY), settings, random, s);
+				}
+				sum[i] += c;
+			}
+		}
+	});
+
+	if (stats)
+	{
+		*stats = SphereTraceStats();
+		for (const SphereTraceStats& s : tileStats)
+		{
+			stats->Add(s);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+// The point light is reached by next event estimation at every hit: Shade() is exactly the
+// direct light of the diffuse and specular terms. The path then carries on along one of the
+// material's three terms, picked in proportion to its weight: a cosine weighted diffuse bounce,
+// a bounce in Phong()'s specular lobe, or the mirror reflection the shader traces. Nothing but
+// Shade() can reach a point light, so none of it is counted twice. A path that leaves the
+// spheres sees the background, unlike RayTracing(), which divides it by the depth squared.
+float3 SphereTracer::TracePath(const float3& origin, const float3& direction, const SpherePathSettings& settings, SphereRandom& random, SphereTraceStats& stats) const
+{
+	stats.primaryRays++;
+	SphereHit hit = NearestHit(origin, direction, stats);
+	float3 c(0.0f, 0.0f, 0.0f);
+	if (hit.sphere < 0)
+	{
+		return c;
+	}
+	stats.hits++;
+
+	float3 throughput(1.0f, 1.0f, 1.0f);
+	float3 ro = origin;
+	float3 rd = direction;
+	for (int bounce = 0; ; bounce++)
+	{
+		const float3 i = ro + rd * hit.t;
+		const float3 n = normalize(i - m_scene.GetCentre(hit.sphere));
+		c += throughput * Shade(i, n, rd, hit.sphere, 1.0f, stats);
+		if (bounce == settings.maxBounces)
+		{
+			break;
+		}
+
+		const SphereMaterial& material = m_scene.GetMaterial(hit.sphere);
+		const float3 diff = material.colour * material.kd * FractalNoise(float2(i.x, i.y));
+		const float3 spec = material.colour * material.ks;
+		const float diffWeight = Average(diff);
+		const float specWeight = Average(spec);
+		const float total = diffWeight + specWeight + material.kr;
+		if (total <= 0.0f)
+		{
+			break;
+		}
+
+		const float3 mirror = reflect(rd, n);
+		const float pick = random.Next() * total;
+		const float u1 = random.Next();
+		const float u2 = random.Next();
+		if (pick < diffWeight)
+		{
+			rd = SampleLobe(n, 1.0f, u1, u2);
+			throughput = throughput * diff * (total / diffWeight);
+		}
+		else if (pick < diffWeight + specWeight)
+		{
+			rd = SampleLobe(mirror, material.shininess, u1, u2);
+			if (dot(rd, n) <= 0.0f)
+			{
+				break;
+			}
+			throughput = throughput * spec * (total / specWeight);
+		}
+		else
+		{
+			rd = mirror;
+			throughput *= total;
+		}
+
+		if (bounce + 1 >= settings.rouletteBounce)
+		{
+			const float survive = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), 0.95f);
+			if (random.Next() >= survive)
+			{
+				break;
+			}
+			throughput *= 1.0f / survive;
+		}
+
+		ro = i;
+		stats.reflectionRays++;
+		hit = NearestHit(ro, rd, stats);
+		if (hit.sphere < 0)
+		{
+			c += throughput * m_lighting.backgroundColour;
+			break;
+		}
+	}
+	return c;
+}
+
+// The shader traces one more reflection after the last bounce it shades; that hit is never used,
+// so it isn't traced here.
+float3 SphereTracer::Trace(const float3& origin, const float3& direction, SphereHit& primary, SphereTraceStats& stats) const
+{
+	stats.primaryRays++;
+	primary = NearestHit(origin, direction, stats);
+	float3 c(0.0f, 0.0f, 0.0f);
+	if (primary.sphere < 0)
+	{
+		return c;
+	}
+	stats.hits++;
+
+	float lightIntensity = 1.0f;
+	float3 ro = origin;
+	float3 rd = direction;
+	SphereHit hit = primary;
+	for (int depth = 1; depth <= SphereMaxDepth; depth++)
+	{
+		if (hit.sphere >= 0)
+		{
+			const float3 i = ro + rd * hit.t;
+			const float3 n = normalize(i - m_scene.GetCentre(hit.sphere));
+			c += Shade(i, n, rd, hit.sphere, lightIntensity, stats);
+
+			lightIntensity *= m_scene.GetMaterial(hit.sphere).kr;
+			ro = i;
+			rd = reflect(rd, n);
+			if (depth < SphereMaxDepth)
+			{
+				stats.reflectionRays++;
+				hit = NearestHit(ro, rd, stats);
+			}
+		}
+		else
+		{
+			c += m_lighting.backgroundColour / static_cast<float>(depth * depth);
+		}
+	}
+	return c;
+}
+
+SphereHit SphereTracer::NearestHit(const float3& origin, const float3& direction, SphereTraceStats& stats) const
+{
+	if (m_bvh)
+	{
+		return m_bvh->Intersect(origin, direction, m_lighting.farPlane, &stats.queries);
+	}
+	stats.queries.sphereTests += m_scene.GetCount();
+	return SphereBvh::IntersectLinear(m_scene, origin, direction, m_lighting.farPlane);
+}
+
+bool SphereTracer::Occluded(const float3& origin, const float3& direction, float tmin, float tmax, SphereTraceStats& stats) const
+{
+	stats.shadowRays++;
+	if (m_bvh)
+	{
+		return m_bvh->Occluded(origin, direction, tmin, tmax, &stats.shadowQueries);
+	}
+	stats.shadowQueries.sphereTests += m_scene.GetCount();
+	return SphereBvh::OccludedLinear(m_scene, origin, direction, tmin, tmax);
+}
+
+// Phong() is zero wherever the light is behind the surface, so the shadow ray is only traced
+// where it can make a difference.
+float3 SphereTracer::Shade(const float3& hitPos, const float3& normal, const float3& viewDir, int sphere, float lightIntensity, SphereTraceStats& stats) const
+{
+	const SphereMaterial& material = m_scene.GetMaterial(sphere);
+	const float3 toLight = m_lighting.lightPosition - hitPos;
+	const float lightDistance = length(toLight);
+	const float3 lightDir = toLight / lightDistance;
+	if (dot(normal, lightDir) <= 0.0f || Occluded(hitPos, lightDir, 0.0f, lightDistance, stats))
+	{
+		return float3(0.0f, 0.0f, 0.0f);
+	}
+
+	const float3 diff = material.colour * material.kd * FractalNoise(float2(hitPos.x, hitPos.y));
+	const float3 spec = material.colour * material.ks;
+	return m_lighting.lightColour * lightIntensity * Phong(normal, lightDir, viewDir, material.shininess, diff, spec);
+}
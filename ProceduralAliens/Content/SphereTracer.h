@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#include "SphereBvh.h"
+#include "SdfRaymarcher.h"
+
+namespace ProceduralAliens
+{
+	// RayTracing()'s depth loop runs 1 to 4: the primary hit and three reflections are shaded.
+	static const int SphereMaxDepth = 4;
+
+	// One ray of a wavefront batch.
+	struct SphereWaveRay
+	{
+		Hlsl::float3 origin;
+		Hlsl::float3 direction;
+		int pixel;
+		float lightIntensity; // the product of the Kr values the ray has bounced off
+	};
+
+	struct SphereWavefrontSettings
+	{
+		// Order each bounce's rays by direction octant, then by the Morton code of their origin's
+		// cell in the batch bounds, so that neighbouring rays traverse the same nodes.
+		bool sort = true;
+		// Reflection rays whose light intensity is below this are dropped. RayTracing() adds the
+		// background unscaled where a reflection misses, so this loses that term as well as the
+		// dimmed shading; 0 keeps every ray and matches Render() exactly.
+		float cutoff = 0.0f;
+	};
+
+	// Bounce 0 is the primary rays.
+	struct SphereBounceStats
+	{
+		uint64_t rays = 0;
+		uint64_t dropped = 0;     // rays below the cutoff, never traced
+		double sortSeconds = 0;
+		double traceSeconds = 0;  // nearest hit queries only
+		double shadeSeconds = 0;  // shading, shadow rays and compaction of the survivors
+	};
+
+	struct SphereTraceStats
+	{
+		double seconds = 0;
+		uint64_t primaryRays = 0;
+		uint64_t reflectionRays = 0;
+		uint64_t shadowRays = 0;
+		uint64_t hits = 0;              // primary rays that hit a sphere
+		SphereQueryStats queries;       // nearest hit queries, primary and reflection rays
+		SphereQueryStats shadowQueries; // any-hit queries
+
+		void Add(const SphereTraceStats& other);
+		uint64_t GetRayCount() const { return primaryRays + reflectionRays + shadowRays; }
+	};
+
+	struct SpherePathSettings
+	{
+		int samples = 1;         // paths per pixel per pass
+		int maxBounces = 8;      // diffuse, glossy or mirror bounces after the primary hit
+		int rouletteBounce = 3;  // Russian roulette from this bounce on
+		uint32_t seed = 0;
+	};
+
+	// Counter-based random numbers: the n-th number of a stream is a hash of the stream's key and
+	// n, so a pixel's samples don't depend on which thread draws them and nothing is shared.
+	class SphereRandom
+	{
+	public:
+		SphereRandom(uint32_t seed, uint32_t pixel, uint32_t sample);
+
+		// Uniform in [0, 1).
+		float Next();
+
+		static uint32_t Hash(uint32_t x);
+
+	private:
+		uint32_t m_key;
+		uint32_t m_counter;
+	};
+
+	// CPU port of ShinySpheresPS: RayTracing()'s reflection loop with Shade() and Phong() at every
+	// hit, over any number of spheres. With a SphereBvh the NearestHit() and Occluded() queries
+	// traverse it, without one they loop over every sphere the way the shader does. The image is
+	// cut into 16x16 tiles that are traced in parallel; t is the primary hit distance and material
+	// the index of the sphere hit, both -1 where the shader would discard.
+	class SphereTracer
+	{
+	public:
+		SphereTracer(const SphereScene& scene, const SphereBvh* bvh, const SphereLighting& lighting);
+
+		void Render(const SdfCamera& camera, SdfImage& image, SphereTraceStats* stats) const;
+
+		// The same image traced a bounce at a time instead of a pixel at a time: all primary rays,
+		// then the reflections of those that hit, and so on, each batch traced as its own stream.
+		// bounces, if given, gets SphereMaxDepth entries; batches, if given, the rays of each batch
+		// in the order they were traced.
+		void RenderWavefront(const SdfCamera& camera, const SphereWavefrontSettings& settings, SdfImage& image, SphereTraceStats* stats,
+			SphereBounceStats* bounces, std::vector<std::vector<SphereWaveRay>>* batches = nullptr) const;
+
+		// Nearest hits for a stream of rays, in order, in parallel chunks.
+		void TraceStream(const std::vector<SphereWaveRay>& rays, std::vector<SphereHit>& hits, SphereTraceStats& stats) const;
+
+		// Replaces the colour of each listed pixel with the mean of Trace() over a grid x grid
+		// pattern of rays inside it (SdfAntialias), keeping its hit and material.
+		void RenderSupersampled(const SdfCamera& camera, const std::vector<int>& pixels, int grid, SdfImage& image, SphereTraceStats* stats) const;
+
+		// Path traced samples firstSample onwards, settings.samples of them per pixel, added to sum.
+		// The primary rays are jittered over the pixel; hits, if given, gets the hit and material
+		// of the pixel centre's ray and is left black.
+		void RenderPaths(const SdfCamera& camera, const SpherePathSettings& settings, uint32_t firstSample, std::vector<Hlsl::float3>& sum, SdfImage* hits,
+			SphereTraceStats* stats) const;
+
+		// RayTracing() for one eye ray. primary is the first hit, sphere -1 on a miss, and the
+		// colour is then black.
+		Hlsl::float3 Trace(const Hlsl::float3& origin, const Hlsl::float3& direction, SphereHit& primary, SphereTraceStats& stats) const;
+
+	private:
+		SphereHit NearestHit(const Hlsl::float3& origin, const Hlsl::float3& direction, SphereTraceStats& stats) const;
+		bool Occluded(const Hlsl::float3& origin, const Hlsl::float3& direction, float tmin, float tmax, SphereTraceStats& stats) const;
+		Hlsl::float3 TracePath(const Hlsl::float3& origin, const Hlsl::float3& direction, const SpherePathSettings& settings, SphereRandom& random, SphereTraceStats& stats) const;
+		Hlsl::float3 Shade(const Hlsl::float3& hitPos, const Hlsl::float3& normal, const Hlsl::float3& viewDir, int sphere, float lightIntensity, SphereTraceStats& stats) const;
+
+		const SphereScene& m_scene;
+		const SphereBvh* m_bvh;
+		SphereLighting m_lighting;
+	};
+}
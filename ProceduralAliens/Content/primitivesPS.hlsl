@@ -365,9 +365,26 @@ float2 iBox(in float3 ro, in float3 rd, in float3 rad)
 
 const float maxHei = 0.8;
 
-float2 castRay(in float3 ro, in float3 rd)
+// Over-relaxed sphere tracing (Keinert et al. 2014): steps are scaled by marchOmega and the ray
+// falls back to plain steps from the previous point when consecutive unbounding spheres stop
+// overlapping. 1.0 gives the original sphere tracer.
+static const float marchOmega = 1.0;
+static const int marchMaxSteps = 250;
+
+// 1 = hit when the distance is below the pixel footprint instead of 0.00001*t.
+#define PIXEL_FOOTPRINT_EPSILON 0
+// 1 = show steps per pixel (green to red) and rays that ran out of steps (blue) instead of shading.
+#define SHOW_MARCH_STEPS 0
+
+// Per-ray counters, written by castRay.
+static int marchSteps;
+static bool marchCapped;
+
+float2 castRay(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float2 res = float2(-1.0, -1.0);
+	marchSteps = 0;
+	marchCapped = false;
 
 	float tmin = 1.0;
 	float tmax = 200.0;
@@ -388,19 +405,54 @@ float2 castRay(in float3 ro, in float3 rd)
 		tmin = max(tb.x, tmin);
 		tmax = min(tb.y, tmax);
 
+#if PIXEL_FOOTPRINT_EPSILON
+		float epsilon = pixelRadius;
+#else
+		float epsilon = 0.00001;
+#endif
+		float omega = marchOmega;
 		float t = tmin;
-		for (int i = 0; i < 250 && t < tmax; i++)
+		float previousT = tmin;
+		float previousRadius = 0.0;
+		float stepLength = 0.0;
+		float candidateError = 1e10;
+		float2 candidate = float2(-1.0, -1.0);
+
+		int i = 0;
+		for (; i < marchMaxSteps && t < tmax; i++)
 		{
-
 			float2 h = map(ro + rd * t);
-			if (abs(h.x) < (0.00001*t))
+			marchSteps++;
+			float radius = abs(h.x);
+			if (omega > 1.0 && radius + previousRadius < stepLength)
+			{
+				t = previousT + stepLength / omega;
+				omega = 1.0;
+				continue;
+			}
+
+			float error = radius / t;
+			if (error < candidateError)
+			{
+				candidateError = error;
+				candidate = float2(t, h.y);
+			}
+			if (error < epsilon)
 			{
-				res = float2(t, h.y);
 				break;
 			}
-			t += h.x;
+
+			previousT = t;
+			previousRadius = radius;
+			stepLength = h.x * omega;
+			t += stepLength;
 		}
 
+		marchCapped = (i == marchMaxSteps) && (t < tmax);
+		if (candidateError < epsilon)
+		{
+			res = candidate;
+		}
 	}
 
 	return res;
@@ -472,10 +524,13 @@ float checkersGradBox(in float2 p)
 	return 0.5 - 0.5*i.x*i.y;
 }
 
-float3 render(in float3 ro, in float3 rd)
+float3 render(in float3 ro, in float3 rd, in float pixelRadius)
 {
 	float3 col = float3(0.7, 0.9, 1.0) + rd.y*0.8;
-	float2 res = castRay(ro, rd);
+	float2 res = castRay(ro, rd, pixelRadius);
+#if SHOW_MARCH_STEPS
+	return marchCapped ? float3(0.0, 0.0, 1.0) : lerp(float3(0.0, 1.0, 0.0), float3(1.0, 0.0, 0.0), marchSteps / float(marchMaxSteps));
+#else
 	float t = res.x;
 	float m = res.y;
 	if (m > -0.5)
@@ -529,6 +584,7 @@ float3 render(in float3 ro, in float3 rd)
 	}
 
 	return float3(clamp(col, 0.0, 1.0));
+#endif
 }
 
 float3x3 setCamera(in float3 ro, in float3 ta, float cr)
@@ -552,6 +608,9 @@ PixelShaderOutput main(VS_QUAD input)
 	eyeRay.o = eyePos.xyz;
 	eyeRay.d = normalize(PixelPos - eyePos.xyz);
 
-	output.colour = float4(render(eyeRay.o, eyeRay.d), 1);
+	// Half the angle one pixel covers, for the footprint hit test.
+	float pixelRadius = 0.5 * zoom * abs(ddx(input.canvasXY.x)) / length(PixelPos - eyePos.xyz);
+
+	output.colour = float4(render(eyeRay.o, eyeRay.d, pixelRadius), 1);
 	return output;
 }
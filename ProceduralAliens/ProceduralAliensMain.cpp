@@ -1,6 +1,8 @@
 ﻿#include "pch.h"
 #include "ProceduralAliensMain.h"
 #include "Common\DirectXHelper.h"
+#include "Content\SdfBenchmark.h"
+#include "Content\SdfRegression.h"
 
 using namespace ProceduralAliens;
 using namespace Windows::Foundation;
@@ -9,7 +11,8 @@ using namespace Concurrency;
 
 // Loads and initializes application assets when the application is loaded.
 ProceduralAliensMain::ProceduralAliensMain(const std::shared_ptr<DX::DeviceResources>& deviceResources) :
-	m_deviceResources(deviceResources)
+	m_deviceResources(deviceResources),
+	m_benchmarkRunning(false)
 {
 	// Register to be notified if the Device is lost or recreated
 	m_deviceResources->RegisterDeviceNotify(this);
@@ -71,6 +74,35 @@ void ProceduralAliensMain::Update(const std::vector<int>& keysDown)
 		{
 			m_sceneRenderer->MoveEye(DirectX::XMFLOAT4(0, 10*deltaTime, 0, 0));
 		}
+		if (std::find(keysDown.begin(), keysDown.end(), 66) != keysDown.end() && !m_benchmarkRunning) // b
+		{
+			// CPU SDF benchmarks take a few seconds, keep them off the render thread.
+			m_benchmarkRunning = true;
+			create_task([this]()
+			{
+				std::wstring report = SdfBenchmark::Run();
+				OutputDebugStringW(report.c_str());
+				m_benchmarkRunning = false;
+			});
+		}
+		if (std::find(keysDown.begin(), keysDown.end(), 71) != keysDown.end() && !m_benchmarkRunning) // g
+		{
+			// Golden images and budgets for the CPU layers. The goldens ship with the app; the
+			// results (regression.jsonl) and any failing renders go to the local app data folder.
+			m_benchmarkRunning = true;
+			create_task([this]()
+			{
+				SdfRegressionSettings settings;
+				settings.goldenDirectory = std::wstring(Windows::ApplicationModel::Package::Current->InstalledLocation->Path->Data()) + L"\\Assets\\Golden";
+				settings.outputDirectory = Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data();
+				std::vector<SdfRegressionResult> results;
+				bool passed;
+				std::wstring report = SdfRegression::Run(settings, results, passed);
+				report += passed ? L"SDF regression passed\n" : L"SDF regression FAILED\n";
+				OutputDebugStringW(report.c_str());
+				m_benchmarkRunning = false;
+			});
+		}
 		// TODO: Replace this with your app's content update functions.
 		m_sceneRenderer->Update(m_timer);
 		m_fpsTextRenderer->Update(m_timer);
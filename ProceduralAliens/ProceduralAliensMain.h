@@ -5,6 +5,7 @@
 #include "Content\Sample3DSceneRenderer.h"
 #include "Content\SampleFpsTextRenderer.h"
 #include <vector>
+#include <atomic>
 
 // Renders Direct2D and 3D content on the screen.
 namespace ProceduralAliens
@@ -32,5 +33,8 @@ namespace ProceduralAliens
 
 		// Rendering loop timer.
 		DX::StepTimer m_timer;
+
+		// Set while the CPU SDF benchmark (b key) or regression check (g key) runs in the background.
+		std::atomic<bool> m_benchmarkRunning;
 	};
 }
\ No newline at end of file